@@ -0,0 +1,126 @@
+/*
+ * charset.h - Character set negotiation support and transcoding
+ *
+ * Provides the character set registry used by CHARSET negotiation
+ * (RFC 2066) and a table-driven transcoding stage between the remote
+ * character set (EUC-KR, CP949, Shift-JIS, ISO-8859-x) and the local
+ * UTF-8 terminal.
+ */
+
+#ifndef OTELNET_CHARSET_H
+#define OTELNET_CHARSET_H
+
+#include "telnet.h"
+
+/* Supported character sets */
+typedef enum {
+    CHARSET_UTF8 = 0,           /* UTF-8 (no transcoding) */
+    CHARSET_EUC_KR,             /* EUC-KR (KS X 1001) */
+    CHARSET_CP949,              /* CP949 / UHC (EUC-KR superset) */
+    CHARSET_SHIFT_JIS,          /* Shift-JIS (CP932 variant, ASCII-safe) */
+    CHARSET_ISO_8859_1,         /* ISO-8859-1 .. ISO-8859-16 (no -12) */
+    CHARSET_ISO_8859_2,
+    CHARSET_ISO_8859_3,
+    CHARSET_ISO_8859_4,
+    CHARSET_ISO_8859_5,
+    CHARSET_ISO_8859_6,
+    CHARSET_ISO_8859_7,
+    CHARSET_ISO_8859_8,
+    CHARSET_ISO_8859_9,
+    CHARSET_ISO_8859_10,
+    CHARSET_ISO_8859_11,
+    CHARSET_ISO_8859_13,
+    CHARSET_ISO_8859_14,
+    CHARSET_ISO_8859_15,
+    CHARSET_ISO_8859_16,
+    CHARSET_COUNT
+} charset_id_t;
+
+/* Invalid character set identifier (lookup failure) */
+#define CHARSET_INVALID     -1
+
+/* Worst-case growth when decoding to UTF-8 (one byte -> three bytes) */
+#define CHARSET_DECODE_MAX_GROWTH   3
+
+/* Precomputed lookup tables for one character set */
+typedef struct {
+    uint16_t single[128];           /* 0x80-0xFF -> UCS (0 = lead byte or invalid) */
+    bool lead[128];                 /* 0x80-0xFF: true if first byte of a pair */
+    uint16_t *pair;                 /* (lead - 0x80) * 256 + trail -> UCS, DBCS only */
+    uint16_t *reverse;              /* UCS (BMP) -> code, 0 = unmapped */
+} charset_table_t;
+
+/* Transcoder state (one per session, carries partial sequences) */
+typedef struct {
+    int charset;                    /* Active charset_id_t */
+    const charset_table_t *table;   /* NULL for UTF-8 (pass-through) */
+
+    /* Decode (remote -> UTF-8) carry: pending lead byte */
+    unsigned char dec_lead;
+    bool dec_has_lead;
+
+    /* Encode (UTF-8 -> remote) carry: incomplete UTF-8 sequence */
+    unsigned char enc_carry[4];
+    size_t enc_carry_len;
+} charset_conv_t;
+
+/**
+ * Look up a character set by name (case and punctuation insensitive)
+ * @param name Character set name (e.g., "EUC-KR", "ks_c_5601-1987", "latin1")
+ * @return charset_id_t on success, CHARSET_INVALID if unsupported
+ */
+int charset_lookup(const char *name);
+
+/**
+ * Get canonical (IANA) name of a character set
+ * @param charset Character set identifier
+ * @return Canonical name, or "UNKNOWN"
+ */
+const char *charset_name(int charset);
+
+/**
+ * Initialize transcoder for a character set
+ * Builds the lookup tables on first use of the character set
+ * @param conv Transcoder state
+ * @param charset Character set identifier
+ * @return SUCCESS on success, error code on failure (conv falls back to UTF-8)
+ */
+int charset_conv_init(charset_conv_t *conv, int charset);
+
+/**
+ * Check if transcoder performs any conversion
+ * @param conv Transcoder state
+ * @return true if remote charset is not UTF-8
+ */
+bool charset_conv_active(const charset_conv_t *conv);
+
+/**
+ * Decode remote charset data to UTF-8
+ * A trailing lead byte is carried over to the next call.
+ * @param conv Transcoder state
+ * @param input Remote data
+ * @param input_len Remote data length
+ * @param output Output buffer (should be input_len * CHARSET_DECODE_MAX_GROWTH + 3)
+ * @param output_size Size of output buffer
+ * @param output_len Pointer to store actual output length
+ * @return SUCCESS on success, error code on failure
+ */
+int charset_decode(charset_conv_t *conv, const unsigned char *input, size_t input_len,
+                   unsigned char *output, size_t output_size, size_t *output_len);
+
+/**
+ * Encode UTF-8 data to remote charset
+ * An incomplete trailing UTF-8 sequence is carried over to the next call.
+ * Characters not representable in the remote charset are sent as '?'.
+ * @param conv Transcoder state
+ * @param input UTF-8 data
+ * @param input_len UTF-8 data length
+ * @param output Output buffer (input_len + 4 is always sufficient)
+ * @param output_size Size of output buffer
+ * @param output_len Pointer to store actual output length
+ * @return SUCCESS on success, error code on failure
+ */
+int charset_encode(charset_conv_t *conv, const unsigned char *input, size_t input_len,
+                   unsigned char *output, size_t output_size, size_t *output_len);
+
+#endif /* OTELNET_CHARSET_H */
@@ -0,0 +1,217 @@
+/*
+ * comport.h - Telnet COM Port Control Option (RFC 2217)
+ *
+ * Client side of COM-PORT-OPTION for serial ports behind terminal
+ * servers: line settings, modem control lines, BREAK, purge and
+ * flow control suspend/resume.
+ */
+
+#ifndef OTELNET_COMPORT_H
+#define OTELNET_COMPORT_H
+
+#include "telnet.h"
+
+/* Client to server commands (server replies add COMPORT_SERVER_OFFSET) */
+#define COMPORT_SIGNATURE           0
+#define COMPORT_SET_BAUDRATE        1
+#define COMPORT_SET_DATASIZE        2
+#define COMPORT_SET_PARITY          3
+#define COMPORT_SET_STOPSIZE        4
+#define COMPORT_SET_CONTROL         5
+#define COMPORT_NOTIFY_LINESTATE    6
+#define COMPORT_NOTIFY_MODEMSTATE   7
+#define COMPORT_FLOWCONTROL_SUSPEND 8
+#define COMPORT_FLOWCONTROL_RESUME  9
+#define COMPORT_SET_LINESTATE_MASK  10
+#define COMPORT_SET_MODEMSTATE_MASK 11
+#define COMPORT_PURGE_DATA          12
+#define COMPORT_SERVER_OFFSET       100
+
+/* SET-PARITY values */
+#define COMPORT_PARITY_NONE         1
+#define COMPORT_PARITY_ODD          2
+#define COMPORT_PARITY_EVEN         3
+#define COMPORT_PARITY_MARK         4
+#define COMPORT_PARITY_SPACE        5
+
+/* SET-STOPSIZE values */
+#define COMPORT_STOPSIZE_1          1
+#define COMPORT_STOPSIZE_2          2
+#define COMPORT_STOPSIZE_1_5        3
+
+/* SET-CONTROL values */
+#define COMPORT_CONTROL_FLOW_NONE   1
+#define COMPORT_CONTROL_FLOW_XONXOFF 2
+#define COMPORT_CONTROL_FLOW_HARDWARE 3
+#define COMPORT_CONTROL_BREAK_ON    5
+#define COMPORT_CONTROL_BREAK_OFF   6
+#define COMPORT_CONTROL_DTR_ON      8
+#define COMPORT_CONTROL_DTR_OFF     9
+#define COMPORT_CONTROL_RTS_ON      11
+#define COMPORT_CONTROL_RTS_OFF     12
+
+/* PURGE-DATA values */
+#define COMPORT_PURGE_RX            1
+#define COMPORT_PURGE_TX            2
+#define COMPORT_PURGE_BOTH          3
+
+/* NOTIFY-LINESTATE bits */
+#define COMPORT_LINE_TIMEOUT        0x80
+#define COMPORT_LINE_TSRE           0x40
+#define COMPORT_LINE_THRE           0x20
+#define COMPORT_LINE_BREAK          0x10
+#define COMPORT_LINE_FRAMING        0x08
+#define COMPORT_LINE_PARITY         0x04
+#define COMPORT_LINE_OVERRUN        0x02
+#define COMPORT_LINE_DATA_READY     0x01
+
+/* NOTIFY-MODEMSTATE bits */
+#define COMPORT_MODEM_CD            0x80
+#define COMPORT_MODEM_RI            0x40
+#define COMPORT_MODEM_DSR           0x20
+#define COMPORT_MODEM_CTS           0x10
+
+/* Default BREAK duration in milliseconds */
+#define COMPORT_BREAK_MS            250
+
+/**
+ * Apply configured port settings once the server accepts the option
+ * @param tn Telnet structure
+ */
+void comport_on_enabled(telnet_t *tn);
+
+/**
+ * Handle COM-PORT-OPTION subnegotiation from the server
+ * @param tn Telnet structure (sb_buffer holds the subnegotiation)
+ * @return SUCCESS on success, error code on failure
+ */
+int comport_handle_subnegotiation(telnet_t *tn);
+
+/**
+ * Set baud rate (0 queries the current rate)
+ * @param tn Telnet structure
+ * @param baudrate Baud rate
+ * @return SUCCESS on success, error code on failure
+ */
+int comport_set_baudrate(telnet_t *tn, uint32_t baudrate);
+
+/**
+ * Set data bits (5-8, 0 queries)
+ * @param tn Telnet structure
+ * @param datasize Data bits
+ * @return SUCCESS on success, error code on failure
+ */
+int comport_set_datasize(telnet_t *tn, uint8_t datasize);
+
+/**
+ * Set parity (COMPORT_PARITY_*, 0 queries)
+ * @param tn Telnet structure
+ * @param parity Parity value
+ * @return SUCCESS on success, error code on failure
+ */
+int comport_set_parity(telnet_t *tn, uint8_t parity);
+
+/**
+ * Set stop bits (COMPORT_STOPSIZE_*, 0 queries)
+ * @param tn Telnet structure
+ * @param stopsize Stop size value
+ * @return SUCCESS on success, error code on failure
+ */
+int comport_set_stopsize(telnet_t *tn, uint8_t stopsize);
+
+/**
+ * Send SET-CONTROL (flow control, BREAK, DTR, RTS)
+ * @param tn Telnet structure
+ * @param control COMPORT_CONTROL_* value
+ * @return SUCCESS on success, error code on failure
+ */
+int comport_set_control(telnet_t *tn, uint8_t control);
+
+/**
+ * Start a BREAK for a duration (BREAK ON now, BREAK OFF from comport_check_break())
+ * The duration counts from when BREAK ON has left the outbound queue, so
+ * a backed-up connection does not shorten the break on the line.
+ * @param tn Telnet structure
+ * @param duration_ms Break duration in milliseconds (<= 0 for the default)
+ * @return SUCCESS on success, ERROR_GENERAL if a BREAK is already in progress,
+ *         error code on failure
+ */
+int comport_send_break(telnet_t *tn, int duration_ms);
+
+/**
+ * Time a BREAK in progress: start its clock once BREAK ON is sent, and
+ * send BREAK OFF when it runs out
+ * @param tn Telnet structure
+ * @param now_ms Monotonic time in milliseconds
+ */
+void comport_check_break(telnet_t *tn, uint64_t now_ms);
+
+/**
+ * Time comport_check_break() is next due
+ * @param tn Telnet structure
+ * @param now_ms Monotonic time in milliseconds
+ * @return Deadline in monotonic ms, or 0 if no BREAK is in progress
+ */
+uint64_t comport_break_deadline(const telnet_t *tn, uint64_t now_ms);
+
+/**
+ * Purge access server buffers
+ * @param tn Telnet structure
+ * @param which COMPORT_PURGE_RX, COMPORT_PURGE_TX or COMPORT_PURGE_BOTH
+ * @return SUCCESS on success, error code on failure
+ */
+int comport_purge(telnet_t *tn, uint8_t which);
+
+/**
+ * Ask the server to stop sending data (FLOWCONTROL-SUSPEND)
+ * The access server then applies flow control to the device itself.
+ * @param tn Telnet structure
+ * @return SUCCESS on success, error code on failure
+ */
+int comport_flow_suspend(telnet_t *tn);
+
+/**
+ * Ask the server to resume sending data (FLOWCONTROL-RESUME)
+ * @param tn Telnet structure
+ * @return SUCCESS on success, error code on failure
+ */
+int comport_flow_resume(telnet_t *tn);
+
+/**
+ * Parse serial settings in "baud[,data[,parity[,stop]]]" form (e.g., "115200,8,N,1")
+ * Only fields present in the string are stored into tn->comport.want_*.
+ * @param tn Telnet structure
+ * @param spec Settings string
+ * @return SUCCESS on success, ERROR_INVALID_ARG on parse error
+ */
+int comport_parse_settings(telnet_t *tn, const char *spec);
+
+/**
+ * Parse parity name (none/odd/even/mark/space or N/O/E/M/S)
+ * @param name Parity name
+ * @return COMPORT_PARITY_* value, or 0 if invalid
+ */
+uint8_t comport_parse_parity(const char *name);
+
+/**
+ * Get parity name
+ * @param parity COMPORT_PARITY_* value
+ * @return Parity name
+ */
+const char *comport_parity_name(uint8_t parity);
+
+/**
+ * Get stop size name
+ * @param stopsize COMPORT_STOPSIZE_* value
+ * @return Stop size name ("1", "2", "1.5" or "?")
+ */
+const char *comport_stopsize_name(uint8_t stopsize);
+
+/**
+ * Get flow control name
+ * @param flow COMPORT_CONTROL_FLOW_* value
+ * @return Flow control name
+ */
+const char *comport_flow_name(uint8_t flow);
+
+#endif /* OTELNET_COMPORT_H */
@@ -0,0 +1,79 @@
+/*
+ * config.h - Build profile configuration
+ *
+ * Buffer sizes and queue limits for the whole program, selected at build
+ * time with "make PROFILE=tiny|default|throughput" (OTELNET_PROFILE_*):
+ *
+ *   tiny        small-memory console appliances: 1 KB I/O buffers,
+ *               small queues, few idle pool buffers
+ *   default     interactive desktop use
+ *   throughput  collectors and bulk transfers: 64 KB I/O buffers,
+ *               large queues, huge pages for ring buffers
+ */
+
+#ifndef OTELNET_CONFIG_H
+#define OTELNET_CONFIG_H
+
+#if defined(OTELNET_PROFILE_TINY)
+
+#define OTELNET_PROFILE_NAME        "tiny"
+#define BUFFER_SIZE                 1024        /* General buffers (paths, SB, config values) */
+#define SMALL_BUFFER_SIZE           128
+#define LINE_BUFFER_SIZE            256
+#define IO_BUFFER_SIZE              1024        /* Socket receive/decode chunk */
+#define OTELNET_RECV_MAX            (16 * 1024) /* Largest adaptive read */
+#define OTELNET_RECV_BUDGET         (32 * 1024) /* Bytes drained per loop iteration */
+#define TELNET_OUTQ_LIMIT           (64 * 1024)
+#define TELNET_NOTSENT_LOWAT        (4 * 1024)  /* Unsent bytes the kernel may hold */
+#define OTELNET_TERM_QUEUE_LIMIT    (64 * 1024)
+#define OTELNET_TERM_HIGH_WATER     (8 * 1024)
+#define OTELNET_TERM_LOW_WATER      (2 * 1024)
+#define POOL_BUF_MIN_SHIFT          10          /* 1 KB ... 16 KB classes */
+#define POOL_BUF_CLASSES            5
+#define POOL_BUF_KEEP               2
+#define POOL_SLAB_OBJECTS           8
+#define OTELNET_HUGEPAGES           0
+
+#elif defined(OTELNET_PROFILE_THROUGHPUT)
+
+#define OTELNET_PROFILE_NAME        "throughput"
+#define BUFFER_SIZE                 4096
+#define SMALL_BUFFER_SIZE           256
+#define LINE_BUFFER_SIZE            1024
+#define IO_BUFFER_SIZE              (64 * 1024)
+#define OTELNET_RECV_MAX            (1024 * 1024)
+#define OTELNET_RECV_BUDGET         (4 * 1024 * 1024)
+#define TELNET_OUTQ_LIMIT           (16 * 1024 * 1024)
+#define TELNET_NOTSENT_LOWAT        (256 * 1024)
+#define OTELNET_TERM_QUEUE_LIMIT    (16 * 1024 * 1024)
+#define OTELNET_TERM_HIGH_WATER     (1024 * 1024)
+#define OTELNET_TERM_LOW_WATER      (256 * 1024)
+#define POOL_BUF_MIN_SHIFT          12          /* 4 KB ... 1 MB classes */
+#define POOL_BUF_CLASSES            9
+#define POOL_BUF_KEEP               16
+#define POOL_SLAB_OBJECTS           256
+#define OTELNET_HUGEPAGES           1
+
+#else
+
+#define OTELNET_PROFILE_NAME        "default"
+#define BUFFER_SIZE                 4096
+#define SMALL_BUFFER_SIZE           256
+#define LINE_BUFFER_SIZE            1024
+#define IO_BUFFER_SIZE              4096
+#define OTELNET_RECV_MAX            (256 * 1024)
+#define OTELNET_RECV_BUDGET         (512 * 1024)
+#define TELNET_OUTQ_LIMIT           (1024 * 1024)
+#define TELNET_NOTSENT_LOWAT        (16 * 1024)
+#define OTELNET_TERM_QUEUE_LIMIT    (1024 * 1024)
+#define OTELNET_TERM_HIGH_WATER     (64 * 1024)
+#define OTELNET_TERM_LOW_WATER      (16 * 1024)
+#define POOL_BUF_MIN_SHIFT          12          /* 4 KB ... 64 KB classes */
+#define POOL_BUF_CLASSES            5
+#define POOL_BUF_KEEP               8
+#define POOL_SLAB_OBJECTS           64
+#define OTELNET_HUGEPAGES           0
+
+#endif
+
+#endif /* OTELNET_CONFIG_H */
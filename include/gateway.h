@@ -0,0 +1,213 @@
+/*
+ * gateway.h - Telnet relay for many concurrent clients (otelnet -G)
+ *
+ * The gateway listens on local ports and relays each client to the
+ * upstream server of the port's route.  Both legs are full telnet
+ * sessions on the same engine: the client is served with telnet_accept(),
+ * the upstream is an ordinary client connection, and only decoded data
+ * crosses between them, so each side negotiates what it supports.  The
+ * client is offered echo whenever the upstream echoes, and window size
+ * changes are passed on.  Routes marked "pass" leave telnet to the two
+ * ends: their bytes go from socket to socket through a pipe with
+ * splice() and never enter user space.
+ *
+ * One thread serves every pair from an epoll loop.  Pairs come from a
+ * slab pool and I/O buffers are borrowed only while data is queued, so
+ * an idle pair costs its two sockets and a few hundred bytes.  A side is
+ * not read while the other has GATEWAY_HIGH_WATER bytes queued.
+ *
+ * Routes file, one route per line ('#' starts a comment):
+ *
+ *   [ADDRESS:]PORT  TARGET [PORT] [pass|ws]
+ *
+ *   7001            10.1.0.5 23
+ *   127.0.0.1:7002  unix:/run/ser2net/ttyS1
+ *   7003            10.1.0.6 4001 pass
+ *
+ * TARGET is a host, tls:host or unix:path as on the command line.
+ *
+ * Routes marked "ws" serve browsers instead: clients speak WebSocket,
+ * and every browser on the port shares one upstream session, opened with
+ * the first and hung up with the last.  Decoded output goes out once per
+ * read as a binary frame, stored once and queued by reference for each
+ * browser (see share.h); frame payload from any browser is input.  The
+ * upstream is read while some browser has less than GATEWAY_HIGH_WATER
+ * queued, so one browser gets full backpressure, and a browser with
+ * GATEWAY_WS_QUEUE bytes still unsent is disconnected rather than
+ * holding the others back.
+ *
+ *   127.0.0.1:8023  10.1.0.5 23 ws
+ */
+
+#ifndef OTELNET_GATEWAY_H
+#define OTELNET_GATEWAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "config.h"
+#include "pool.h"
+#include "share.h"
+#include "telnet.h"
+#include "websocket.h"
+
+/* Queued bytes on one side that stop reading the other */
+#define GATEWAY_HIGH_WATER      OTELNET_TERM_HIGH_WATER
+
+/* Largest splice() step on pass routes (default pipe capacity) */
+#define GATEWAY_SPLICE_MAX      (64 * 1024)
+
+/* epoll events handled per wakeup */
+#define GATEWAY_MAX_EVENTS      256
+
+/* Connections accepted per listening socket and wakeup */
+#define GATEWAY_ACCEPT_BURST    32
+
+/* Unsent bytes that disconnect a browser on a ws route */
+#define GATEWAY_WS_QUEUE        (GATEWAY_HIGH_WATER * 4)
+
+/* What an epoll entry points at (first member of each) */
+typedef enum {
+    GATEWAY_WATCH_ROUTE,
+    GATEWAY_WATCH_END,
+    GATEWAY_WATCH_WEB,
+    GATEWAY_WATCH_VIEWER
+} gateway_watch_t;
+
+typedef struct gateway_web_s gateway_web_t;
+
+/* Listening port and where its clients go */
+typedef struct {
+    gateway_watch_t watch;          /* GATEWAY_WATCH_ROUTE */
+    int listen_fd;
+    char listen[SMALL_BUFFER_SIZE]; /* [ADDRESS:]PORT (bare ws port: 127.0.0.1) */
+    char target[SMALL_BUFFER_SIZE]; /* Upstream target as written */
+    struct in_addr addr;            /* TCP/TLS: target host, resolved at load */
+    bool resolved;                  /* addr is set (false for unix: and through a proxy) */
+    int port;                       /* Upstream TCP port */
+    bool pass;                      /* Splice bytes, leave telnet to the ends */
+    bool ws;                        /* Browsers over WebSocket share one session */
+    gateway_web_t *web;             /* ws: the session while browsers are connected */
+    unsigned int active;            /* Pairs (ws: browsers) open on this route */
+} gateway_route_t;
+
+typedef struct gateway_pair_s gateway_pair_t;
+
+/* One side of a pair */
+typedef struct {
+    gateway_watch_t watch;          /* GATEWAY_WATCH_END */
+    gateway_pair_t *pair;
+    telnet_t tn;                    /* Telnet session (pass: transport only) */
+    uint32_t events;                /* Events registered with epoll */
+    int pipe[2];                    /* Pass: bytes read from this side, for the other */
+    size_t piped;                   /* Pass: bytes in the pipe */
+} gateway_end_t;
+
+/* Client and its upstream connection */
+struct gateway_pair_s {
+    gateway_end_t client;
+    gateway_end_t upstream;
+    gateway_route_t *route;
+    bool pass;                      /* Spliced (route says pass and both are plain sockets) */
+    bool upstream_up;               /* Bytes went to or came from the upstream */
+    bool closing;                   /* One side is gone: drain the other, then close */
+    bool dead;                      /* Closed; freed after the current batch of events */
+    gateway_pair_t *prev;           /* Open pairs (dead ones: next only) */
+    gateway_pair_t *next;
+};
+
+typedef struct gateway_viewer_s gateway_viewer_t;
+
+/* Browser on a ws route */
+struct gateway_viewer_s {
+    gateway_watch_t watch;          /* GATEWAY_WATCH_VIEWER */
+    gateway_route_t *route;
+    gateway_web_t *web;             /* Session (NULL while handshaking or closing) */
+    int fd;
+    uint32_t events;                /* Events registered with epoll */
+    iobuf_t request;                /* Handshake request so far */
+    ws_parser_t parser;
+    share_entry_t queue[SHARE_QUEUE_SLOTS];
+    size_t head;                    /* First queued entry */
+    size_t count;                   /* Queued entries */
+    size_t queued;                  /* Queued bytes */
+    bool joined;                    /* Handshake done */
+    bool closing;                   /* Close frame queued: send it, then close */
+    bool dead;                      /* Closed; freed after the current batch of events */
+    gateway_viewer_t *prev;         /* Session's or pending viewers (dead ones: next only) */
+    gateway_viewer_t *next;
+};
+
+/* Upstream session of a ws route */
+struct gateway_web_s {
+    gateway_watch_t watch;          /* GATEWAY_WATCH_WEB */
+    gateway_route_t *route;
+    telnet_t tn;                    /* Upstream connection */
+    uint32_t events;                /* Events registered with epoll */
+    bool upstream_up;               /* Bytes went to or came from the upstream */
+    bool dead;                      /* Closed; freed after the current batch of events */
+    gateway_viewer_t *viewers;      /* Browsers sharing the session */
+    size_t viewer_count;
+    gateway_web_t *next;            /* Dead sessions */
+};
+
+/* Gateway */
+typedef struct {
+    int epoll_fd;
+    int spare_fd;                   /* Given up to refuse clients when out of descriptors */
+    gateway_route_t *routes;
+    size_t route_count;
+    pool_t pairs;
+    gateway_pair_t *open;           /* Pairs open */
+    gateway_pair_t *dead;           /* Pairs closed during this batch */
+    pool_t viewers;
+    gateway_viewer_t *pending;      /* Browsers handshaking or closing */
+    gateway_viewer_t *dead_viewers; /* Browsers closed during this batch */
+    gateway_web_t *dead_webs;       /* Sessions closed during this batch */
+    share_chunk_t *last;            /* Browser output chunk still taking appends */
+    char ws_origin[SMALL_BUFFER_SIZE]; /* Origin browsers must come from (empty = any) */
+
+    /* Statistics */
+    size_t active;                  /* Pairs open */
+    size_t peak;                    /* Most pairs open at once */
+    unsigned long long served;      /* Clients relayed */
+    unsigned long long failed;      /* Clients whose upstream could not be reached */
+    uint64_t bytes_up;              /* Client -> upstream (decoded) */
+    uint64_t bytes_down;            /* Upstream -> client (decoded) */
+    uint64_t bytes_spliced;         /* Both directions on pass routes */
+    unsigned long long browsers;    /* Browsers joined on ws routes */
+    unsigned long long browsers_dropped; /* Disconnected for falling behind */
+} gateway_t;
+
+/**
+ * Initialize the gateway (epoll instance, descriptor limit)
+ * @param gw Gateway
+ * @return SUCCESS on success, ERROR_IO on failure
+ */
+int gateway_init(gateway_t *gw);
+
+/**
+ * Load routes and start listening on their ports
+ * Host names are resolved once here, not for every client.
+ * @param gw Gateway
+ * @param path Routes file
+ * @return SUCCESS on success, ERROR_INVALID_ARG for a malformed file,
+ *         ERROR_IO if a file or port cannot be opened
+ */
+int gateway_load(gateway_t *gw, const char *path);
+
+/**
+ * Relay clients until SIGINT or SIGTERM
+ * @param gw Gateway
+ * @return SUCCESS on a requested stop, ERROR_IO if the event loop fails
+ */
+int gateway_run(gateway_t *gw);
+
+/**
+ * Close every pair and listening socket
+ * @param gw Gateway
+ */
+void gateway_close(gateway_t *gw);
+
+#endif /* OTELNET_GATEWAY_H */
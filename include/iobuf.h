@@ -0,0 +1,82 @@
+/*
+ * iobuf.h - Growable byte queue for pending I/O
+ *
+ * Holds bytes that could not be written yet (terminal output, outbound
+ * telnet data) so that non-blocking writes never drop data.  Storage is
+ * borrowed from the per-thread buffer pool and returned as soon as the
+ * queue drains.
+ */
+
+#ifndef OTELNET_IOBUF_H
+#define OTELNET_IOBUF_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Byte queue */
+typedef struct {
+    unsigned char *data;            /* Storage (NULL until first append) */
+    size_t head;                    /* Offset of first pending byte */
+    size_t len;                     /* Number of pending bytes */
+    size_t cap;                     /* Allocated size */
+    size_t limit;                   /* Maximum pending bytes */
+} iobuf_t;
+
+/**
+ * Initialize byte queue
+ * @param buf Byte queue
+ * @param limit Maximum number of pending bytes
+ */
+void iobuf_init(iobuf_t *buf, size_t limit);
+
+/**
+ * Release byte queue storage
+ * @param buf Byte queue
+ */
+void iobuf_free(iobuf_t *buf);
+
+/**
+ * Append bytes to queue
+ * @param buf Byte queue
+ * @param data Data to append
+ * @param len Data length
+ * @return SUCCESS on success, ERROR_GENERAL if limit would be exceeded
+ */
+int iobuf_append(iobuf_t *buf, const void *data, size_t len);
+
+/**
+ * Get pointer to first pending byte
+ * @param buf Byte queue
+ * @return Pointer to pending data (valid until next append)
+ */
+const unsigned char *iobuf_data(const iobuf_t *buf);
+
+/**
+ * Get number of pending bytes
+ * @param buf Byte queue
+ * @return Pending byte count
+ */
+size_t iobuf_len(const iobuf_t *buf);
+
+/**
+ * Remove bytes from front of queue
+ * @param buf Byte queue
+ * @param len Number of bytes to remove
+ */
+void iobuf_consume(iobuf_t *buf, size_t len);
+
+/**
+ * Discard all pending bytes
+ * @param buf Byte queue
+ */
+void iobuf_clear(iobuf_t *buf);
+
+/**
+ * Write pending bytes to a non-blocking file descriptor
+ * @param buf Byte queue
+ * @param fd File descriptor
+ * @return Number of bytes written (0 if it would block), or ERROR_IO on failure
+ */
+ssize_t iobuf_write_fd(iobuf_t *buf, int fd);
+
+#endif /* OTELNET_IOBUF_H */
@@ -0,0 +1,101 @@
+/*
+ * login.h - Login script replayed after each connect
+ *
+ * A small expect/send script, one directive per line:
+ *
+ *   expect TEXT       wait until the server sends TEXT
+ *   send TEXT         send TEXT (no line end is added)
+ *   timeout SECONDS   give up on later expect lines after this long
+ *
+ * TEXT may be wrapped in double quotes to keep leading or trailing
+ * spaces and understands the escapes \r \n \t \e and \\.  Lines starting
+ * with '#' are comments.  With auto-reconnect the script runs again on
+ * every new connection, so an unattended session logs itself back in.
+ */
+
+#ifndef OTELNET_LOGIN_H
+#define OTELNET_LOGIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "config.h"
+#include "ring.h"
+
+/* Expect timeout until a timeout line says otherwise */
+#define LOGIN_DEFAULT_TIMEOUT_MS    10000
+
+/* Script step */
+typedef struct {
+    bool expect;                    /* Wait for text (else send it) */
+    uint32_t timeout_ms;            /* Expect: give up after this long */
+    size_t len;                     /* Text length */
+    char text[SMALL_BUFFER_SIZE];   /* Unescaped text */
+} login_step_t;
+
+/* Login script */
+typedef struct {
+    login_step_t *steps;            /* Steps in file order (NULL if none loaded) */
+    size_t count;                   /* Number of steps */
+    size_t next;                    /* Current step while active */
+    size_t seen;                    /* Bytes received since the current expect began */
+    uint64_t deadline_ms;           /* Current expect times out (0 = not armed) */
+    bool active;                    /* Running on the current connection */
+} login_script_t;
+
+/**
+ * Load a login script
+ * @param ls Login script (replaces any loaded script)
+ * @param path Script file
+ * @return SUCCESS on success, ERROR_IO if unreadable, ERROR_INVALID_ARG on a bad
+ *         line, ERROR_GENERAL if out of memory
+ */
+int login_script_load(login_script_t *ls, const char *path);
+
+/**
+ * Release a login script
+ * @param ls Login script
+ */
+void login_script_free(login_script_t *ls);
+
+/**
+ * Run the script from the top (no-op if none is loaded)
+ * @param ls Login script
+ */
+void login_script_start(login_script_t *ls);
+
+/**
+ * Stop the script (connection lost)
+ * @param ls Login script
+ */
+void login_script_stop(login_script_t *ls);
+
+/**
+ * Get the next send step that is due
+ * Arms the timeout of an expect step reached on the way.
+ * @param ls Login script
+ * @param now_ms Monotonic time in milliseconds
+ * @return Step to send, or NULL while waiting (or when finished)
+ */
+const login_step_t *login_script_next(login_script_t *ls, uint64_t now_ms);
+
+/**
+ * Match newly received text against the current expect step
+ * Looks back into the receive ring so text split across reads matches.
+ * @param ls Login script
+ * @param ring Receive ring (decoded text)
+ * @param len Bytes just committed to the ring
+ * @return true if the expect step matched
+ */
+bool login_script_feed(login_script_t *ls, const ring_t *ring, size_t len);
+
+/**
+ * Check whether the current expect step has timed out (stops the script)
+ * @param ls Login script
+ * @param now_ms Monotonic time in milliseconds
+ * @return true if the script just timed out
+ */
+bool login_script_expired(login_script_t *ls, uint64_t now_ms);
+
+#endif /* OTELNET_LOGIN_H */
@@ -29,11 +29,20 @@
 
 /* Telnet protocol (standalone header) */
 #include "telnet.h"
-
-/* Constants from common.h */
-#define BUFFER_SIZE         4096
-#define SMALL_BUFFER_SIZE   256
-#define LINE_BUFFER_SIZE    1024
+#include "charset.h"
+#include "utf8.h"
+#include "iobuf.h"
+#include "comport.h"
+#include "pool.h"
+#include "ring.h"
+#include "pipeline.h"
+#include "login.h"
+#include "session.h"
+#include "share.h"
+#include "gateway.h"
+#include "server.h"
+
+/* Constants from common.h (buffer sizes come from config.h) */
 #define SUCCESS             0
 #define ERROR_GENERAL       -1
 #define ERROR_INVALID_ARG   -2
@@ -74,8 +83,23 @@
 /* Default configuration file */
 #define OTELNET_DEFAULT_CONFIG "otelnet.conf"
 
+/* Pipelined input lines wait for a prompt mark (EOR/GA), at most this long */
+#define OTELNET_PACE_TIMEOUT_MS     2000
+
+/* Auto-reconnect backoff defaults (RECONNECT_DELAY_MIN/MAX) */
+#define OTELNET_RECONNECT_MIN_MS    1000
+#define OTELNET_RECONNECT_MAX_MS    60000
+
+/* Liveness probe defaults (PROBE_INTERVAL/PROBE_TIMEOUT, seconds) */
+#define OTELNET_PROBE_INTERVAL      30
+#define OTELNET_PROBE_TIMEOUT       10
+
+/* Larger stdin reads are pastes: sent as bulk, behind keystrokes */
+#define OTELNET_KEYSTROKE_MAX       16
+
 /* Console mode constants */
 #define CONSOLE_TRIGGER_KEY 0x1D    /* Ctrl+] (telnet escape character) */
+#define INTERRUPT_KEY       0x03    /* Ctrl+C (IP + Synch in line mode) */
 
 /* otelnet operation modes */
 typedef enum {
@@ -83,6 +107,13 @@ typedef enum {
     OTELNET_MODE_CONSOLE        /* Console command mode (Ctrl+M pressed) */
 } otelnet_mode_t;
 
+/* Application-level liveness probes on idle sessions (PROBE) */
+typedef enum {
+    OTELNET_PROBE_OFF,
+    OTELNET_PROBE_NOP,              /* IAC NOP: keeps data in flight for TCP_USER_TIMEOUT */
+    OTELNET_PROBE_TIMING_MARK       /* DO TIMING-MARK: must be answered within PROBE_TIMEOUT */
+} otelnet_probe_t;
+
 /* Configuration structure */
 typedef struct {
     char kermit_path[BUFFER_SIZE];
@@ -90,6 +121,34 @@ typedef struct {
     char receive_zmodem_path[BUFFER_SIZE];
     bool log_enabled;
     char log_file[BUFFER_SIZE];
+    char charset[SMALL_BUFFER_SIZE];    /* Remote charset (empty = UTF-8) */
+    bool utf8_replace_invalid;          /* Replace invalid UTF-8 with U+FFFD */
+    bool comport_enabled;               /* Offer RFC 2217 COM-PORT-OPTION */
+    char comport_settings[SMALL_BUFFER_SIZE]; /* e.g., "115200,8,N,1" */
+    char comport_flow[SMALL_BUFFER_SIZE];     /* none, xon or rts */
+    bool remote_xonxoff;                /* Pause sending on XOFF from the remote */
+    bool prompt_pacing;                 /* Send pasted lines one per prompt mark */
+    bool pipeline;                      /* Render and log on their own threads */
+    bool tls_verify;                    /* Verify the TLS server certificate */
+    char tls_ca_file[BUFFER_SIZE];      /* CA bundle (empty = system default) */
+    char proxy[BUFFER_SIZE];            /* socks5:// or http:// proxy URL (empty = direct) */
+    bool reconnect;                     /* Reconnect when the connection drops */
+    unsigned int reconnect_min_ms;      /* First backoff delay */
+    unsigned int reconnect_max_ms;      /* Backoff ceiling */
+    unsigned int reconnect_attempts;    /* Give up after this many in a row (0 = never) */
+    char login_script[BUFFER_SIZE];     /* expect/send script run after each connect */
+    int keepalive_idle;                 /* TCP keepalive: idle seconds (0 = off) */
+    int keepalive_interval;             /* TCP keepalive: seconds between probes */
+    int keepalive_count;                /* TCP keepalive: unanswered probes */
+    unsigned int user_timeout_ms;       /* TCP_USER_TIMEOUT (0 = kernel default) */
+    otelnet_probe_t probe;              /* Probe idle sessions */
+    unsigned int probe_interval;        /* Seconds of silence before a probe */
+    unsigned int probe_timeout;         /* Seconds to wait for a TIMING-MARK answer */
+    char spectate[BUFFER_SIZE];         /* Spectator socket path or loopback port (empty = off) */
+    unsigned int spectate_queue;        /* Per-spectator queue limit in bytes */
+    bool spectate_disconnect;           /* Disconnect slow spectators (else skip output) */
+    char listen_program[BUFFER_SIZE];   /* Program served by --listen without one given */
+    char websocket_origin[SMALL_BUFFER_SIZE]; /* Browser Origin required (empty = same host) */
 } otelnet_config_t;
 
 /* Main otelnet context */
@@ -115,6 +174,60 @@ typedef struct {
     /* Configuration */
     otelnet_config_t config;
 
+    /* Charset transcoding (remote charset <-> UTF-8 terminal) */
+    charset_conv_t charset_conv;
+
+    /* UTF-8 chunk boundary carry (when remote charset is UTF-8) */
+    utf8_stream_t utf8_stream;
+
+    /* Pending terminal output (stdout is non-blocking) */
+    iobuf_t term_out;
+    bool term_throttled;
+    bool term_paused;                   /* Output stopped by local XOFF (LFLOW) */
+
+    /* Adaptive receive: read size grows under load, shrinks when idle */
+    ring_t rx_ring;                     /* Receive ring; decoded text stays as history */
+    size_t rx_size;                     /* Current read size */
+    size_t rx_max;                      /* Read size limit (SO_RCVBUF capped) */
+
+    /* Pipelined mode: render and log stages (see pipeline.h) */
+    pipeline_stage_t render;
+    pipeline_stage_t log;
+    int pipeline_fd;                    /* eventfd: a stage drained to its notify level */
+
+    /* Input lines held until the server marks its next prompt (EOR/GA) */
+    iobuf_t paced_out;
+    bool awaiting_prompt;
+    uint64_t pace_sent_ms;
+
+    /* Login script (LOGIN_SCRIPT) */
+    login_script_t login;
+
+    /* Auto-reconnect: the session (log, ring history, stats) outlives connections */
+    const char *host;                   /* Connection target, kept for reconnecting */
+    int port;
+    unsigned int reconnect_failures;    /* Attempts since the last working connection */
+    uint64_t reconnect_at_ms;           /* Next attempt is due (0 = none scheduled) */
+    uint64_t lost_at_ms;                /* Connection went down (0 = up) */
+    unsigned int reconnects;            /* Connections restored */
+    uint64_t downtime_ms;               /* Time spent reconnecting */
+
+    /* Liveness: a dead path is detected and handled like a close */
+    uint64_t last_rx_ms;                /* Server last sent anything */
+    uint64_t last_probe_ms;             /* Last probe sent */
+    uint64_t dead_links;                /* Dead connections detected */
+    uint64_t dead_detect_ms;            /* Silence before the last detection */
+
+    /* Detached session (-D): the terminal is lent by whichever client is attached */
+    int session_fd;                     /* Session socket (-1 = ordinary foreground run) */
+    int attach_fd;                      /* Attached client's control socket (-1 = detached) */
+    int attach_pending_fd;              /* Accepted client yet to send its request (-1 = none) */
+    uint64_t attach_deadline_ms;        /* Drop the pending client then (0 = none) */
+    char session_path[BUFFER_SIZE];     /* Absolute socket path, removed on exit */
+
+    /* Read-only spectators (SPECTATE) */
+    share_t share;
+
     /* Running flag */
     bool running;
 
@@ -132,8 +245,9 @@ typedef struct {
 /**
  * Initialize otelnet context
  * @param ctx Context to initialize
+ * @return SUCCESS on success, error code on failure
  */
-void otelnet_init(otelnet_ctx_t *ctx);
+int otelnet_init(otelnet_ctx_t *ctx);
 
 /**
  * Load configuration from file
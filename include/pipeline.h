@@ -0,0 +1,117 @@
+/*
+ * pipeline.h - Threaded output stages fed by lock-free SPSC queues
+ *
+ * In pipelined mode the main thread receives and decodes, then hands
+ * text to a render stage (terminal) and a log stage, each running on
+ * its own thread.  A stage owns a single-producer/single-consumer byte
+ * queue of framed records; the fast path is two atomic indices, and
+ * eventfds are used only to sleep and wake.  Records are delivered in
+ * order, and a full queue throttles the producer (ordered backpressure),
+ * so the slowest stage sets the session's throughput.
+ */
+
+#ifndef OTELNET_PIPELINE_H
+#define OTELNET_PIPELINE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "ring.h"
+
+/* Record flags (meaning is up to the sink) */
+#define PIPELINE_REC_TRANSLATE  0x01    /* Render: LF -> CRLF (line mode) */
+#define PIPELINE_REC_SEND       0x02    /* Log: data sent to the server */
+
+/* Largest payload of a single record (longer pushes are split) */
+#define PIPELINE_RECORD_MAX     (64 * 1024)
+
+/* Stage consumer: called on the stage thread for every record */
+typedef void (*pipeline_sink_t)(void *arg, unsigned int flags,
+                                const unsigned char *data, size_t len);
+
+/* Output stage: SPSC queue plus consumer thread */
+typedef struct {
+    ring_t queue;                   /* Double-mapped storage */
+    _Atomic size_t head;            /* Bytes produced (producer only writes) */
+    _Atomic size_t tail;            /* Bytes consumed (consumer only writes) */
+    _Atomic size_t discard_to;      /* Skip records before this position */
+    _Atomic size_t notify_below;    /* Wake producer when pending drops to this */
+    _Atomic bool notify_armed;      /* Producer waits for notify_below */
+    _Atomic bool consumer_idle;     /* Consumer sleeps on wake_fd */
+    _Atomic bool paused;            /* Consumer holds records (local XOFF) */
+    _Atomic bool stop;              /* Drain and exit */
+    int wake_fd;                    /* eventfd: records queued or state changed */
+    int notify_fd;                  /* eventfd: space freed (shared with producer) */
+    pipeline_sink_t sink;
+    void *arg;
+    pthread_t thread;
+    bool running;
+} pipeline_stage_t;
+
+/**
+ * Start an output stage
+ * @param st Stage
+ * @param size Queue size in bytes
+ * @param sink Consumer callback (runs on the stage thread)
+ * @param arg Callback argument
+ * @param notify_fd eventfd the producer polls for freed space
+ * @return SUCCESS on success, error code on failure
+ */
+int pipeline_stage_start(pipeline_stage_t *st, size_t size, pipeline_sink_t sink, void *arg,
+                         int notify_fd);
+
+/**
+ * Drain remaining records, stop the thread and release the queue
+ * @param st Stage
+ */
+void pipeline_stage_stop(pipeline_stage_t *st);
+
+/**
+ * Queue a record
+ * Waits for space while the consumer is running; fails only when the
+ * consumer is paused and the queue is full.
+ * @param st Stage
+ * @param flags PIPELINE_REC_* flags
+ * @param data Payload
+ * @param len Payload length
+ * @return SUCCESS on success, ERROR_IO if the record could not be queued
+ */
+int pipeline_stage_push(pipeline_stage_t *st, unsigned int flags, const void *data, size_t len);
+
+/**
+ * Get bytes queued and not yet consumed
+ * @param st Stage
+ * @return Pending bytes (including record headers)
+ */
+size_t pipeline_stage_pending(pipeline_stage_t *st);
+
+/**
+ * Ask to be woken via notify_fd once pending drops to a level
+ * @param st Stage
+ * @param level Pending byte count to wait for
+ */
+void pipeline_stage_notify_at(pipeline_stage_t *st, size_t level);
+
+/**
+ * Hold or release records at the consumer
+ * @param st Stage
+ * @param paused true to hold
+ */
+void pipeline_stage_pause(pipeline_stage_t *st, bool paused);
+
+/**
+ * Drop every record queued so far
+ * @param st Stage
+ */
+void pipeline_stage_discard(pipeline_stage_t *st);
+
+/**
+ * Wait until every queued record has been consumed (no-op while paused)
+ * @param st Stage
+ */
+void pipeline_stage_drain(pipeline_stage_t *st);
+
+#endif /* OTELNET_PIPELINE_H */
@@ -0,0 +1,92 @@
+/*
+ * pool.h - Slab allocator for session objects and per-thread I/O buffer pool
+ *
+ * Session structures come from fixed-size slabs so that thousands of
+ * sessions do not each pay malloc overhead and fragmentation.  I/O
+ * buffers are borrowed from a per-thread cache only while data is in
+ * flight and returned when the queue drains, so an idle session holds
+ * no buffer memory at all.
+ */
+
+#ifndef OTELNET_POOL_H
+#define OTELNET_POOL_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "config.h"
+
+/* Buffer size classes: POOL_BUF_MIN doubling up to POOL_BUF_MAX (larger
+ * sizes bypass the cache); per-thread idle buffers are limited to
+ * POOL_BUF_KEEP per class.  All three depend on the build profile. */
+#define POOL_BUF_MIN            ((size_t)1 << POOL_BUF_MIN_SHIFT)
+#define POOL_BUF_MAX            (POOL_BUF_MIN << (POOL_BUF_CLASSES - 1))
+
+typedef struct pool_slab_s pool_slab_t;
+
+/* Fixed-size object pool (not thread-safe: use from one thread) */
+typedef struct {
+    size_t obj_size;                /* Object size, rounded up for alignment */
+    size_t per_slab;                /* Objects carved from each slab */
+    void *free_list;                /* Free objects (next pointer stored in object) */
+    pool_slab_t *slabs;             /* Allocated slabs */
+    size_t slab_count;              /* Number of slabs */
+    size_t in_use;                  /* Objects handed out */
+} pool_t;
+
+/**
+ * Initialize object pool (no memory is allocated until first use)
+ * @param pool Object pool
+ * @param obj_size Object size in bytes
+ * @param per_slab Objects per slab (0 = POOL_SLAB_OBJECTS)
+ */
+void pool_init(pool_t *pool, size_t obj_size, size_t per_slab);
+
+/**
+ * Allocate a zeroed object
+ * @param pool Object pool
+ * @return Object, or NULL if out of memory
+ */
+void *pool_alloc(pool_t *pool);
+
+/**
+ * Return an object to its pool
+ * @param pool Object pool
+ * @param obj Object from pool_alloc() (NULL is ignored)
+ */
+void pool_free(pool_t *pool, void *obj);
+
+/**
+ * Release all slabs (every object must have been freed)
+ * @param pool Object pool
+ */
+void pool_destroy(pool_t *pool);
+
+/**
+ * Borrow an I/O buffer from the calling thread's cache
+ * @param size Minimum size in bytes
+ * @param cap Pointer to store actual buffer size (pass it back to pool_buf_put)
+ * @return Buffer, or NULL if out of memory
+ */
+void *pool_buf_get(size_t size, size_t *cap);
+
+/**
+ * Return an I/O buffer to the calling thread's cache
+ * Buffers beyond POOL_BUF_KEEP per class are freed.
+ * @param buf Buffer from pool_buf_get() (NULL is ignored)
+ * @param cap Size requested from or reported by pool_buf_get()
+ */
+void pool_buf_put(void *buf, size_t cap);
+
+/**
+ * Free all idle buffers cached by the calling thread (call before thread exit)
+ */
+void pool_buf_trim(void);
+
+/**
+ * Get bytes held idle in the calling thread's cache
+ * @return Cached bytes
+ */
+size_t pool_buf_cached(void);
+
+#endif /* OTELNET_POOL_H */
@@ -0,0 +1,73 @@
+/*
+ * ring.h - Double-mapped ("magic") ring buffer
+ *
+ * The same memfd pages are mapped twice back to back, so any span of up
+ * to the ring size starting anywhere in the ring is virtually contiguous.
+ * The receive path recv()s straight into the ring and decodes in place;
+ * the decoded text stays behind the write position as history that
+ * matchers can inspect across chunk boundaries without copying.
+ */
+
+#ifndef OTELNET_RING_H
+#define OTELNET_RING_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Ring buffer */
+typedef struct {
+    unsigned char *base;            /* Mapping (2 * size when mirrored) */
+    size_t size;                    /* Ring size (page multiple) */
+    size_t pos;                     /* Write offset, 0 <= pos < size */
+    size_t fill;                    /* Valid history bytes behind pos */
+    bool mirrored;                  /* Double mapping active (else linear fallback) */
+    bool huge;                      /* Backed by huge pages */
+} ring_t;
+
+/**
+ * Create ring buffer
+ * Falls back to a plain linear buffer (history is dropped at wraparound)
+ * if the double mapping cannot be set up.
+ * @param ring Ring buffer
+ * @param size Minimum size in bytes (rounded up to the page size)
+ * @return SUCCESS on success, ERROR_GENERAL if out of memory
+ */
+int ring_init(ring_t *ring, size_t size);
+
+/**
+ * Release ring buffer
+ * @param ring Ring buffer
+ */
+void ring_free(ring_t *ring);
+
+/**
+ * Get contiguous space at the write position
+ * @param ring Ring buffer
+ * @param len Bytes needed (at most ring size)
+ * @return Write pointer, or NULL if len exceeds the ring size
+ */
+unsigned char *ring_reserve(ring_t *ring, size_t len);
+
+/**
+ * Commit bytes written at the write position
+ * @param ring Ring buffer
+ * @param len Bytes to keep as history
+ */
+void ring_commit(ring_t *ring, size_t len);
+
+/**
+ * Get the most recent history bytes as one contiguous span
+ * @param ring Ring buffer
+ * @param len Number of bytes wanted (at most ring_history())
+ * @return Pointer to the first of the last len bytes, or NULL
+ */
+const unsigned char *ring_tail(const ring_t *ring, size_t len);
+
+/**
+ * Get number of history bytes available to ring_tail()
+ * @param ring Ring buffer
+ * @return History length
+ */
+size_t ring_history(const ring_t *ring);
+
+#endif /* OTELNET_RING_H */
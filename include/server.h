@@ -0,0 +1,119 @@
+/*
+ * server.h - Telnet server running a program per client (otelnet --listen)
+ *
+ * Every client gets its own pseudo-terminal with the configured program
+ * on it, as telnetd does with login.  The client side is the telnet
+ * engine in the server role (telnet_accept): it offers ECHO and SGA, so
+ * the pty's line discipline does the echoing and line editing, and asks
+ * for the window size and terminal type.  The program is started once
+ * the terminal type arrives (or SERVER_SPAWN_WAIT_MS passed without it),
+ * so TERM and the pty size are right from its first byte; window size
+ * changes later become TIOCSWINSZ and SIGWINCH.
+ *
+ * One thread serves every client from an epoll loop, with the same
+ * backpressure as the gateway: the client is not read while the program
+ * has SERVER_HIGH_WATER bytes of input waiting, and the pty is not read
+ * while as much output is queued for the client.
+ */
+
+#ifndef OTELNET_SERVER_H
+#define OTELNET_SERVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "config.h"
+#include "iobuf.h"
+#include "pool.h"
+#include "telnet.h"
+
+/* Queued bytes on one side that stop reading the other */
+#define SERVER_HIGH_WATER       OTELNET_TERM_HIGH_WATER
+
+/* How long a new client may take to send its terminal type */
+#define SERVER_SPAWN_WAIT_MS    300
+
+/* epoll events handled per wakeup */
+#define SERVER_MAX_EVENTS       256
+
+/* Connections accepted per wakeup */
+#define SERVER_ACCEPT_BURST     32
+
+/* What an epoll entry points at (the listening socket has none) */
+typedef enum {
+    SERVER_WATCH_CLIENT,
+    SERVER_WATCH_PTY
+} server_watch_t;
+
+typedef struct server_conn_s server_conn_t;
+
+/* epoll entry of one of a connection's descriptors */
+typedef struct {
+    server_watch_t watch;
+    server_conn_t *conn;
+    uint32_t events;                /* Events registered with epoll */
+} server_ref_t;
+
+/* Client and the program serving it */
+struct server_conn_s {
+    telnet_t tn;                    /* Client session (server role) */
+    server_ref_t client;
+    server_ref_t pty;
+    int pty_fd;                     /* Pty master (-1 until the program runs) */
+    pid_t pid;                      /* Program (session and process group leader) */
+    iobuf_t to_pty;                 /* Client input the program has not read yet */
+    uint64_t spawn_by;              /* Start the program by then (monotonic ms) */
+    bool cr;                        /* Last input byte was CR (CR LF becomes CR) */
+    bool closing;                   /* Program ended: send its last output, then close */
+    bool dead;                      /* Closed; freed after the current batch of events */
+    server_conn_t *prev;            /* Open connections (dead ones: next only) */
+    server_conn_t *next;
+};
+
+/* Server */
+typedef struct {
+    int epoll_fd;
+    int listen_fd;
+    int spare_fd;                   /* Given up to refuse clients when out of descriptors */
+    char listen[SMALL_BUFFER_SIZE]; /* ADDRESS:PORT */
+    char **argv;                    /* Program and arguments (NULL-terminated) */
+    pool_t conns;
+    server_conn_t *open;            /* Connections open */
+    server_conn_t *dead;            /* Connections closed during this batch */
+    size_t starting;                /* Open connections whose program has not started */
+
+    /* Statistics */
+    size_t active;                  /* Connections open */
+    size_t peak;                    /* Most connections open at once */
+    unsigned long long served;      /* Clients accepted */
+    unsigned long long failed;      /* Clients whose program could not be started */
+    uint64_t bytes_in;              /* Client -> program (decoded) */
+    uint64_t bytes_out;             /* Program -> client */
+} server_t;
+
+/**
+ * Start listening
+ * @param srv Server
+ * @param spec [ADDRESS:]PORT; a bare port listens on 127.0.0.1 only
+ * @param argv Program and arguments, NULL-terminated (kept, not copied)
+ * @return SUCCESS on success, ERROR_INVALID_ARG for a malformed spec,
+ *         ERROR_IO if the port cannot be opened
+ */
+int server_init(server_t *srv, const char *spec, char **argv);
+
+/**
+ * Serve clients until SIGINT or SIGTERM
+ * @param srv Server
+ * @return SUCCESS on a requested stop, ERROR_IO if the event loop fails
+ */
+int server_run(server_t *srv);
+
+/**
+ * Hang up every client and stop listening
+ * @param srv Server
+ */
+void server_close(server_t *srv);
+
+#endif /* OTELNET_SERVER_H */
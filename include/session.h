@@ -0,0 +1,71 @@
+/*
+ * session.h - Detachable sessions (otelnet -D / otelnet -A)
+ *
+ * A detached session runs in the background and keeps the connection,
+ * negotiated options, scrollback and log alive while no one is watching.
+ * Clients attach over a Unix socket by handing the session their terminal
+ * file descriptors (SCM_RIGHTS).  The session then reads and writes that
+ * terminal itself, so output is never copied through the client; the
+ * client only relays window size changes and waits to be let go.
+ */
+
+#ifndef OTELNET_SESSION_H
+#define OTELNET_SESSION_H
+
+#include <stdbool.h>
+
+/* Control messages (one byte each) */
+#define SESSION_MSG_ATTACH      'A'     /* Client -> session, carries the terminal fds */
+#define SESSION_MSG_WINCH       'W'     /* Client -> session: window size changed */
+#define SESSION_MSG_DETACHED    'D'     /* Session -> client: terminal handed back */
+#define SESSION_MSG_ENDED       'Q'     /* Session -> client: session is over */
+
+/* Time an accepted client has to send its attach request */
+#define SESSION_ATTACH_TIMEOUT_MS   2000
+
+/**
+ * Create the session socket
+ * A stale socket left by a session that died is replaced.
+ * @param path Socket path
+ * @return Listening socket, ERROR_CONNECTION if a session already runs there,
+ *         ERROR_IO on failure
+ */
+int session_listen(const char *path);
+
+/**
+ * Accept an attaching client
+ * Its attach request is read with session_read_attach() once the socket
+ * is readable, so a client that connects and stalls cannot block the
+ * session.  Clients running as another user are refused.
+ * @param listen_fd Session socket
+ * @return Client control socket (non-blocking), or ERROR_IO
+ */
+int session_accept(int listen_fd);
+
+/**
+ * Read an accepted client's attach request (never blocks)
+ * @param fd Client control socket from session_accept()
+ * @param in_fd Receives the client's terminal input fd
+ * @param out_fd Receives the client's terminal output fd
+ * @return SUCCESS, 1 if the request has not arrived yet, or ERROR_IO if
+ *         the client sent something else or went away
+ */
+int session_read_attach(int fd, int *in_fd, int *out_fd);
+
+/**
+ * Send a control message
+ * @param fd Control socket
+ * @param msg SESSION_MSG_*
+ * @return SUCCESS on success, ERROR_IO on failure
+ */
+int session_send(int fd, char msg);
+
+/**
+ * Attach this terminal to a session and wait until it is handed back
+ * @param path Socket path
+ * @return SESSION_MSG_DETACHED or SESSION_MSG_ENDED, ERROR_CONNECTION if no
+ *         session runs there, ERROR_INVALID_ARG if stdin is not a terminal
+ */
+int session_attach(const char *path);
+
+#endif /* OTELNET_SESSION_H */
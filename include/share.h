@@ -0,0 +1,129 @@
+/*
+ * share.h - Read-only spectators of a session (SPECTATE)
+ *
+ * Spectators connect to a Unix socket or a loopback TCP port and receive
+ * the same decoded output the terminal shows; anything they send is
+ * ignored.  Output is written straight through to spectators that keep
+ * up.  For those that fall behind it is copied once into a reference
+ * counted chunk that every lagging spectator queues, so a slow viewer
+ * costs a pointer, not a copy.  Each spectator's queue is bounded: past
+ * the limit its output is skipped (with a note once it catches up) or it
+ * is disconnected, and the session itself never waits.
+ */
+
+#ifndef OTELNET_SHARE_H
+#define OTELNET_SHARE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/select.h>
+
+#include "config.h"
+#include "pool.h"
+
+/* Spectators at once */
+#define SHARE_MAX_VIEWERS       32
+
+/* Queued chunk references per spectator */
+#define SHARE_QUEUE_SLOTS       64
+
+/* Default per-spectator queue limit (SPECTATE_QUEUE) */
+#define SHARE_QUEUE_DEFAULT     (OTELNET_TERM_HIGH_WATER * 4)
+
+/* Shared output chunk; freed when the last spectator has sent it */
+typedef struct {
+    unsigned int refs;              /* Queue entries pointing here */
+    size_t cap;                     /* Pool buffer size (header included) */
+    size_t len;                     /* Bytes stored */
+    unsigned char data[];
+} share_chunk_t;
+
+/* Span of a chunk waiting to be sent */
+typedef struct {
+    share_chunk_t *chunk;
+    size_t start;                   /* Next byte to send */
+    size_t end;                     /* End of this spectator's span */
+} share_entry_t;
+
+/* Spectator */
+typedef struct {
+    int fd;                         /* -1 = free slot */
+    share_entry_t queue[SHARE_QUEUE_SLOTS];
+    size_t head;                    /* First queued entry */
+    size_t count;                   /* Queued entries */
+    size_t queued;                  /* Queued bytes */
+    uint64_t skipped;               /* Bytes skipped while behind (drop policy) */
+} share_viewer_t;
+
+/* Spectator hub */
+typedef struct {
+    int listen_fd;                  /* -1 = sharing off */
+    char path[BUFFER_SIZE];         /* Unix socket path, removed on close (empty = TCP) */
+    size_t queue_limit;             /* Per-spectator queue limit */
+    bool disconnect_slow;           /* Disconnect, rather than skip, when behind */
+    share_chunk_t *last;            /* Chunk still taking appends */
+    share_viewer_t viewers[SHARE_MAX_VIEWERS];
+    size_t count;                   /* Spectators connected */
+    unsigned int served;            /* Spectators accepted */
+    unsigned int slow_disconnects;  /* Disconnected for falling behind */
+    uint64_t skipped_bytes;         /* Output skipped for slow spectators */
+} share_t;
+
+/**
+ * Initialize the hub (sharing off)
+ * @param sh Spectator hub
+ */
+void share_init(share_t *sh);
+
+/**
+ * Start accepting spectators
+ * @param sh Spectator hub
+ * @param spec Unix socket path, or a port number for 127.0.0.1
+ * @param queue_limit Per-spectator queue limit in bytes
+ * @param disconnect_slow Disconnect spectators that fall behind (else skip output)
+ * @return SUCCESS on success, ERROR_IO on failure
+ */
+int share_open(share_t *sh, const char *spec, size_t queue_limit, bool disconnect_slow);
+
+/**
+ * Disconnect all spectators and stop listening
+ * @param sh Spectator hub
+ */
+void share_close(share_t *sh);
+
+/**
+ * Accept a spectator
+ * @param sh Spectator hub
+ * @return New spectator, or NULL (nothing pending, or no free slot)
+ */
+share_viewer_t *share_accept(share_t *sh);
+
+/**
+ * Send output to spectators
+ * @param sh Spectator hub
+ * @param only One spectator (e.g. a welcome for a new one), or NULL for all
+ * @param data Output bytes
+ * @param len Number of bytes
+ */
+void share_push(share_t *sh, share_viewer_t *only, const void *data, size_t len);
+
+/**
+ * Add the listening socket and spectators to select() sets
+ * @param sh Spectator hub
+ * @param readfds Read set
+ * @param writefds Write set (spectators with queued output)
+ * @param maxfd Highest fd so far
+ * @return Highest fd including the hub's
+ */
+int share_fill_fds(share_t *sh, fd_set *readfds, fd_set *writefds, int maxfd);
+
+/**
+ * Flush queued output and drop closed spectators after select()
+ * @param sh Spectator hub
+ * @param readfds Read set
+ * @param writefds Write set
+ */
+void share_service(share_t *sh, fd_set *readfds, fd_set *writefds);
+
+#endif /* OTELNET_SHARE_H */
@@ -3,6 +3,7 @@
  *
  * Implements Telnet protocol (RFC 854) for connecting to telnet servers
  * Handles IAC commands, option negotiation, line mode, and character mode
+ * The same engine can take the server side of a connection (telnet_accept)
  */
 
 #ifndef OTELNET_TELNET_H
@@ -22,9 +23,11 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 
-/* Constants */
-#define BUFFER_SIZE         4096
-#define SMALL_BUFFER_SIZE   256
+#include "config.h"
+#include "iobuf.h"
+#include "transport.h"
+
+/* Constants (buffer sizes come from config.h) */
 #define SUCCESS             0
 #define ERROR_GENERAL       -1
 #define ERROR_INVALID_ARG   -2
@@ -50,6 +53,8 @@
     syslog(LOG_ERR, "[ERROR] %s:%d: " fmt, __FILE__, __LINE__, ##__VA_ARGS__)
 
 /* Utility macros */
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
 #define SAFE_STRNCPY(dst, src, size) do { \
     strncpy(dst, src, size - 1); \
     dst[size - 1] = '\0'; \
@@ -81,11 +86,14 @@
 #define TELOPT_STATUS       5       /* Status */
 #define TELOPT_TIMING_MARK  6       /* Timing mark */
 #define TELOPT_TTYPE        24      /* Terminal type */
+#define TELOPT_EOR          25      /* End of record (RFC 885) */
 #define TELOPT_NAWS         31      /* Negotiate about window size */
 #define TELOPT_TSPEED       32      /* Terminal speed */
 #define TELOPT_LFLOW        33      /* Remote flow control */
 #define TELOPT_LINEMODE     34      /* Linemode */
 #define TELOPT_ENVIRON      36      /* Environment variables */
+#define TELOPT_CHARSET      42      /* Character set (RFC 2066) */
+#define TELOPT_COMPORT      44      /* COM port control (RFC 2217) */
 
 /* TERMINAL-TYPE subnegotiation codes (RFC 1091) */
 #define TTYPE_IS            0       /* Terminal type IS */
@@ -104,6 +112,28 @@
 #define LM_FORWARDMASK      2       /* Forward mask */
 #define LM_SLC              3       /* Set local characters */
 
+/* CHARSET subnegotiation codes (RFC 2066) */
+#define CHARSET_REQUEST         1   /* Request charset from list */
+#define CHARSET_ACCEPTED        2   /* Charset accepted */
+#define CHARSET_REJECTED        3   /* No charset in list acceptable */
+#define CHARSET_TTABLE_IS       4   /* Translation table follows */
+#define CHARSET_TTABLE_REJECTED 5   /* Translation table rejected */
+#define CHARSET_TTABLE_ACK      6   /* Translation table acknowledged */
+#define CHARSET_TTABLE_NAK      7   /* Translation table not acknowledged */
+
+/* LFLOW subnegotiation codes (RFC 1372) */
+#define LFLOW_OFF           0       /* Disable local flow control */
+#define LFLOW_ON            1       /* Enable local flow control */
+#define LFLOW_RESTART_ANY   2       /* Any character restarts output */
+#define LFLOW_RESTART_XON   3       /* Only XON restarts output */
+
+/* Flow control characters */
+#define ASCII_XON           0x11    /* Ctrl+Q */
+#define ASCII_XOFF          0x13    /* Ctrl+S */
+
+/* Maximum subnegotiation length (longer SBs are truncated) */
+#define TELNET_SB_MAX       BUFFER_SIZE
+
 /* LINEMODE MODE bits */
 #define MODE_EDIT           0x01    /* Local editing */
 #define MODE_TRAPSIG        0x02    /* Trap signals */
@@ -111,6 +141,38 @@
 #define MODE_SOFT_TAB       0x08    /* Soft tab */
 #define MODE_LIT_ECHO       0x10    /* Literal echo */
 
+/* COM-PORT-OPTION state (RFC 2217) */
+typedef struct {
+    bool offer;                     /* Offer WILL COM-PORT-OPTION on connect */
+    bool enabled;                   /* Server agreed (DO COM-PORT-OPTION) */
+    char signature[64];             /* Access server signature */
+
+    /* Port settings as last reported by the server (0 = unknown) */
+    uint32_t baudrate;
+    uint8_t datasize;
+    uint8_t parity;
+    uint8_t stopsize;
+    uint8_t flow;                   /* SET-CONTROL outbound flow setting */
+    uint8_t linestate;              /* Last NOTIFY-LINESTATE */
+    uint8_t modemstate;             /* Last NOTIFY-MODEMSTATE */
+
+    /* Port settings applied once the server agrees (0 = leave unchanged) */
+    uint32_t want_baudrate;
+    uint8_t want_datasize;
+    uint8_t want_parity;
+    uint8_t want_stopsize;
+    uint8_t want_flow;
+
+    /* Flow control (FLOWCONTROL-SUSPEND/RESUME) */
+    bool suspended;                 /* We asked the server to stop sending */
+    bool remote_suspended;          /* Server asked us to stop sending */
+
+    /* BREAK in progress: BREAK-OFF is due break_ms after BREAK-ON went out */
+    bool break_on;
+    unsigned int break_ms;
+    uint64_t break_until;           /* Monotonic ms (0 while BREAK-ON is still queued) */
+} comport_state_t;
+
 /* Telnet state machine states */
 typedef enum {
     TELNET_STATE_DATA,          /* Normal data */
@@ -124,70 +186,198 @@ typedef enum {
     TELNET_STATE_SEENCR         /* Received CR (for CR/LF processing) */
 } telnet_state_t;
 
-/* Telnet connection structure */
+/* Outbound traffic classes, drained in this order */
+typedef enum {
+    TELNET_OUT_CONTROL,         /* Negotiation replies, NAWS, IP/AO/Synch */
+    TELNET_OUT_INTERACTIVE,     /* Keystrokes */
+    TELNET_OUT_BULK,            /* Pastes, paced lines */
+    TELNET_OUT_CLASSES
+} telnet_out_class_t;
+
+typedef struct telnet_s telnet_t;
+
+/* Decoder variant: returns input bytes consumed, appends data at *out_pos */
+typedef size_t (*telnet_decoder_t)(telnet_t *tn, const unsigned char *input, size_t input_len,
+                                   unsigned char *output, size_t output_size, size_t *out_pos);
+
+/* 256-bit option set (one bit per telnet option) */
+typedef struct {
+    uint64_t bits[4];
+} telnet_optset_t;
+
+/**
+ * Check whether an option is set
+ */
+static inline bool telnet_opt_isset(const telnet_optset_t *set, unsigned char option)
+{
+    return (set->bits[option >> 6] >> (option & 63)) & 1;
+}
+
+/**
+ * Set or clear an option
+ */
+static inline void telnet_opt_set(telnet_optset_t *set, unsigned char option, bool on)
+{
+    if (on) {
+        set->bits[option >> 6] |= (uint64_t)1 << (option & 63);
+    } else {
+        set->bits[option >> 6] &= ~((uint64_t)1 << (option & 63));
+    }
+}
+
+/* Rarely used connection data, allocated separately from telnet_t */
 typedef struct {
-    int fd;                         /* Socket file descriptor */
     char host[SMALL_BUFFER_SIZE];   /* Remote host */
     int port;                       /* Remote port */
-    bool is_connected;              /* Connection status */
 
-    /* Protocol state */
-    telnet_state_t state;           /* Current protocol state */
-    unsigned char option;           /* Current option being negotiated */
+    /* Terminal type (RFC 1091 multi-type support) */
+    char terminal_type[64];         /* Current terminal type (e.g., "ANSI", "VT100") */
+    int ttype_index;                /* Terminal type cycle index */
 
-    /* Subnegotiation buffer */
-    unsigned char sb_buffer[BUFFER_SIZE];
-    size_t sb_len;
+    /* Terminal size (NAWS - RFC 1073) */
+    int term_width;                 /* Terminal width in columns */
+    int term_height;                /* Terminal height in rows */
 
-    /* Option tracking */
-    bool local_options[256];        /* Options we support locally */
-    bool remote_options[256];       /* Options remote supports */
+    /* Terminal speed (TSPEED - RFC 1079) */
+    char terminal_speed[32];        /* Terminal speed (e.g., "38400,38400") */
+
+    /* Serial port control (COM-PORT-OPTION - RFC 2217) */
+    comport_state_t comport;
+
+    /* Options the remote enabled in the last session (telnet_reconnect) */
+    telnet_optset_t remote_cached;
+} telnet_cold_t;
+
+/* Telnet connection structure
+ * Fields used for every received chunk come first (first cache line);
+ * negotiation state follows; everything else lives in the cold block. */
+typedef struct telnet_s {
+    /* Hot: receive path */
+    telnet_decoder_t decoder;       /* Variant for current mode (telnet_update_mode) */
+    int fd;                         /* Socket file descriptor */
+    telnet_state_t state;           /* Current protocol state */
+    unsigned char *sb_buffer;       /* Subnegotiation data (pool buffer, held only during SB) */
+    size_t sb_len;                  /* Subnegotiation bytes in sb_buffer */
+    size_t mark_count;              /* Marks seen in the last telnet_process_input() */
+    size_t mark_offset;             /* Output offset just after the last mark */
+    uint64_t synch_discarded;       /* Bytes discarded by Synch */
+    bool is_connected;              /* Connection status */
+    bool binary_remote;             /* They send binary */
+    bool synch;                     /* Urgent data seen, discard input until IAC DM */
+    bool timing_mark;               /* DO TIMING-MARK sent, answer not yet seen */
+    bool remote_xonxoff;            /* Honor XON/XOFF sent by the remote */
+    bool output_paused;             /* Remote sent XOFF - hold outbound queue */
+    bool prompt_marks;              /* Server marks prompts with EOR or GA */
+    bool linemode;                  /* Line mode vs character mode */
+    bool echo_remote;               /* They echo */
 
     /* Mode flags (bidirectional - RFC 855 compliant) */
     bool binary_local;              /* We send binary */
-    bool binary_remote;             /* They send binary */
     bool echo_local;                /* We echo */
-    bool echo_remote;               /* They echo */
     bool sga_local;                 /* We suppress GA */
     bool sga_remote;                /* They suppress GA */
     bool linemode_active;           /* Linemode option active */
     bool linemode_edit;             /* Local editing enabled */
 
-    /* Deprecated: kept for compatibility, use bidirectional flags */
-    bool binary_mode;               /* Binary transmission mode (OR of local/remote) */
-    bool echo_mode;                 /* Echo mode (remote echo) */
-    bool sga_mode;                  /* Suppress go ahead (OR of local/remote) */
-    bool linemode;                  /* Line mode vs character mode */
+    /* Server role (telnet_accept): we echo, the client reports its terminal */
+    bool server;                    /* Option roles are those of a server */
+    bool echo_offer;                /* Willing to echo (DO ECHO is accepted) */
+    bool window_changed;            /* Client sent a window size (NAWS); caller clears */
 
-    /* Terminal type (RFC 1091 multi-type support) */
-    char terminal_type[64];         /* Current terminal type (e.g., "ANSI", "VT100") */
-    int ttype_index;                /* Terminal type cycle index */
+    /* Remote flow control (LFLOW - RFC 1372) */
+    bool lflow_enabled;             /* Server asked us to handle XON/XOFF locally */
+    bool lflow_restart_any;         /* Any character restarts paused output */
 
-    /* Terminal size (NAWS - RFC 1073) */
-    int term_width;                 /* Terminal width in columns */
-    int term_height;                /* Terminal height in rows */
+    /* Character set (CHARSET - RFC 2066) */
+    int charset;                    /* Remote character set (charset_id_t) */
+    int charset_preferred;          /* Configured charset, or CHARSET_INVALID if none */
 
-    /* Terminal speed (TSPEED - RFC 1079) */
-    char terminal_speed[32];        /* Terminal speed (e.g., "38400,38400") */
+    /* Option tracking */
+    telnet_optset_t local_options;  /* Options we support locally */
+    telnet_optset_t remote_options; /* Options remote supports */
+
+    /* Outbound data (IAC-escaped) not yet accepted by the socket, per class */
+    iobuf_t outq[TELNET_OUT_CLASSES];
+    size_t out_urgent;              /* Offset + 1 of the Synch DM in the control queue */
+    uint8_t out_split;              /* Class whose next byte ends a split IAC/CR pair */
+
+    /* Byte stream under the protocol (fd above mirrors transport.fd) */
+    transport_t transport;
+
+    /* Cold: host, terminal and COM port settings */
+    telnet_cold_t *cold;
 } telnet_t;
 
 /* Function prototypes */
 
 /**
  * Initialize telnet structure
+ * Allocates the cold block from a slab pool; release with telnet_free().
+ * Sessions must be created and freed on the same thread.
  * @param tn Telnet structure to initialize
+ * @return SUCCESS on success, ERROR_GENERAL if allocation fails
+ */
+int telnet_init(telnet_t *tn);
+
+/**
+ * Release memory owned by a telnet structure
+ * @param tn Telnet structure
  */
-void telnet_init(telnet_t *tn);
+void telnet_free(telnet_t *tn);
 
 /**
  * Connect to telnet server
  * @param tn Telnet structure
- * @param host Remote host (IP or hostname)
- * @param port Remote port
+ * @param host Remote host (IP or hostname), or a unix:, serial: or pipe:
+ *             target (see transport.h)
+ * @param port Remote port (TCP only)
  * @return SUCCESS on success, error code on failure
  */
 int telnet_connect(telnet_t *tn, const char *host, int port);
 
+/**
+ * Start a session over an already open transport (e.g., in-memory)
+ * Takes ownership of the transport and sends the initial negotiation.
+ * @param tn Telnet structure
+ * @param tp Open transport
+ * @return SUCCESS on success, error code on failure
+ */
+int telnet_attach(telnet_t *tn, const transport_t *tp);
+
+/**
+ * Serve a client over an accepted transport
+ * Takes ownership of the transport and offers the server side of a
+ * character-mode session: WILL SGA, WILL/DO BINARY, DO NAWS, DO TTYPE,
+ * and WILL ECHO if echo is set.  The client's window size and terminal
+ * type land in the cold block (term_width/term_height, terminal_type).
+ * @param tn Telnet structure (from telnet_init())
+ * @param tp Accepted transport (see transport_adopt())
+ * @param echo Offer to echo the client's input
+ * @return SUCCESS on success, error code on failure
+ */
+int telnet_accept(telnet_t *tn, const transport_t *tp, bool echo);
+
+/**
+ * Offer or withdraw server-side echo (WILL/WONT ECHO)
+ * @param tn Telnet structure in the server role
+ * @param on Echo the client's input
+ * @return SUCCESS on success, error code on failure
+ */
+int telnet_set_echo(telnet_t *tn, bool on);
+
+/**
+ * Connect again after the connection was lost (or an attempt failed)
+ * Negotiation starts over from the defaults, but options the remote
+ * enabled in the last session are requested in the first flight rather
+ * than after the server offers them again.  Configuration (charset,
+ * COM port, terminal type and size) is kept.
+ * @param tn Telnet structure
+ * @param host Connection target, as for telnet_connect()
+ * @param port Remote port (TCP only)
+ * @return SUCCESS on success, error code on failure
+ */
+int telnet_reconnect(telnet_t *tn, const char *host, int port);
+
 /**
  * Disconnect from telnet server
  * @param tn Telnet structure
@@ -198,6 +388,8 @@ int telnet_disconnect(telnet_t *tn);
 /**
  * Process incoming data from telnet server
  * Handles IAC sequences and returns clean data
+ * Output may start one byte before input to decode in place (output
+ * never overtakes input; input_len + 1 bytes of output always suffice).
  * @param tn Telnet structure
  * @param input Input data buffer
  * @param input_len Input data length
@@ -209,6 +401,14 @@ int telnet_disconnect(telnet_t *tn);
 int telnet_process_input(telnet_t *tn, const unsigned char *input, size_t input_len,
                          unsigned char *output, size_t output_size, size_t *output_len);
 
+/**
+ * Check whether the last processed input ended on a record/prompt mark
+ * @param tn Telnet structure
+ * @param output_len Output length returned by telnet_process_input()
+ * @return true if IAC EOR or IAC GA was the last thing in the chunk
+ */
+bool telnet_ends_with_mark(telnet_t *tn, size_t output_len);
+
 /**
  * Prepare data for sending to telnet server
  * Escapes IAC bytes (0xFF -> 0xFF 0xFF)
@@ -232,6 +432,57 @@ int telnet_prepare_output(telnet_t *tn, const unsigned char *input, size_t input
  */
 ssize_t telnet_send(telnet_t *tn, const void *data, size_t len);
 
+/**
+ * Queue IAC-escaped data for the server and send as much as possible
+ * Control data always goes first, then interactive, then bulk; a class
+ * is only preempted between IAC sequences and CR LF / CR NUL pairs.
+ * Interactive and bulk data are held while the remote has paused us
+ * (XOFF or FLOWCONTROL-SUSPEND); control data never is.
+ * @param tn Telnet structure
+ * @param cls Traffic class (TELNET_OUT_*)
+ * @param data Data to send (already escaped)
+ * @param len Data length
+ * @return Number of bytes sent now, or error code on failure
+ */
+ssize_t telnet_queue_output(telnet_t *tn, telnet_out_class_t cls, const void *data, size_t len);
+
+/**
+ * Send queued outbound data in priority order
+ * @param tn Telnet structure
+ * @return Number of bytes sent (0 if paused or would block), or error code on failure
+ */
+ssize_t telnet_flush_output(telnet_t *tn);
+
+/**
+ * Drop queued outbound data of one class
+ * @param tn Telnet structure
+ * @param cls Traffic class (TELNET_OUT_INTERACTIVE or TELNET_OUT_BULK)
+ * @return Number of bytes dropped
+ */
+size_t telnet_discard_output(telnet_t *tn, telnet_out_class_t cls);
+
+/**
+ * Get number of queued outbound bytes
+ * @param tn Telnet structure
+ * @param cls Traffic class, or TELNET_OUT_CLASSES for all
+ * @return Queued bytes
+ */
+size_t telnet_output_queued(const telnet_t *tn, telnet_out_class_t cls);
+
+/**
+ * Check whether outbound data is held by remote flow control
+ * @param tn Telnet structure
+ * @return true if the remote has paused our output
+ */
+bool telnet_output_paused(const telnet_t *tn);
+
+/**
+ * Check whether queued outbound data can be sent
+ * @param tn Telnet structure
+ * @return true if control data is queued, or other data and output is not paused
+ */
+bool telnet_output_pending(const telnet_t *tn);
+
 /**
  * Receive data from telnet server
  * @param tn Telnet structure
@@ -258,6 +509,15 @@ int telnet_send_command(telnet_t *tn, unsigned char command);
  */
 int telnet_send_negotiate(telnet_t *tn, unsigned char command, unsigned char option);
 
+/**
+ * Send IAC DO TIMING-MARK (RFC 860) as a liveness probe
+ * The server answers WILL or WONT TIMING-MARK once it has processed
+ * everything sent before; the answer clears tn->timing_mark.
+ * @param tn Telnet structure
+ * @return SUCCESS on success, error code on failure
+ */
+int telnet_send_timing_mark(telnet_t *tn);
+
 /**
  * Handle received option negotiation
  * @param tn Telnet structure
@@ -274,6 +534,16 @@ int telnet_handle_negotiate(telnet_t *tn, unsigned char command, unsigned char o
  */
 int telnet_handle_subnegotiation(telnet_t *tn);
 
+/**
+ * Send subnegotiation
+ * Builds IAC SB <data> IAC SE, escaping IAC bytes in data
+ * @param tn Telnet structure
+ * @param data Subnegotiation data (option code first)
+ * @param len Data length
+ * @return SUCCESS on success, error code on failure
+ */
+int telnet_send_subnegotiation(telnet_t *tn, const unsigned char *data, size_t len);
+
 /**
  * Send NAWS (Negotiate About Window Size) subnegotiation
  * @param tn Telnet structure
@@ -283,6 +553,46 @@ int telnet_handle_subnegotiation(telnet_t *tn);
  */
 int telnet_send_naws(telnet_t *tn, int width, int height);
 
+/**
+ * Set preferred remote character set
+ * Used as-is for servers that do not negotiate CHARSET, and offered first
+ * in CHARSET REQUEST/ACCEPTED exchanges.
+ * @param tn Telnet structure
+ * @param name Character set name (e.g., "EUC-KR")
+ * @return SUCCESS on success, ERROR_INVALID_ARG if charset unsupported
+ */
+int telnet_set_charset(telnet_t *tn, const char *name);
+
+/**
+ * Handle TCP urgent notification (exceptional condition on the socket)
+ * Enters Synch mode: data is discarded until IAC DM, commands are still
+ * processed (RFC 854).
+ * @param tn Telnet structure
+ */
+void telnet_handle_urgent(telnet_t *tn);
+
+/**
+ * Send Synch (IAC DM with the DM byte sent as TCP urgent data)
+ * @param tn Telnet structure
+ * @return SUCCESS on success, error code on failure
+ */
+int telnet_send_synch(telnet_t *tn);
+
+/**
+ * Send Interrupt Process followed by Synch
+ * Outbound data still queued is discarded.
+ * @param tn Telnet structure
+ * @return SUCCESS on success, error code on failure
+ */
+int telnet_send_interrupt(telnet_t *tn);
+
+/**
+ * Send Abort Output followed by Synch
+ * @param tn Telnet structure
+ * @return SUCCESS on success, error code on failure
+ */
+int telnet_send_abort_output(telnet_t *tn);
+
 /**
  * Get file descriptor for select/poll
  * @param tn Telnet structure
@@ -0,0 +1,257 @@
+/*
+ * transport.h - Byte stream transports under the telnet engine
+ *
+ * The telnet engine only needs a non-blocking byte stream.  A transport
+ * hides where that stream comes from:
+ *
+ *   host port             TCP (AF_INET)
+ *   tls:host [port]       TLS over TCP ("telnets", port 992 by default);
+ *                         needs a build with OpenSSL (OTELNET_TLS)
+ *   unix:PATH             Unix domain stream socket
+ *   serial:DEV[,BAUD]     Local serial line or pty device (raw mode)
+ *   pipe:COMMAND          Stdin/stdout of a helper command, e.g. a jump
+ *                         host hop with "ssh -W host:23 jumphost"
+ *   (memory)              In-memory loopback for benchmarks and tests
+ *
+ * Operations follow send()/recv() conventions: -1 with errno set on
+ * failure (EAGAIN when nothing can be transferred right now), 0 from
+ * recv at end of stream.
+ *
+ * TCP and TLS connections can go through a SOCKS5 or HTTP CONNECT proxy
+ * (transport_proxy_configure()).  The proxy request is written as soon
+ * as the connect completes, with the session's first bytes right behind
+ * it, so the proxy hop adds no round trip of its own for plain TCP.
+ *
+ * TLS uses kernel TLS offload (TLS_TX/TLS_RX) when OpenSSL and the
+ * kernel support it; the socket then carries the plain stream again, so
+ * external transfer programs can be handed the descriptor.
+ */
+
+#ifndef OTELNET_TRANSPORT_H
+#define OTELNET_TRANSPORT_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+
+#include "iobuf.h"
+
+/* Transport types */
+typedef enum {
+    TRANSPORT_NONE,
+    TRANSPORT_TCP,
+    TRANSPORT_TLS,
+    TRANSPORT_UNIX,
+    TRANSPORT_SERIAL,
+    TRANSPORT_PIPE,
+    TRANSPORT_MEMORY
+} transport_type_t;
+
+/* Default port for TLS-wrapped telnet (telnets) */
+#define TRANSPORT_TLS_DEFAULT_PORT  992
+
+typedef struct transport_s transport_t;
+typedef struct transport_tls_s transport_tls_t;
+typedef struct transport_proxy_s transport_proxy_t;
+
+/* Transport operations */
+typedef struct {
+    /* Send bytes; urgent marks the last byte as TCP urgent data where supported */
+    ssize_t (*send)(transport_t *tp, const void *data, size_t len, bool urgent);
+    ssize_t (*recv)(transport_t *tp, void *buffer, size_t size);
+    void (*close)(transport_t *tp);
+    /* Write out bytes accepted earlier (see held); NULL if never needed */
+    int (*flush)(transport_t *tp);
+} transport_ops_t;
+
+/* Transport instance */
+struct transport_s {
+    const transport_ops_t *ops;     /* NULL when closed */
+    transport_type_t type;
+    int fd;                         /* Descriptor to poll (-1 for memory) */
+    pid_t pid;                      /* Pipe: helper command */
+    iobuf_t *mem_rx;                /* Memory: bytes to receive */
+    iobuf_t *mem_tx;                /* Memory: bytes sent */
+    transport_tls_t *tls;           /* TLS: session state */
+    transport_proxy_t *proxy;       /* Proxy handshake state (NULL if direct) */
+    size_t held;                    /* Bytes accepted by send but not yet written */
+    bool want_read;                 /* Sending waits for inbound data (handshake) */
+};
+
+/**
+ * Get transport type named by a connection target
+ * @param target "tls:", "unix:", "serial:" or "pipe:" prefixed target, else a host
+ * @return Transport type
+ */
+transport_type_t transport_parse(const char *target);
+
+/**
+ * Open a transport for a connection target (see transport_parse())
+ * The descriptor is non-blocking; a TCP connect may still be in progress.
+ * @param tp Transport
+ * @param target Connection target
+ * @param port TCP port (ignored for non-network transports)
+ * @return SUCCESS on success, ERROR_CONNECTION on failure
+ */
+int transport_open(transport_t *tp, const char *target, int port);
+
+/**
+ * Open a transport without a DNS lookup for TCP and TLS targets
+ * The connection goes to addr (see transport_resolve()), while the host
+ * name is still used for the proxy request, TLS SNI and certificate
+ * verification.  Through a proxy, addr is ignored: the proxy resolves
+ * the target.
+ * @param tp Transport
+ * @param target Connection target
+ * @param port TCP port (ignored for non-network transports)
+ * @param addr Address of the target's host (NULL to resolve it now)
+ * @return SUCCESS on success, ERROR_CONNECTION on failure
+ */
+int transport_open_resolved(transport_t *tp, const char *target, int port,
+                            const struct in_addr *addr);
+
+/**
+ * Resolve the host of a TCP or TLS target (blocks for DNS)
+ * @param target Connection target
+ * @param addr Where to store the IPv4 address
+ * @return SUCCESS on success, ERROR_CONNECTION if the host cannot be
+ *         resolved, ERROR_INVALID_ARG for other transport types
+ */
+int transport_resolve(const char *target, struct in_addr *addr);
+
+/**
+ * Open an in-memory transport
+ * Received bytes are taken from rx and sent bytes appended to tx; two
+ * transports with swapped queues form a loopback pair.
+ * @param tp Transport
+ * @param rx Inbound queue
+ * @param tx Outbound queue
+ * @return SUCCESS on success, error code on failure
+ */
+int transport_open_memory(transport_t *tp, iobuf_t *rx, iobuf_t *tx);
+
+/**
+ * Take over an accepted socket (server side of a connection)
+ * The socket gets the same options as an outgoing one and is made
+ * non-blocking; transport_close() closes it.
+ * @param tp Transport
+ * @param type TRANSPORT_TCP or TRANSPORT_UNIX
+ * @param fd Accepted socket
+ * @return SUCCESS on success, ERROR_INVALID_ARG for other types
+ */
+int transport_adopt(transport_t *tp, transport_type_t type, int fd);
+
+/**
+ * Base64-encode (HTTP Basic proxy credentials, WebSocket handshake)
+ * @param in Bytes to encode
+ * @param len Number of bytes
+ * @param out Output, NUL-terminated
+ * @param size Output buffer size
+ * @return true on success, false if out is too small
+ */
+bool transport_base64(const unsigned char *in, size_t len, char *out, size_t size);
+
+/**
+ * Listen for TCP clients on [ADDRESS:]PORT (all addresses if none given)
+ * The socket is non-blocking and close-on-exec, ready for accept4().
+ * @param spec Port, or IPv4 address and port
+ * @return Listening socket, ERROR_INVALID_ARG for a malformed spec,
+ *         ERROR_IO if the port cannot be bound
+ */
+int transport_listen(const char *spec);
+
+/**
+ * Close a transport (safe to call when not open)
+ * @param tp Transport
+ */
+void transport_close(transport_t *tp);
+
+/**
+ * Write out bytes held by the transport (see held)
+ * @param tp Transport
+ * @return 0 when nothing is held any more, -1 with errno set otherwise
+ */
+int transport_flush(transport_t *tp);
+
+/**
+ * Check whether a transport type takes a TCP port
+ * @param type Transport type
+ * @return true for TCP and TLS
+ */
+bool transport_uses_port(transport_type_t type);
+
+/**
+ * Check whether the descriptor carries the plain byte stream
+ * External programs (file transfers) can only be handed such a descriptor;
+ * TLS qualifies only with kernel TLS active in both directions.
+ * @param tp Transport
+ * @return true if the descriptor can be used directly
+ */
+bool transport_fd_is_stream(const transport_t *tp);
+
+/**
+ * Route TCP and TLS connections through a proxy
+ * @param url "socks5://[user:pass@]host[:port]" (default port 1080),
+ *            "http://[user:pass@]host[:port]" (default port 8080), or
+ *            NULL/empty to connect directly
+ * @return SUCCESS on success, ERROR_INVALID_ARG if the URL is malformed
+ */
+int transport_proxy_configure(const char *url);
+
+/**
+ * Check whether TCP and TLS connections go through a proxy
+ * @return true if a proxy is configured
+ */
+bool transport_proxy_enabled(void);
+
+/**
+ * Resolve the proxy host now, so that later connections make no DNS lookup
+ * For long-running servers; the client resolves it on every connect.
+ * @return SUCCESS (also without a proxy), ERROR_CONNECTION if the proxy
+ *         host cannot be resolved
+ */
+int transport_proxy_resolve(void);
+
+/**
+ * Set dead peer detection for TCP and TLS sockets opened afterwards
+ * A silently dead path otherwise goes unnoticed for about two hours
+ * (kernel keepalive defaults) or forever (no keepalive, nothing sent).
+ * @param idle Seconds of silence before the first keepalive (0 = no keepalive)
+ * @param interval Seconds between unanswered keepalives
+ * @param count Unanswered keepalives before the connection is dropped
+ * @param user_timeout_ms Drop the connection once sent data (or keepalives)
+ *                        stay unacknowledged this long (0 = kernel default)
+ */
+void transport_keepalive_configure(int idle, int interval, int count, unsigned int user_timeout_ms);
+
+/**
+ * Set TLS peer verification options (before the first TLS connection)
+ * @param verify Verify the server certificate and host name
+ * @param ca_file CA bundle (NULL or empty for the system default)
+ */
+void transport_tls_configure(bool verify, const char *ca_file);
+
+/**
+ * Describe an established TLS session (protocol, cipher, kTLS state)
+ * @param tp Transport
+ * @param buf Output buffer
+ * @param size Buffer size
+ * @return true if tp is an established TLS session
+ */
+bool transport_tls_info(const transport_t *tp, char *buf, size_t size);
+
+/**
+ * Check whether this build supports TLS
+ * @return true if built with OpenSSL
+ */
+bool transport_tls_available(void);
+
+/**
+ * Get a printable name for a transport type
+ * @param type Transport type
+ * @return Static name
+ */
+const char *transport_name(transport_type_t type);
+
+#endif /* OTELNET_TRANSPORT_H */
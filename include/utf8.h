@@ -0,0 +1,86 @@
+/*
+ * utf8.h - UTF-8 validation and chunk boundary handling
+ *
+ * Provides a decode stage that carries incomplete UTF-8 sequences across
+ * recv() chunk boundaries so the terminal and log never see half a
+ * character, with a vectorized validator for the common valid case.
+ */
+
+#ifndef OTELNET_UTF8_H
+#define OTELNET_UTF8_H
+
+#include "telnet.h"
+
+/* Worst-case growth of utf8_stream_process() output (invalid byte -> U+FFFD) */
+#define UTF8_STREAM_MAX_GROWTH  3
+
+/* UTF-8 stream state (one per session) */
+typedef struct {
+    unsigned char carry[4];         /* Incomplete sequence from previous chunk */
+    size_t carry_len;
+    bool replace_invalid;           /* Replace invalid sequences with U+FFFD */
+    uint64_t invalid_count;         /* Invalid sequences seen */
+} utf8_stream_t;
+
+/**
+ * Check if byte is start of multibyte UTF-8 sequence
+ * @param byte Byte to check
+ * @return true if byte is a multibyte lead byte
+ */
+bool utf8_is_start(unsigned char byte);
+
+/**
+ * Check if byte is UTF-8 continuation byte
+ * @param byte Byte to check
+ * @return true if byte is 10xxxxxx
+ */
+bool utf8_is_continuation(unsigned char byte);
+
+/**
+ * Get expected length of UTF-8 sequence from first byte
+ * @param byte Lead byte
+ * @return Sequence length (1-4), or 0 if invalid lead byte
+ */
+int utf8_sequence_length(unsigned char byte);
+
+/**
+ * Decode one UTF-8 character (strict: no overlongs, surrogates or > U+10FFFF)
+ * @param s Input bytes
+ * @param len Number of bytes available
+ * @param cp Pointer to store code point
+ * @return Bytes consumed, 0 if sequence is incomplete, -1 if invalid
+ */
+int utf8_decode_char(const unsigned char *s, size_t len, uint32_t *cp);
+
+/**
+ * Find the longest prefix consisting of complete, valid UTF-8 characters
+ * Uses SSSE3 lookup tables when the CPU supports them.
+ * @param data Input bytes
+ * @param len Input length
+ * @return Length of valid prefix
+ */
+size_t utf8_validate(const unsigned char *data, size_t len);
+
+/**
+ * Initialize UTF-8 stream state
+ * @param st Stream state
+ * @param replace_invalid Replace invalid sequences with U+FFFD
+ */
+void utf8_stream_init(utf8_stream_t *st, bool replace_invalid);
+
+/**
+ * Process a chunk of UTF-8 data
+ * Complete characters are copied to output; an incomplete trailing sequence
+ * is held back and prepended to the next chunk.
+ * @param st Stream state
+ * @param input Input data
+ * @param input_len Input data length
+ * @param output Output buffer ((input_len + 4) * UTF8_STREAM_MAX_GROWTH is always sufficient)
+ * @param output_size Size of output buffer
+ * @param output_len Pointer to store actual output length
+ * @return SUCCESS on success, error code on failure
+ */
+int utf8_stream_process(utf8_stream_t *st, const unsigned char *input, size_t input_len,
+                        unsigned char *output, size_t output_size, size_t *output_len);
+
+#endif /* OTELNET_UTF8_H */
@@ -0,0 +1,125 @@
+/*
+ * websocket.h - WebSocket server side (RFC 6455) for browser consoles
+ *
+ * Only what the gateway needs to serve browsers: the opening handshake
+ * (with its SHA-1/base64 accept key), headers for unmasked server frames
+ * and an incremental parser for masked client frames.  The parser
+ * unmasks payload in place and hands it over as it arrives, so a frame
+ * never has to fit a buffer; only control frames (at most 125 bytes)
+ * are collected.
+ */
+
+#ifndef OTELNET_WEBSOCKET_H
+#define OTELNET_WEBSOCKET_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/* Opcodes */
+#define WS_OP_CONTINUATION      0x0
+#define WS_OP_TEXT              0x1
+#define WS_OP_BINARY            0x2
+#define WS_OP_CLOSE             0x8
+#define WS_OP_PING              0x9
+#define WS_OP_PONG              0xA
+
+/* Close status codes */
+#define WS_CLOSE_NORMAL         1000
+#define WS_CLOSE_GOING_AWAY     1001
+#define WS_CLOSE_PROTOCOL       1002
+#define WS_CLOSE_ERROR          1011
+
+/* Largest server frame header (no mask) and control payload */
+#define WS_HEADER_MAX           10
+#define WS_CONTROL_MAX          125
+
+/* Largest handshake request accepted */
+#define WS_REQUEST_MAX          4096
+
+/* Client frame parser */
+typedef struct {
+    unsigned char head[14];         /* Header bytes so far */
+    size_t head_len;
+    size_t head_need;               /* Header size (known after two bytes) */
+    bool in_payload;                /* Header done, payload follows */
+    unsigned char opcode;           /* Opcode of the current frame */
+    uint64_t remaining;             /* Payload bytes still to come */
+    unsigned char mask[4];
+    size_t mask_pos;
+    unsigned char control[WS_CONTROL_MAX];
+    size_t control_len;
+} ws_parser_t;
+
+/* What ws_parse() found */
+typedef enum {
+    WS_MSG_NONE,                    /* Nothing complete yet */
+    WS_MSG_DATA,                    /* Payload of a text/binary/continuation frame */
+    WS_MSG_CONTROL                  /* Complete close, ping or pong frame */
+} ws_msg_type_t;
+
+typedef struct {
+    ws_msg_type_t type;
+    unsigned char opcode;           /* WS_MSG_CONTROL: WS_OP_CLOSE/PING/PONG */
+    const unsigned char *data;      /* Payload (unmasked) */
+    size_t len;
+} ws_msg_t;
+
+/**
+ * Compute the SHA-1 digest of data
+ * @param data Input bytes
+ * @param len Number of bytes
+ * @param digest 20-byte digest
+ */
+void ws_sha1(const void *data, size_t len, unsigned char digest[20]);
+
+/**
+ * Check an opening handshake and build the HTTP response
+ * @param request Request head, NUL-terminated (up to the blank line)
+ * @param origin Origin the request must come from (NULL or empty: a
+ *               browser's Origin must name the Host it connected to)
+ * @param response Response buffer (also for refusals)
+ * @param size Buffer size
+ * @param response_len Response length
+ * @return 101 when the connection is upgraded, else the refusal's HTTP status
+ */
+int ws_handshake(const char *request, const char *origin, char *response, size_t size,
+                 size_t *response_len);
+
+/**
+ * Write a final (FIN) server frame header
+ * @param out At least WS_HEADER_MAX bytes
+ * @param opcode Frame opcode
+ * @param len Payload length
+ * @return Header length
+ */
+size_t ws_frame_header(unsigned char *out, unsigned char opcode, uint64_t len);
+
+/**
+ * Build a close frame
+ * @param out At least WS_HEADER_MAX + 2 bytes
+ * @param status Close status code
+ * @return Frame length
+ */
+size_t ws_close_frame(unsigned char *out, unsigned int status);
+
+/**
+ * Reset a parser for a new connection
+ * @param p Parser
+ */
+void ws_parser_init(ws_parser_t *p);
+
+/**
+ * Decode client frames
+ * Call until all data is consumed; each call reports at most one piece.
+ * Data frame payload is unmasked in place and returned as it arrives.
+ * @param p Parser
+ * @param data Received bytes (payload is unmasked in place)
+ * @param len Number of bytes
+ * @param msg What was found
+ * @return Bytes consumed, or ERROR_INVALID_ARG on a protocol violation
+ */
+ssize_t ws_parse(ws_parser_t *p, unsigned char *data, size_t len, ws_msg_t *msg);
+
+#endif /* OTELNET_WEBSOCKET_H */
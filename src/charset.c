@@ -0,0 +1,495 @@
+/*
+ * charset.c - Character set negotiation support and transcoding
+ *
+ * Lookup tables are built once per character set from the system iconv
+ * converters, so the per-byte path is a plain table lookup with an ASCII
+ * fast path and no iconv calls.
+ */
+
+#include "charset.h"
+#include "utf8.h"
+#include <ctype.h>
+#include <iconv.h>
+
+/* Character set registry entry */
+typedef struct {
+    const char *name;               /* Canonical (IANA) name used in negotiation */
+    const char *iconv_name;         /* Name of the iconv converter for table build */
+    bool dbcs;                      /* Double-byte character set */
+    const char *aliases[8];         /* Normalized aliases (uppercase, alnum only) */
+} charset_desc_t;
+
+static const charset_desc_t charset_registry[CHARSET_COUNT] = {
+    [CHARSET_UTF8]        = {"UTF-8", "UTF-8", false, {"UTF8", NULL}},
+    [CHARSET_EUC_KR]      = {"EUC-KR", "EUC-KR", true, {"EUCKR", "CSEUCKR", NULL}},
+    [CHARSET_CP949]       = {"CP949", "CP949", true,
+                             {"CP949", "UHC", "MS949", "WINDOWS949", "KSC56011987", NULL}},
+    [CHARSET_SHIFT_JIS]   = {"SHIFT_JIS", "CP932", true,
+                             {"SHIFTJIS", "SJIS", "CP932", "MS932", "WINDOWS31J",
+                              "MSKANJI", "CSSHIFTJIS", NULL}},
+    [CHARSET_ISO_8859_1]  = {"ISO-8859-1", "ISO-8859-1", false, {"ISO88591", "LATIN1", "L1", NULL}},
+    [CHARSET_ISO_8859_2]  = {"ISO-8859-2", "ISO-8859-2", false, {"ISO88592", "LATIN2", "L2", NULL}},
+    [CHARSET_ISO_8859_3]  = {"ISO-8859-3", "ISO-8859-3", false, {"ISO88593", "LATIN3", "L3", NULL}},
+    [CHARSET_ISO_8859_4]  = {"ISO-8859-4", "ISO-8859-4", false, {"ISO88594", "LATIN4", "L4", NULL}},
+    [CHARSET_ISO_8859_5]  = {"ISO-8859-5", "ISO-8859-5", false, {"ISO88595", "CYRILLIC", NULL}},
+    [CHARSET_ISO_8859_6]  = {"ISO-8859-6", "ISO-8859-6", false, {"ISO88596", "ARABIC", NULL}},
+    [CHARSET_ISO_8859_7]  = {"ISO-8859-7", "ISO-8859-7", false, {"ISO88597", "GREEK", NULL}},
+    [CHARSET_ISO_8859_8]  = {"ISO-8859-8", "ISO-8859-8", false, {"ISO88598", "HEBREW", NULL}},
+    [CHARSET_ISO_8859_9]  = {"ISO-8859-9", "ISO-8859-9", false, {"ISO88599", "LATIN5", "L5", NULL}},
+    [CHARSET_ISO_8859_10] = {"ISO-8859-10", "ISO-8859-10", false, {"ISO885910", "LATIN6", "L6", NULL}},
+    [CHARSET_ISO_8859_11] = {"ISO-8859-11", "ISO-8859-11", false, {"ISO885911", NULL}},
+    [CHARSET_ISO_8859_13] = {"ISO-8859-13", "ISO-8859-13", false, {"ISO885913", "LATIN7", "L7", NULL}},
+    [CHARSET_ISO_8859_14] = {"ISO-8859-14", "ISO-8859-14", false, {"ISO885914", "LATIN8", "L8", NULL}},
+    [CHARSET_ISO_8859_15] = {"ISO-8859-15", "ISO-8859-15", false, {"ISO885915", "LATIN9", "L9", NULL}},
+    [CHARSET_ISO_8859_16] = {"ISO-8859-16", "ISO-8859-16", false, {"ISO885916", "LATIN10", "L10", NULL}},
+};
+
+/* Lookup tables, built on first use and shared by all sessions */
+static charset_table_t *charset_tables[CHARSET_COUNT];
+
+/* U+FFFD REPLACEMENT CHARACTER in UTF-8 */
+static const unsigned char charset_replacement[3] = {0xEF, 0xBF, 0xBD};
+
+/**
+ * Normalize character set name: uppercase, alphanumerics only
+ */
+static void charset_normalize(const char *name, char *out, size_t out_size)
+{
+    size_t pos = 0;
+
+    for (; *name != '\0' && pos < out_size - 1; name++) {
+        if (isalnum((unsigned char)*name)) {
+            out[pos++] = (char)toupper((unsigned char)*name);
+        }
+    }
+    out[pos] = '\0';
+}
+
+/**
+ * Look up a character set by name
+ */
+int charset_lookup(const char *name)
+{
+    char normalized[SMALL_BUFFER_SIZE];
+
+    if (name == NULL) {
+        return CHARSET_INVALID;
+    }
+
+    charset_normalize(name, normalized, sizeof(normalized));
+    if (normalized[0] == '\0') {
+        return CHARSET_INVALID;
+    }
+
+    for (int id = 0; id < CHARSET_COUNT; id++) {
+        for (int a = 0; charset_registry[id].aliases[a] != NULL; a++) {
+            if (strcmp(normalized, charset_registry[id].aliases[a]) == 0) {
+                return id;
+            }
+        }
+    }
+
+    return CHARSET_INVALID;
+}
+
+/**
+ * Get canonical name of a character set
+ */
+const char *charset_name(int charset)
+{
+    if (charset < 0 || charset >= CHARSET_COUNT) {
+        return "UNKNOWN";
+    }
+
+    return charset_registry[charset].name;
+}
+
+/**
+ * Convert one candidate byte sequence with iconv
+ * @return 1 on success (*ucs set), 0 if incomplete (lead byte), -1 if invalid
+ */
+static int charset_iconv_probe(iconv_t cd, const unsigned char *in, size_t in_len, uint16_t *ucs)
+{
+    unsigned char out[8];
+    char *inp = (char *)in;
+    char *outp = (char *)out;
+    size_t in_left = in_len;
+    size_t out_left = sizeof(out);
+
+    /* Reset conversion state */
+    iconv(cd, NULL, NULL, NULL, NULL);
+
+    if (iconv(cd, &inp, &in_left, &outp, &out_left) == (size_t)-1) {
+        return (errno == EINVAL) ? 0 : -1;
+    }
+
+    /* Exactly one BMP character expected */
+    if (in_left != 0 || sizeof(out) - out_left != 2) {
+        return -1;
+    }
+
+    *ucs = (uint16_t)(out[0] | (out[1] << 8));
+    return (*ucs != 0) ? 1 : -1;
+}
+
+/**
+ * Build lookup tables for a character set
+ */
+static charset_table_t *charset_build_table(int charset)
+{
+    const charset_desc_t *desc = &charset_registry[charset];
+    charset_table_t *table;
+    iconv_t cd;
+    unsigned char seq[2];
+    uint16_t ucs;
+
+    cd = iconv_open("UCS-2LE", desc->iconv_name);
+    if (cd == (iconv_t)-1) {
+        MB_LOG_ERROR("iconv does not support %s: %s", desc->iconv_name, strerror(errno));
+        return NULL;
+    }
+
+    table = calloc(1, sizeof(*table));
+    if (table == NULL) {
+        iconv_close(cd);
+        return NULL;
+    }
+
+    table->reverse = calloc(65536, sizeof(uint16_t));
+    if (desc->dbcs) {
+        table->pair = calloc(128 * 256, sizeof(uint16_t));
+    }
+    if (table->reverse == NULL || (desc->dbcs && table->pair == NULL)) {
+        free(table->reverse);
+        free(table->pair);
+        free(table);
+        iconv_close(cd);
+        return NULL;
+    }
+
+    /* Single bytes first so that reverse mapping prefers the shortest code */
+    for (int b = 0x80; b <= 0xFF; b++) {
+        seq[0] = (unsigned char)b;
+        int ret = charset_iconv_probe(cd, seq, 1, &ucs);
+        if (ret > 0) {
+            table->single[b - 0x80] = ucs;
+            if (ucs >= 0x80 && table->reverse[ucs] == 0) {
+                table->reverse[ucs] = (uint16_t)b;
+            }
+        } else if (ret == 0 && desc->dbcs) {
+            table->lead[b - 0x80] = true;
+        }
+    }
+
+    /* Double-byte pairs */
+    if (desc->dbcs) {
+        for (int lead = 0x80; lead <= 0xFF; lead++) {
+            if (!table->lead[lead - 0x80]) {
+                continue;
+            }
+            seq[0] = (unsigned char)lead;
+            for (int trail = 0x21; trail <= 0xFE; trail++) {
+                seq[1] = (unsigned char)trail;
+                if (charset_iconv_probe(cd, seq, 2, &ucs) > 0) {
+                    table->pair[(lead - 0x80) * 256 + trail] = ucs;
+                    if (ucs >= 0x80 && table->reverse[ucs] == 0) {
+                        table->reverse[ucs] = (uint16_t)((lead << 8) | trail);
+                    }
+                }
+            }
+        }
+    }
+
+    iconv_close(cd);
+
+    MB_LOG_INFO("Character set tables built for %s", desc->name);
+
+    return table;
+}
+
+/**
+ * Initialize transcoder for a character set
+ */
+int charset_conv_init(charset_conv_t *conv, int charset)
+{
+    if (conv == NULL) {
+        return ERROR_INVALID_ARG;
+    }
+
+    memset(conv, 0, sizeof(*conv));
+    conv->charset = CHARSET_UTF8;
+    conv->table = NULL;
+
+    if (charset < 0 || charset >= CHARSET_COUNT) {
+        return ERROR_INVALID_ARG;
+    }
+
+    if (charset == CHARSET_UTF8) {
+        return SUCCESS;
+    }
+
+    if (charset_tables[charset] == NULL) {
+        charset_tables[charset] = charset_build_table(charset);
+        if (charset_tables[charset] == NULL) {
+            MB_LOG_WARNING("Transcoding for %s unavailable, falling back to UTF-8",
+                          charset_registry[charset].name);
+            return ERROR_GENERAL;
+        }
+    }
+
+    conv->charset = charset;
+    conv->table = charset_tables[charset];
+
+    MB_LOG_INFO("Transcoding enabled: %s <-> UTF-8", charset_registry[charset].name);
+
+    return SUCCESS;
+}
+
+/**
+ * Check if transcoder performs any conversion
+ */
+bool charset_conv_active(const charset_conv_t *conv)
+{
+    return conv != NULL && conv->table != NULL;
+}
+
+/**
+ * Write a BMP code point as UTF-8, return bytes written
+ */
+static size_t charset_put_utf8(unsigned char *out, uint16_t ucs)
+{
+    if (ucs < 0x80) {
+        out[0] = (unsigned char)ucs;
+        return 1;
+    } else if (ucs < 0x800) {
+        out[0] = (unsigned char)(0xC0 | (ucs >> 6));
+        out[1] = (unsigned char)(0x80 | (ucs & 0x3F));
+        return 2;
+    }
+
+    out[0] = (unsigned char)(0xE0 | (ucs >> 12));
+    out[1] = (unsigned char)(0x80 | ((ucs >> 6) & 0x3F));
+    out[2] = (unsigned char)(0x80 | (ucs & 0x3F));
+    return 3;
+}
+
+/**
+ * Decode one double-byte pair
+ * @return Number of input bytes consumed (1 if trail must be reprocessed, 2 otherwise)
+ */
+static size_t charset_decode_pair(const charset_table_t *table, unsigned char lead,
+                                  unsigned char trail, unsigned char *out, size_t *out_pos)
+{
+    uint16_t ucs = table->pair[(lead - 0x80) * 256 + trail];
+
+    if (ucs != 0) {
+        *out_pos += charset_put_utf8(out + *out_pos, ucs);
+        return 2;
+    }
+
+    /* Invalid pair - replace lead byte, reprocess an ASCII trail byte */
+    memcpy(out + *out_pos, charset_replacement, sizeof(charset_replacement));
+    *out_pos += sizeof(charset_replacement);
+    return (trail < 0x80) ? 1 : 2;
+}
+
+/**
+ * Decode remote charset data to UTF-8
+ */
+int charset_decode(charset_conv_t *conv, const unsigned char *input, size_t input_len,
+                   unsigned char *output, size_t output_size, size_t *output_len)
+{
+    const charset_table_t *table;
+    size_t i = 0;
+    size_t out_pos = 0;
+
+    if (conv == NULL || input == NULL || output == NULL || output_len == NULL) {
+        return ERROR_INVALID_ARG;
+    }
+
+    *output_len = 0;
+    table = conv->table;
+
+    /* UTF-8 remote: pass through */
+    if (table == NULL) {
+        size_t len = MIN(input_len, output_size);
+        memcpy(output, input, len);
+        *output_len = len;
+        return SUCCESS;
+    }
+
+    /* Complete a lead byte carried over from the previous chunk */
+    if (conv->dec_has_lead && input_len > 0 && output_size >= 3) {
+        conv->dec_has_lead = false;
+        if (charset_decode_pair(table, conv->dec_lead, input[0], output, &out_pos) == 2) {
+            i = 1;
+        }
+    }
+
+    while (i < input_len) {
+        /* ASCII fast path: copy 7-bit runs eight bytes at a time */
+        while (i + 8 <= input_len && out_pos + 8 <= output_size) {
+            uint64_t word;
+            memcpy(&word, input + i, sizeof(word));
+            if (word & 0x8080808080808080ULL) {
+                break;
+            }
+            memcpy(output + out_pos, &word, sizeof(word));
+            i += 8;
+            out_pos += 8;
+        }
+
+        if (i >= input_len) {
+            break;
+        }
+
+        if (out_pos + 3 > output_size) {
+            MB_LOG_WARNING("Charset decode buffer full - %zu bytes dropped", input_len - i);
+            break;
+        }
+
+        unsigned char c = input[i];
+
+        if (c < 0x80) {
+            output[out_pos++] = c;
+            i++;
+        } else if (table->lead[c - 0x80]) {
+            if (i + 1 >= input_len) {
+                /* Lead byte split across chunks - carry it */
+                conv->dec_lead = c;
+                conv->dec_has_lead = true;
+                i++;
+                break;
+            }
+            i += charset_decode_pair(table, c, input[i + 1], output, &out_pos);
+        } else if (table->single[c - 0x80] != 0) {
+            out_pos += charset_put_utf8(output + out_pos, table->single[c - 0x80]);
+            i++;
+        } else {
+            memcpy(output + out_pos, charset_replacement, sizeof(charset_replacement));
+            out_pos += sizeof(charset_replacement);
+            i++;
+        }
+    }
+
+    *output_len = out_pos;
+
+    return SUCCESS;
+}
+
+/**
+ * Encode one code point to the remote charset
+ */
+static size_t charset_put_remote(const charset_table_t *table, uint32_t cp, unsigned char *out)
+{
+    uint16_t code = (cp < 0x80) ? (uint16_t)cp : (cp <= 0xFFFF ? table->reverse[cp] : 0);
+
+    if (cp < 0x80) {
+        out[0] = (unsigned char)cp;
+        return 1;
+    } else if (code == 0) {
+        out[0] = '?';
+        return 1;
+    } else if (code < 0x100) {
+        out[0] = (unsigned char)code;
+        return 1;
+    }
+
+    out[0] = (unsigned char)(code >> 8);
+    out[1] = (unsigned char)(code & 0xFF);
+    return 2;
+}
+
+/**
+ * Encode UTF-8 data to remote charset
+ */
+int charset_encode(charset_conv_t *conv, const unsigned char *input, size_t input_len,
+                   unsigned char *output, size_t output_size, size_t *output_len)
+{
+    const charset_table_t *table;
+    size_t i = 0;
+    size_t out_pos = 0;
+    uint32_t cp;
+    int used;
+
+    if (conv == NULL || input == NULL || output == NULL || output_len == NULL) {
+        return ERROR_INVALID_ARG;
+    }
+
+    *output_len = 0;
+    table = conv->table;
+
+    /* UTF-8 remote: pass through */
+    if (table == NULL) {
+        size_t len = MIN(input_len, output_size);
+        memcpy(output, input, len);
+        *output_len = len;
+        return SUCCESS;
+    }
+
+    /* Complete a UTF-8 sequence carried over from the previous call */
+    if (conv->enc_carry_len > 0 && input_len > 0 && output_size >= 2) {
+        size_t carried = conv->enc_carry_len;
+
+        used = 0;
+        while (used == 0 && i < input_len && conv->enc_carry_len < sizeof(conv->enc_carry)) {
+            conv->enc_carry[conv->enc_carry_len++] = input[i++];
+            used = utf8_decode_char(conv->enc_carry, conv->enc_carry_len, &cp);
+        }
+
+        if (used == 0) {
+            /* Still incomplete - keep carrying */
+            return SUCCESS;
+        }
+
+        if (used > 0) {
+            out_pos += charset_put_remote(table, cp, output + out_pos);
+        } else {
+            /* Invalid sequence - replace it and reprocess the new bytes */
+            output[out_pos++] = '?';
+            i -= conv->enc_carry_len - carried;
+        }
+        conv->enc_carry_len = 0;
+    }
+
+    while (i < input_len) {
+        /* ASCII fast path */
+        while (i + 8 <= input_len && out_pos + 8 <= output_size) {
+            uint64_t word;
+            memcpy(&word, input + i, sizeof(word));
+            if (word & 0x8080808080808080ULL) {
+                break;
+            }
+            memcpy(output + out_pos, &word, sizeof(word));
+            i += 8;
+            out_pos += 8;
+        }
+
+        if (i >= input_len) {
+            break;
+        }
+
+        if (out_pos + 2 > output_size) {
+            MB_LOG_WARNING("Charset encode buffer full - %zu bytes dropped", input_len - i);
+            break;
+        }
+
+        used = utf8_decode_char(input + i, input_len - i, &cp);
+        if (used == 0) {
+            /* Incomplete sequence at end of input - carry it */
+            conv->enc_carry_len = input_len - i;
+            memcpy(conv->enc_carry, input + i, conv->enc_carry_len);
+            break;
+        } else if (used < 0) {
+            output[out_pos++] = '?';
+            i++;
+        } else {
+            out_pos += charset_put_remote(table, cp, output + out_pos);
+            i += (size_t)used;
+        }
+    }
+
+    *output_len = out_pos;
+
+    return SUCCESS;
+}
@@ -0,0 +1,513 @@
+/*
+ * comport.c - Telnet COM Port Control Option (RFC 2217)
+ */
+
+#include "comport.h"
+#include <ctype.h>
+#include <strings.h>
+
+/**
+ * Send COM-PORT-OPTION command
+ * Format: IAC SB COM-PORT-OPTION <command> <value...> IAC SE
+ */
+static int comport_send(telnet_t *tn, uint8_t command, const unsigned char *value, size_t value_len)
+{
+    unsigned char data[2 + 64];
+
+    if (tn == NULL || value_len > sizeof(data) - 2) {
+        return ERROR_INVALID_ARG;
+    }
+
+    if (!tn->cold->comport.enabled) {
+        MB_LOG_WARNING("COM-PORT-OPTION not negotiated with server");
+        return ERROR_GENERAL;
+    }
+
+    data[0] = TELOPT_COMPORT;
+    data[1] = command;
+    if (value_len > 0) {
+        memcpy(&data[2], value, value_len);
+    }
+
+    MB_LOG_DEBUG("Sending COM-PORT-OPTION command %d (%zu bytes)", command, value_len);
+
+    return telnet_send_subnegotiation(tn, data, 2 + value_len);
+}
+
+/**
+ * Send single-byte COM-PORT-OPTION command
+ */
+static int comport_send_byte(telnet_t *tn, uint8_t command, uint8_t value)
+{
+    return comport_send(tn, command, &value, 1);
+}
+
+/**
+ * Apply configured port settings once the server accepts the option
+ */
+void comport_on_enabled(telnet_t *tn)
+{
+    comport_state_t *cp;
+
+    if (tn == NULL) {
+        return;
+    }
+
+    cp = &tn->cold->comport;
+    cp->enabled = true;
+    cp->suspended = false;
+    cp->remote_suspended = false;
+
+    /* Request server signature (empty SIGNATURE) */
+    comport_send(tn, COMPORT_SIGNATURE, NULL, 0);
+
+    /* Set configured values; a value of 0 queries the current setting */
+    comport_set_baudrate(tn, cp->want_baudrate);
+    comport_set_datasize(tn, cp->want_datasize);
+    comport_set_parity(tn, cp->want_parity);
+    comport_set_stopsize(tn, cp->want_stopsize);
+    if (cp->want_flow != 0) {
+        comport_set_control(tn, cp->want_flow);
+    }
+}
+
+/**
+ * Handle COM-PORT-OPTION subnegotiation from the server
+ */
+int comport_handle_subnegotiation(telnet_t *tn)
+{
+    comport_state_t *cp;
+    const unsigned char *value;
+    size_t value_len;
+    uint8_t command;
+
+    if (tn == NULL || tn->sb_len < 2) {
+        return ERROR_INVALID_ARG;
+    }
+
+    cp = &tn->cold->comport;
+    command = tn->sb_buffer[1];
+    value = &tn->sb_buffer[2];
+    value_len = tn->sb_len - 2;
+
+    /* Server replies carry an offset of 100 */
+    if (command >= COMPORT_SERVER_OFFSET) {
+        command -= COMPORT_SERVER_OFFSET;
+    }
+
+    switch (command) {
+        case COMPORT_SIGNATURE:
+            if (value_len == 0) {
+                /* Server requests our signature */
+                const char *signature = "otelnet";
+                comport_send(tn, COMPORT_SIGNATURE, (const unsigned char *)signature, strlen(signature));
+            } else {
+                size_t len = MIN(value_len, sizeof(cp->signature) - 1);
+                memcpy(cp->signature, value, len);
+                cp->signature[len] = '\0';
+                MB_LOG_INFO("COM-PORT server signature: %s", cp->signature);
+            }
+            break;
+
+        case COMPORT_SET_BAUDRATE:
+            if (value_len >= 4) {
+                cp->baudrate = ((uint32_t)value[0] << 24) | ((uint32_t)value[1] << 16) |
+                               ((uint32_t)value[2] << 8) | (uint32_t)value[3];
+                MB_LOG_INFO("COM-PORT baud rate: %u", cp->baudrate);
+            }
+            break;
+
+        case COMPORT_SET_DATASIZE:
+            if (value_len >= 1) {
+                cp->datasize = value[0];
+                MB_LOG_INFO("COM-PORT data size: %u", cp->datasize);
+            }
+            break;
+
+        case COMPORT_SET_PARITY:
+            if (value_len >= 1) {
+                cp->parity = value[0];
+                MB_LOG_INFO("COM-PORT parity: %s", comport_parity_name(cp->parity));
+            }
+            break;
+
+        case COMPORT_SET_STOPSIZE:
+            if (value_len >= 1) {
+                cp->stopsize = value[0];
+                MB_LOG_INFO("COM-PORT stop size: %s", comport_stopsize_name(cp->stopsize));
+            }
+            break;
+
+        case COMPORT_SET_CONTROL:
+            if (value_len >= 1) {
+                if (value[0] >= COMPORT_CONTROL_FLOW_NONE && value[0] <= COMPORT_CONTROL_FLOW_HARDWARE) {
+                    cp->flow = value[0];
+                    MB_LOG_INFO("COM-PORT flow control: %s", comport_flow_name(cp->flow));
+                } else {
+                    MB_LOG_DEBUG("COM-PORT control reply: %u", value[0]);
+                }
+            }
+            break;
+
+        case COMPORT_NOTIFY_LINESTATE:
+            if (value_len >= 1) {
+                cp->linestate = value[0];
+                if (cp->linestate & (COMPORT_LINE_OVERRUN | COMPORT_LINE_PARITY |
+                                     COMPORT_LINE_FRAMING | COMPORT_LINE_BREAK)) {
+                    MB_LOG_WARNING("COM-PORT line state 0x%02x:%s%s%s%s", cp->linestate,
+                                  (cp->linestate & COMPORT_LINE_OVERRUN) ? " overrun" : "",
+                                  (cp->linestate & COMPORT_LINE_PARITY) ? " parity-error" : "",
+                                  (cp->linestate & COMPORT_LINE_FRAMING) ? " framing-error" : "",
+                                  (cp->linestate & COMPORT_LINE_BREAK) ? " break" : "");
+                }
+            }
+            break;
+
+        case COMPORT_NOTIFY_MODEMSTATE:
+            if (value_len >= 1) {
+                cp->modemstate = value[0];
+                MB_LOG_DEBUG("COM-PORT modem state 0x%02x", cp->modemstate);
+            }
+            break;
+
+        case COMPORT_FLOWCONTROL_SUSPEND:
+            /* Server cannot accept more data */
+            cp->remote_suspended = true;
+            MB_LOG_INFO("COM-PORT server suspended flow");
+            break;
+
+        case COMPORT_FLOWCONTROL_RESUME:
+            cp->remote_suspended = false;
+            MB_LOG_INFO("COM-PORT server resumed flow");
+            break;
+
+        default:
+            MB_LOG_DEBUG("Ignoring COM-PORT-OPTION reply %d", tn->sb_buffer[1]);
+            break;
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * Set baud rate
+ */
+int comport_set_baudrate(telnet_t *tn, uint32_t baudrate)
+{
+    unsigned char value[4];
+
+    value[0] = (unsigned char)((baudrate >> 24) & 0xFF);
+    value[1] = (unsigned char)((baudrate >> 16) & 0xFF);
+    value[2] = (unsigned char)((baudrate >> 8) & 0xFF);
+    value[3] = (unsigned char)(baudrate & 0xFF);
+
+    if (baudrate != 0) {
+        MB_LOG_INFO("Requesting COM-PORT baud rate %u", baudrate);
+    }
+
+    return comport_send(tn, COMPORT_SET_BAUDRATE, value, sizeof(value));
+}
+
+/**
+ * Set data bits
+ */
+int comport_set_datasize(telnet_t *tn, uint8_t datasize)
+{
+    if (datasize != 0 && (datasize < 5 || datasize > 8)) {
+        return ERROR_INVALID_ARG;
+    }
+
+    return comport_send_byte(tn, COMPORT_SET_DATASIZE, datasize);
+}
+
+/**
+ * Set parity
+ */
+int comport_set_parity(telnet_t *tn, uint8_t parity)
+{
+    if (parity > COMPORT_PARITY_SPACE) {
+        return ERROR_INVALID_ARG;
+    }
+
+    return comport_send_byte(tn, COMPORT_SET_PARITY, parity);
+}
+
+/**
+ * Set stop bits
+ */
+int comport_set_stopsize(telnet_t *tn, uint8_t stopsize)
+{
+    if (stopsize > COMPORT_STOPSIZE_1_5) {
+        return ERROR_INVALID_ARG;
+    }
+
+    return comport_send_byte(tn, COMPORT_SET_STOPSIZE, stopsize);
+}
+
+/**
+ * Send SET-CONTROL
+ */
+int comport_set_control(telnet_t *tn, uint8_t control)
+{
+    return comport_send_byte(tn, COMPORT_SET_CONTROL, control);
+}
+
+/**
+ * Start a BREAK for a duration
+ */
+int comport_send_break(telnet_t *tn, int duration_ms)
+{
+    comport_state_t *cp = &tn->cold->comport;
+    int ret;
+
+    if (cp->break_on) {
+        MB_LOG_WARNING("COM-PORT BREAK already in progress");
+        return ERROR_GENERAL;
+    }
+    if (duration_ms <= 0) {
+        duration_ms = COMPORT_BREAK_MS;
+    }
+
+    ret = comport_set_control(tn, COMPORT_CONTROL_BREAK_ON);
+    if (ret != SUCCESS) {
+        return ret;
+    }
+
+    MB_LOG_INFO("COM-PORT BREAK for %d ms", duration_ms);
+    cp->break_on = true;
+    cp->break_ms = (unsigned int)duration_ms;
+    cp->break_until = 0;
+
+    return SUCCESS;
+}
+
+/**
+ * Time a BREAK in progress
+ */
+void comport_check_break(telnet_t *tn, uint64_t now_ms)
+{
+    comport_state_t *cp = &tn->cold->comport;
+
+    if (!cp->break_on) {
+        return;
+    }
+
+    /* The clock starts once BREAK ON is on the wire, not when it was queued */
+    if (cp->break_until == 0) {
+        if (telnet_output_queued(tn, TELNET_OUT_CONTROL) == 0) {
+            cp->break_until = now_ms + cp->break_ms;
+        }
+        return;
+    }
+
+    if (now_ms >= cp->break_until) {
+        cp->break_on = false;
+        if (comport_set_control(tn, COMPORT_CONTROL_BREAK_OFF) != SUCCESS) {
+            MB_LOG_WARNING("Failed to end COM-PORT BREAK");
+        }
+    }
+}
+
+/**
+ * Time comport_check_break() is next due
+ */
+uint64_t comport_break_deadline(const telnet_t *tn, uint64_t now_ms)
+{
+    const comport_state_t *cp = &tn->cold->comport;
+
+    if (!cp->break_on) {
+        return 0;
+    }
+
+    /* Still queued: due as soon as the queue drains (socket writability wakes us) */
+    if (cp->break_until == 0) {
+        return (telnet_output_queued(tn, TELNET_OUT_CONTROL) == 0) ? now_ms : 0;
+    }
+
+    return cp->break_until;
+}
+
+/**
+ * Purge access server buffers
+ */
+int comport_purge(telnet_t *tn, uint8_t which)
+{
+    if (which < COMPORT_PURGE_RX || which > COMPORT_PURGE_BOTH) {
+        return ERROR_INVALID_ARG;
+    }
+
+    return comport_send_byte(tn, COMPORT_PURGE_DATA, which);
+}
+
+/**
+ * Ask the server to stop sending data
+ */
+int comport_flow_suspend(telnet_t *tn)
+{
+    int ret;
+
+    if (tn == NULL || tn->cold->comport.suspended) {
+        return SUCCESS;
+    }
+
+    ret = comport_send(tn, COMPORT_FLOWCONTROL_SUSPEND, NULL, 0);
+    if (ret == SUCCESS) {
+        tn->cold->comport.suspended = true;
+        MB_LOG_DEBUG("COM-PORT flow suspended");
+    }
+
+    return ret;
+}
+
+/**
+ * Ask the server to resume sending data
+ */
+int comport_flow_resume(telnet_t *tn)
+{
+    int ret;
+
+    if (tn == NULL || !tn->cold->comport.suspended) {
+        return SUCCESS;
+    }
+
+    ret = comport_send(tn, COMPORT_FLOWCONTROL_RESUME, NULL, 0);
+    if (ret == SUCCESS) {
+        tn->cold->comport.suspended = false;
+        MB_LOG_DEBUG("COM-PORT flow resumed");
+    }
+
+    return ret;
+}
+
+/**
+ * Parse parity name
+ */
+uint8_t comport_parse_parity(const char *name)
+{
+    if (name == NULL) {
+        return 0;
+    }
+
+    if (strcasecmp(name, "none") == 0 || strcasecmp(name, "n") == 0) {
+        return COMPORT_PARITY_NONE;
+    } else if (strcasecmp(name, "odd") == 0 || strcasecmp(name, "o") == 0) {
+        return COMPORT_PARITY_ODD;
+    } else if (strcasecmp(name, "even") == 0 || strcasecmp(name, "e") == 0) {
+        return COMPORT_PARITY_EVEN;
+    } else if (strcasecmp(name, "mark") == 0 || strcasecmp(name, "m") == 0) {
+        return COMPORT_PARITY_MARK;
+    } else if (strcasecmp(name, "space") == 0 || strcasecmp(name, "s") == 0) {
+        return COMPORT_PARITY_SPACE;
+    }
+
+    return 0;
+}
+
+/**
+ * Parse serial settings string
+ */
+int comport_parse_settings(telnet_t *tn, const char *spec)
+{
+    char buffer[SMALL_BUFFER_SIZE];
+    char *cursor, *field;
+    int index = 0;
+
+    if (tn == NULL || spec == NULL) {
+        return ERROR_INVALID_ARG;
+    }
+
+    SAFE_STRNCPY(buffer, spec, sizeof(buffer));
+    cursor = buffer;
+
+    while ((field = strsep(&cursor, ",")) != NULL) {
+        if (strlen(field) == 0) {
+            index++;
+            continue;
+        }
+
+        switch (index) {
+            case 0: {
+                char *end;
+                unsigned long baud = strtoul(field, &end, 10);
+                if (*end != '\0' || baud == 0 || baud > 0xFFFFFFFFUL) {
+                    return ERROR_INVALID_ARG;
+                }
+                tn->cold->comport.want_baudrate = (uint32_t)baud;
+                break;
+            }
+            case 1: {
+                int bits = atoi(field);
+                if (bits < 5 || bits > 8) {
+                    return ERROR_INVALID_ARG;
+                }
+                tn->cold->comport.want_datasize = (uint8_t)bits;
+                break;
+            }
+            case 2: {
+                uint8_t parity = comport_parse_parity(field);
+                if (parity == 0) {
+                    return ERROR_INVALID_ARG;
+                }
+                tn->cold->comport.want_parity = parity;
+                break;
+            }
+            case 3:
+                if (strcmp(field, "1") == 0) {
+                    tn->cold->comport.want_stopsize = COMPORT_STOPSIZE_1;
+                } else if (strcmp(field, "2") == 0) {
+                    tn->cold->comport.want_stopsize = COMPORT_STOPSIZE_2;
+                } else if (strcmp(field, "1.5") == 0) {
+                    tn->cold->comport.want_stopsize = COMPORT_STOPSIZE_1_5;
+                } else {
+                    return ERROR_INVALID_ARG;
+                }
+                break;
+            default:
+                return ERROR_INVALID_ARG;
+        }
+        index++;
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * Get parity name
+ */
+const char *comport_parity_name(uint8_t parity)
+{
+    switch (parity) {
+        case COMPORT_PARITY_NONE:  return "none";
+        case COMPORT_PARITY_ODD:   return "odd";
+        case COMPORT_PARITY_EVEN:  return "even";
+        case COMPORT_PARITY_MARK:  return "mark";
+        case COMPORT_PARITY_SPACE: return "space";
+        default:                   return "?";
+    }
+}
+
+/**
+ * Get stop size name
+ */
+const char *comport_stopsize_name(uint8_t stopsize)
+{
+    switch (stopsize) {
+        case COMPORT_STOPSIZE_1:   return "1";
+        case COMPORT_STOPSIZE_2:   return "2";
+        case COMPORT_STOPSIZE_1_5: return "1.5";
+        default:                   return "?";
+    }
+}
+
+/**
+ * Get flow control name
+ */
+const char *comport_flow_name(uint8_t flow)
+{
+    switch (flow) {
+        case COMPORT_CONTROL_FLOW_NONE:     return "none";
+        case COMPORT_CONTROL_FLOW_XONXOFF:  return "xon/xoff";
+        case COMPORT_CONTROL_FLOW_HARDWARE: return "rts/cts";
+        default:                            return "?";
+    }
+}
@@ -0,0 +1,1456 @@
+/*
+ * gateway.c - Telnet relay for many concurrent clients (otelnet -G)
+ */
+
+#include "gateway.h"
+#include <ctype.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/uio.h>
+
+/* Set by SIGINT/SIGTERM */
+static volatile sig_atomic_t g_gateway_stop = 0;
+
+/**
+ * Gateway signal handler
+ */
+static void gateway_signal_handler(int signum)
+{
+    (void)signum;
+    g_gateway_stop = 1;
+}
+
+/**
+ * Initialize the gateway
+ */
+int gateway_init(gateway_t *gw)
+{
+    struct rlimit rl;
+
+    memset(gw, 0, sizeof(*gw));
+    gw->spare_fd = -1;
+    pool_init(&gw->pairs, sizeof(gateway_pair_t), 0);
+    pool_init(&gw->viewers, sizeof(gateway_viewer_t), 0);
+
+    gw->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (gw->epoll_fd < 0) {
+        MB_LOG_ERROR("Failed to create epoll instance: %s", strerror(errno));
+        return ERROR_IO;
+    }
+    gw->spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    /* Every pair holds two sockets (six on pass routes): take all we may */
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+        if (rl.rlim_cur < rl.rlim_max) {
+            rl.rlim_cur = rl.rlim_max;
+            if (setrlimit(RLIMIT_NOFILE, &rl) < 0) {
+                getrlimit(RLIMIT_NOFILE, &rl);
+            }
+        }
+        MB_LOG_INFO("Gateway descriptor limit %llu", (unsigned long long)rl.rlim_cur);
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * Parse one route line (tokens already split)
+ */
+static int gateway_parse_route(gateway_route_t *route, char **tok, size_t count)
+{
+    transport_type_t type = transport_parse(tok[1]);
+
+    memset(route, 0, sizeof(*route));
+    route->watch = GATEWAY_WATCH_ROUTE;
+    route->listen_fd = -1;
+    SAFE_STRNCPY(route->listen, tok[0], sizeof(route->listen));
+    SAFE_STRNCPY(route->target, tok[1], sizeof(route->target));
+
+    for (size_t i = 2; i < count; i++) {
+        if (strcmp(tok[i], "pass") == 0) {
+            route->pass = true;
+        } else if (strcmp(tok[i], "ws") == 0) {
+            route->ws = true;
+        } else if (route->port == 0 && isdigit((unsigned char)tok[i][0])) {
+            route->port = atoi(tok[i]);
+        } else {
+            return ERROR_INVALID_ARG;
+        }
+    }
+
+    /* One process per client is what the gateway replaces */
+    if (type == TRANSPORT_SERIAL || type == TRANSPORT_PIPE || (route->pass && route->ws)) {
+        return ERROR_INVALID_ARG;
+    }
+    /* A ws port is a console for any browser that reaches it: loopback
+     * unless an address is given, as with --listen */
+    if (route->ws && strchr(tok[0], ':') == NULL) {
+        snprintf(route->listen, sizeof(route->listen), "127.0.0.1:%s", tok[0]);
+    }
+    if (type == TRANSPORT_TLS && route->port == 0) {
+        route->port = TRANSPORT_TLS_DEFAULT_PORT;
+    }
+    if (transport_uses_port(type) && (route->port < 1 || route->port > 65535)) {
+        return ERROR_INVALID_ARG;
+    }
+
+    /* Resolve now: the event loop must not wait for DNS (a proxy resolves
+     * targets itself; its own host is resolved in gateway_load()).  The
+     * name stays in target for TLS SNI and verification. */
+    if ((type == TRANSPORT_TCP || type == TRANSPORT_TLS) && !transport_proxy_enabled()) {
+        if (transport_resolve(route->target, &route->addr) != SUCCESS) {
+            return ERROR_CONNECTION;
+        }
+        route->resolved = true;
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * Load routes and start listening on their ports
+ */
+int gateway_load(gateway_t *gw, const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    char line[BUFFER_SIZE];
+    size_t cap = gw->route_count;
+    int line_no = 0;
+    int ret = SUCCESS;
+
+    if (fp == NULL) {
+        MB_LOG_ERROR("Cannot open routes file %s: %s", path, strerror(errno));
+        return ERROR_IO;
+    }
+
+    if (transport_proxy_resolve() != SUCCESS) {
+        fprintf(stderr, "Error: cannot resolve the proxy host\n");
+        fclose(fp);
+        return ERROR_CONNECTION;
+    }
+
+    while (ret == SUCCESS && fgets(line, sizeof(line), fp) != NULL) {
+        char *tok[5];
+        char *save = NULL;
+        char *hash = strchr(line, '#');
+        size_t count = 0;
+
+        line_no++;
+        if (hash != NULL) {
+            *hash = '\0';
+        }
+        for (char *t = strtok_r(line, " \t\r\n", &save); t != NULL && count < 5;
+             t = strtok_r(NULL, " \t\r\n", &save)) {
+            tok[count++] = t;
+        }
+        if (count == 0) {
+            continue;
+        }
+
+        if (gw->route_count == cap) {
+            gateway_route_t *routes;
+
+            cap = (cap == 0) ? 64 : cap * 2;
+            routes = realloc(gw->routes, cap * sizeof(*routes));
+            if (routes == NULL) {
+                ret = ERROR_IO;
+                break;
+            }
+            gw->routes = routes;
+        }
+
+        gateway_route_t *route = &gw->routes[gw->route_count];
+        ret = (count < 2 || count > 4) ? ERROR_INVALID_ARG : gateway_parse_route(route, tok, count);
+        if (ret == ERROR_CONNECTION) {
+            fprintf(stderr, "Error: %s:%d: cannot resolve %s\n", path, line_no, tok[1]);
+            break;
+        }
+        if (ret != SUCCESS) {
+            fprintf(stderr, "Error: %s:%d: expected [ADDRESS:]PORT TARGET [PORT] [pass|ws]\n",
+                    path, line_no);
+            ret = ERROR_INVALID_ARG;
+            break;
+        }
+
+        route->listen_fd = transport_listen(route->listen);
+        if (route->listen_fd < 0) {
+            fprintf(stderr, "Error: %s:%d: cannot listen on %s: %s\n", path, line_no, route->listen,
+                    route->listen_fd == ERROR_INVALID_ARG ? "bad address" : strerror(errno));
+            ret = (route->listen_fd == ERROR_INVALID_ARG) ? ERROR_INVALID_ARG : ERROR_IO;
+            break;
+        }
+        gw->route_count++;
+
+        MB_LOG_INFO("Route %s -> %s%s%.0d%s", route->listen, route->target,
+                    route->port > 0 ? ":" : "", route->port,
+                    route->pass ? " (pass)" : route->ws ? " (WebSocket)" : "");
+    }
+
+    fclose(fp);
+
+    /* The array has stopped moving: epoll entries can point into it now */
+    for (size_t i = 0; ret == SUCCESS && i < gw->route_count; i++) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &gw->routes[i] };
+
+        if (epoll_ctl(gw->epoll_fd, EPOLL_CTL_ADD, gw->routes[i].listen_fd, &ev) < 0) {
+            MB_LOG_ERROR("Failed to watch %s: %s", gw->routes[i].listen, strerror(errno));
+            ret = ERROR_IO;
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * Get the other side of a pair
+ */
+static gateway_end_t *gateway_peer(gateway_end_t *end)
+{
+    gateway_pair_t *pair = end->pair;
+
+    return (end == &pair->client) ? &pair->upstream : &pair->client;
+}
+
+/**
+ * Tell the client its upstream could not be reached
+ */
+static void gateway_note(gateway_pair_t *pair)
+{
+    char note[SMALL_BUFFER_SIZE + 64];
+    int len = snprintf(note, sizeof(note), "\r\n[otelnet: cannot reach %s]\r\n",
+                       pair->route->target);
+
+    /* Behind anything queued, so a half-sent command is not cut */
+    if (pair->client.tn.is_connected) {
+        telnet_queue_output(&pair->client.tn, TELNET_OUT_BULK, note, (size_t)len);
+    } else {
+        send(pair->client.tn.fd, note, (size_t)len, MSG_NOSIGNAL | MSG_DONTWAIT);
+    }
+}
+
+/**
+ * Close both sides; the pair is freed after the current batch of events
+ */
+static void gateway_close_pair(gateway_t *gw, gateway_pair_t *pair)
+{
+    gateway_end_t *ends[2] = { &pair->client, &pair->upstream };
+
+    if (pair->dead) {
+        return;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        telnet_free(&ends[i]->tn);
+        transport_close(&ends[i]->tn.transport);
+        for (int j = 0; j < 2; j++) {
+            if (ends[i]->pipe[j] >= 0) {
+                close(ends[i]->pipe[j]);
+            }
+        }
+    }
+
+    pair->route->active--;
+    gw->active--;
+    MB_LOG_INFO("Gateway %s: client left (%zu open)", pair->route->listen, gw->active);
+
+    /* Off the open list, onto the dead one */
+    if (pair->prev != NULL) {
+        pair->prev->next = pair->next;
+    } else {
+        gw->open = pair->next;
+    }
+    if (pair->next != NULL) {
+        pair->next->prev = pair->prev;
+    }
+    pair->dead = true;
+    pair->next = gw->dead;
+    gw->dead = pair;
+}
+
+/**
+ * Free pairs closed during the last batch of events
+ */
+static void gateway_reap(gateway_t *gw)
+{
+    while (gw->dead != NULL) {
+        gateway_pair_t *pair = gw->dead;
+
+        gw->dead = pair->next;
+        pool_free(&gw->pairs, pair);
+    }
+    while (gw->dead_viewers != NULL) {
+        gateway_viewer_t *v = gw->dead_viewers;
+
+        gw->dead_viewers = v->next;
+        pool_free(&gw->viewers, v);
+    }
+    while (gw->dead_webs != NULL) {
+        gateway_web_t *web = gw->dead_webs;
+
+        gw->dead_webs = web->next;
+        free(web);
+    }
+}
+
+/**
+ * Register what a side waits for with epoll
+ */
+static void gateway_watch(gateway_t *gw, gateway_end_t *end, gateway_end_t *peer)
+{
+    gateway_pair_t *pair = end->pair;
+    uint32_t want = 0;
+
+    if (pair->pass) {
+        /* One pipe load at a time per direction */
+        if (!pair->closing && end->piped == 0) {
+            want |= EPOLLIN;
+        }
+        if (peer->piped > 0) {
+            want |= EPOLLOUT;
+        }
+    } else {
+        if (!pair->closing && telnet_output_queued(&peer->tn, TELNET_OUT_CLASSES) < GATEWAY_HIGH_WATER) {
+            want |= EPOLLIN;
+        }
+        if (telnet_output_pending(&end->tn)) {
+            want |= EPOLLOUT;
+        }
+    }
+
+    if (want != end->events) {
+        struct epoll_event ev = { .events = want, .data.ptr = end };
+
+        epoll_ctl(gw->epoll_fd, EPOLL_CTL_MOD, end->tn.fd, &ev);
+        end->events = want;
+    }
+}
+
+/**
+ * Bring both sides' epoll registrations up to date
+ */
+static void gateway_update(gateway_t *gw, gateway_pair_t *pair)
+{
+    gateway_watch(gw, &pair->client, &pair->upstream);
+    gateway_watch(gw, &pair->upstream, &pair->client);
+
+    /* One side left and everything for the other has gone out */
+    if (pair->closing && !(pair->client.events & EPOLLOUT) && !(pair->upstream.events & EPOLLOUT)) {
+        gateway_close_pair(gw, pair);
+    }
+}
+
+/**
+ * Start a pair for an accepted client
+ */
+static void gateway_open_pair(gateway_t *gw, gateway_route_t *route, int fd,
+                              const struct sockaddr_in *addr)
+{
+    gateway_pair_t *pair = pool_alloc(&gw->pairs);
+    gateway_end_t *ends[2];
+    transport_t client_tp;
+    transport_t upstream_tp;
+
+    if (pair == NULL) {
+        MB_LOG_ERROR("Out of memory for gateway client on %s", route->listen);
+        close(fd);
+        return;
+    }
+
+    pair->route = route;
+    ends[0] = &pair->client;
+    ends[1] = &pair->upstream;
+    for (int i = 0; i < 2; i++) {
+        ends[i]->watch = GATEWAY_WATCH_END;
+        ends[i]->pair = pair;
+        ends[i]->pipe[0] = -1;
+        ends[i]->pipe[1] = -1;
+    }
+
+    if (telnet_init(&pair->client.tn) != SUCCESS || telnet_init(&pair->upstream.tn) != SUCCESS) {
+        telnet_free(&pair->client.tn);
+        pool_free(&gw->pairs, pair);
+        close(fd);
+        return;
+    }
+
+    transport_adopt(&client_tp, TRANSPORT_TCP, fd);
+    inet_ntop(AF_INET, &addr->sin_addr, pair->client.tn.cold->host, sizeof(pair->client.tn.cold->host));
+    pair->client.tn.cold->port = ntohs(addr->sin_port);
+    snprintf(pair->upstream.tn.cold->host, sizeof(pair->upstream.tn.cold->host), "%s", route->target);
+    pair->upstream.tn.cold->port = route->port;
+
+    /* The connect itself completes in the event loop */
+    if (transport_open_resolved(&upstream_tp, route->target, route->port,
+                                route->resolved ? &route->addr : NULL) != SUCCESS) {
+        gw->failed++;
+        pair->client.tn.fd = client_tp.fd;      /* Not attached yet: the note goes out raw */
+        gateway_note(pair);
+        telnet_free(&pair->client.tn);
+        telnet_free(&pair->upstream.tn);
+        transport_close(&client_tp);
+        pool_free(&gw->pairs, pair);
+        return;
+    }
+
+    /* Splice only plain sockets both ways (not TLS or a proxy handshake) */
+    if (route->pass && transport_fd_is_stream(&upstream_tp)) {
+        if (pipe2(pair->client.pipe, O_NONBLOCK | O_CLOEXEC) == 0 &&
+            pipe2(pair->upstream.pipe, O_NONBLOCK | O_CLOEXEC) == 0) {
+            pair->pass = true;
+        } else {
+            MB_LOG_WARNING("No pipes for %s (%s), relaying through telnet", route->listen,
+                           strerror(errno));
+        }
+    }
+
+    if (pair->pass) {
+        pair->client.tn.transport = client_tp;
+        pair->client.tn.fd = client_tp.fd;
+        pair->upstream.tn.transport = upstream_tp;
+        pair->upstream.tn.fd = upstream_tp.fd;
+    } else {
+        /* Echo is offered once the upstream echoes (gateway_relay) */
+        telnet_accept(&pair->client.tn, &client_tp, false);
+        telnet_attach(&pair->upstream.tn, &upstream_tp);
+    }
+
+    pair->next = gw->open;
+    if (gw->open != NULL) {
+        gw->open->prev = pair;
+    }
+    gw->open = pair;
+    route->active++;
+    gw->active++;
+    gw->peak = MAX(gw->peak, gw->active);
+    gw->served++;
+
+    for (int i = 0; i < 2; i++) {
+        struct epoll_event ev = { .events = 0, .data.ptr = ends[i] };
+
+        if (epoll_ctl(gw->epoll_fd, EPOLL_CTL_ADD, ends[i]->tn.fd, &ev) < 0) {
+            MB_LOG_ERROR("Failed to watch gateway client: %s", strerror(errno));
+            gateway_close_pair(gw, pair);
+            return;
+        }
+    }
+
+    MB_LOG_INFO("Gateway %s: client %s:%d -> %s%s (%zu open)", route->listen,
+                pair->client.tn.cold->host, pair->client.tn.cold->port, route->target,
+                pair->pass ? " (pass)" : "", gw->active);
+
+    gateway_update(gw, pair);
+}
+
+static void gateway_viewer_update(gateway_t *gw, gateway_viewer_t *v);
+
+/**
+ * Drop a reference to a browser output chunk
+ */
+static void gateway_chunk_put(gateway_t *gw, share_chunk_t *chunk)
+{
+    if (--chunk->refs > 0) {
+        return;
+    }
+
+    if (gw->last == chunk) {
+        gw->last = NULL;
+    }
+    pool_buf_put(chunk, chunk->cap);
+}
+
+/**
+ * Store a frame (header and payload) once for every browser that sends it
+ * @return Chunk holding the frame at *at, or NULL if out of memory
+ */
+static share_chunk_t *gateway_chunk_store(gateway_t *gw, const unsigned char *head, size_t head_len,
+                                          const void *data, size_t len, size_t *at)
+{
+    share_chunk_t *c = gw->last;
+    size_t total = head_len + len;
+
+    if (c == NULL || c->cap - sizeof(*c) - c->len < total) {
+        size_t cap;
+
+        c = pool_buf_get(sizeof(*c) + MAX(total, POOL_BUF_MAX - sizeof(*c)), &cap);
+        if (c == NULL) {
+            return NULL;
+        }
+        c->refs = 0;
+        c->cap = cap;
+        c->len = 0;
+        gw->last = c;
+    }
+
+    *at = c->len;
+    memcpy(c->data + c->len, head, head_len);
+    if (len > 0) {
+        memcpy(c->data + c->len + head_len, data, len);
+    }
+    c->len += total;
+
+    return c;
+}
+
+/**
+ * Queue a span of a chunk for a browser
+ * @return false if the browser has no queue slot left
+ */
+static bool gateway_viewer_queue(gateway_viewer_t *v, share_chunk_t *chunk, size_t at, size_t len)
+{
+    share_entry_t *tail = (v->count > 0) ?
+        &v->queue[(v->head + v->count - 1) % SHARE_QUEUE_SLOTS] : NULL;
+
+    if (tail != NULL && tail->chunk == chunk && tail->end == at) {
+        tail->end = at + len;
+    } else if (v->count < SHARE_QUEUE_SLOTS) {
+        share_entry_t *e = &v->queue[(v->head + v->count) % SHARE_QUEUE_SLOTS];
+
+        e->chunk = chunk;
+        e->start = at;
+        e->end = at + len;
+        chunk->refs++;
+        v->count++;
+    } else {
+        return false;
+    }
+    v->queued += len;
+
+    return true;
+}
+
+/**
+ * Send a browser's queued frames
+ */
+static int gateway_viewer_flush(gateway_t *gw, gateway_viewer_t *v)
+{
+    struct iovec iov[SHARE_QUEUE_SLOTS];
+    size_t n_iov = 0;
+    ssize_t n;
+
+    for (size_t i = 0; i < v->count; i++) {
+        share_entry_t *e = &v->queue[(v->head + i) % SHARE_QUEUE_SLOTS];
+        iov[n_iov].iov_base = e->chunk->data + e->start;
+        iov[n_iov].iov_len = e->end - e->start;
+        n_iov++;
+    }
+    if (n_iov == 0) {
+        return SUCCESS;
+    }
+
+    n = writev(v->fd, iov, (int)n_iov);
+    if (n < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? SUCCESS : ERROR_IO;
+    }
+
+    v->queued -= (size_t)n;
+    while (n > 0) {
+        share_entry_t *e = &v->queue[v->head];
+        size_t span = MIN((size_t)n, e->end - e->start);
+
+        e->start += span;
+        n -= (ssize_t)span;
+        if (e->start == e->end) {
+            gateway_chunk_put(gw, e->chunk);
+            v->head = (v->head + 1) % SHARE_QUEUE_SLOTS;
+            v->count--;
+        }
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * Send a frame to one browser (handshake reply, pong, close)
+ */
+static int gateway_viewer_send(gateway_t *gw, gateway_viewer_t *v, const unsigned char *head,
+                               size_t head_len, const void *data, size_t len)
+{
+    size_t at;
+    share_chunk_t *chunk = gateway_chunk_store(gw, head, head_len, data, len, &at);
+
+    if (chunk == NULL) {
+        return ERROR_IO;
+    }
+    if (!gateway_viewer_queue(v, chunk, at, head_len + len)) {
+        if (chunk->refs == 0) {
+            chunk->refs = 1;
+            gateway_chunk_put(gw, chunk);
+        }
+        return ERROR_IO;
+    }
+
+    return gateway_viewer_flush(gw, v);
+}
+
+/**
+ * Queue a close frame; the browser is closed once it has gone out
+ */
+static void gateway_viewer_bye(gateway_t *gw, gateway_viewer_t *v, unsigned int status)
+{
+    unsigned char frame[WS_HEADER_MAX + 2];
+
+    if (!v->closing) {
+        v->closing = true;
+        gateway_viewer_send(gw, v, frame, ws_close_frame(frame, status), NULL, 0);
+    }
+}
+
+/**
+ * Add a browser to a list
+ */
+static void gateway_viewer_link(gateway_viewer_t **list, gateway_viewer_t *v)
+{
+    v->prev = NULL;
+    v->next = *list;
+    if (*list != NULL) {
+        (*list)->prev = v;
+    }
+    *list = v;
+}
+
+/**
+ * Take a browser off a list
+ */
+static void gateway_viewer_unlink(gateway_viewer_t **list, gateway_viewer_t *v)
+{
+    if (v->prev != NULL) {
+        v->prev->next = v->next;
+    } else {
+        *list = v->next;
+    }
+    if (v->next != NULL) {
+        v->next->prev = v->prev;
+    }
+}
+
+/**
+ * Hang up a ws route's upstream and send its browsers away
+ * They are told when the upstream was never reached; the session is freed
+ * after the current batch of events.
+ */
+static void gateway_web_close(gateway_t *gw, gateway_web_t *web, unsigned int status)
+{
+    if (web->dead) {
+        return;
+    }
+
+    while (web->viewers != NULL) {
+        gateway_viewer_t *v = web->viewers;
+
+        gateway_viewer_unlink(&web->viewers, v);
+        gateway_viewer_link(&gw->pending, v);
+        v->web = NULL;
+        web->route->active--;
+
+        if (!web->upstream_up) {
+            char note[SMALL_BUFFER_SIZE + 64];
+            unsigned char head[WS_HEADER_MAX];
+            int len = snprintf(note, sizeof(note), "\r\n[otelnet: cannot reach %s]\r\n",
+                               web->route->target);
+
+            gateway_viewer_send(gw, v, head, ws_frame_header(head, WS_OP_BINARY, (size_t)len),
+                                note, (size_t)len);
+        }
+        gateway_viewer_bye(gw, v, status);
+        gateway_viewer_update(gw, v);
+    }
+
+    if (!web->upstream_up) {
+        gw->failed++;
+    }
+    telnet_free(&web->tn);
+    transport_close(&web->tn.transport);
+
+    MB_LOG_INFO("Gateway %s: session with %s ended", web->route->listen, web->route->target);
+
+    web->route->web = NULL;
+    web->dead = true;
+    web->next = gw->dead_webs;
+    gw->dead_webs = web;
+}
+
+/**
+ * Close a browser; it is freed after the current batch of events
+ * The last browser to leave a session hangs up its upstream.
+ */
+static void gateway_viewer_close(gateway_t *gw, gateway_viewer_t *v)
+{
+    gateway_web_t *web = v->web;
+
+    if (v->dead) {
+        return;
+    }
+
+    while (v->count > 0) {
+        gateway_chunk_put(gw, v->queue[v->head].chunk);
+        v->head = (v->head + 1) % SHARE_QUEUE_SLOTS;
+        v->count--;
+    }
+    v->queued = 0;
+    iobuf_free(&v->request);
+    close(v->fd);
+
+    if (web != NULL) {
+        gateway_viewer_unlink(&web->viewers, v);
+        web->viewer_count--;
+        web->route->active--;
+        MB_LOG_INFO("Gateway %s: browser left (%zu watching)", web->route->listen,
+                    web->viewer_count);
+        if (web->viewer_count == 0) {
+            gateway_web_close(gw, web, WS_CLOSE_GOING_AWAY);
+        }
+    } else {
+        gateway_viewer_unlink(&gw->pending, v);
+    }
+
+    v->dead = true;
+    v->next = gw->dead_viewers;
+    gw->dead_viewers = v;
+}
+
+/**
+ * Register what a browser waits for with epoll
+ */
+static void gateway_viewer_update(gateway_t *gw, gateway_viewer_t *v)
+{
+    uint32_t want = 0;
+
+    if (v->dead) {
+        return;
+    }
+
+    /* Sent everything it was owed after the close frame */
+    if (v->closing && v->count == 0) {
+        gateway_viewer_close(gw, v);
+        return;
+    }
+
+    if (!v->closing && (!v->joined ||
+        telnet_output_queued(&v->web->tn, TELNET_OUT_CLASSES) < GATEWAY_HIGH_WATER)) {
+        want |= EPOLLIN;
+    }
+    if (v->count > 0) {
+        want |= EPOLLOUT;
+    }
+
+    if (want != v->events) {
+        struct epoll_event ev = { .events = want, .data.ptr = v };
+
+        epoll_ctl(gw->epoll_fd, EPOLL_CTL_MOD, v->fd, &ev);
+        v->events = want;
+    }
+}
+
+/**
+ * Register what a ws route's upstream waits for with epoll
+ * It is read while some browser can take more output.
+ */
+static void gateway_web_update(gateway_t *gw, gateway_web_t *web)
+{
+    uint32_t want = 0;
+
+    if (web->dead) {
+        return;
+    }
+
+    for (gateway_viewer_t *v = web->viewers; v != NULL; v = v->next) {
+        if (!v->closing && v->queued < GATEWAY_HIGH_WATER) {
+            want |= EPOLLIN;
+            break;
+        }
+    }
+    if (telnet_output_pending(&web->tn)) {
+        want |= EPOLLOUT;
+    }
+
+    if (want != web->events) {
+        struct epoll_event ev = { .events = want, .data.ptr = web };
+
+        epoll_ctl(gw->epoll_fd, EPOLL_CTL_MOD, web->tn.fd, &ev);
+        web->events = want;
+    }
+}
+
+/**
+ * Connect a ws route's upstream for its first browser
+ */
+static gateway_web_t *gateway_web_open(gateway_t *gw, gateway_route_t *route)
+{
+    gateway_web_t *web = calloc(1, sizeof(*web));
+    struct epoll_event ev = { .events = 0, .data.ptr = web };
+    transport_t tp;
+
+    if (web == NULL) {
+        return NULL;
+    }
+    web->watch = GATEWAY_WATCH_WEB;
+    web->route = route;
+
+    if (telnet_init(&web->tn) != SUCCESS) {
+        free(web);
+        return NULL;
+    }
+    snprintf(web->tn.cold->host, sizeof(web->tn.cold->host), "%s", route->target);
+    web->tn.cold->port = route->port;
+
+    /* The connect itself completes in the event loop */
+    if (transport_open_resolved(&tp, route->target, route->port,
+                                route->resolved ? &route->addr : NULL) != SUCCESS) {
+        telnet_free(&web->tn);
+        free(web);
+        return NULL;
+    }
+    telnet_attach(&web->tn, &tp);
+
+    if (epoll_ctl(gw->epoll_fd, EPOLL_CTL_ADD, web->tn.fd, &ev) < 0) {
+        MB_LOG_ERROR("Failed to watch upstream: %s", strerror(errno));
+        telnet_free(&web->tn);
+        transport_close(&web->tn.transport);
+        free(web);
+        return NULL;
+    }
+
+    route->web = web;
+    MB_LOG_INFO("Gateway %s: session with %s for browsers", route->listen, route->target);
+
+    return web;
+}
+
+/**
+ * Answer a browser's opening handshake and add it to the route's session
+ * @return SUCCESS (also while the request is incomplete), ERROR_CONNECTION
+ *         if the request was refused
+ */
+static int gateway_viewer_handshake(gateway_t *gw, gateway_viewer_t *v, const unsigned char *in,
+                                    size_t len)
+{
+    char request[WS_REQUEST_MAX + 1];
+    char response[SMALL_BUFFER_SIZE * 2];
+    size_t response_len;
+    size_t request_len;
+    char *end;
+    int status;
+
+    if (iobuf_append(&v->request, in, len) != SUCCESS) {
+        MB_LOG_WARNING("Gateway %s: browser request too large", v->route->listen);
+        return ERROR_CONNECTION;
+    }
+
+    request_len = iobuf_len(&v->request);
+    memcpy(request, iobuf_data(&v->request), request_len);
+    request[request_len] = '\0';
+    end = strstr(request, "\r\n\r\n");
+    if (end == NULL) {
+        return SUCCESS;
+    }
+    end[2] = '\0';
+    iobuf_free(&v->request);
+
+    status = ws_handshake(request, gw->ws_origin, response, sizeof(response), &response_len);
+    if (status != 101) {
+        MB_LOG_WARNING("Gateway %s: browser refused (HTTP %d)", v->route->listen, status);
+        send(v->fd, response, response_len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        return ERROR_CONNECTION;
+    }
+
+    if (gateway_viewer_send(gw, v, (const unsigned char *)response, response_len, NULL, 0) != SUCCESS) {
+        return ERROR_IO;
+    }
+    v->joined = true;
+    ws_parser_init(&v->parser);
+
+    if (v->route->web == NULL && gateway_web_open(gw, v->route) == NULL) {
+        char note[SMALL_BUFFER_SIZE + 64];
+        unsigned char head[WS_HEADER_MAX];
+        int note_len = snprintf(note, sizeof(note), "\r\n[otelnet: cannot reach %s]\r\n",
+                                v->route->target);
+
+        gw->failed++;
+        gateway_viewer_send(gw, v, head, ws_frame_header(head, WS_OP_BINARY, (size_t)note_len),
+                            note, (size_t)note_len);
+        gateway_viewer_bye(gw, v, WS_CLOSE_ERROR);
+        return SUCCESS;
+    }
+
+    gateway_viewer_unlink(&gw->pending, v);
+    v->web = v->route->web;
+    gateway_viewer_link(&v->web->viewers, v);
+    v->web->viewer_count++;
+    v->route->active++;
+    gw->browsers++;
+
+    MB_LOG_INFO("Gateway %s: browser joined (%zu watching)", v->route->listen,
+                v->web->viewer_count);
+
+    return SUCCESS;
+}
+
+/**
+ * Pass frame payload from a browser to the upstream
+ */
+static int gateway_web_input(gateway_t *gw, gateway_web_t *web, const unsigned char *data,
+                             size_t len)
+{
+    static unsigned char out[2 * IO_BUFFER_SIZE];
+
+    while (len > 0) {
+        size_t piece = MIN(len, IO_BUFFER_SIZE);
+        size_t out_len;
+
+        telnet_prepare_output(&web->tn, data, piece, out, sizeof(out), &out_len);
+        if (telnet_queue_output(&web->tn, TELNET_OUT_INTERACTIVE, out, out_len) < 0) {
+            return ERROR_IO;
+        }
+        gw->bytes_up += piece;
+        data += piece;
+        len -= piece;
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * Read from a browser: handshake, then frames
+ * @return SUCCESS, ERROR_CONNECTION when the browser left, ERROR_IO on failure
+ */
+static int gateway_viewer_read(gateway_t *gw, gateway_viewer_t *v)
+{
+    static unsigned char in[IO_BUFFER_SIZE];
+    ssize_t n = recv(v->fd, in, sizeof(in), MSG_DONTWAIT);
+    size_t used = 0;
+
+    if (n == 0) {
+        return ERROR_CONNECTION;
+    }
+    if (n < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? SUCCESS : ERROR_IO;
+    }
+
+    if (!v->joined) {
+        return gateway_viewer_handshake(gw, v, in, (size_t)n);
+    }
+
+    while (used < (size_t)n && !v->closing) {
+        ws_msg_t msg;
+        ssize_t step = ws_parse(&v->parser, in + used, (size_t)n - used, &msg);
+        unsigned char head[WS_HEADER_MAX];
+
+        if (step < 0) {
+            MB_LOG_WARNING("Gateway %s: bad frame from browser", v->route->listen);
+            gateway_viewer_bye(gw, v, WS_CLOSE_PROTOCOL);
+            break;
+        }
+        used += (size_t)step;
+
+        if (msg.type == WS_MSG_DATA && v->web != NULL) {
+            if (gateway_web_input(gw, v->web, msg.data, msg.len) != SUCCESS) {
+                gateway_web_close(gw, v->web, WS_CLOSE_ERROR);
+            }
+        } else if (msg.type == WS_MSG_CONTROL && msg.opcode == WS_OP_PING) {
+            gateway_viewer_send(gw, v, head, ws_frame_header(head, WS_OP_PONG, msg.len),
+                                msg.data, msg.len);
+        } else if (msg.type == WS_MSG_CONTROL && msg.opcode == WS_OP_CLOSE) {
+            /* Answer with the same status */
+            gateway_viewer_bye(gw, v, (msg.len >= 2) ?
+                               (unsigned int)(msg.data[0] << 8 | msg.data[1]) : WS_CLOSE_NORMAL);
+        }
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * Send decoded upstream output to every browser of the session
+ */
+static void gateway_web_output(gateway_t *gw, gateway_web_t *web, const unsigned char *data,
+                               size_t len)
+{
+    unsigned char head[WS_HEADER_MAX];
+    size_t head_len = ws_frame_header(head, WS_OP_BINARY, len);
+    gateway_viewer_t *next;
+    share_chunk_t *chunk;
+    size_t at;
+
+    chunk = gateway_chunk_store(gw, head, head_len, data, len, &at);
+    if (chunk == NULL) {
+        MB_LOG_ERROR("Out of memory for browser output on %s", web->route->listen);
+        return;
+    }
+
+    /* Held while queuing: a browser dropped on the way may have been the only one */
+    chunk->refs++;
+    for (gateway_viewer_t *v = web->viewers; v != NULL; v = next) {
+        next = v->next;
+        if (v->closing) {
+            continue;
+        }
+
+        if (v->queued + head_len + len > GATEWAY_WS_QUEUE ||
+            !gateway_viewer_queue(v, chunk, at, head_len + len)) {
+            MB_LOG_WARNING("Gateway %s: browser too slow (%zu bytes queued), disconnecting",
+                           web->route->listen, v->queued);
+            gw->browsers_dropped++;
+            gateway_viewer_close(gw, v);
+            continue;
+        }
+        if (v->count == 1 && gateway_viewer_flush(gw, v) != SUCCESS) {
+            gateway_viewer_close(gw, v);
+            continue;
+        }
+        gateway_viewer_update(gw, v);
+    }
+    gateway_chunk_put(gw, chunk);
+}
+
+/**
+ * Read the upstream of a ws route
+ * @return SUCCESS, ERROR_CONNECTION at end of stream, ERROR_IO on failure
+ */
+static int gateway_web_read(gateway_t *gw, gateway_web_t *web)
+{
+    static unsigned char in[IO_BUFFER_SIZE];
+    static unsigned char data[IO_BUFFER_SIZE + 1];
+    size_t data_len;
+    ssize_t n;
+
+    n = telnet_recv(&web->tn, in, sizeof(in));
+    if (n < 0) {
+        return ERROR_IO;
+    }
+    if (n == 0) {
+        return web->tn.is_connected ? SUCCESS : ERROR_CONNECTION;
+    }
+    web->upstream_up = true;
+
+    telnet_process_input(&web->tn, in, (size_t)n, data, sizeof(data), &data_len);
+    gw->bytes_down += data_len;
+    if (data_len > 0) {
+        gateway_web_output(gw, web, data, data_len);
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * Handle epoll events on a ws route's upstream
+ */
+static void gateway_web_event(gateway_t *gw, gateway_web_t *web, uint32_t events)
+{
+    int ret = SUCCESS;
+
+    if (events & EPOLLOUT) {
+        ssize_t sent = telnet_flush_output(&web->tn);
+
+        if (sent < 0) {
+            ret = ERROR_IO;
+        } else if (sent > 0) {
+            web->upstream_up = true;
+        }
+    }
+
+    if (ret == SUCCESS && (events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+        if (web->events & EPOLLIN) {
+            ret = gateway_web_read(gw, web);
+        } else if (events & (EPOLLHUP | EPOLLERR)) {
+            ret = ERROR_IO;
+        }
+    }
+
+    if (ret != SUCCESS) {
+        gateway_web_close(gw, web, (ret == ERROR_CONNECTION) ? WS_CLOSE_NORMAL : WS_CLOSE_ERROR);
+        return;
+    }
+
+    /* Input sent upstream: browsers held back may be read again */
+    if (events & EPOLLOUT) {
+        gateway_viewer_t *next;
+
+        for (gateway_viewer_t *v = web->viewers; v != NULL && !web->dead; v = next) {
+            next = v->next;
+            gateway_viewer_update(gw, v);
+        }
+    }
+    gateway_web_update(gw, web);
+}
+
+/**
+ * Handle epoll events on a browser
+ */
+static void gateway_viewer_event(gateway_t *gw, gateway_viewer_t *v, uint32_t events)
+{
+    gateway_web_t *web = v->web;
+    int ret = SUCCESS;
+
+    if (events & EPOLLOUT) {
+        ret = gateway_viewer_flush(gw, v);
+    }
+
+    if (ret == SUCCESS && (events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+        if (v->events & EPOLLIN) {
+            ret = gateway_viewer_read(gw, v);
+        } else if (events & (EPOLLHUP | EPOLLERR)) {
+            ret = ERROR_IO;
+        }
+    }
+
+    if (ret != SUCCESS) {
+        gateway_viewer_close(gw, v);
+    } else {
+        gateway_viewer_update(gw, v);
+    }
+
+    /* Output drained or input queued: the upstream may need other events */
+    if (web == NULL) {
+        web = v->web;
+    }
+    if (web != NULL) {
+        gateway_web_update(gw, web);
+    }
+}
+
+/**
+ * Start serving a browser on a ws route (handshake first)
+ */
+static void gateway_open_viewer(gateway_t *gw, gateway_route_t *route, int fd)
+{
+    gateway_viewer_t *v = pool_alloc(&gw->viewers);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = v };
+
+    if (v == NULL) {
+        MB_LOG_ERROR("Out of memory for browser on %s", route->listen);
+        close(fd);
+        return;
+    }
+
+    v->watch = GATEWAY_WATCH_VIEWER;
+    v->route = route;
+    v->fd = fd;
+    v->events = EPOLLIN;
+    iobuf_init(&v->request, WS_REQUEST_MAX);
+    gateway_viewer_link(&gw->pending, v);
+
+    if (epoll_ctl(gw->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        MB_LOG_ERROR("Failed to watch browser: %s", strerror(errno));
+        gateway_viewer_close(gw, v);
+    }
+}
+
+/**
+ * Out of descriptors: take one client off the queue and close it, rather
+ * than spin on a listening socket that stays readable
+ */
+static void gateway_refuse(gateway_t *gw, gateway_route_t *route)
+{
+    int fd;
+
+    if (gw->spare_fd < 0) {
+        return;
+    }
+
+    close(gw->spare_fd);
+    fd = accept4(route->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd >= 0) {
+        close(fd);
+    }
+    gw->spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    MB_LOG_WARNING("Out of file descriptors (%zu pairs open), refused a client on %s",
+                   gw->active, route->listen);
+}
+
+/**
+ * Accept clients on a route's port
+ */
+static void gateway_accept(gateway_t *gw, gateway_route_t *route)
+{
+    for (int i = 0; i < GATEWAY_ACCEPT_BURST; i++) {
+        struct sockaddr_in addr;
+        socklen_t addr_len = sizeof(addr);
+        int fd = accept4(route->listen_fd, (struct sockaddr *)&addr, &addr_len,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (fd < 0) {
+            if (errno == EMFILE || errno == ENFILE) {
+                gateway_refuse(gw, route);
+            }
+            return;
+        }
+
+        if (route->ws) {
+            gateway_open_viewer(gw, route, fd);
+        } else {
+            gateway_open_pair(gw, route, fd, &addr);
+        }
+    }
+}
+
+/**
+ * Send queued output of a telnet side
+ */
+static int gateway_flush(gateway_end_t *end)
+{
+    ssize_t sent = telnet_flush_output(&end->tn);
+
+    if (sent < 0) {
+        return ERROR_IO;
+    }
+    if (sent > 0 && end == &end->pair->upstream) {
+        end->pair->upstream_up = true;
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * Relay one read from a telnet side to the other
+ * @return SUCCESS, ERROR_CONNECTION at end of stream, ERROR_IO on failure
+ */
+static int gateway_relay(gateway_t *gw, gateway_end_t *from, gateway_end_t *to)
+{
+    static unsigned char in[IO_BUFFER_SIZE];
+    static unsigned char data[IO_BUFFER_SIZE + 1];
+    static unsigned char out[2 * (IO_BUFFER_SIZE + 1)];
+    gateway_pair_t *pair = from->pair;
+    bool upstream = (from == &pair->upstream);
+    const unsigned char *payload = out;
+    size_t data_len;
+    size_t len;
+    ssize_t n;
+
+    n = telnet_recv(&from->tn, in, sizeof(in));
+    if (n < 0) {
+        return ERROR_IO;
+    }
+    if (n == 0) {
+        return from->tn.is_connected ? SUCCESS : ERROR_CONNECTION;
+    }
+    if (upstream) {
+        pair->upstream_up = true;
+    }
+
+    if (from->tn.state == TELNET_STATE_DATA && from->tn.binary_remote && to->tn.binary_local &&
+        !from->tn.synch && memchr(in, TELNET_IAC, (size_t)n) == NULL) {
+        /* Binary both ways and no command: the bytes are already what the other side expects */
+        payload = in;
+        data_len = len = (size_t)n;
+    } else {
+        telnet_process_input(&from->tn, in, (size_t)n, data, sizeof(data), &data_len);
+        telnet_prepare_output(&to->tn, data, data_len, out, sizeof(out), &len);
+    }
+
+    if (len > 0 && telnet_queue_output(&to->tn, upstream ? TELNET_OUT_BULK : TELNET_OUT_INTERACTIVE,
+                                       payload, len) < 0) {
+        return ERROR_IO;
+    }
+    if (upstream) {
+        gw->bytes_down += data_len;
+    } else {
+        gw->bytes_up += data_len;
+    }
+
+    /* Echo follows the upstream, window size follows the client */
+    if (upstream && pair->client.tn.echo_offer != from->tn.echo_remote) {
+        telnet_set_echo(&pair->client.tn, from->tn.echo_remote);
+    } else if (!upstream && from->tn.window_changed) {
+        from->tn.window_changed = false;
+        to->tn.cold->term_width = from->tn.cold->term_width;
+        to->tn.cold->term_height = from->tn.cold->term_height;
+        if (telnet_opt_isset(&to->tn.local_options, TELOPT_NAWS)) {
+            telnet_send_naws(&to->tn, to->tn.cold->term_width, to->tn.cold->term_height);
+        }
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * Move piped bytes on to the other side (pass routes)
+ */
+static int gateway_splice_out(gateway_t *gw, gateway_end_t *from, gateway_end_t *to)
+{
+    while (from->piped > 0) {
+        ssize_t n = splice(from->pipe[0], NULL, to->tn.fd, NULL, from->piped,
+                           SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+        if (n < 0) {
+            return (errno == EAGAIN || errno == EINTR) ? SUCCESS : ERROR_IO;
+        }
+        if (n == 0) {
+            break;
+        }
+        from->piped -= (size_t)n;
+        gw->bytes_spliced += (uint64_t)n;
+        if (to == &to->pair->upstream) {
+            to->pair->upstream_up = true;
+        }
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * Pull bytes from one side into its pipe and on to the other (pass routes)
+ * @return SUCCESS, ERROR_CONNECTION at end of stream, ERROR_IO on failure
+ */
+static int gateway_splice_in(gateway_t *gw, gateway_end_t *from, gateway_end_t *to)
+{
+    ssize_t n = splice(from->tn.fd, NULL, from->pipe[1], NULL, GATEWAY_SPLICE_MAX,
+                       SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+    if (n == 0) {
+        return ERROR_CONNECTION;
+    }
+    if (n < 0) {
+        return (errno == EAGAIN || errno == EINTR) ? SUCCESS : ERROR_IO;
+    }
+
+    from->piped += (size_t)n;
+    if (from == &from->pair->upstream) {
+        from->pair->upstream_up = true;
+    }
+
+    return gateway_splice_out(gw, from, to);
+}
+
+/**
+ * Handle epoll events on one side of a pair
+ */
+static void gateway_end_event(gateway_t *gw, gateway_end_t *end, uint32_t events)
+{
+    gateway_pair_t *pair = end->pair;
+    gateway_end_t *peer = gateway_peer(end);
+    int ret = SUCCESS;
+
+    /* Closed earlier in this batch */
+    if (pair->dead) {
+        return;
+    }
+
+    if (events & EPOLLOUT) {
+        ret = pair->pass ? gateway_splice_out(gw, peer, end) : gateway_flush(end);
+    }
+
+    if (ret == SUCCESS && (events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+        if (end->events & EPOLLIN) {
+            ret = pair->pass ? gateway_splice_in(gw, end, peer) : gateway_relay(gw, end, peer);
+        } else if (events & (EPOLLHUP | EPOLLERR)) {
+            /* Not reading (draining or held back) and the socket is gone */
+            ret = ERROR_IO;
+        }
+    }
+
+    if (ret == ERROR_CONNECTION) {
+        /* Orderly close: deliver what is queued for the other side first */
+        pair->closing = true;
+    } else if (ret != SUCCESS) {
+        if (!pair->upstream_up) {
+            gw->failed++;
+            gateway_note(pair);
+        }
+        gateway_close_pair(gw, pair);
+        return;
+    }
+
+    gateway_update(gw, pair);
+}
+
+/**
+ * Relay clients until SIGINT or SIGTERM
+ */
+int gateway_run(gateway_t *gw)
+{
+    struct epoll_event events[GATEWAY_MAX_EVENTS];
+    struct sigaction sa;
+    int ret = SUCCESS;
+
+    /* No SA_RESTART: a signal ends epoll_wait() */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = gateway_signal_handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    MB_LOG_INFO("Gateway running with %zu routes", gw->route_count);
+
+    while (!g_gateway_stop) {
+        int n = epoll_wait(gw->epoll_fd, events, GATEWAY_MAX_EVENTS, -1);
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            MB_LOG_ERROR("epoll_wait failed: %s", strerror(errno));
+            ret = ERROR_IO;
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            gateway_watch_t *watch = events[i].data.ptr;
+
+            switch (*watch) {
+                case GATEWAY_WATCH_ROUTE:
+                    gateway_accept(gw, (gateway_route_t *)watch);
+                    break;
+                case GATEWAY_WATCH_END:
+                    gateway_end_event(gw, (gateway_end_t *)watch, events[i].events);
+                    break;
+                case GATEWAY_WATCH_WEB:
+                    if (!((gateway_web_t *)watch)->dead) {
+                        gateway_web_event(gw, (gateway_web_t *)watch, events[i].events);
+                    }
+                    break;
+                case GATEWAY_WATCH_VIEWER:
+                    if (!((gateway_viewer_t *)watch)->dead) {
+                        gateway_viewer_event(gw, (gateway_viewer_t *)watch, events[i].events);
+                    }
+                    break;
+            }
+        }
+
+        gateway_reap(gw);
+    }
+
+    MB_LOG_INFO("Gateway stopped: %llu clients served, %zu at most at once",
+                gw->served, gw->peak);
+
+    return ret;
+}
+
+/**
+ * Close every pair and listening socket
+ */
+void gateway_close(gateway_t *gw)
+{
+    while (gw->open != NULL) {
+        gateway_close_pair(gw, gw->open);
+    }
+    for (size_t i = 0; i < gw->route_count; i++) {
+        if (gw->routes[i].web != NULL) {
+            gateway_web_close(gw, gw->routes[i].web, WS_CLOSE_GOING_AWAY);
+        }
+    }
+    while (gw->pending != NULL) {
+        gateway_viewer_close(gw, gw->pending);
+    }
+    gateway_reap(gw);
+    pool_destroy(&gw->pairs);
+    pool_destroy(&gw->viewers);
+
+    for (size_t i = 0; i < gw->route_count; i++) {
+        close(gw->routes[i].listen_fd);
+    }
+    free(gw->routes);
+    gw->routes = NULL;
+    gw->route_count = 0;
+
+    if (gw->spare_fd >= 0) {
+        close(gw->spare_fd);
+        gw->spare_fd = -1;
+    }
+    if (gw->epoll_fd >= 0) {
+        close(gw->epoll_fd);
+        gw->epoll_fd = -1;
+    }
+}
@@ -0,0 +1,162 @@
+/*
+ * iobuf.c - Growable byte queue for pending I/O
+ */
+
+#include "iobuf.h"
+#include "pool.h"
+#include "telnet.h"
+
+/**
+ * Initialize byte queue
+ */
+void iobuf_init(iobuf_t *buf, size_t limit)
+{
+    if (buf == NULL) {
+        return;
+    }
+
+    memset(buf, 0, sizeof(*buf));
+    buf->limit = limit;
+}
+
+/**
+ * Release byte queue storage
+ */
+void iobuf_free(iobuf_t *buf)
+{
+    if (buf == NULL) {
+        return;
+    }
+
+    pool_buf_put(buf->data, buf->cap);
+    buf->data = NULL;
+    buf->head = 0;
+    buf->len = 0;
+    buf->cap = 0;
+}
+
+/**
+ * Append bytes to queue
+ */
+int iobuf_append(iobuf_t *buf, const void *data, size_t len)
+{
+    if (buf == NULL || (data == NULL && len > 0)) {
+        return ERROR_INVALID_ARG;
+    }
+
+    if (len == 0) {
+        return SUCCESS;
+    }
+
+    if (buf->len + len > buf->limit) {
+        return ERROR_GENERAL;
+    }
+
+    /* Compact pending bytes to the front before growing */
+    if (buf->head + buf->len + len > buf->cap && buf->head > 0) {
+        memmove(buf->data, buf->data + buf->head, buf->len);
+        buf->head = 0;
+    }
+
+    if (buf->len + len > buf->cap) {
+        size_t new_cap = buf->cap > 0 ? buf->cap : IO_BUFFER_SIZE;
+        while (new_cap < buf->len + len) {
+            new_cap *= 2;
+        }
+        unsigned char *new_data = pool_buf_get(new_cap, &new_cap);
+        if (new_data == NULL) {
+            MB_LOG_ERROR("Failed to grow I/O buffer to %zu bytes", new_cap);
+            return ERROR_GENERAL;
+        }
+        if (buf->len > 0) {
+            memcpy(new_data, buf->data, buf->len);
+        }
+        pool_buf_put(buf->data, buf->cap);
+        buf->data = new_data;
+        buf->cap = new_cap;
+    }
+
+    memcpy(buf->data + buf->head + buf->len, data, len);
+    buf->len += len;
+
+    return SUCCESS;
+}
+
+/**
+ * Get pointer to first pending byte
+ */
+const unsigned char *iobuf_data(const iobuf_t *buf)
+{
+    if (buf == NULL || buf->data == NULL) {
+        return NULL;
+    }
+
+    return buf->data + buf->head;
+}
+
+/**
+ * Get number of pending bytes
+ */
+size_t iobuf_len(const iobuf_t *buf)
+{
+    return (buf != NULL) ? buf->len : 0;
+}
+
+/**
+ * Remove bytes from front of queue
+ */
+void iobuf_consume(iobuf_t *buf, size_t len)
+{
+    if (buf == NULL) {
+        return;
+    }
+
+    if (len >= buf->len) {
+        /* Drained: hand the storage back so idle queues hold no memory */
+        pool_buf_put(buf->data, buf->cap);
+        buf->data = NULL;
+        buf->head = 0;
+        buf->len = 0;
+        buf->cap = 0;
+        return;
+    }
+
+    buf->head += len;
+    buf->len -= len;
+}
+
+/**
+ * Discard all pending bytes
+ */
+void iobuf_clear(iobuf_t *buf)
+{
+    iobuf_consume(buf, (buf != NULL) ? buf->len : 0);
+}
+
+/**
+ * Write pending bytes to a non-blocking file descriptor
+ */
+ssize_t iobuf_write_fd(iobuf_t *buf, int fd)
+{
+    ssize_t written;
+
+    if (buf == NULL || fd < 0) {
+        return ERROR_INVALID_ARG;
+    }
+
+    if (buf->len == 0) {
+        return 0;
+    }
+
+    written = write(fd, buf->data + buf->head, buf->len);
+    if (written < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return 0;
+        }
+        return ERROR_IO;
+    }
+
+    iobuf_consume(buf, (size_t)written);
+
+    return written;
+}
@@ -0,0 +1,257 @@
+/*
+ * login.c - Login script replayed after each connect
+ */
+
+#include "login.h"
+#include "telnet.h"
+#include <ctype.h>
+
+/**
+ * Unescape script text (optionally double-quoted) into a step
+ */
+static int login_parse_text(login_step_t *step, const char *text)
+{
+    size_t len = strlen(text);
+
+    if (len >= 2 && text[0] == '"' && text[len - 1] == '"') {
+        text++;
+        len -= 2;
+    }
+
+    step->len = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = text[i];
+
+        if (c == '\\' && i + 1 < len) {
+            switch (text[++i]) {
+                case 'r':
+                    c = '\r';
+                    break;
+                case 'n':
+                    c = '\n';
+                    break;
+                case 't':
+                    c = '\t';
+                    break;
+                case 'e':
+                    c = 0x1B;
+                    break;
+                default:
+                    c = text[i];
+                    break;
+            }
+        }
+
+        if (step->len >= sizeof(step->text)) {
+            return ERROR_INVALID_ARG;
+        }
+        step->text[step->len++] = c;
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * Load a login script
+ */
+int login_script_load(login_script_t *ls, const char *path)
+{
+    FILE *fp;
+    char line[LINE_BUFFER_SIZE];
+    uint32_t timeout_ms = LOGIN_DEFAULT_TIMEOUT_MS;
+    int line_no = 0;
+    int ret = SUCCESS;
+
+    if (ls == NULL || path == NULL) {
+        return ERROR_INVALID_ARG;
+    }
+
+    login_script_free(ls);
+
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        MB_LOG_WARNING("Could not open login script %s: %s", path, strerror(errno));
+        return ERROR_IO;
+    }
+
+    while (ret == SUCCESS && fgets(line, sizeof(line), fp) != NULL) {
+        char *directive = line;
+        char *arg;
+        login_step_t step;
+
+        line_no++;
+        line[strcspn(line, "\r\n")] = '\0';
+        while (isspace((unsigned char)*directive)) {
+            directive++;
+        }
+        if (*directive == '\0' || *directive == '#') {
+            continue;
+        }
+
+        /* Directive word, then its argument */
+        arg = directive + strcspn(directive, " \t");
+        if (*arg != '\0') {
+            *arg++ = '\0';
+            while (*arg == ' ' || *arg == '\t') {
+                arg++;
+            }
+        }
+
+        memset(&step, 0, sizeof(step));
+        if (strcmp(directive, "timeout") == 0) {
+            timeout_ms = (uint32_t)atoi(arg) * 1000;
+            continue;
+        } else if (strcmp(directive, "expect") == 0) {
+            step.expect = true;
+            step.timeout_ms = timeout_ms;
+        } else if (strcmp(directive, "send") != 0) {
+            MB_LOG_ERROR("%s:%d: unknown directive '%s'", path, line_no, directive);
+            ret = ERROR_INVALID_ARG;
+            continue;
+        }
+
+        if (login_parse_text(&step, arg) != SUCCESS || (step.expect && step.len == 0)) {
+            MB_LOG_ERROR("%s:%d: bad %s text", path, line_no, directive);
+            ret = ERROR_INVALID_ARG;
+            continue;
+        }
+
+        login_step_t *steps = realloc(ls->steps, (ls->count + 1) * sizeof(*steps));
+        if (steps == NULL) {
+            MB_LOG_ERROR("Failed to allocate login script");
+            ret = ERROR_GENERAL;
+            continue;
+        }
+        ls->steps = steps;
+        ls->steps[ls->count++] = step;
+    }
+
+    fclose(fp);
+
+    /* A script that stops halfway would leave the session half logged in */
+    if (ret != SUCCESS) {
+        login_script_free(ls);
+        return ret;
+    }
+
+    MB_LOG_INFO("Login script %s: %zu steps", path, ls->count);
+
+    return SUCCESS;
+}
+
+/**
+ * Release a login script
+ */
+void login_script_free(login_script_t *ls)
+{
+    if (ls == NULL) {
+        return;
+    }
+
+    free(ls->steps);
+    memset(ls, 0, sizeof(*ls));
+}
+
+/**
+ * Run the script from the top
+ */
+void login_script_start(login_script_t *ls)
+{
+    if (ls == NULL || ls->count == 0) {
+        return;
+    }
+
+    ls->next = 0;
+    ls->seen = 0;
+    ls->deadline_ms = 0;
+    ls->active = true;
+}
+
+/**
+ * Stop the script
+ */
+void login_script_stop(login_script_t *ls)
+{
+    if (ls == NULL) {
+        return;
+    }
+
+    ls->active = false;
+}
+
+/**
+ * Get the next send step that is due
+ */
+const login_step_t *login_script_next(login_script_t *ls, uint64_t now_ms)
+{
+    const login_step_t *step;
+
+    if (ls == NULL || !ls->active) {
+        return NULL;
+    }
+
+    if (ls->next >= ls->count) {
+        ls->active = false;
+        MB_LOG_INFO("Login script finished");
+        return NULL;
+    }
+
+    step = &ls->steps[ls->next];
+    if (!step->expect) {
+        ls->next++;
+        return step;
+    }
+
+    if (ls->deadline_ms == 0) {
+        ls->deadline_ms = now_ms + step->timeout_ms;
+    }
+
+    return NULL;
+}
+
+/**
+ * Match newly received text against the current expect step
+ */
+bool login_script_feed(login_script_t *ls, const ring_t *ring, size_t len)
+{
+    const login_step_t *step;
+    size_t span;
+
+    if (ls == NULL || !ls->active || ls->next >= ls->count || len == 0) {
+        return false;
+    }
+
+    step = &ls->steps[ls->next];
+    if (!step->expect) {
+        return false;
+    }
+
+    /* New text, plus enough received earlier in this step for a split match */
+    span = MIN(len + MIN(ls->seen, step->len - 1), ring_history(ring));
+    ls->seen += len;
+    if (span < step->len || memmem(ring_tail(ring, span), span, step->text, step->len) == NULL) {
+        return false;
+    }
+
+    MB_LOG_DEBUG("Login script step %zu matched", ls->next);
+    ls->next++;
+    ls->seen = 0;
+    ls->deadline_ms = 0;
+
+    return true;
+}
+
+/**
+ * Check whether the current expect step has timed out
+ */
+bool login_script_expired(login_script_t *ls, uint64_t now_ms)
+{
+    if (ls == NULL || !ls->active || ls->deadline_ms == 0 || now_ms < ls->deadline_ms) {
+        return false;
+    }
+
+    MB_LOG_WARNING("Login script timed out waiting for step %zu", ls->next + 1);
+    ls->active = false;
+
+    return true;
+}
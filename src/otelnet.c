@@ -10,7 +10,10 @@
 #include <sys/ioctl.h>
 #include <sys/select.h>
 #include <sys/wait.h>
+#include <sys/eventfd.h>
+#include <poll.h>
 #include <ctype.h>
+#include <stdarg.h>
 
 /* Global signal handler flags */
 static volatile sig_atomic_t g_running_local = 1;
@@ -50,50 +53,16 @@ static char *otelnet_trim_whitespace(char *str)
     return str;
 }
 
-/* UTF-8 helper functions (from bridge.c) - may be used for future enhancements */
-
-/**
- * Check if byte is start of multibyte UTF-8 sequence
- */
-__attribute__((unused))
-static bool is_utf8_start(unsigned char byte)
-{
-    /* UTF-8 start bytes: 11xxxxxx */
-    return (byte & 0xC0) == 0xC0 && (byte & 0xFE) != 0xFE;
-}
-
 /**
- * Check if byte is UTF-8 continuation byte
+ * Get monotonic time in milliseconds
  */
-__attribute__((unused))
-static bool is_utf8_continuation(unsigned char byte)
+static uint64_t otelnet_now_ms(void)
 {
-    /* UTF-8 continuation bytes: 10xxxxxx */
-    return (byte & 0xC0) == 0x80;
-}
+    struct timespec ts;
 
-/**
- * Get expected length of UTF-8 sequence from first byte
- */
-__attribute__((unused))
-static int utf8_sequence_length(unsigned char byte)
-{
-    if ((byte & 0x80) == 0x00) {
-        /* 0xxxxxxx - 1 byte (ASCII) */
-        return 1;
-    } else if ((byte & 0xE0) == 0xC0) {
-        /* 110xxxxx - 2 bytes */
-        return 2;
-    } else if ((byte & 0xF0) == 0xE0) {
-        /* 1110xxxx - 3 bytes */
-        return 3;
-    } else if ((byte & 0xF8) == 0xF0) {
-        /* 11110xxx - 4 bytes */
-        return 4;
-    }
+    clock_gettime(CLOCK_MONOTONIC, &ts);
 
-    /* Invalid */
-    return 0;
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
 }
 
 /**
@@ -111,15 +80,17 @@ static void signal_handler(int signum)
 /**
  * Initialize otelnet context
  */
-void otelnet_init(otelnet_ctx_t *ctx)
+int otelnet_init(otelnet_ctx_t *ctx)
 {
     if (ctx == NULL) {
-        return;
+        return ERROR_INVALID_ARG;
     }
 
     memset(ctx, 0, sizeof(otelnet_ctx_t));
 
-    telnet_init(&ctx->telnet);
+    if (telnet_init(&ctx->telnet) != SUCCESS) {
+        return ERROR_GENERAL;
+    }
 
     ctx->mode = OTELNET_MODE_CLIENT;
     ctx->running = true;
@@ -130,6 +101,26 @@ void otelnet_init(otelnet_ctx_t *ctx)
     ctx->bytes_received = 0;
     ctx->connection_start_time = 0;
     ctx->log_fp = NULL;
+
+    charset_conv_init(&ctx->charset_conv, CHARSET_UTF8);
+    utf8_stream_init(&ctx->utf8_stream, false);
+    iobuf_init(&ctx->term_out, OTELNET_TERM_QUEUE_LIMIT);
+    ctx->term_throttled = false;
+    ctx->term_paused = false;
+    iobuf_init(&ctx->paced_out, TELNET_OUTQ_LIMIT);
+    ctx->awaiting_prompt = false;
+    ctx->pace_sent_ms = 0;
+    ctx->pipeline_fd = -1;
+    ctx->session_fd = -1;
+    ctx->attach_fd = -1;
+    ctx->attach_pending_fd = -1;
+    ctx->attach_deadline_ms = 0;
+    share_init(&ctx->share);
+
+    /* Reconnect jitter differs between clients started together */
+    srandom((unsigned int)time(NULL) ^ (unsigned int)getpid());
+
+    return SUCCESS;
 }
 
 /**
@@ -152,6 +143,34 @@ int otelnet_load_config(otelnet_ctx_t *ctx, const char *config_file)
     SAFE_STRNCPY(ctx->config.receive_zmodem_path, "rz", sizeof(ctx->config.receive_zmodem_path));
     ctx->config.log_enabled = false;
     SAFE_STRNCPY(ctx->config.log_file, "otelnet.log", sizeof(ctx->config.log_file));
+    ctx->config.charset[0] = '\0';
+    ctx->config.utf8_replace_invalid = false;
+    ctx->config.comport_enabled = false;
+    ctx->config.comport_settings[0] = '\0';
+    ctx->config.comport_flow[0] = '\0';
+    ctx->config.remote_xonxoff = false;
+    ctx->config.prompt_pacing = true;
+    ctx->config.pipeline = false;
+    ctx->config.tls_verify = true;
+    ctx->config.tls_ca_file[0] = '\0';
+    ctx->config.proxy[0] = '\0';
+    ctx->config.reconnect = false;
+    ctx->config.reconnect_min_ms = OTELNET_RECONNECT_MIN_MS;
+    ctx->config.reconnect_max_ms = OTELNET_RECONNECT_MAX_MS;
+    ctx->config.reconnect_attempts = 0;
+    ctx->config.login_script[0] = '\0';
+    ctx->config.keepalive_idle = 0;
+    ctx->config.keepalive_interval = 0;
+    ctx->config.keepalive_count = 0;
+    ctx->config.user_timeout_ms = 0;
+    ctx->config.probe = OTELNET_PROBE_OFF;
+    ctx->config.probe_interval = OTELNET_PROBE_INTERVAL;
+    ctx->config.probe_timeout = OTELNET_PROBE_TIMEOUT;
+    ctx->config.spectate[0] = '\0';
+    ctx->config.spectate_queue = SHARE_QUEUE_DEFAULT;
+    ctx->config.spectate_disconnect = false;
+    ctx->config.listen_program[0] = '\0';
+    ctx->config.websocket_origin[0] = '\0';
 
     fp = fopen(config_file, "r");
     if (fp == NULL) {
@@ -193,6 +212,94 @@ int otelnet_load_config(otelnet_ctx_t *ctx, const char *config_file)
                                           strcasecmp(v, "yes") == 0);
             } else if (strcmp(k, "LOG_FILE") == 0) {
                 SAFE_STRNCPY(ctx->config.log_file, v, sizeof(ctx->config.log_file));
+            } else if (strcmp(k, "CHARSET") == 0) {
+                SAFE_STRNCPY(ctx->config.charset, v, sizeof(ctx->config.charset));
+            } else if (strcmp(k, "UTF8_REPLACE_INVALID") == 0) {
+                ctx->config.utf8_replace_invalid = (strcmp(v, "1") == 0 ||
+                                                    strcasecmp(v, "true") == 0 ||
+                                                    strcasecmp(v, "yes") == 0);
+            } else if (strcmp(k, "COMPORT") == 0) {
+                ctx->config.comport_enabled = (strcmp(v, "1") == 0 ||
+                                               strcasecmp(v, "true") == 0 ||
+                                               strcasecmp(v, "yes") == 0);
+            } else if (strcmp(k, "COMPORT_SETTINGS") == 0) {
+                SAFE_STRNCPY(ctx->config.comport_settings, v, sizeof(ctx->config.comport_settings));
+            } else if (strcmp(k, "COMPORT_FLOW") == 0) {
+                SAFE_STRNCPY(ctx->config.comport_flow, v, sizeof(ctx->config.comport_flow));
+            } else if (strcmp(k, "PROMPT_PACING") == 0) {
+                ctx->config.prompt_pacing = (strcmp(v, "1") == 0 ||
+                                             strcasecmp(v, "true") == 0 ||
+                                             strcasecmp(v, "yes") == 0);
+            } else if (strcmp(k, "PIPELINE") == 0) {
+                ctx->config.pipeline = (strcmp(v, "1") == 0 ||
+                                        strcasecmp(v, "true") == 0 ||
+                                        strcasecmp(v, "yes") == 0);
+            } else if (strcmp(k, "TLS_VERIFY") == 0) {
+                ctx->config.tls_verify = (strcmp(v, "1") == 0 ||
+                                          strcasecmp(v, "true") == 0 ||
+                                          strcasecmp(v, "yes") == 0);
+            } else if (strcmp(k, "TLS_CA_FILE") == 0) {
+                SAFE_STRNCPY(ctx->config.tls_ca_file, v, sizeof(ctx->config.tls_ca_file));
+            } else if (strcmp(k, "PROXY") == 0) {
+                SAFE_STRNCPY(ctx->config.proxy, v, sizeof(ctx->config.proxy));
+            } else if (strcmp(k, "RECONNECT") == 0) {
+                ctx->config.reconnect = (strcmp(v, "1") == 0 ||
+                                         strcasecmp(v, "true") == 0 ||
+                                         strcasecmp(v, "yes") == 0);
+            } else if (strcmp(k, "RECONNECT_DELAY_MIN") == 0) {
+                if (atoi(v) > 0) {
+                    ctx->config.reconnect_min_ms = (unsigned int)atoi(v);
+                }
+            } else if (strcmp(k, "RECONNECT_DELAY_MAX") == 0) {
+                if (atoi(v) > 0) {
+                    ctx->config.reconnect_max_ms = (unsigned int)atoi(v);
+                }
+            } else if (strcmp(k, "RECONNECT_ATTEMPTS") == 0) {
+                ctx->config.reconnect_attempts = (unsigned int)MAX(atoi(v), 0);
+            } else if (strcmp(k, "KEEPALIVE") == 0) {
+                /* idle,interval,count in seconds; 0 = off */
+                int idle = 0, interval = 0, count = 0;
+                if (sscanf(v, "%d,%d,%d", &idle, &interval, &count) >= 1) {
+                    ctx->config.keepalive_idle = MAX(idle, 0);
+                    ctx->config.keepalive_interval = interval > 0 ? interval : MAX(idle / 3, 1);
+                    ctx->config.keepalive_count = count > 0 ? count : 3;
+                }
+            } else if (strcmp(k, "TCP_USER_TIMEOUT") == 0) {
+                ctx->config.user_timeout_ms = (unsigned int)MAX(atoi(v), 0);
+            } else if (strcmp(k, "PROBE") == 0) {
+                if (strcasecmp(v, "nop") == 0) {
+                    ctx->config.probe = OTELNET_PROBE_NOP;
+                } else if (strcasecmp(v, "tm") == 0 || strcasecmp(v, "timing-mark") == 0) {
+                    ctx->config.probe = OTELNET_PROBE_TIMING_MARK;
+                } else {
+                    ctx->config.probe = OTELNET_PROBE_OFF;
+                }
+            } else if (strcmp(k, "PROBE_INTERVAL") == 0) {
+                if (atoi(v) > 0) {
+                    ctx->config.probe_interval = (unsigned int)atoi(v);
+                }
+            } else if (strcmp(k, "PROBE_TIMEOUT") == 0) {
+                if (atoi(v) > 0) {
+                    ctx->config.probe_timeout = (unsigned int)atoi(v);
+                }
+            } else if (strcmp(k, "SPECTATE") == 0) {
+                SAFE_STRNCPY(ctx->config.spectate, v, sizeof(ctx->config.spectate));
+            } else if (strcmp(k, "SPECTATE_QUEUE") == 0) {
+                if (atoi(v) > 0) {
+                    ctx->config.spectate_queue = (unsigned int)atoi(v);
+                }
+            } else if (strcmp(k, "SPECTATE_SLOW") == 0) {
+                ctx->config.spectate_disconnect = (strcasecmp(v, "disconnect") == 0);
+            } else if (strcmp(k, "LISTEN_PROGRAM") == 0) {
+                SAFE_STRNCPY(ctx->config.listen_program, v, sizeof(ctx->config.listen_program));
+            } else if (strcmp(k, "WEBSOCKET_ORIGIN") == 0) {
+                SAFE_STRNCPY(ctx->config.websocket_origin, v, sizeof(ctx->config.websocket_origin));
+            } else if (strcmp(k, "LOGIN_SCRIPT") == 0) {
+                SAFE_STRNCPY(ctx->config.login_script, v, sizeof(ctx->config.login_script));
+            } else if (strcmp(k, "REMOTE_XONXOFF") == 0) {
+                ctx->config.remote_xonxoff = (strcmp(v, "1") == 0 ||
+                                              strcasecmp(v, "true") == 0 ||
+                                              strcasecmp(v, "yes") == 0);
             }
         }
     }
@@ -208,6 +315,98 @@ int otelnet_load_config(otelnet_ctx_t *ctx, const char *config_file)
         MB_LOG_INFO("  LOG_FILE: %s", ctx->config.log_file);
     }
 
+    ctx->telnet.remote_xonxoff = ctx->config.remote_xonxoff;
+    MB_LOG_INFO("  REMOTE_XONXOFF: %s", ctx->config.remote_xonxoff ? "yes" : "no");
+    MB_LOG_INFO("  PROMPT_PACING: %s", ctx->config.prompt_pacing ? "yes" : "no");
+    MB_LOG_INFO("  PIPELINE: %s", ctx->config.pipeline ? "yes" : "no");
+
+    transport_tls_configure(ctx->config.tls_verify, ctx->config.tls_ca_file);
+    MB_LOG_INFO("  TLS_VERIFY: %s", ctx->config.tls_verify ? "yes" : "no");
+    if (ctx->config.tls_ca_file[0] != '\0') {
+        MB_LOG_INFO("  TLS_CA_FILE: %s", ctx->config.tls_ca_file);
+    }
+
+    if (ctx->config.proxy[0] != '\0') {
+        /* The URL may carry credentials: log only that a proxy is set */
+        MB_LOG_INFO("  PROXY: %.*s", (int)strcspn(ctx->config.proxy, ":"), ctx->config.proxy);
+        if (transport_proxy_configure(ctx->config.proxy) != SUCCESS) {
+            printf("Warning: Invalid PROXY setting, connecting directly\r\n");
+        }
+    }
+
+    ctx->config.reconnect_max_ms = MAX(ctx->config.reconnect_max_ms, ctx->config.reconnect_min_ms);
+    MB_LOG_INFO("  RECONNECT: %s", ctx->config.reconnect ? "yes" : "no");
+    if (ctx->config.reconnect) {
+        MB_LOG_INFO("  RECONNECT_DELAY: %u-%u ms, %u attempts", ctx->config.reconnect_min_ms,
+                    ctx->config.reconnect_max_ms, ctx->config.reconnect_attempts);
+    }
+
+    transport_keepalive_configure(ctx->config.keepalive_idle, ctx->config.keepalive_interval,
+                                  ctx->config.keepalive_count, ctx->config.user_timeout_ms);
+    if (ctx->config.keepalive_idle > 0) {
+        MB_LOG_INFO("  KEEPALIVE: %d s idle, every %d s, %d probes", ctx->config.keepalive_idle,
+                    ctx->config.keepalive_interval, ctx->config.keepalive_count);
+    }
+    if (ctx->config.user_timeout_ms > 0) {
+        MB_LOG_INFO("  TCP_USER_TIMEOUT: %u ms", ctx->config.user_timeout_ms);
+    }
+    if (ctx->config.probe != OTELNET_PROBE_OFF) {
+        MB_LOG_INFO("  PROBE: %s after %u s idle (timeout %u s)",
+                    ctx->config.probe == OTELNET_PROBE_NOP ? "NOP" : "TIMING-MARK",
+                    ctx->config.probe_interval, ctx->config.probe_timeout);
+    }
+
+    if (ctx->config.spectate[0] != '\0') {
+        MB_LOG_INFO("  SPECTATE: %s (queue %u bytes, slow spectators %s)", ctx->config.spectate,
+                    ctx->config.spectate_queue, ctx->config.spectate_disconnect ? "disconnected" : "skip");
+    }
+    MB_LOG_INFO("  LISTEN_PROGRAM: %s", ctx->config.listen_program);
+    if (ctx->config.websocket_origin[0] != '\0') {
+        MB_LOG_INFO("  WEBSOCKET_ORIGIN: %s", ctx->config.websocket_origin);
+    }
+
+    if (ctx->config.login_script[0] != '\0') {
+        MB_LOG_INFO("  LOGIN_SCRIPT: %s", ctx->config.login_script);
+        if (login_script_load(&ctx->login, ctx->config.login_script) != SUCCESS) {
+            printf("Warning: Could not load login script '%s'\r\n", ctx->config.login_script);
+        }
+    }
+
+    ctx->utf8_stream.replace_invalid = ctx->config.utf8_replace_invalid;
+    MB_LOG_INFO("  UTF8_REPLACE_INVALID: %s", ctx->config.utf8_replace_invalid ? "yes" : "no");
+
+    if (ctx->config.charset[0] != '\0') {
+        MB_LOG_INFO("  CHARSET: %s", ctx->config.charset);
+        if (telnet_set_charset(&ctx->telnet, ctx->config.charset) != SUCCESS) {
+            printf("Warning: Unsupported charset '%s', using UTF-8\r\n", ctx->config.charset);
+        }
+    }
+
+    if (ctx->config.comport_enabled) {
+        ctx->telnet.cold->comport.offer = true;
+        MB_LOG_INFO("  COMPORT: enabled");
+
+        if (ctx->config.comport_settings[0] != '\0') {
+            MB_LOG_INFO("  COMPORT_SETTINGS: %s", ctx->config.comport_settings);
+            if (comport_parse_settings(&ctx->telnet, ctx->config.comport_settings) != SUCCESS) {
+                printf("Warning: Invalid COMPORT_SETTINGS '%s'\r\n", ctx->config.comport_settings);
+            }
+        }
+
+        if (ctx->config.comport_flow[0] != '\0') {
+            MB_LOG_INFO("  COMPORT_FLOW: %s", ctx->config.comport_flow);
+            if (strcasecmp(ctx->config.comport_flow, "none") == 0) {
+                ctx->telnet.cold->comport.want_flow = COMPORT_CONTROL_FLOW_NONE;
+            } else if (strcasecmp(ctx->config.comport_flow, "xon") == 0) {
+                ctx->telnet.cold->comport.want_flow = COMPORT_CONTROL_FLOW_XONXOFF;
+            } else if (strcasecmp(ctx->config.comport_flow, "rts") == 0) {
+                ctx->telnet.cold->comport.want_flow = COMPORT_CONTROL_FLOW_HARDWARE;
+            } else {
+                printf("Warning: Invalid COMPORT_FLOW '%s'\r\n", ctx->config.comport_flow);
+            }
+        }
+    }
+
     return SUCCESS;
 }
 
@@ -287,6 +486,23 @@ void otelnet_restore_terminal(otelnet_ctx_t *ctx)
     MB_LOG_DEBUG("Terminal restored");
 }
 
+/**
+ * Print a status line on the terminal, after whatever the render thread
+ * (PIPELINE=1) still has to write, so the two never interleave
+ */
+static void __attribute__((format(printf, 2, 3)))
+otelnet_status(otelnet_ctx_t *ctx, const char *fmt, ...)
+{
+    va_list ap;
+
+    pipeline_stage_drain(&ctx->render);
+
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+    fflush(stdout);
+}
+
 /**
  * Connect to telnet server
  */
@@ -298,26 +514,72 @@ int otelnet_connect(otelnet_ctx_t *ctx, const char *host, int port)
         return ERROR_INVALID_ARG;
     }
 
-    MB_LOG_INFO("Connecting to %s:%d...", host, port);
-    printf("Connecting to %s:%d...\r\n", host, port);
+    /* host:port for TCP and TLS, the target itself for other transports */
+    char where[BUFFER_SIZE];
+    if (transport_uses_port(transport_parse(host))) {
+        snprintf(where, sizeof(where), "%s:%d", host, port);
+    } else {
+        SAFE_STRNCPY(where, host, sizeof(where));
+    }
+
+    MB_LOG_INFO("Connecting to %s...", where);
+    otelnet_status(ctx, "Connecting to %s...\r\n", where);
+
+    /* Kept for reconnecting (RECONNECT=1) */
+    ctx->host = host;
+    ctx->port = port;
 
-    ret = telnet_connect(&ctx->telnet, host, port);
+    /* After the first connection: start over with cached negotiation */
+    if (ctx->connection_start_time == 0) {
+        ret = telnet_connect(&ctx->telnet, host, port);
+    } else {
+        ret = telnet_reconnect(&ctx->telnet, host, port);
+    }
     if (ret != SUCCESS) {
-        MB_LOG_ERROR("Failed to connect to %s:%d", host, port);
-        printf("Connection failed: %s\r\n", strerror(errno));
+        MB_LOG_ERROR("Failed to connect to %s", where);
+        otelnet_status(ctx, "Connection failed: %s\r\n", strerror(errno));
         return ret;
     }
 
+    login_script_start(&ctx->login);
+    ctx->last_rx_ms = otelnet_now_ms();
+    ctx->last_probe_ms = 0;
+
+    /* Reconnected: the receive ring and its history carry over */
+    if (ctx->connection_start_time != 0) {
+        otelnet_status(ctx, "Connected to %s\r\n", where);
+        return SUCCESS;
+    }
+
+    /* Never read more per call than the kernel can have queued, nor more
+     * than the terminal queue can absorb above its high watermark once
+     * translated (charset growth, then LF -> CRLF) */
+    int rcvbuf = 0;
+    socklen_t optlen = sizeof(rcvbuf);
+    ctx->rx_max = MIN(OTELNET_RECV_MAX, (OTELNET_TERM_QUEUE_LIMIT - OTELNET_TERM_HIGH_WATER) /
+                                        (UTF8_STREAM_MAX_GROWTH * 2));
+    if (getsockopt(telnet_get_fd(&ctx->telnet), SOL_SOCKET, SO_RCVBUF, &rcvbuf, &optlen) == 0 &&
+        rcvbuf > 0 && (size_t)rcvbuf < ctx->rx_max) {
+        ctx->rx_max = MAX((size_t)rcvbuf, IO_BUFFER_SIZE);
+    }
+    ctx->rx_size = IO_BUFFER_SIZE;
+
+    /* Receive ring: room for a full read plus as much decoded history */
+    if (ring_init(&ctx->rx_ring, ctx->rx_max * 2 + 1) != SUCCESS) {
+        telnet_disconnect(&ctx->telnet);
+        return ERROR_GENERAL;
+    }
+
     ctx->connection_start_time = time(NULL);
-    printf("Connected to %s:%d\r\n", host, port);
-    printf("Press Ctrl+] for console mode\r\n");
+    otelnet_status(ctx, "Connected to %s\r\n", where);
+    otelnet_status(ctx, "Press Ctrl+] for console mode\r\n");
 
     /* Get initial window size and store it */
     struct winsize ws;
     if (ioctl(STDIN_FILENO, TIOCGWINSZ, &ws) == 0) {
-        ctx->telnet.term_width = ws.ws_col;
-        ctx->telnet.term_height = ws.ws_row;
-        MB_LOG_DEBUG("Initial window size: %dx%d", ctx->telnet.term_width, ctx->telnet.term_height);
+        ctx->telnet.cold->term_width = ws.ws_col;
+        ctx->telnet.cold->term_height = ws.ws_row;
+        MB_LOG_DEBUG("Initial window size: %dx%d", ctx->telnet.cold->term_width, ctx->telnet.cold->term_height);
     }
 
     return SUCCESS;
@@ -335,8 +597,10 @@ void otelnet_disconnect(otelnet_ctx_t *ctx)
     if (telnet_is_connected(&ctx->telnet)) {
         MB_LOG_INFO("Disconnecting from telnet server");
         telnet_disconnect(&ctx->telnet);
-        printf("\r\nConnection closed\r\n");
+        otelnet_status(ctx, "\r\nConnection closed\r\n");
     }
+
+    ring_free(&ctx->rx_ring);
 }
 
 /**
@@ -356,17 +620,17 @@ static int otelnet_update_window_size(otelnet_ctx_t *ctx)
         int new_height = ws.ws_row;
 
         /* Check if size actually changed */
-        if (new_width != ctx->telnet.term_width || new_height != ctx->telnet.term_height) {
+        if (new_width != ctx->telnet.cold->term_width || new_height != ctx->telnet.cold->term_height) {
             MB_LOG_INFO("Window size changed: %dx%d -> %dx%d",
-                       ctx->telnet.term_width, ctx->telnet.term_height,
+                       ctx->telnet.cold->term_width, ctx->telnet.cold->term_height,
                        new_width, new_height);
 
             /* Update stored size */
-            ctx->telnet.term_width = new_width;
-            ctx->telnet.term_height = new_height;
+            ctx->telnet.cold->term_width = new_width;
+            ctx->telnet.cold->term_height = new_height;
 
             /* Send NAWS if negotiated */
-            if (ctx->telnet.local_options[TELOPT_NAWS] && telnet_is_connected(&ctx->telnet)) {
+            if (telnet_opt_isset(&ctx->telnet.local_options, TELOPT_NAWS) && telnet_is_connected(&ctx->telnet)) {
                 telnet_send_naws(&ctx->telnet, new_width, new_height);
             }
         }
@@ -382,6 +646,334 @@ static int otelnet_update_window_size(otelnet_ctx_t *ctx)
     }
 }
 
+/**
+ * Keep transcoder in sync with the configured or negotiated remote charset
+ */
+static void otelnet_sync_charset(otelnet_ctx_t *ctx)
+{
+    if (ctx->charset_conv.charset == ctx->telnet.charset) {
+        return;
+    }
+
+    if (charset_conv_init(&ctx->charset_conv, ctx->telnet.charset) != SUCCESS) {
+        /* Tables unavailable - stay on UTF-8 rather than retrying every chunk */
+        ctx->telnet.charset = CHARSET_UTF8;
+    }
+
+    /* Drop any partial UTF-8 sequence from the previous charset */
+    utf8_stream_init(&ctx->utf8_stream, ctx->config.utf8_replace_invalid);
+}
+
+/**
+ * Throttle the server when terminal output backs up
+ * Above the high watermark the socket is no longer read (TCP backpressure)
+ * and a COM-PORT access server is asked to suspend the device.
+ */
+static void otelnet_term_update_throttle(otelnet_ctx_t *ctx)
+{
+    size_t pending = iobuf_len(&ctx->term_out);
+
+    /* Pipelined: the slower of the render and log stages */
+    pending = MAX(pending, pipeline_stage_pending(&ctx->render));
+    pending = MAX(pending, pipeline_stage_pending(&ctx->log));
+
+    if (!ctx->term_throttled && pending >= OTELNET_TERM_HIGH_WATER) {
+        ctx->term_throttled = true;
+        MB_LOG_DEBUG("Terminal output backlog %zu bytes, throttling server", pending);
+        if (ctx->telnet.cold->comport.enabled) {
+            comport_flow_suspend(&ctx->telnet);
+        }
+    } else if (ctx->term_throttled && pending <= OTELNET_TERM_LOW_WATER) {
+        ctx->term_throttled = false;
+        MB_LOG_DEBUG("Terminal output drained, resuming server");
+        if (ctx->telnet.cold->comport.enabled) {
+            comport_flow_resume(&ctx->telnet);
+        }
+    }
+}
+
+/**
+ * Write to terminal, queueing whatever stdout cannot take right now
+ */
+static int otelnet_term_write(otelnet_ctx_t *ctx, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    ssize_t written = 0;
+
+    if (len == 0) {
+        return SUCCESS;
+    }
+
+    /* Pipelined: the render thread writes, in order */
+    if (ctx->render.running) {
+        int ret = pipeline_stage_push(&ctx->render, 0, data, len);
+        otelnet_term_update_throttle(ctx);
+        return ret;
+    }
+
+    /* Preserve ordering: only write directly when nothing is queued
+     * and output has not been stopped with XOFF */
+    if (iobuf_len(&ctx->term_out) == 0 && !ctx->term_paused) {
+        written = write(STDOUT_FILENO, p, len);
+        if (written < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                MB_LOG_ERROR("Failed to write to stdout: %s", strerror(errno));
+                return ERROR_IO;
+            }
+            written = 0;
+        }
+    }
+
+    if ((size_t)written < len) {
+        if (iobuf_append(&ctx->term_out, p + written, len - written) != SUCCESS) {
+            MB_LOG_ERROR("Terminal output queue full, dropping %zu bytes", len - written);
+            return ERROR_IO;
+        }
+        otelnet_term_update_throttle(ctx);
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * Flush queued terminal output
+ */
+static int otelnet_term_flush(otelnet_ctx_t *ctx)
+{
+    if (ctx->term_paused) {
+        return SUCCESS;
+    }
+
+    if (iobuf_write_fd(&ctx->term_out, STDOUT_FILENO) < 0) {
+        MB_LOG_ERROR("Failed to write to stdout: %s", strerror(errno));
+        return ERROR_IO;
+    }
+
+    otelnet_term_update_throttle(ctx);
+
+    return SUCCESS;
+}
+
+/**
+ * Translate line mode text for display (LF and lone CR become CRLF)
+ * Translates at most IO_BUFFER_SIZE + 1 input bytes, never splitting a
+ * CR from its LF; out must hold (IO_BUFFER_SIZE + 1) * 2 bytes.
+ * @return Number of input bytes consumed
+ */
+static size_t otelnet_translate_crlf(const unsigned char *data, size_t data_len,
+                                     unsigned char *out, size_t *out_len)
+{
+    size_t translated_len = 0;
+    size_t piece = MIN(data_len, IO_BUFFER_SIZE);
+
+    /* Keep CR LF together */
+    if (piece < data_len && data[piece - 1] == '\r') {
+        piece++;
+    }
+
+    for (size_t i = 0; i < piece; i++) {
+        if (data[i] == '\n') {
+            /* LF -> CRLF */
+            out[translated_len++] = '\r';
+            out[translated_len++] = '\n';
+        } else if (data[i] == '\r') {
+            /* Standalone CR: check if next byte is not LF */
+            if (i + 1 < piece && data[i + 1] == '\n') {
+                /* CR LF sequence - keep as is */
+                out[translated_len++] = '\r';
+            } else {
+                /* Standalone CR - convert to CRLF for proper line break */
+                out[translated_len++] = '\r';
+                out[translated_len++] = '\n';
+            }
+        } else {
+            out[translated_len++] = data[i];
+        }
+    }
+
+    *out_len = translated_len;
+
+    return piece;
+}
+
+/**
+ * Check whether input lines are paced by server prompt marks
+ * Only in line mode, and only once the server marks prompts (EOR or GA)
+ */
+static bool otelnet_pacing_active(otelnet_ctx_t *ctx)
+{
+    return ctx->config.prompt_pacing && ctx->telnet.prompt_marks &&
+           telnet_is_linemode(&ctx->telnet);
+}
+
+/**
+ * Get length of the first line in data, including its CR LF / CR NUL end
+ * @return Line length, or 0 if data holds no complete line
+ */
+static size_t otelnet_line_length(const unsigned char *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] == '\n') {
+            return i + 1;
+        }
+        if (data[i] == '\r') {
+            if (i + 1 < len && (data[i + 1] == '\n' || data[i + 1] == '\0')) {
+                return i + 2;
+            }
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Send data to the server now, returning the number of bytes sent
+ */
+static ssize_t otelnet_send_now(otelnet_ctx_t *ctx, telnet_out_class_t cls,
+                                const unsigned char *data, size_t len)
+{
+    ssize_t sent = telnet_queue_output(&ctx->telnet, cls, data, len);
+
+    if (sent > 0) {
+        ctx->bytes_sent += sent;
+    }
+
+    return sent;
+}
+
+/**
+ * Release held input up to the next line end (or everything if no line
+ * end is left), then wait for the next prompt mark
+ */
+static void otelnet_send_next_line(otelnet_ctx_t *ctx)
+{
+    size_t pending = iobuf_len(&ctx->paced_out);
+    size_t line_len;
+
+    if (pending == 0) {
+        return;
+    }
+
+    line_len = otelnet_line_length(iobuf_data(&ctx->paced_out), pending);
+    if (line_len == 0) {
+        line_len = pending;
+    } else {
+        ctx->awaiting_prompt = true;
+        ctx->pace_sent_ms = otelnet_now_ms();
+    }
+
+    otelnet_send_now(ctx, TELNET_OUT_BULK, iobuf_data(&ctx->paced_out), line_len);
+    iobuf_consume(&ctx->paced_out, line_len);
+}
+
+/**
+ * Send user input, pacing pipelined lines on server prompt marks
+ */
+static ssize_t otelnet_send_user_data(otelnet_ctx_t *ctx, telnet_out_class_t cls,
+                                      const unsigned char *data, size_t len)
+{
+    size_t line_len;
+    ssize_t sent;
+
+    if (!otelnet_pacing_active(ctx)) {
+        return otelnet_send_now(ctx, cls, data, len);
+    }
+
+    /* Earlier lines still waiting for a prompt: keep order */
+    if (ctx->awaiting_prompt || iobuf_len(&ctx->paced_out) > 0) {
+        return (iobuf_append(&ctx->paced_out, data, len) == SUCCESS) ? 0 : ERROR_GENERAL;
+    }
+
+    line_len = otelnet_line_length(data, len);
+    if (line_len == 0) {
+        return otelnet_send_now(ctx, cls, data, len);
+    }
+
+    /* Send the first line, hold the rest until the server prompts again */
+    sent = otelnet_send_now(ctx, cls, data, line_len);
+    ctx->awaiting_prompt = true;
+    ctx->pace_sent_ms = otelnet_now_ms();
+
+    if (line_len < len && iobuf_append(&ctx->paced_out, data + line_len, len - line_len) != SUCCESS) {
+        return ERROR_GENERAL;
+    }
+
+    return sent;
+}
+
+/**
+ * Release held input when prompts arrive, time out, or pacing stops
+ */
+static void otelnet_update_pacing(otelnet_ctx_t *ctx, size_t marks)
+{
+    if (!otelnet_pacing_active(ctx)) {
+        ctx->awaiting_prompt = false;
+        if (iobuf_len(&ctx->paced_out) > 0) {
+            otelnet_send_now(ctx, TELNET_OUT_BULK, iobuf_data(&ctx->paced_out),
+                             iobuf_len(&ctx->paced_out));
+            iobuf_clear(&ctx->paced_out);
+        }
+        return;
+    }
+
+    /* One line per prompt mark */
+    for (size_t i = 0; i < marks; i++) {
+        ctx->awaiting_prompt = false;
+        otelnet_send_next_line(ctx);
+    }
+
+    /* Server did not prompt in time - do not stall the paste */
+    if (ctx->awaiting_prompt && iobuf_len(&ctx->paced_out) > 0 &&
+        otelnet_now_ms() - ctx->pace_sent_ms >= OTELNET_PACE_TIMEOUT_MS) {
+        MB_LOG_DEBUG("No prompt mark within %d ms, sending next line", OTELNET_PACE_TIMEOUT_MS);
+        ctx->awaiting_prompt = false;
+        otelnet_send_next_line(ctx);
+    }
+
+    if (iobuf_len(&ctx->paced_out) == 0 && marks > 0) {
+        ctx->awaiting_prompt = false;
+    }
+}
+
+/**
+ * Interrupt the remote process (or abort its output) and drop everything
+ * still waiting to be rendered, so a runaway dump stops immediately
+ */
+static int otelnet_abort_output(otelnet_ctx_t *ctx, bool interrupt)
+{
+    int ret;
+
+    if (!telnet_is_connected(&ctx->telnet)) {
+        return ERROR_CONNECTION;
+    }
+
+    ret = interrupt ? telnet_send_interrupt(&ctx->telnet) : telnet_send_abort_output(&ctx->telnet);
+    if (ret != SUCCESS) {
+        return ret;
+    }
+
+    if (iobuf_len(&ctx->term_out) > 0) {
+        MB_LOG_INFO("Discarding %zu bytes of pending terminal output", iobuf_len(&ctx->term_out));
+        iobuf_clear(&ctx->term_out);
+        otelnet_term_update_throttle(ctx);
+    }
+
+    if (pipeline_stage_pending(&ctx->render) > 0) {
+        MB_LOG_INFO("Discarding %zu bytes queued for the render thread",
+                    pipeline_stage_pending(&ctx->render));
+        pipeline_stage_discard(&ctx->render);
+    }
+
+    if (interrupt) {
+        ctx->line_buffer_len = 0;
+        iobuf_clear(&ctx->paced_out);
+        ctx->awaiting_prompt = false;
+    }
+
+    return SUCCESS;
+}
+
 /**
  * Open log file for writing
  */
@@ -434,24 +1026,20 @@ static void otelnet_close_log(otelnet_ctx_t *ctx)
 }
 
 /**
- * Write data to log file
+ * Format a log entry (runs on the log thread in pipelined mode)
  */
-static void otelnet_log_data(otelnet_ctx_t *ctx, const char *direction,
-                            const unsigned char *data, size_t len)
+static void otelnet_log_write(otelnet_ctx_t *ctx, const char *direction,
+                              const unsigned char *data, size_t len)
 {
-    if (ctx == NULL || ctx->log_fp == NULL || !ctx->config.log_enabled) {
-        return;
-    }
-
-    if (data == NULL || len == 0) {
-        return;
-    }
-
     /* Get timestamp */
     time_t now = time(NULL);
-    struct tm *tm_info = localtime(&now);
+    struct tm tm_info;
     char timestamp[64];
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", tm_info);
+    localtime_r(&now, &tm_info);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &tm_info);
+
+    /* Hold the stream lock for the whole entry (cheap re-locks per call) */
+    flockfile(ctx->log_fp);
 
     /* Write log entry */
     fprintf(ctx->log_fp, "[%s][%s] ", timestamp, direction);
@@ -496,6 +1084,199 @@ static void otelnet_log_data(otelnet_ctx_t *ctx, const char *direction,
 
     fprintf(ctx->log_fp, "\n");
     fflush(ctx->log_fp);
+    funlockfile(ctx->log_fp);
+}
+
+/**
+ * Write data to log file
+ */
+static void otelnet_log_data(otelnet_ctx_t *ctx, const char *direction,
+                            const unsigned char *data, size_t len)
+{
+    if (ctx == NULL || ctx->log_fp == NULL || !ctx->config.log_enabled) {
+        return;
+    }
+
+    if (data == NULL || len == 0) {
+        return;
+    }
+
+    if (ctx->log.running) {
+        pipeline_stage_push(&ctx->log, strcmp(direction, "send") == 0 ? PIPELINE_REC_SEND : 0,
+                            data, len);
+        return;
+    }
+
+    otelnet_log_write(ctx, direction, data, len);
+}
+
+/**
+ * Write a session marker line to the log, after any entries still queued
+ */
+static void otelnet_log_marker(otelnet_ctx_t *ctx, const char *text)
+{
+    if (ctx->log_fp == NULL || !ctx->config.log_enabled) {
+        return;
+    }
+
+    pipeline_stage_drain(&ctx->log);
+
+    time_t now = time(NULL);
+    struct tm tm_info;
+    char timestamp[64];
+    localtime_r(&now, &tm_info);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &tm_info);
+    fprintf(ctx->log_fp, "[%s] === %s ===\n", timestamp, text);
+    fflush(ctx->log_fp);
+}
+
+/**
+ * Log stage sink
+ */
+static void otelnet_log_sink(void *arg, unsigned int flags, const unsigned char *data, size_t len)
+{
+    otelnet_log_write(arg, (flags & PIPELINE_REC_SEND) ? "send" : "receive", data, len);
+}
+
+/**
+ * Write all of a span to the (non-blocking) terminal from the render thread
+ */
+static void otelnet_render_write(const unsigned char *data, size_t len)
+{
+    struct pollfd pfd = { .fd = STDOUT_FILENO, .events = POLLOUT };
+
+    while (len > 0) {
+        ssize_t written = write(STDOUT_FILENO, data, len);
+        if (written < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                poll(&pfd, 1, -1);
+                continue;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            MB_LOG_ERROR("Failed to write to stdout: %s", strerror(errno));
+            return;
+        }
+        data += written;
+        len -= (size_t)written;
+    }
+}
+
+/**
+ * Render stage sink
+ */
+static void otelnet_render_sink(void *arg, unsigned int flags, const unsigned char *data, size_t len)
+{
+    (void)arg;
+
+    if (!(flags & PIPELINE_REC_TRANSLATE)) {
+        otelnet_render_write(data, len);
+        return;
+    }
+
+    while (len > 0) {
+        unsigned char translated_buf[(IO_BUFFER_SIZE + 1) * 2];
+        size_t translated_len;
+        size_t piece = otelnet_translate_crlf(data, len, translated_buf, &translated_len);
+
+        otelnet_render_write(translated_buf, translated_len);
+        data += piece;
+        len -= piece;
+    }
+}
+
+/**
+ * Start the render and log stages (PIPELINE=1)
+ * Falls back to single-threaded output if a stage cannot start.
+ */
+static void otelnet_pipeline_start(otelnet_ctx_t *ctx)
+{
+    if (!ctx->config.pipeline) {
+        return;
+    }
+
+    ctx->pipeline_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ctx->pipeline_fd < 0) {
+        MB_LOG_ERROR("Failed to create eventfd: %s", strerror(errno));
+        return;
+    }
+
+    /* Terminal output already queued must go out first (waiting for
+     * POLLOUT while stdout is full) */
+    otelnet_render_write(iobuf_data(&ctx->term_out), iobuf_len(&ctx->term_out));
+    iobuf_clear(&ctx->term_out);
+
+    if (pipeline_stage_start(&ctx->render, OTELNET_TERM_QUEUE_LIMIT, otelnet_render_sink, ctx,
+                             ctx->pipeline_fd) != SUCCESS) {
+        close(ctx->pipeline_fd);
+        ctx->pipeline_fd = -1;
+        return;
+    }
+
+    if (ctx->log_fp != NULL &&
+        pipeline_stage_start(&ctx->log, OTELNET_TERM_QUEUE_LIMIT, otelnet_log_sink, ctx,
+                             ctx->pipeline_fd) != SUCCESS) {
+        MB_LOG_WARNING("Log stage unavailable, logging on the main thread");
+    }
+
+    MB_LOG_INFO("Pipelined output: render%s thread%s", ctx->log.running ? " and log" : "",
+                ctx->log.running ? "s" : "");
+}
+
+/**
+ * Drain and stop the render and log stages
+ */
+static void otelnet_pipeline_stop(otelnet_ctx_t *ctx)
+{
+    pipeline_stage_stop(&ctx->render);
+    pipeline_stage_stop(&ctx->log);
+
+    if (ctx->pipeline_fd >= 0) {
+        close(ctx->pipeline_fd);
+        ctx->pipeline_fd = -1;
+    }
+}
+
+/**
+ * Hand the terminal back to the attached client; the session carries on
+ * detached, with stdin/stdout on /dev/null
+ */
+static void otelnet_session_detach(otelnet_ctx_t *ctx, char msg)
+{
+    int null_fd;
+
+    if (ctx->attach_fd < 0) {
+        return;
+    }
+
+    /* Let the render thread finish with this terminal */
+    pipeline_stage_drain(&ctx->render);
+
+    ctx->mode = OTELNET_MODE_CLIENT;
+    ctx->console_buffer_len = 0;
+    ctx->line_buffer_len = 0;
+    otelnet_restore_terminal(ctx);
+    ctx->termios_saved = false;
+
+    /* Output the terminal never took is dropped; the log and ring still have it */
+    iobuf_clear(&ctx->term_out);
+    ctx->term_paused = false;
+    otelnet_term_update_throttle(ctx);
+
+    null_fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+    if (null_fd >= 0) {
+        dup2(null_fd, STDIN_FILENO);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        close(null_fd);
+    }
+
+    session_send(ctx->attach_fd, msg);
+    close(ctx->attach_fd);
+    ctx->attach_fd = -1;
+
+    MB_LOG_INFO("Session detached");
 }
 
 /**
@@ -507,6 +1288,9 @@ void otelnet_enter_console_mode(otelnet_ctx_t *ctx)
         return;
     }
 
+    /* Let the render thread finish before writing to the terminal here */
+    pipeline_stage_drain(&ctx->render);
+
     ctx->mode = OTELNET_MODE_CONSOLE;
     ctx->console_buffer_len = 0;
     memset(ctx->console_buffer, 0, sizeof(ctx->console_buffer));
@@ -634,6 +1418,14 @@ int otelnet_execute_external_program_with_args(otelnet_ctx_t *ctx, const char *p
         return ERROR_CONFIG;
     }
 
+    /* The program gets the raw descriptor: over TLS that only works
+     * while the kernel does the record layer (kTLS both ways) */
+    if (telnet_is_connected(&ctx->telnet) && !transport_fd_is_stream(&ctx->telnet.transport)) {
+        printf("\r\nError: File transfer over %s needs kernel TLS offload, which is not active\r\n",
+               transport_name(ctx->telnet.transport.type));
+        return ERROR_GENERAL;
+    }
+
     /* Show execution info */
     printf("\r\n[Executing: %s", program_path);
     if (argv != NULL) {
@@ -747,14 +1539,31 @@ int otelnet_process_console_command(otelnet_ctx_t *ctx, const char *command)
         return SUCCESS;
     }
 
+    /* detach - leave a detached session running */
+    if (strcmp(program, "detach") == 0) {
+        if (ctx->attach_fd < 0) {
+            printf("\r\nNot a detached session (start one with -D <socket>)\r\n");
+            return SUCCESS;
+        }
+        printf("\r\n");
+        fflush(stdout);
+        otelnet_session_detach(ctx, SESSION_MSG_DETACHED);
+        return SUCCESS;
+    }
+
     /* help */
     if (strcmp(program, "help") == 0 || strcmp(program, "?") == 0) {
         printf("\r\n");
         printf("=== Console Commands ===\r\n");
         printf("  [empty]       - Return to client mode\r\n");
         printf("  quit, exit    - Disconnect and exit program\r\n");
+        printf("  detach        - Leave the session running in the background (-D)\r\n");
         printf("  help, ?       - Show this help message\r\n");
-        printf("  stats         - Show connection statistics\r\n\r\n");
+        printf("  stats         - Show connection statistics\r\n");
+        printf("  charset [name] - Show or set remote character set\r\n");
+        printf("  comport [cmd] - Serial port control (RFC 2217), 'comport help'\r\n");
+        printf("  ip            - Send Interrupt Process + Synch, drop pending output\r\n");
+        printf("  ao            - Send Abort Output + Synch, drop pending output\r\n\r\n");
         printf("=== File Transfer Commands ===\r\n");
         printf("Send Files:\r\n");
         printf("  sz [options] <files...> - Send via ZMODEM (default)\r\n");
@@ -793,6 +1602,162 @@ int otelnet_process_console_command(otelnet_ctx_t *ctx, const char *command)
         return SUCCESS;
     }
 
+    /* charset - show or set remote character set */
+    if (strcmp(program, "charset") == 0) {
+        if (arg_count == 0) {
+            printf("\r\nRemote charset: %s%s\r\n", charset_name(ctx->telnet.charset),
+                   (telnet_opt_isset(&ctx->telnet.local_options, TELOPT_CHARSET) ||
+                    telnet_opt_isset(&ctx->telnet.remote_options, TELOPT_CHARSET)) ? " (CHARSET negotiated)" : "");
+            printf("Supported: UTF-8, EUC-KR, CP949, SHIFT_JIS, ISO-8859-1 .. ISO-8859-16\r\n");
+        } else if (telnet_set_charset(&ctx->telnet, args[0]) == SUCCESS) {
+            printf("\r\nRemote charset set to %s\r\n", charset_name(ctx->telnet.charset));
+        } else {
+            printf("\r\nUnsupported charset: %s\r\n", args[0]);
+        }
+        return SUCCESS;
+    }
+
+    /* ip/ao - interrupt process or abort output */
+    if (strcmp(program, "ip") == 0 || strcmp(program, "ao") == 0) {
+        if (otelnet_abort_output(ctx, strcmp(program, "ip") == 0) == SUCCESS) {
+            printf("\r\n%s sent\r\n", strcmp(program, "ip") == 0 ? "Interrupt Process" : "Abort Output");
+        } else {
+            printf("\r\nNot connected\r\n");
+        }
+        return SUCCESS;
+    }
+
+    /* comport - RFC 2217 serial port control */
+    if (strcmp(program, "comport") == 0) {
+        telnet_t *tn = &ctx->telnet;
+        comport_state_t *cp = &tn->cold->comport;
+        const char *sub = (arg_count > 0) ? args[0] : "status";
+        const char *val = (arg_count > 1) ? args[1] : NULL;
+        int ret = SUCCESS;
+
+        if (strcmp(sub, "help") == 0) {
+            printf("\r\n=== COM Port Commands (RFC 2217) ===\r\n");
+            printf("  comport [status]          - Show port settings and line state\r\n");
+            printf("  comport set <b,d,p,s>     - Set e.g. 115200,8,N,1\r\n");
+            printf("  comport baud <rate>       - Set baud rate\r\n");
+            printf("  comport data <5-8>        - Set data bits\r\n");
+            printf("  comport parity <n|o|e|m|s> - Set parity\r\n");
+            printf("  comport stop <1|2|1.5>    - Set stop bits\r\n");
+            printf("  comport flow <none|xon|rts> - Set flow control\r\n");
+            printf("  comport break [ms]        - Send BREAK (default %d ms)\r\n", COMPORT_BREAK_MS);
+            printf("  comport dtr <on|off>      - Set DTR\r\n");
+            printf("  comport rts <on|off>      - Set RTS\r\n");
+            printf("  comport purge <rx|tx|both> - Purge server buffers\r\n");
+            printf("  comport suspend|resume    - Pause or resume device output\r\n");
+            printf("====================================\r\n");
+            return SUCCESS;
+        }
+
+        if (strcmp(sub, "status") == 0) {
+            printf("\r\n=== COM Port Status ===\r\n");
+            printf("Option:      %s\r\n", cp->enabled ? "enabled" :
+                   (cp->offer ? "offered, not accepted" : "disabled (COMPORT=1 to offer)"));
+            if (cp->enabled) {
+                printf("Server:      %s\r\n", cp->signature[0] ? cp->signature : "(unknown)");
+                printf("Settings:    %u,%u,%s,%s\r\n", cp->baudrate, cp->datasize,
+                       comport_parity_name(cp->parity), comport_stopsize_name(cp->stopsize));
+                printf("Flow:        %s%s%s\r\n", comport_flow_name(cp->flow),
+                       cp->suspended ? " (suspended by us)" : "",
+                       cp->remote_suspended ? " (suspended by server)" : "");
+                printf("Modem state: 0x%02x%s%s%s%s\r\n", cp->modemstate,
+                       (cp->modemstate & COMPORT_MODEM_CD) ? " CD" : "",
+                       (cp->modemstate & COMPORT_MODEM_RI) ? " RI" : "",
+                       (cp->modemstate & COMPORT_MODEM_DSR) ? " DSR" : "",
+                       (cp->modemstate & COMPORT_MODEM_CTS) ? " CTS" : "");
+                printf("Line state:  0x%02x\r\n", cp->linestate);
+            }
+            printf("=======================\r\n");
+            return SUCCESS;
+        }
+
+        if (!cp->enabled) {
+            printf("\r\nCOM-PORT-OPTION not negotiated with server\r\n");
+            return SUCCESS;
+        }
+
+        if (strcmp(sub, "set") == 0 && val != NULL) {
+            ret = comport_parse_settings(tn, val);
+            if (ret == SUCCESS) {
+                comport_on_enabled(tn);
+            }
+        } else if (strcmp(sub, "baud") == 0 && val != NULL) {
+            unsigned long baud = strtoul(val, NULL, 10);
+            ret = (baud > 0 && baud <= 0xFFFFFFFFUL) ? comport_set_baudrate(tn, (uint32_t)baud) : ERROR_INVALID_ARG;
+        } else if (strcmp(sub, "data") == 0 && val != NULL) {
+            ret = comport_set_datasize(tn, (uint8_t)atoi(val));
+        } else if (strcmp(sub, "parity") == 0 && val != NULL) {
+            uint8_t parity = comport_parse_parity(val);
+            ret = (parity != 0) ? comport_set_parity(tn, parity) : ERROR_INVALID_ARG;
+        } else if (strcmp(sub, "stop") == 0 && val != NULL) {
+            if (strcmp(val, "1") == 0) {
+                ret = comport_set_stopsize(tn, COMPORT_STOPSIZE_1);
+            } else if (strcmp(val, "2") == 0) {
+                ret = comport_set_stopsize(tn, COMPORT_STOPSIZE_2);
+            } else if (strcmp(val, "1.5") == 0) {
+                ret = comport_set_stopsize(tn, COMPORT_STOPSIZE_1_5);
+            } else {
+                ret = ERROR_INVALID_ARG;
+            }
+        } else if (strcmp(sub, "flow") == 0 && val != NULL) {
+            if (strcmp(val, "none") == 0) {
+                ret = comport_set_control(tn, COMPORT_CONTROL_FLOW_NONE);
+            } else if (strcmp(val, "xon") == 0) {
+                ret = comport_set_control(tn, COMPORT_CONTROL_FLOW_XONXOFF);
+            } else if (strcmp(val, "rts") == 0) {
+                ret = comport_set_control(tn, COMPORT_CONTROL_FLOW_HARDWARE);
+            } else {
+                ret = ERROR_INVALID_ARG;
+            }
+        } else if (strcmp(sub, "break") == 0) {
+            if (cp->break_on) {
+                printf("\r\nBREAK already in progress\r\n");
+                return SUCCESS;
+            }
+            ret = comport_send_break(tn, (val != NULL) ? atoi(val) : COMPORT_BREAK_MS);
+        } else if ((strcmp(sub, "dtr") == 0 || strcmp(sub, "rts") == 0) && val != NULL) {
+            bool on = (strcmp(val, "on") == 0);
+            if (!on && strcmp(val, "off") != 0) {
+                ret = ERROR_INVALID_ARG;
+            } else if (strcmp(sub, "dtr") == 0) {
+                ret = comport_set_control(tn, on ? COMPORT_CONTROL_DTR_ON : COMPORT_CONTROL_DTR_OFF);
+            } else {
+                ret = comport_set_control(tn, on ? COMPORT_CONTROL_RTS_ON : COMPORT_CONTROL_RTS_OFF);
+            }
+        } else if (strcmp(sub, "purge") == 0 && val != NULL) {
+            if (strcmp(val, "rx") == 0) {
+                ret = comport_purge(tn, COMPORT_PURGE_RX);
+            } else if (strcmp(val, "tx") == 0) {
+                ret = comport_purge(tn, COMPORT_PURGE_TX);
+            } else if (strcmp(val, "both") == 0) {
+                ret = comport_purge(tn, COMPORT_PURGE_BOTH);
+            } else {
+                ret = ERROR_INVALID_ARG;
+            }
+        } else if (strcmp(sub, "suspend") == 0) {
+            ret = comport_flow_suspend(tn);
+        } else if (strcmp(sub, "resume") == 0) {
+            ret = comport_flow_resume(tn);
+        } else {
+            printf("\r\nUsage: comport [status|set|baud|data|parity|stop|flow|break|dtr|rts|purge|suspend|resume]\r\n");
+            printf("Type 'comport help' for details\r\n");
+            return SUCCESS;
+        }
+
+        if (ret == ERROR_INVALID_ARG) {
+            printf("\r\nInvalid value for 'comport %s'\r\n", sub);
+        } else if (ret != SUCCESS) {
+            printf("\r\nFailed to send COM-PORT command\r\n");
+        } else {
+            printf("\r\nOK\r\n");
+        }
+        return SUCCESS;
+    }
+
     /* ls - list files */
     if (strcmp(program, "ls") == 0) {
         char ls_cmd[LINE_BUFFER_SIZE];
@@ -1042,6 +2007,12 @@ int otelnet_process_stdin(otelnet_ctx_t *ctx)
     }
 
     if (n == 0) {
+        /* Attached terminal hung up: the session outlives it */
+        if (ctx->attach_fd >= 0) {
+            otelnet_session_detach(ctx, SESSION_MSG_DETACHED);
+            return SUCCESS;
+        }
+
         /* EOF on stdin (Ctrl+D in non-console mode) */
         if (ctx->mode == OTELNET_MODE_CLIENT) {
             ctx->running = false;
@@ -1059,6 +2030,52 @@ int otelnet_process_stdin(otelnet_ctx_t *ctx)
             }
         }
 
+        /* Ctrl+C in line mode: IP + Synch, and stop rendering what is queued */
+        if (telnet_is_linemode(&ctx->telnet) && telnet_is_connected(&ctx->telnet) &&
+            memchr(buf, INTERRUPT_KEY, n) != NULL) {
+            otelnet_abort_output(ctx, true);
+            if (!ctx->telnet.echo_remote) {
+                otelnet_term_write(ctx, "^C\r\n", 4);
+            }
+            return SUCCESS;
+        }
+
+        /* Ctrl+C in character mode stops a runaway paste; the keystroke
+         * itself still goes out, ahead of anything else queued */
+        if (memchr(buf, INTERRUPT_KEY, n) != NULL &&
+            telnet_output_queued(&ctx->telnet, TELNET_OUT_BULK) + iobuf_len(&ctx->paced_out) > 0) {
+            MB_LOG_INFO("Discarding %zu bytes of pasted input",
+                        telnet_output_queued(&ctx->telnet, TELNET_OUT_BULK) +
+                        iobuf_len(&ctx->paced_out));
+            telnet_discard_output(&ctx->telnet, TELNET_OUT_BULK);
+            iobuf_clear(&ctx->paced_out);
+            ctx->awaiting_prompt = false;
+        }
+
+        /* Local flow control (LFLOW): XOFF/XON stop and restart terminal
+         * output here instead of being sent to the server */
+        if (ctx->telnet.lflow_enabled) {
+            ssize_t kept = 0;
+            for (ssize_t i = 0; i < n; i++) {
+                unsigned char c = buf[i];
+                if (c == ASCII_XOFF) {
+                    ctx->term_paused = true;
+                } else if (c == ASCII_XON) {
+                    ctx->term_paused = false;
+                } else {
+                    if (ctx->term_paused && ctx->telnet.lflow_restart_any) {
+                        ctx->term_paused = false;
+                    }
+                    buf[kept++] = c;
+                }
+            }
+            n = kept;
+            pipeline_stage_pause(&ctx->render, ctx->term_paused);
+            if (n == 0) {
+                return SUCCESS;
+            }
+        }
+
         /* Normal data - send to telnet server */
         if (telnet_is_connected(&ctx->telnet)) {
             /* Local echo if server doesn't echo */
@@ -1088,31 +2105,42 @@ int otelnet_process_stdin(otelnet_ctx_t *ctx)
                 /* Echo input locally - support multibyte characters */
                 for (ssize_t i = 0; i < n; i++) {
                     unsigned char c = buf[i];
-                    ssize_t written;
                     if (c == '\r') {
                         /* CR - echo as CR+LF */
-                        written = write(STDOUT_FILENO, "\r\n", 2);
-                        (void)written; /* Ignore write errors for echo */
+                        otelnet_term_write(ctx, "\r\n", 2);
                     } else if (c == 0x7F || c == 0x08) {
                         /* Backspace/Delete - echo backspace sequence */
-                        written = write(STDOUT_FILENO, "\b \b", 3);
-                        (void)written; /* Ignore write errors for echo */
+                        otelnet_term_write(ctx, "\b \b", 3);
                     } else if (c >= 0x20) {
                         /* Printable ASCII character or multibyte sequence byte (0x80-0xFF) */
-                        written = write(STDOUT_FILENO, &c, 1);
-                        (void)written; /* Ignore write errors for echo */
+                        otelnet_term_write(ctx, &c, 1);
                     }
                     /* Only control characters (< 0x20) not echoed */
                 }
             }
 
+            /* Transcode UTF-8 input to the remote charset */
+            const unsigned char *send_data = buf;
+            size_t send_len = n;
+            unsigned char charset_buf[BUFFER_SIZE + 4];
+
+            otelnet_sync_charset(ctx);
+            if (charset_conv_active(&ctx->charset_conv)) {
+                charset_encode(&ctx->charset_conv, buf, n, charset_buf, sizeof(charset_buf), &send_len);
+                send_data = charset_buf;
+            }
+
             /* Prepare data (escape IAC) */
-            telnet_prepare_output(&ctx->telnet, buf, n, telnet_buf, sizeof(telnet_buf), &telnet_len);
+            telnet_prepare_output(&ctx->telnet, send_data, send_len, telnet_buf, sizeof(telnet_buf), &telnet_len);
 
             if (telnet_len > 0) {
-                ssize_t sent = telnet_send(&ctx->telnet, telnet_buf, telnet_len);
-                if (sent > 0) {
-                    ctx->bytes_sent += sent;
+                /* Keystrokes go ahead of pastes; a paste is one large read */
+                telnet_out_class_t cls = (n > OTELNET_KEYSTROKE_MAX) ? TELNET_OUT_BULK
+                                                                     : TELNET_OUT_INTERACTIVE;
+
+                /* Queued while the remote has paused us (XOFF/FLOWCONTROL-SUSPEND)
+                 * or while earlier lines wait for the next prompt mark */
+                if (otelnet_send_user_data(ctx, cls, telnet_buf, telnet_len) >= 0) {
                     /* Log sent data */
                     otelnet_log_data(ctx, "send", buf, n);
                 }
@@ -1170,114 +2198,167 @@ int otelnet_process_stdin(otelnet_ctx_t *ctx)
 }
 
 /**
- * Process data from telnet server
+ * Write decoded text to the terminal, translating LF to CRLF in line mode
  */
-int otelnet_process_telnet(otelnet_ctx_t *ctx)
+static int otelnet_render_text(otelnet_ctx_t *ctx, const unsigned char *data, size_t data_len,
+                               bool is_linemode)
 {
-    unsigned char recv_buf[BUFFER_SIZE];
-    unsigned char output_buf[BUFFER_SIZE];
-    size_t output_len;
-    ssize_t n;
+    if (!is_linemode) {
+        /* Character mode: output as-is (server handles CRLF) */
+        return otelnet_term_write(ctx, data, data_len);
+    }
 
-    if (ctx == NULL) {
-        return ERROR_INVALID_ARG;
+    /* Pipelined: the render thread translates (records never split CR LF) */
+    if (ctx->render.running) {
+        while (data_len > 0) {
+            size_t piece = MIN(data_len, PIPELINE_RECORD_MAX - 1);
+            if (piece < data_len && data[piece - 1] == '\r') {
+                piece++;
+            }
+            if (pipeline_stage_push(&ctx->render, PIPELINE_REC_TRANSLATE, data, piece) != SUCCESS) {
+                return ERROR_IO;
+            }
+            data += piece;
+            data_len -= piece;
+        }
+        otelnet_term_update_throttle(ctx);
+        return SUCCESS;
     }
 
-    if (!telnet_is_connected(&ctx->telnet)) {
-        return ERROR_CONNECTION;
+    /* Line mode: translate LF to CRLF for proper display */
+    while (data_len > 0) {
+        unsigned char translated_buf[(IO_BUFFER_SIZE + 1) * 2];
+        size_t translated_len;
+        size_t piece = otelnet_translate_crlf(data, data_len, translated_buf, &translated_len);
+
+        if (otelnet_term_write(ctx, translated_buf, translated_len) != SUCCESS) {
+            return ERROR_IO;
+        }
+
+        data += piece;
+        data_len -= piece;
     }
 
-    n = telnet_recv(&ctx->telnet, recv_buf, sizeof(recv_buf));
-    if (n < 0) {
-        MB_LOG_ERROR("Telnet connection error");
-        return ERROR_CONNECTION;
+    return SUCCESS;
+}
+
+/**
+ * Send decoded text to spectators (one, or NULL for all) as the terminal shows it
+ */
+static void otelnet_share_text(otelnet_ctx_t *ctx, share_viewer_t *viewer,
+                               const unsigned char *data, size_t data_len, bool is_linemode)
+{
+    if (ctx->share.count == 0) {
+        return;
     }
 
-    if (n == 0) {
-        /* Connection closed or no data */
-        if (!telnet_is_connected(&ctx->telnet)) {
-            MB_LOG_INFO("Telnet connection closed by server");
-            ctx->running = false;
-            return ERROR_CONNECTION;
-        }
-        return SUCCESS;
+    if (!is_linemode) {
+        share_push(&ctx->share, viewer, data, data_len);
+        return;
     }
 
-    /* Process telnet protocol (remove IAC sequences) */
-    telnet_process_input(&ctx->telnet, recv_buf, n, output_buf, sizeof(output_buf), &output_len);
+    while (data_len > 0) {
+        unsigned char translated_buf[(IO_BUFFER_SIZE + 1) * 2];
+        size_t translated_len;
+        size_t piece = otelnet_translate_crlf(data, data_len, translated_buf, &translated_len);
 
-    if (output_len > 0) {
-        ctx->bytes_received += output_len;
+        share_push(&ctx->share, viewer, translated_buf, translated_len);
+        data += piece;
+        data_len -= piece;
+    }
+}
+
+/**
+ * Log decoded text and write it to the terminal
+ */
+static int otelnet_display_text(otelnet_ctx_t *ctx, const unsigned char *data, size_t data_len,
+                                bool is_linemode)
+{
+    /* Log received data */
+    otelnet_log_data(ctx, "receive", data, data_len);
 
-        /* Log received data */
-        otelnet_log_data(ctx, "receive", output_buf, output_len);
+    /* Spectators see what the terminal shows */
+    otelnet_share_text(ctx, NULL, data, data_len, is_linemode);
 
-        /* In line mode, check if we need to preserve current input line */
-        bool is_linemode = telnet_is_linemode(&ctx->telnet);
+    return otelnet_render_text(ctx, data, data_len, is_linemode);
+}
 
-        /* Check if server output ends with a prompt (ends with "> " or ">> ")
-         * If it does, don't redisplay input as server will handle it */
-        bool ends_with_prompt = false;
-        if (is_linemode && output_len >= 2) {
-            if (output_buf[output_len - 1] == ' ' && output_buf[output_len - 2] == '>') {
-                ends_with_prompt = true;
+/**
+ * Pass decoded server data through the text stage to the terminal
+ * Valid UTF-8 is displayed straight from the receive ring; only charset
+ * transcoding and invalid or split sequences go through a copy.
+ */
+static int otelnet_receive_text(otelnet_ctx_t *ctx, const unsigned char *data, size_t len)
+{
+    unsigned char text_buf[(IO_BUFFER_SIZE + 5) * UTF8_STREAM_MAX_GROWTH];
+    bool is_linemode = telnet_is_linemode(&ctx->telnet);
+    bool ends_with_prompt = false;
+    bool need_redisplay = false;
+    bool shown = false;
+
+    /* Check if server output ends with a prompt. Servers that mark
+     * prompts with EOR/GA are trusted; otherwise guess from "> " or ">> "
+     * (looking back into the ring, so a prompt split across reads counts).
+     * If it does, don't redisplay input as server will handle it */
+    if (ctx->telnet.prompt_marks) {
+        ends_with_prompt = telnet_ends_with_mark(&ctx->telnet, len);
+    } else if (is_linemode && ring_history(&ctx->rx_ring) >= 2) {
+        const unsigned char *tail = ring_tail(&ctx->rx_ring, 2);
+        ends_with_prompt = (tail[0] == '>' && tail[1] == ' ');
+    }
+
+    otelnet_sync_charset(ctx);
+
+    while (len > 0) {
+        const unsigned char *text = data;
+        size_t text_len = 0;
+        size_t used;
+
+        /* Text stage: transcode the remote charset to UTF-8, or hold back UTF-8
+         * sequences split across chunks so terminal and log see whole characters */
+        if (!charset_conv_active(&ctx->charset_conv) && ctx->utf8_stream.carry_len == 0 &&
+            (text_len = utf8_validate(data, len)) > 0) {
+            used = text_len;
+        } else {
+            used = MIN(len, IO_BUFFER_SIZE);
+            if (used < len && data[used - 1] == '\r') {
+                used++;
+            }
+            text = text_buf;
+            if (charset_conv_active(&ctx->charset_conv)) {
+                charset_decode(&ctx->charset_conv, data, used, text_buf, sizeof(text_buf), &text_len);
+            } else {
+                utf8_stream_process(&ctx->utf8_stream, data, used, text_buf, sizeof(text_buf), &text_len);
             }
         }
+        data += used;
+        len -= used;
 
-        bool need_redisplay = is_linemode && ctx->line_buffer_len > 0 && !ends_with_prompt;
-
-        if (need_redisplay) {
-            /* Clear current input line by backspacing */
-            for (size_t i = 0; i < ctx->line_buffer_len; i++) {
-                ssize_t ret = write(STDOUT_FILENO, "\b \b", 3);
-                (void)ret; /* Ignore write errors for backspace */
-            }
+        if (text_len == 0) {
+            continue;
         }
 
-        /* Write server output to stdout with LF -> CRLF translation for line mode */
-        if (is_linemode) {
-            /* Line mode: translate LF to CRLF for proper display */
-            unsigned char translated_buf[BUFFER_SIZE * 2];
-            size_t translated_len = 0;
-
-            for (size_t i = 0; i < output_len && translated_len < sizeof(translated_buf) - 1; i++) {
-                if (output_buf[i] == '\n') {
-                    /* LF -> CRLF */
-                    translated_buf[translated_len++] = '\r';
-                    translated_buf[translated_len++] = '\n';
-                } else if (output_buf[i] == '\r') {
-                    /* Standalone CR: check if next byte is not LF */
-                    if (i + 1 < output_len && output_buf[i + 1] == '\n') {
-                        /* CR LF sequence - keep as is */
-                        translated_buf[translated_len++] = '\r';
-                    } else {
-                        /* Standalone CR - convert to CRLF for proper line break */
-                        translated_buf[translated_len++] = '\r';
-                        translated_buf[translated_len++] = '\n';
-                    }
-                } else {
-                    translated_buf[translated_len++] = output_buf[i];
+        if (!shown) {
+            /* In line mode, preserve the user's current input line */
+            need_redisplay = is_linemode && ctx->line_buffer_len > 0 && !ends_with_prompt;
+            if (need_redisplay) {
+                /* Clear current input line by backspacing */
+                for (size_t i = 0; i < ctx->line_buffer_len; i++) {
+                    otelnet_term_write(ctx, "\b \b", 3);
                 }
             }
+            shown = true;
+        }
 
-            ssize_t written = write(STDOUT_FILENO, translated_buf, translated_len);
-            if (written < 0) {
-                MB_LOG_ERROR("Failed to write to stdout: %s", strerror(errno));
-                return ERROR_IO;
-            }
-        } else {
-            /* Character mode: output as-is (server handles CRLF) */
-            ssize_t written = write(STDOUT_FILENO, output_buf, output_len);
-            if (written < 0) {
-                MB_LOG_ERROR("Failed to write to stdout: %s", strerror(errno));
-                return ERROR_IO;
-            }
+        if (otelnet_display_text(ctx, text, text_len, is_linemode) != SUCCESS) {
+            return ERROR_IO;
         }
+    }
 
+    if (shown) {
         /* Redisplay user's input line if it was cleared and not ending with prompt */
         if (need_redisplay) {
-            ssize_t written = write(STDOUT_FILENO, ctx->line_buffer, ctx->line_buffer_len);
-            (void)written; /* Ignore errors for redisplay */
+            otelnet_term_write(ctx, ctx->line_buffer, ctx->line_buffer_len);
         }
 
         /* If server sent a prompt, clear our line buffer as user will start new input */
@@ -1290,47 +2371,621 @@ int otelnet_process_telnet(otelnet_ctx_t *ctx)
 }
 
 /**
- * Main event loop
+ * Redraw recent output from the receive ring on a newly attached terminal,
+ * or for a new spectator; starts at a line boundary and is not logged again
  */
-int otelnet_run(otelnet_ctx_t *ctx)
+static void otelnet_replay(otelnet_ctx_t *ctx, share_viewer_t *viewer)
 {
-    fd_set readfds;
-    struct timeval timeout;
-    int maxfd;
-    int ret;
+    unsigned char text_buf[(IO_BUFFER_SIZE + 5) * UTF8_STREAM_MAX_GROWTH];
+    size_t len = MIN(ring_history(&ctx->rx_ring), OTELNET_TERM_HIGH_WATER);
+    const unsigned char *data = ring_tail(&ctx->rx_ring, len);
+    bool is_linemode = telnet_is_linemode(&ctx->telnet);
+    charset_conv_t conv = ctx->charset_conv;
+    const unsigned char *nl;
 
-    if (ctx == NULL) {
-        return ERROR_INVALID_ARG;
+    if (len < ring_history(&ctx->rx_ring) && (nl = memchr(data, '\n', len)) != NULL) {
+        len -= (size_t)(nl + 1 - data);
+        data = nl + 1;
     }
 
-    while (ctx->running && g_running_local) {
-        /* Check for window size changes */
-        if (g_winsize_changed) {
-            otelnet_update_window_size(ctx);
-        }
-
-        FD_ZERO(&readfds);
-        maxfd = 0;
+    /* A private transcoder: the live one may be holding half a character */
+    conv.dec_has_lead = false;
 
-        /* Add stdin */
-        FD_SET(STDIN_FILENO, &readfds);
-        maxfd = MAX(maxfd, STDIN_FILENO);
+    while (len > 0) {
+        const unsigned char *text = data;
+        size_t used = MIN(len, IO_BUFFER_SIZE);
+        size_t text_len = used;
 
-        /* Add telnet socket if connected */
-        if (telnet_is_connected(&ctx->telnet)) {
-            int telnet_fd = telnet_get_fd(&ctx->telnet);
+        if (used < len && data[used - 1] == '\r') {
+            used++;
+            text_len++;
+        }
+        if (charset_conv_active(&conv)) {
+            charset_decode(&conv, data, used, text_buf, sizeof(text_buf), &text_len);
+            text = text_buf;
+        }
+        if (viewer != NULL) {
+            otelnet_share_text(ctx, viewer, text, text_len, is_linemode);
+        } else if (otelnet_render_text(ctx, text, text_len, is_linemode) != SUCCESS) {
+            return;
+        }
+        data += used;
+        len -= used;
+    }
+}
+
+/**
+ * Drop a client that connected but has not sent its attach request
+ */
+static void otelnet_session_drop_pending(otelnet_ctx_t *ctx)
+{
+    if (ctx->attach_pending_fd < 0) {
+        return;
+    }
+
+    close(ctx->attach_pending_fd);
+    ctx->attach_pending_fd = -1;
+    ctx->attach_deadline_ms = 0;
+}
+
+/**
+ * Accept a client attaching to the session; its request is read once it arrives
+ * A newer client replaces one still silent.
+ */
+static void otelnet_session_accept(otelnet_ctx_t *ctx)
+{
+    int fd = session_accept(ctx->session_fd);
+
+    if (fd < 0) {
+        return;
+    }
+
+    otelnet_session_drop_pending(ctx);
+    ctx->attach_pending_fd = fd;
+    ctx->attach_deadline_ms = otelnet_now_ms() + SESSION_ATTACH_TIMEOUT_MS;
+}
+
+/**
+ * Give up on a pending client that stayed silent
+ */
+static void otelnet_session_check_pending(otelnet_ctx_t *ctx)
+{
+    if (ctx->attach_pending_fd >= 0 && otelnet_now_ms() >= ctx->attach_deadline_ms) {
+        MB_LOG_WARNING("Session client sent no attach request within %d ms",
+                       SESSION_ATTACH_TIMEOUT_MS);
+        otelnet_session_drop_pending(ctx);
+    }
+}
+
+/**
+ * Take over the terminal of a client attaching to the session
+ * The newest client wins; one already attached is detached first.
+ */
+static void otelnet_session_attach(otelnet_ctx_t *ctx)
+{
+    int in_fd;
+    int out_fd;
+    int fd = ctx->attach_pending_fd;
+    int ret = session_read_attach(fd, &in_fd, &out_fd);
+
+    /* Not all there yet: wait for more until the deadline */
+    if (ret > 0) {
+        return;
+    }
+
+    ctx->attach_pending_fd = -1;
+    ctx->attach_deadline_ms = 0;
+    if (ret != SUCCESS) {
+        close(fd);
+        return;
+    }
+
+    otelnet_session_detach(ctx, SESSION_MSG_DETACHED);
+
+    dup2(in_fd, STDIN_FILENO);
+    dup2(out_fd, STDOUT_FILENO);
+    dup2(out_fd, STDERR_FILENO);
+    close(in_fd);
+    close(out_fd);
+    ctx->attach_fd = fd;
+
+    if (otelnet_setup_terminal(ctx) != SUCCESS) {
+        otelnet_session_detach(ctx, SESSION_MSG_DETACHED);
+        return;
+    }
+
+    MB_LOG_INFO("Session attached");
+
+    otelnet_replay(ctx, NULL);
+    if (!telnet_is_connected(&ctx->telnet)) {
+        otelnet_status(ctx, "\r\n[Not connected%s]\r\n",
+                       ctx->reconnect_at_ms > 0 ? " - reconnecting" : "");
+    }
+
+    /* NAWS follows the new terminal's size */
+    g_winsize_changed = 1;
+}
+
+/**
+ * Welcome a new spectator with the recent output
+ */
+static void otelnet_share_welcome(otelnet_ctx_t *ctx, share_viewer_t *viewer)
+{
+    char banner[BUFFER_SIZE];
+    int len = snprintf(banner, sizeof(banner), "[otelnet: watching %s %d read-only, %zu watching]\r\n",
+                       ctx->host ? ctx->host : "", ctx->port, ctx->share.count);
+
+    share_push(&ctx->share, viewer, banner, (size_t)MIN((size_t)len, sizeof(banner) - 1));
+    otelnet_replay(ctx, viewer);
+}
+
+/**
+ * Read control messages from the attached client
+ */
+static void otelnet_session_control(otelnet_ctx_t *ctx)
+{
+    char msg[16];
+    ssize_t n = read(ctx->attach_fd, msg, sizeof(msg));
+
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return;
+    }
+
+    /* Client went away (killed, or its terminal closed) */
+    if (n <= 0) {
+        otelnet_session_detach(ctx, SESSION_MSG_DETACHED);
+        return;
+    }
+
+    if (memchr(msg, SESSION_MSG_WINCH, (size_t)n) != NULL) {
+        g_winsize_changed = 1;
+    }
+}
+
+/**
+ * End a detached session: release the client and remove the socket
+ */
+static void otelnet_session_end(otelnet_ctx_t *ctx)
+{
+    if (ctx->session_fd < 0) {
+        return;
+    }
+
+    if (ctx->attach_fd >= 0) {
+        session_send(ctx->attach_fd, SESSION_MSG_ENDED);
+        close(ctx->attach_fd);
+        ctx->attach_fd = -1;
+    }
+    otelnet_session_drop_pending(ctx);
+
+    close(ctx->session_fd);
+    ctx->session_fd = -1;
+    unlink(ctx->session_path);
+
+    MB_LOG_INFO("Session ended");
+}
+
+/**
+ * Run due login script steps; give up on an expect that stalled
+ */
+static void otelnet_login_run(otelnet_ctx_t *ctx)
+{
+    const login_step_t *step;
+    uint64_t now = otelnet_now_ms();
+
+    if (!ctx->login.active || !telnet_is_connected(&ctx->telnet)) {
+        return;
+    }
+
+    if (login_script_expired(&ctx->login, now)) {
+        otelnet_status(ctx, "\r\nLogin script timed out\r\n");
+        return;
+    }
+
+    /* Script text may hold a password: it is sent but not logged */
+    while ((step = login_script_next(&ctx->login, now)) != NULL) {
+        unsigned char buf[SMALL_BUFFER_SIZE * 2];
+        size_t len;
+
+        telnet_prepare_output(&ctx->telnet, (const unsigned char *)step->text, step->len,
+                              buf, sizeof(buf), &len);
+        otelnet_send_now(ctx, TELNET_OUT_INTERACTIVE, buf, len);
+    }
+}
+
+/**
+ * Next reconnect delay: exponential backoff with equal jitter, so clients
+ * dropped together (a terminal server reboot) do not retry in lockstep
+ */
+static uint64_t otelnet_reconnect_delay(otelnet_ctx_t *ctx)
+{
+    uint64_t delay = ctx->config.reconnect_min_ms;
+
+    for (unsigned int i = 0; i < ctx->reconnect_failures && delay < ctx->config.reconnect_max_ms; i++) {
+        delay *= 2;
+    }
+    delay = MIN(delay, ctx->config.reconnect_max_ms);
+
+    return delay / 2 + (uint64_t)random() % (delay / 2 + 1);
+}
+
+/**
+ * The connection dropped (or an attempt failed): end the session, or
+ * schedule the next reconnect with RECONNECT=1
+ */
+static void otelnet_connection_lost(otelnet_ctx_t *ctx)
+{
+    uint64_t now = otelnet_now_ms();
+    uint64_t delay;
+
+    if (!ctx->config.reconnect) {
+        ctx->running = false;
+        return;
+    }
+
+    telnet_disconnect(&ctx->telnet);
+    login_script_stop(&ctx->login);
+
+    /* Held input and flow state belonged to the old connection */
+    iobuf_clear(&ctx->paced_out);
+    ctx->awaiting_prompt = false;
+    ctx->term_paused = false;
+
+    if (ctx->lost_at_ms == 0) {
+        ctx->lost_at_ms = now;
+        if (ctx->connection_start_time != 0) {
+            otelnet_log_marker(ctx, "Connection lost");
+        }
+    }
+
+    if (ctx->config.reconnect_attempts > 0 && ctx->reconnect_failures >= ctx->config.reconnect_attempts) {
+        MB_LOG_ERROR("Giving up after %u reconnect attempts", ctx->reconnect_failures);
+        otelnet_status(ctx, "\r\nGiving up after %u reconnect attempts\r\n", ctx->reconnect_failures);
+        ctx->downtime_ms += now - ctx->lost_at_ms;
+        ctx->lost_at_ms = 0;
+        ctx->running = false;
+        return;
+    }
+
+    delay = otelnet_reconnect_delay(ctx);
+    MB_LOG_INFO("Reconnecting in %llu ms (attempt %u)", (unsigned long long)delay,
+                ctx->reconnect_failures + 1);
+    otelnet_status(ctx, "\r\n%s, reconnecting in %.1f s\r\n",
+                   (ctx->reconnect_failures == 0 && ctx->connection_start_time != 0) ?
+                   "Connection lost" : "Connection failed",
+                   delay / 1000.0);
+
+    ctx->reconnect_failures++;
+    ctx->reconnect_at_ms = now + delay;
+}
+
+/**
+ * Make the scheduled reconnect attempt
+ */
+static void otelnet_reconnect(otelnet_ctx_t *ctx)
+{
+    ctx->reconnect_at_ms = 0;
+
+    if (otelnet_connect(ctx, ctx->host, ctx->port) != SUCCESS) {
+        otelnet_connection_lost(ctx);
+        return;
+    }
+
+    otelnet_login_run(ctx);
+}
+
+/**
+ * First bytes on a new connection: the server is back
+ */
+static void otelnet_connection_restored(otelnet_ctx_t *ctx)
+{
+    char marker[SMALL_BUFFER_SIZE];
+    uint64_t down = otelnet_now_ms() - ctx->lost_at_ms;
+
+    ctx->downtime_ms += down;
+    ctx->lost_at_ms = 0;
+    ctx->reconnect_failures = 0;
+    ctx->reconnects++;
+
+    snprintf(marker, sizeof(marker), "Reconnected after %.1f s", down / 1000.0);
+    MB_LOG_INFO("%s", marker);
+    otelnet_log_marker(ctx, marker);
+}
+
+/**
+ * Record a dead connection (path or server gone without a close)
+ */
+static void otelnet_dead_link(otelnet_ctx_t *ctx, const char *why)
+{
+    uint64_t silent = otelnet_now_ms() - ctx->last_rx_ms;
+
+    ctx->dead_links++;
+    ctx->dead_detect_ms = silent;
+
+    MB_LOG_WARNING("Connection dead (%s), %llu ms after the server last sent data", why,
+                   (unsigned long long)silent);
+    otelnet_status(ctx, "\r\nConnection dead (%s) after %.1f s of silence\r\n", why,
+                   silent / 1000.0);
+}
+
+/**
+ * Probe an idle connection (PROBE); a TIMING-MARK left unanswered means
+ * the path or the server is dead.  NOP gets no answer: it only keeps data
+ * in flight so TCP_USER_TIMEOUT can notice a dead path.
+ */
+static void otelnet_check_liveness(otelnet_ctx_t *ctx)
+{
+    uint64_t now;
+
+    if (ctx->config.probe == OTELNET_PROBE_OFF || !telnet_is_connected(&ctx->telnet)) {
+        return;
+    }
+
+    now = otelnet_now_ms();
+
+    if (ctx->telnet.timing_mark) {
+        if (now - ctx->last_probe_ms >= ctx->config.probe_timeout * 1000ULL) {
+            otelnet_dead_link(ctx, "no TIMING-MARK answer");
+            otelnet_connection_lost(ctx);
+        }
+        return;
+    }
+
+    if (now - MAX(ctx->last_rx_ms, ctx->last_probe_ms) < ctx->config.probe_interval * 1000ULL) {
+        return;
+    }
+
+    MB_LOG_DEBUG("Session idle, sending liveness probe");
+    ctx->last_probe_ms = now;
+    if (ctx->config.probe == OTELNET_PROBE_NOP) {
+        telnet_send_command(&ctx->telnet, TELNET_NOP);
+    } else {
+        telnet_send_timing_mark(&ctx->telnet);
+    }
+}
+
+/**
+ * Time the next liveness check is due (0 = none)
+ */
+static uint64_t otelnet_liveness_deadline(otelnet_ctx_t *ctx)
+{
+    if (ctx->config.probe == OTELNET_PROBE_OFF || !telnet_is_connected(&ctx->telnet)) {
+        return 0;
+    }
+
+    if (ctx->telnet.timing_mark) {
+        return ctx->last_probe_ms + ctx->config.probe_timeout * 1000ULL;
+    }
+
+    return MAX(ctx->last_rx_ms, ctx->last_probe_ms) + ctx->config.probe_interval * 1000ULL;
+}
+
+/**
+ * Shorten a select() timeout so that it ends by a deadline (0 = none)
+ */
+static void otelnet_timeout_until(struct timeval *timeout, uint64_t deadline_ms)
+{
+    uint64_t now = otelnet_now_ms();
+    uint64_t wait;
+
+    if (deadline_ms == 0) {
+        return;
+    }
+
+    wait = (deadline_ms > now) ? deadline_ms - now : 0;
+    if (wait < (uint64_t)timeout->tv_sec * 1000 + (uint64_t)timeout->tv_usec / 1000) {
+        timeout->tv_sec = (time_t)(wait / 1000);
+        timeout->tv_usec = (suseconds_t)(wait % 1000) * 1000;
+    }
+}
+
+/**
+ * Process data from telnet server
+ * recv() writes into the receive ring one byte ahead of the write
+ * position and the decoder compacts the data in place, so the decoded
+ * text lands contiguously after the previous read with no copy.
+ * Drains the socket until it would block, the terminal backs up or the
+ * per-iteration budget is spent (so stdin is not starved during floods).
+ * The read size doubles while reads come back full and halves when the
+ * socket drains with little data.
+ */
+int otelnet_process_telnet(otelnet_ctx_t *ctx)
+{
+    size_t total = 0;
+    ssize_t n;
+
+    if (ctx == NULL) {
+        return ERROR_INVALID_ARG;
+    }
+
+    if (!telnet_is_connected(&ctx->telnet)) {
+        return ERROR_CONNECTION;
+    }
+
+    if (ctx->rx_size < IO_BUFFER_SIZE) {
+        ctx->rx_size = IO_BUFFER_SIZE;
+    }
+
+    while (total < OTELNET_RECV_BUDGET && ctx->running && !ctx->term_throttled) {
+        unsigned char *out = ring_reserve(&ctx->rx_ring, ctx->rx_size + 1);
+        size_t output_len;
+
+        if (out == NULL) {
+            return ERROR_GENERAL;
+        }
+
+        n = telnet_recv(&ctx->telnet, out + 1, ctx->rx_size);
+        if (n < 0) {
+            /* Keepalive or user timeout gave up on the path */
+            if (errno == ETIMEDOUT || errno == EHOSTUNREACH) {
+                otelnet_dead_link(ctx, strerror(errno));
+            }
+            MB_LOG_ERROR("Telnet connection error");
+            return ERROR_CONNECTION;
+        }
+
+        if (n == 0) {
+            /* Connection closed or no data */
+            if (!telnet_is_connected(&ctx->telnet)) {
+                MB_LOG_INFO("Telnet connection closed by server");
+                return ERROR_CONNECTION;
+            }
+            break;
+        }
+
+        if (ctx->lost_at_ms > 0) {
+            otelnet_connection_restored(ctx);
+        }
+
+        /* Process telnet protocol (remove IAC sequences) in place */
+        telnet_process_input(&ctx->telnet, out + 1, (size_t)n, out, (size_t)n + 1, &output_len);
+        ring_commit(&ctx->rx_ring, output_len);
+
+        if (ctx->login.active && login_script_feed(&ctx->login, &ctx->rx_ring, output_len)) {
+            otelnet_login_run(ctx);
+        }
+
+        ctx->bytes_received += output_len;
+        total += (size_t)n;
+
+        if (output_len > 0 && otelnet_receive_text(ctx, out, output_len) != SUCCESS) {
+            return ERROR_IO;
+        }
+
+        if (ctx->telnet.mark_count > 0) {
+            /* Record complete: render it now rather than with the next read */
+            otelnet_term_flush(ctx);
+
+            /* Prompt: release the next pipelined line */
+            otelnet_update_pacing(ctx, ctx->telnet.mark_count);
+        }
+
+        if ((size_t)n < ctx->rx_size) {
+            /* Short read: the socket is drained */
+            break;
+        }
+
+        /* Full read: more is waiting, read bigger next time */
+        ctx->rx_size = MIN(ctx->rx_size * 2, ctx->rx_max);
+    }
+
+    /* Anything from the server, including a probe answer, proves it alive */
+    if (total > 0) {
+        ctx->last_rx_ms = otelnet_now_ms();
+    }
+
+    /* Light traffic: shrink back towards a single chunk */
+    if (total < ctx->rx_size / 4 && ctx->rx_size > IO_BUFFER_SIZE) {
+        ctx->rx_size = MAX(ctx->rx_size / 2, IO_BUFFER_SIZE);
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * Main event loop
+ */
+int otelnet_run(otelnet_ctx_t *ctx)
+{
+    fd_set readfds;
+    fd_set writefds;
+    fd_set exceptfds;
+    struct timeval timeout;
+    int maxfd;
+    int ret;
+
+    if (ctx == NULL) {
+        return ERROR_INVALID_ARG;
+    }
+
+    while (ctx->running && g_running_local) {
+        /* Check for window size changes */
+        if (g_winsize_changed) {
+            otelnet_update_window_size(ctx);
+        }
+
+        FD_ZERO(&readfds);
+        FD_ZERO(&writefds);
+        FD_ZERO(&exceptfds);
+        maxfd = 0;
+
+        /* Add stdin (a detached session has no terminal to read) */
+        if (ctx->session_fd < 0 || ctx->attach_fd >= 0) {
+            FD_SET(STDIN_FILENO, &readfds);
+            maxfd = MAX(maxfd, STDIN_FILENO);
+        }
+
+        /* Detached session: clients attaching, and the attached one's messages */
+        if (ctx->session_fd >= 0) {
+            FD_SET(ctx->session_fd, &readfds);
+            maxfd = MAX(maxfd, ctx->session_fd);
+        }
+        if (ctx->attach_fd >= 0) {
+            FD_SET(ctx->attach_fd, &readfds);
+            maxfd = MAX(maxfd, ctx->attach_fd);
+        }
+        if (ctx->attach_pending_fd >= 0) {
+            FD_SET(ctx->attach_pending_fd, &readfds);
+            maxfd = MAX(maxfd, ctx->attach_pending_fd);
+        }
+
+        /* Spectators joining, leaving, and waiting for queued output */
+        maxfd = share_fill_fds(&ctx->share, &readfds, &writefds, maxfd);
+
+        /* Wait for stdout while terminal output is queued */
+        if (iobuf_len(&ctx->term_out) > 0 && !ctx->term_paused) {
+            FD_SET(STDOUT_FILENO, &writefds);
+            maxfd = MAX(maxfd, STDOUT_FILENO);
+        }
+
+        /* Add telnet socket if connected (not while the terminal is backed up) */
+        if (telnet_is_connected(&ctx->telnet) && !ctx->term_throttled) {
+            int telnet_fd = telnet_get_fd(&ctx->telnet);
             if (telnet_fd >= 0) {
                 FD_SET(telnet_fd, &readfds);
+                FD_SET(telnet_fd, &exceptfds);  /* TCP urgent data (Synch) */
                 maxfd = MAX(maxfd, telnet_fd);
             }
         }
 
-        /* Set timeout */
+        /* Wait for the socket while outbound data is queued and not paused */
+        if (telnet_output_pending(&ctx->telnet)) {
+            int telnet_fd = telnet_get_fd(&ctx->telnet);
+            if (telnet_fd >= 0) {
+                FD_SET(telnet_fd, &writefds);
+                maxfd = MAX(maxfd, telnet_fd);
+            }
+        }
+
+        /* Throttled in pipelined mode: wake when the backed-up stages drain */
+        if (ctx->term_throttled && ctx->pipeline_fd >= 0) {
+            if (pipeline_stage_pending(&ctx->render) > OTELNET_TERM_LOW_WATER) {
+                pipeline_stage_notify_at(&ctx->render, OTELNET_TERM_LOW_WATER);
+            }
+            if (pipeline_stage_pending(&ctx->log) > OTELNET_TERM_LOW_WATER) {
+                pipeline_stage_notify_at(&ctx->log, OTELNET_TERM_LOW_WATER);
+            }
+            FD_SET(ctx->pipeline_fd, &readfds);
+            maxfd = MAX(maxfd, ctx->pipeline_fd);
+        }
+
+        /* Set timeout (short while pipelined lines wait for a prompt) */
         timeout.tv_sec = 1;
         timeout.tv_usec = 0;
+        if (iobuf_len(&ctx->paced_out) > 0) {
+            timeout.tv_sec = 0;
+            timeout.tv_usec = 100000;
+        }
+
+        /* Wake for a scheduled reconnect and login script timeouts */
+        otelnet_timeout_until(&timeout, ctx->reconnect_at_ms);
+        otelnet_timeout_until(&timeout, ctx->login.deadline_ms);
+        otelnet_timeout_until(&timeout, otelnet_liveness_deadline(ctx));
+        otelnet_timeout_until(&timeout, comport_break_deadline(&ctx->telnet, otelnet_now_ms()));
+        otelnet_timeout_until(&timeout, ctx->attach_deadline_ms);
 
         /* Wait for activity */
-        ret = select(maxfd + 1, &readfds, NULL, NULL, &timeout);
+        ret = select(maxfd + 1, &readfds, &writefds, &exceptfds, &timeout);
         if (ret < 0) {
             if (errno == EINTR) {
                 continue;
@@ -1339,28 +2994,109 @@ int otelnet_run(otelnet_ctx_t *ctx)
             return ERROR_IO;
         }
 
+        /* Pipelined lines: prompt timeout, or pacing no longer applies */
+        if (iobuf_len(&ctx->paced_out) > 0) {
+            otelnet_update_pacing(ctx, 0);
+        }
+
+        /* Reconnect (RECONNECT=1) once the backoff delay has passed */
+        if (ctx->reconnect_at_ms > 0 && otelnet_now_ms() >= ctx->reconnect_at_ms) {
+            otelnet_reconnect(ctx);
+        }
+
+        /* Login script: give up on an expect that stalled */
+        otelnet_login_run(ctx);
+
+        /* Idle session: probe it, or give up on an unanswered probe */
+        otelnet_check_liveness(ctx);
+
+        /* COM-PORT BREAK: send BREAK OFF once its time on the line is up */
+        comport_check_break(&ctx->telnet, otelnet_now_ms());
+
+        /* Session client that connected but never asked to attach */
+        otelnet_session_check_pending(ctx);
+
         if (ret == 0) {
             /* Timeout */
             continue;
         }
 
+        /* A pipeline stage drained: maybe resume reading the server */
+        if (ctx->pipeline_fd >= 0 && FD_ISSET(ctx->pipeline_fd, &readfds)) {
+            uint64_t count;
+            if (read(ctx->pipeline_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+                MB_LOG_ERROR("Failed to read eventfd: %s", strerror(errno));
+            }
+            otelnet_term_update_throttle(ctx);
+        }
+
+        /* Attached client: window size changes, or it went away */
+        if (ctx->attach_fd >= 0 && FD_ISSET(ctx->attach_fd, &readfds)) {
+            otelnet_session_control(ctx);
+        }
+
+        /* Drain queued terminal output (a lost attached terminal only detaches) */
+        if (FD_ISSET(STDOUT_FILENO, &writefds)) {
+            if (otelnet_term_flush(ctx) != SUCCESS) {
+                if (ctx->attach_fd >= 0) {
+                    otelnet_session_detach(ctx, SESSION_MSG_DETACHED);
+                } else {
+                    ctx->running = false;
+                }
+            }
+        }
+
         /* Check stdin */
-        if (FD_ISSET(STDIN_FILENO, &readfds)) {
+        if (FD_ISSET(STDIN_FILENO, &readfds) && (ctx->session_fd < 0 || ctx->attach_fd >= 0)) {
             if (otelnet_process_stdin(ctx) != SUCCESS) {
                 MB_LOG_ERROR("Error processing stdin");
+                otelnet_session_detach(ctx, SESSION_MSG_DETACHED);
+            }
+        }
+
+        /* A client attaching to the session: accept it, then take its request */
+        if (ctx->attach_pending_fd >= 0 && FD_ISSET(ctx->attach_pending_fd, &readfds)) {
+            otelnet_session_attach(ctx);
+        }
+        if (ctx->session_fd >= 0 && FD_ISSET(ctx->session_fd, &readfds)) {
+            otelnet_session_accept(ctx);
+        }
+
+        /* Spectators */
+        share_service(&ctx->share, &readfds, &writefds);
+        if (ctx->share.listen_fd >= 0 && FD_ISSET(ctx->share.listen_fd, &readfds)) {
+            share_viewer_t *viewer = share_accept(&ctx->share);
+            if (viewer != NULL) {
+                otelnet_share_welcome(ctx, viewer);
             }
         }
 
         /* Check telnet socket */
         if (telnet_is_connected(&ctx->telnet)) {
             int telnet_fd = telnet_get_fd(&ctx->telnet);
+            if (telnet_fd >= 0 && FD_ISSET(telnet_fd, &exceptfds)) {
+                /* Urgent data: discard input up to the Data Mark */
+                telnet_handle_urgent(&ctx->telnet);
+            }
             if (telnet_fd >= 0 && FD_ISSET(telnet_fd, &readfds)) {
-                if (otelnet_process_telnet(ctx) != SUCCESS) {
+                ret = otelnet_process_telnet(ctx);
+                if (ret == ERROR_CONNECTION) {
+                    /* Closed or reset by the server */
+                    otelnet_connection_lost(ctx);
+                } else if (ret != SUCCESS) {
                     MB_LOG_ERROR("Error processing telnet data");
                     ctx->running = false;
                 }
             }
         }
+
+        /* Send queued outbound data (also picks up an XON just received) */
+        if (telnet_output_pending(&ctx->telnet)) {
+            ssize_t sent = telnet_flush_output(&ctx->telnet);
+            if (sent > 0) {
+                ctx->bytes_sent += sent;
+            }
+        }
     }
 
     return SUCCESS;
@@ -1379,6 +3115,48 @@ void otelnet_print_stats(otelnet_ctx_t *ctx)
     printf("Bytes sent:     %llu\r\n", (unsigned long long)ctx->bytes_sent);
     printf("Bytes received: %llu\r\n", (unsigned long long)ctx->bytes_received);
 
+    char tls_info[SMALL_BUFFER_SIZE];
+    if (transport_tls_info(&ctx->telnet.transport, tls_info, sizeof(tls_info))) {
+        printf("TLS:            %s\r\n", tls_info);
+    }
+
+    if (telnet_output_queued(&ctx->telnet, TELNET_OUT_CLASSES) > 0) {
+        printf("Outbound queue: %zu bytes%s\r\n", telnet_output_queued(&ctx->telnet, TELNET_OUT_CLASSES),
+               telnet_output_paused(&ctx->telnet) ? " (paused by remote)" : "");
+    }
+
+    if (pool_buf_cached() > 0) {
+        printf("Buffer pool:    %zu KB idle\r\n", pool_buf_cached() / 1024);
+    }
+
+    if (ctx->telnet.synch_discarded > 0) {
+        printf("Synch discard:  %llu bytes\r\n", (unsigned long long)ctx->telnet.synch_discarded);
+    }
+
+    if (ctx->utf8_stream.invalid_count > 0) {
+        printf("Invalid UTF-8:  %llu sequences\r\n", (unsigned long long)ctx->utf8_stream.invalid_count);
+    }
+
+    if (ctx->reconnects > 0 || ctx->downtime_ms > 0 || ctx->lost_at_ms > 0) {
+        uint64_t down = ctx->downtime_ms + (ctx->lost_at_ms > 0 ? otelnet_now_ms() - ctx->lost_at_ms : 0);
+        printf("Reconnects:     %u (%.1f s down)%s\r\n", ctx->reconnects, down / 1000.0,
+               ctx->lost_at_ms > 0 ? " - reconnecting" : "");
+    }
+
+    if (ctx->dead_links > 0) {
+        printf("Dead links:     %llu (last detected after %.1f s of silence)\r\n",
+               (unsigned long long)ctx->dead_links, ctx->dead_detect_ms / 1000.0);
+    }
+
+    if (ctx->share.served > 0) {
+        printf("Spectators:     %zu watching, %u served", ctx->share.count, ctx->share.served);
+        if (ctx->share.skipped_bytes > 0 || ctx->share.slow_disconnects > 0) {
+            printf(" (slow: %llu bytes skipped, %u disconnected)",
+                   (unsigned long long)ctx->share.skipped_bytes, ctx->share.slow_disconnects);
+        }
+        printf("\r\n");
+    }
+
     if (ctx->connection_start_time > 0) {
         time_t duration = time(NULL) - ctx->connection_start_time;
         printf("Duration:       %ld seconds\r\n", (long)duration);
@@ -1393,23 +3171,157 @@ void otelnet_print_stats(otelnet_ctx_t *ctx)
 void otelnet_print_usage(const char *program_name)
 {
     printf("Usage: %s <host> <port> [options]\n", program_name);
+    printf("       %s tls:<host> [port] [options]\n", program_name);
+    printf("       %s unix:<path> | serial:<device>[,baud] | pipe:<command> [options]\n",
+           program_name);
+    printf("       %s -D <socket> <target> [port] [options]\n", program_name);
+    printf("       %s -A <socket>\n", program_name);
+    printf("       %s -G <routes> [-c <config>]\n", program_name);
+    printf("       %s --listen [address:]port [program [args...]]\n", program_name);
     printf("\n");
     printf("Arguments:\n");
     printf("  host              Remote host (IP address or hostname)\n");
     printf("  port              Remote port number\n");
+    printf("  tls:<host>        TLS-wrapped telnet (default port %d)%s\n",
+           TRANSPORT_TLS_DEFAULT_PORT, transport_tls_available() ? "" : " - not in this build");
+    printf("  unix:<path>       Unix domain socket\n");
+    printf("  serial:<device>   Local serial line or pty (default 115200 baud)\n");
+    printf("  pipe:<command>    Helper command's stdin/stdout, e.g.\n");
+    printf("                    \"pipe:ssh -W console:23 jumphost\"\n");
     printf("\n");
     printf("Options:\n");
     printf("  -c <config>       Configuration file (default: %s)\n", OTELNET_DEFAULT_CONFIG);
+    printf("  -D <socket>       Start a detached session in the background; it keeps the\n");
+    printf("                    connection, scrollback and log while no terminal is attached\n");
+    printf("  -A <socket>       Attach this terminal to a session (console 'detach' leaves it)\n");
+    printf("  -G <routes>       Run as a gateway relaying clients of many local ports to\n");
+    printf("                    their upstream servers (one route per line:\n");
+    printf("                    [address:]port target [port] [pass|ws]; ws routes\n");
+    printf("                    serve WebSocket browsers sharing one session)\n");
+    printf("  --listen <port> [program [args...]]\n");
+    printf("                    Serve telnet clients, each with the program (or\n");
+    printf("                    LISTEN_PROGRAM) on its own pty; there is no default\n");
+    printf("                    program.  A bare port listens on 127.0.0.1 only.\n");
+    printf("                    Must come last.\n");
     printf("  -h, --help        Show this help message\n");
     printf("  -v, --version     Show version information\n");
     printf("\n");
     printf("Console Mode:\n");
     printf("  Press Ctrl+] to enter console mode\n");
-    printf("  Commands: quit, kermit, sz, rz, help, stats\n");
+    printf("  Commands: quit, detach, kermit, sz, rz, help, stats\n");
     printf("  Press Enter with empty line to return to client mode\n");
     printf("\n");
 }
 
+/**
+ * Run as a gateway (-G): configuration applies to the upstream connections
+ */
+static int otelnet_gateway(otelnet_ctx_t *ctx, const char *config_file, const char *routes_path)
+{
+    gateway_t gw;
+    int ret;
+
+    if (otelnet_init(ctx) != SUCCESS) {
+        fprintf(stderr, "Error: Failed to initialize\n");
+        return EXIT_FAILURE;
+    }
+    if (otelnet_load_config(ctx, config_file) != SUCCESS) {
+        fprintf(stderr, "Warning: Failed to load configuration file\n");
+    }
+
+    ret = gateway_init(&gw);
+    if (ret == SUCCESS) {
+        snprintf(gw.ws_origin, sizeof(gw.ws_origin), "%s", ctx->config.websocket_origin);
+        ret = gateway_load(&gw, routes_path);
+    }
+    if (ret != SUCCESS) {
+        fprintf(stderr, "Error: Cannot start gateway from %s\n", routes_path);
+        gateway_close(&gw);
+        telnet_free(&ctx->telnet);
+        return EXIT_FAILURE;
+    }
+
+    printf("Gateway: %zu routes from %s (Ctrl+C to stop)\n", gw.route_count, routes_path);
+    fflush(stdout);
+
+    ret = gateway_run(&gw);
+
+    printf("Gateway stopped: %llu clients (%llu unreachable), %zu at most at once\n",
+           gw.served, gw.failed, gw.peak);
+    printf("  Relayed: %llu bytes to upstream, %llu bytes to clients, %llu bytes spliced\n",
+           (unsigned long long)gw.bytes_up, (unsigned long long)gw.bytes_down,
+           (unsigned long long)gw.bytes_spliced);
+    if (gw.browsers > 0) {
+        printf("  Browsers: %llu joined, %llu disconnected for falling behind\n",
+               gw.browsers, gw.browsers_dropped);
+    }
+
+    gateway_close(&gw);
+    telnet_free(&ctx->telnet);
+    login_script_free(&ctx->login);
+    pool_buf_trim();
+    closelog();
+
+    return (ret == SUCCESS) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Run as a telnet server (--listen)
+ */
+static int otelnet_serve(otelnet_ctx_t *ctx, const char *config_file, const char *spec,
+                         char **program_argv)
+{
+    char *default_argv[2];
+    server_t srv;
+    int ret;
+
+    if (otelnet_init(ctx) != SUCCESS) {
+        fprintf(stderr, "Error: Failed to initialize\n");
+        return EXIT_FAILURE;
+    }
+    if (otelnet_load_config(ctx, config_file) != SUCCESS) {
+        fprintf(stderr, "Warning: Failed to load configuration file\n");
+    }
+
+    if (program_argv == NULL) {
+        /* Never fall back to a shell: that would hand one to anyone who connects */
+        if (ctx->config.listen_program[0] == '\0') {
+            fprintf(stderr, "Error: --listen needs a program after the port (or LISTEN_PROGRAM)\n");
+            telnet_free(&ctx->telnet);
+            return EXIT_FAILURE;
+        }
+        default_argv[0] = ctx->config.listen_program;
+        default_argv[1] = NULL;
+        program_argv = default_argv;
+    }
+
+    ret = server_init(&srv, spec, program_argv);
+    if (ret != SUCCESS) {
+        fprintf(stderr, "Error: Cannot listen on %s\n", spec);
+        server_close(&srv);
+        telnet_free(&ctx->telnet);
+        return EXIT_FAILURE;
+    }
+
+    printf("Serving %s on %s (Ctrl+C to stop)\n", program_argv[0], srv.listen);
+    fflush(stdout);
+
+    ret = server_run(&srv);
+
+    printf("Server stopped: %llu clients (%llu could not start %s), %zu at most at once\n",
+           srv.served, srv.failed, program_argv[0], srv.peak);
+    printf("  Relayed: %llu bytes to programs, %llu bytes to clients\n",
+           (unsigned long long)srv.bytes_in, (unsigned long long)srv.bytes_out);
+
+    server_close(&srv);
+    telnet_free(&ctx->telnet);
+    login_script_free(&ctx->login);
+    pool_buf_trim();
+    closelog();
+
+    return (ret == SUCCESS) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 /**
  * Main function
  */
@@ -1419,6 +3331,11 @@ int main(int argc, char *argv[])
     char *host = NULL;
     int port = 0;
     char *config_file = OTELNET_DEFAULT_CONFIG;
+    char *session_path = NULL;
+    char *attach_path = NULL;
+    char *routes_path = NULL;
+    char *listen_spec = NULL;
+    char **listen_argv = NULL;
     int ret;
 
     /* Open syslog */
@@ -1430,7 +3347,8 @@ int main(int argc, char *argv[])
             otelnet_print_usage(argv[0]);
             return EXIT_SUCCESS;
         } else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--version") == 0) {
-            printf("%s version %s\n", OTELNET_APP_NAME, OTELNET_VERSION);
+            printf("%s version %s (%s profile%s)\n", OTELNET_APP_NAME, OTELNET_VERSION,
+                   OTELNET_PROFILE_NAME, transport_tls_available() ? ", TLS" : "");
             return EXIT_SUCCESS;
         } else if (strcmp(argv[i], "-c") == 0) {
             if (i + 1 < argc) {
@@ -1440,6 +3358,39 @@ int main(int argc, char *argv[])
                 otelnet_print_usage(argv[0]);
                 return EXIT_FAILURE;
             }
+        } else if (strcmp(argv[i], "-D") == 0 || strcmp(argv[i], "-A") == 0) {
+            if (i + 1 < argc) {
+                if (argv[i][1] == 'D') {
+                    session_path = argv[++i];
+                } else {
+                    attach_path = argv[++i];
+                }
+            } else {
+                fprintf(stderr, "Error: %s requires a socket path\n", argv[i]);
+                otelnet_print_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "-G") == 0) {
+            if (i + 1 < argc) {
+                routes_path = argv[++i];
+            } else {
+                fprintf(stderr, "Error: -G requires a routes file\n");
+                otelnet_print_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--listen") == 0) {
+            if (i + 1 < argc) {
+                listen_spec = argv[++i];
+                /* The rest of the line is the program and its arguments */
+                if (i + 1 < argc) {
+                    listen_argv = &argv[i + 1];
+                }
+                break;
+            } else {
+                fprintf(stderr, "Error: --listen requires a port\n");
+                otelnet_print_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
         } else if (host == NULL) {
             host = argv[i];
         } else if (port == 0) {
@@ -1451,14 +3402,42 @@ int main(int argc, char *argv[])
         }
     }
 
-    /* Validate arguments */
-    if (host == NULL || port == 0) {
+    /* Attach: this process only lends its terminal to the session */
+    if (attach_path != NULL) {
+        ret = session_attach(attach_path);
+        if (ret == ERROR_INVALID_ARG) {
+            fprintf(stderr, "Error: Attaching needs a terminal\n");
+        } else if (ret < 0) {
+            fprintf(stderr, "Error: No session at %s\n", attach_path);
+        } else {
+            printf("[%s %s]\n", ret == SESSION_MSG_ENDED ? "Session ended:" : "Detached from", attach_path);
+        }
+        return (ret < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    /* Gateway: relay clients of many ports, no terminal of its own */
+    if (routes_path != NULL) {
+        return otelnet_gateway(&ctx, config_file, routes_path);
+    }
+
+    /* Server: telnet clients each get a program on a pty */
+    if (listen_spec != NULL) {
+        return otelnet_serve(&ctx, config_file, listen_spec, listen_argv);
+    }
+
+    /* TLS defaults to the telnets port */
+    if (port == 0 && host != NULL && transport_parse(host) == TRANSPORT_TLS) {
+        port = TRANSPORT_TLS_DEFAULT_PORT;
+    }
+
+    /* Validate arguments (only TCP and TLS targets take a port) */
+    if (host == NULL || (port == 0 && transport_parse(host) == TRANSPORT_TCP)) {
         fprintf(stderr, "Error: Missing required arguments\n\n");
         otelnet_print_usage(argv[0]);
         return EXIT_FAILURE;
     }
 
-    if (port < 1 || port > 65535) {
+    if (transport_uses_port(transport_parse(host)) && (port < 1 || port > 65535)) {
         fprintf(stderr, "Error: Invalid port number: %d\n", port);
         return EXIT_FAILURE;
     }
@@ -1470,7 +3449,10 @@ int main(int argc, char *argv[])
     signal(SIGPIPE, SIG_IGN);
 
     /* Initialize context */
-    otelnet_init(&ctx);
+    if (otelnet_init(&ctx) != SUCCESS) {
+        fprintf(stderr, "Error: Failed to initialize\n");
+        return EXIT_FAILURE;
+    }
 
     /* Load configuration */
     ret = otelnet_load_config(&ctx, config_file);
@@ -1481,27 +3463,82 @@ int main(int argc, char *argv[])
     /* Open log file if enabled */
     otelnet_open_log(&ctx);
 
-    /* Setup terminal */
-    ret = otelnet_setup_terminal(&ctx);
-    if (ret != SUCCESS) {
-        fprintf(stderr, "Error: Failed to setup terminal\n");
-        return EXIT_FAILURE;
+    /* Spectators (SPECTATE) */
+    if (ctx.config.spectate[0] != '\0' &&
+        share_open(&ctx.share, ctx.config.spectate, ctx.config.spectate_queue,
+                   ctx.config.spectate_disconnect) != SUCCESS) {
+        fprintf(stderr, "Warning: Cannot accept spectators on %s\n", ctx.config.spectate);
+    }
+
+    if (session_path != NULL) {
+        /* Detached session: no terminal until a client attaches */
+        ctx.session_fd = session_listen(session_path);
+        if (ctx.session_fd < 0) {
+            fprintf(stderr, "Error: %s %s\n", ctx.session_fd == ERROR_CONNECTION ?
+                    "A session is already running at" : "Cannot create session socket", session_path);
+            return EXIT_FAILURE;
+        }
+        if (session_path[0] == '/' || getcwd(ctx.session_path, sizeof(ctx.session_path)) == NULL) {
+            SAFE_STRNCPY(ctx.session_path, session_path, sizeof(ctx.session_path));
+        } else {
+            size_t dir_len = strlen(ctx.session_path);
+            snprintf(ctx.session_path + dir_len, sizeof(ctx.session_path) - dir_len, "/%s", session_path);
+        }
+
+        printf("Session started in the background; attach with: %s -A %s\n", argv[0], session_path);
+        fflush(stdout);
+        if (daemon(1, 0) < 0) {
+            fprintf(stderr, "Error: Failed to detach: %s\n", strerror(errno));
+            unlink(ctx.session_path);
+            return EXIT_FAILURE;
+        }
+
+        /* Messages reach whichever terminal is attached as they are printed */
+        setvbuf(stdout, NULL, _IONBF, 0);
+    } else {
+        /* Setup terminal */
+        ret = otelnet_setup_terminal(&ctx);
+        if (ret != SUCCESS) {
+            fprintf(stderr, "Error: Failed to setup terminal\n");
+            return EXIT_FAILURE;
+        }
     }
 
-    /* Connect to telnet server */
+    /* Connect to telnet server (RECONNECT=1 keeps trying) */
     ret = otelnet_connect(&ctx, host, port);
-    if (ret != SUCCESS) {
+    if (ret == SUCCESS) {
+        otelnet_login_run(&ctx);
+    } else if (ctx.config.reconnect) {
+        otelnet_connection_lost(&ctx);
+    } else {
         otelnet_restore_terminal(&ctx);
+        otelnet_session_end(&ctx);
+        share_close(&ctx.share);
         return EXIT_FAILURE;
     }
 
+    /* Render and log threads (PIPELINE=1) */
+    otelnet_pipeline_start(&ctx);
+
     /* Run main loop */
     ret = otelnet_run(&ctx);
 
     /* Cleanup */
+    otelnet_pipeline_stop(&ctx);
     otelnet_disconnect(&ctx);
     otelnet_restore_terminal(&ctx);
+
+    /* Terminal is blocking again - write out anything still queued */
+    while (iobuf_len(&ctx.term_out) > 0 && iobuf_write_fd(&ctx.term_out, STDOUT_FILENO) > 0) {
+    }
+    iobuf_free(&ctx.term_out);
+    iobuf_free(&ctx.paced_out);
     otelnet_print_stats(&ctx);
+    otelnet_session_end(&ctx);
+    share_close(&ctx.share);
+    telnet_free(&ctx.telnet);
+    login_script_free(&ctx.login);
+    pool_buf_trim();
 
     /* Close log file */
     otelnet_close_log(&ctx);
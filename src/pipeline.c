@@ -0,0 +1,301 @@
+/*
+ * pipeline.c - Threaded output stages fed by lock-free SPSC queues
+ */
+
+#include "pipeline.h"
+#include "telnet.h"
+#include <poll.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+
+/* Record header; payload follows, padded to PIPELINE_ALIGN */
+typedef struct {
+    uint32_t len;
+    uint32_t flags;
+} pipeline_rec_t;
+
+#define PIPELINE_ALIGN          8
+#define PIPELINE_REC_SIZE(len)  (sizeof(pipeline_rec_t) + \
+                                 (((len) + PIPELINE_ALIGN - 1) & ~(size_t)(PIPELINE_ALIGN - 1)))
+
+/* Producer re-checks a paused consumer this often while waiting for space */
+#define PIPELINE_WAIT_MS        100
+
+/**
+ * Signal an eventfd
+ */
+static void pipeline_signal(int fd)
+{
+    uint64_t one = 1;
+    ssize_t ret = write(fd, &one, sizeof(one));
+    (void)ret;
+}
+
+/**
+ * Clear an eventfd
+ */
+static void pipeline_clear(int fd)
+{
+    uint64_t count;
+    ssize_t ret = read(fd, &count, sizeof(count));
+    (void)ret;
+}
+
+/**
+ * Get bytes queued and not yet consumed
+ */
+size_t pipeline_stage_pending(pipeline_stage_t *st)
+{
+    if (st == NULL || !st->running) {
+        return 0;
+    }
+
+    return atomic_load(&st->head) - atomic_load(&st->tail);
+}
+
+/**
+ * Check whether the consumer has something to do
+ */
+static bool pipeline_consumer_ready(pipeline_stage_t *st)
+{
+    if (atomic_load(&st->stop)) {
+        return true;
+    }
+
+    return !atomic_load(&st->paused) && atomic_load(&st->head) != atomic_load(&st->tail);
+}
+
+/**
+ * Stage thread: deliver records to the sink in order
+ */
+static void *pipeline_stage_thread(void *arg)
+{
+    pipeline_stage_t *st = arg;
+    struct pollfd pfd = { .fd = st->wake_fd, .events = POLLIN };
+
+    for (;;) {
+        size_t tail = atomic_load_explicit(&st->tail, memory_order_relaxed);
+        size_t head = atomic_load_explicit(&st->head, memory_order_acquire);
+
+        if (head == tail && atomic_load(&st->stop)) {
+            break;
+        }
+
+        if (head == tail || (atomic_load(&st->paused) && !atomic_load(&st->stop))) {
+            /* Sleep; the producer wakes us if it sees consumer_idle */
+            atomic_store(&st->consumer_idle, true);
+            if (!pipeline_consumer_ready(st)) {
+                poll(&pfd, 1, -1);
+                pipeline_clear(st->wake_fd);
+            }
+            atomic_store(&st->consumer_idle, false);
+            continue;
+        }
+
+        /* Mirrored mapping: header and payload are always contiguous */
+        const pipeline_rec_t *rec = (const pipeline_rec_t *)(st->queue.base + tail % st->queue.size);
+        size_t rec_size = PIPELINE_REC_SIZE(rec->len);
+
+        if (tail >= atomic_load(&st->discard_to)) {
+            st->sink(st->arg, rec->flags, (const unsigned char *)(rec + 1), rec->len);
+        }
+
+        atomic_store_explicit(&st->tail, tail + rec_size, memory_order_release);
+
+        /* Wake a producer waiting for space */
+        if (atomic_load(&st->notify_armed) &&
+            atomic_load(&st->head) - (tail + rec_size) <= atomic_load(&st->notify_below) &&
+            atomic_exchange(&st->notify_armed, false)) {
+            pipeline_signal(st->notify_fd);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Start an output stage
+ */
+int pipeline_stage_start(pipeline_stage_t *st, size_t size, pipeline_sink_t sink, void *arg,
+                         int notify_fd)
+{
+    sigset_t all;
+    sigset_t old;
+    int ret;
+
+    if (st == NULL || sink == NULL || notify_fd < 0) {
+        return ERROR_INVALID_ARG;
+    }
+
+    memset(st, 0, sizeof(*st));
+    st->sink = sink;
+    st->arg = arg;
+    st->notify_fd = notify_fd;
+
+    /* Every record must fit, plus room to keep the consumer busy */
+    size = MAX(size, PIPELINE_REC_SIZE(PIPELINE_RECORD_MAX) * 2);
+    if (ring_init(&st->queue, size) != SUCCESS || !st->queue.mirrored) {
+        MB_LOG_ERROR("Pipeline queue needs a double-mapped ring");
+        ring_free(&st->queue);
+        return ERROR_GENERAL;
+    }
+
+    st->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (st->wake_fd < 0) {
+        MB_LOG_ERROR("Failed to create eventfd: %s", strerror(errno));
+        ring_free(&st->queue);
+        return ERROR_GENERAL;
+    }
+
+    /* Signals stay with the main thread */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    ret = pthread_create(&st->thread, NULL, pipeline_stage_thread, st);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (ret != 0) {
+        MB_LOG_ERROR("Failed to start pipeline thread: %s", strerror(ret));
+        close(st->wake_fd);
+        ring_free(&st->queue);
+        return ERROR_GENERAL;
+    }
+
+    st->running = true;
+
+    return SUCCESS;
+}
+
+/**
+ * Drain remaining records, stop the thread and release the queue
+ */
+void pipeline_stage_stop(pipeline_stage_t *st)
+{
+    if (st == NULL || !st->running) {
+        return;
+    }
+
+    atomic_store(&st->stop, true);
+    pipeline_signal(st->wake_fd);
+    pthread_join(st->thread, NULL);
+
+    close(st->wake_fd);
+    ring_free(&st->queue);
+    st->running = false;
+}
+
+/**
+ * Ask to be woken via notify_fd once pending drops to a level
+ */
+void pipeline_stage_notify_at(pipeline_stage_t *st, size_t level)
+{
+    if (st == NULL || !st->running) {
+        return;
+    }
+
+    atomic_store(&st->notify_below, level);
+    atomic_store(&st->notify_armed, true);
+
+    /* Already there: the consumer may have passed the level before arming */
+    if (pipeline_stage_pending(st) <= level && atomic_exchange(&st->notify_armed, false)) {
+        pipeline_signal(st->notify_fd);
+    }
+}
+
+/**
+ * Wait until pending drops to a level (false if the consumer is paused)
+ */
+static bool pipeline_stage_wait(pipeline_stage_t *st, size_t level)
+{
+    struct pollfd pfd = { .fd = st->notify_fd, .events = POLLIN };
+
+    while (pipeline_stage_pending(st) > level) {
+        if (atomic_load(&st->paused)) {
+            return false;
+        }
+        pipeline_stage_notify_at(st, level);
+        if (pipeline_stage_pending(st) > level) {
+            poll(&pfd, 1, PIPELINE_WAIT_MS);
+        }
+        pipeline_clear(st->notify_fd);
+    }
+
+    return true;
+}
+
+/**
+ * Queue a record
+ */
+int pipeline_stage_push(pipeline_stage_t *st, unsigned int flags, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+
+    if (st == NULL || !st->running || (data == NULL && len > 0)) {
+        return ERROR_INVALID_ARG;
+    }
+
+    while (len > 0) {
+        size_t piece = MIN(len, PIPELINE_RECORD_MAX);
+        size_t rec_size = PIPELINE_REC_SIZE(piece);
+
+        if (!pipeline_stage_wait(st, st->queue.size - rec_size)) {
+            MB_LOG_ERROR("Pipeline queue full while output is paused, dropping %zu bytes", len);
+            return ERROR_IO;
+        }
+
+        size_t head = atomic_load_explicit(&st->head, memory_order_relaxed);
+        pipeline_rec_t *rec = (pipeline_rec_t *)(st->queue.base + head % st->queue.size);
+        rec->len = (uint32_t)piece;
+        rec->flags = flags;
+        memcpy(rec + 1, p, piece);
+
+        atomic_store(&st->head, head + rec_size);
+        if (atomic_load(&st->consumer_idle)) {
+            pipeline_signal(st->wake_fd);
+        }
+
+        p += piece;
+        len -= piece;
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * Hold or release records at the consumer
+ */
+void pipeline_stage_pause(pipeline_stage_t *st, bool paused)
+{
+    if (st == NULL || !st->running) {
+        return;
+    }
+
+    atomic_store(&st->paused, paused);
+    if (!paused) {
+        pipeline_signal(st->wake_fd);
+    }
+}
+
+/**
+ * Drop every record queued so far
+ */
+void pipeline_stage_discard(pipeline_stage_t *st)
+{
+    if (st == NULL || !st->running) {
+        return;
+    }
+
+    atomic_store(&st->discard_to, atomic_load(&st->head));
+    pipeline_signal(st->wake_fd);
+}
+
+/**
+ * Wait until every queued record has been consumed
+ */
+void pipeline_stage_drain(pipeline_stage_t *st)
+{
+    if (st == NULL || !st->running) {
+        return;
+    }
+
+    pipeline_stage_wait(st, 0);
+}
@@ -0,0 +1,239 @@
+/*
+ * pool.c - Slab allocator for session objects and per-thread I/O buffer pool
+ */
+
+#include "pool.h"
+#include "telnet.h"
+
+/* Object alignment inside slabs */
+#define POOL_ALIGN              16
+
+/* Slab header; objects follow at POOL_SLAB_HEADER */
+struct pool_slab_s {
+    pool_slab_t *next;
+};
+
+#define POOL_SLAB_HEADER        ((sizeof(pool_slab_t) + POOL_ALIGN - 1) & ~(size_t)(POOL_ALIGN - 1))
+
+/* Per-thread idle buffer cache, one free list per size class */
+typedef struct {
+    void *free_list[POOL_BUF_CLASSES];
+    size_t count[POOL_BUF_CLASSES];
+} pool_buf_cache_t;
+
+static __thread pool_buf_cache_t pool_buf_cache;
+
+/**
+ * Initialize object pool
+ */
+void pool_init(pool_t *pool, size_t obj_size, size_t per_slab)
+{
+    if (pool == NULL) {
+        return;
+    }
+
+    memset(pool, 0, sizeof(*pool));
+
+    if (obj_size < sizeof(void *)) {
+        obj_size = sizeof(void *);
+    }
+    pool->obj_size = (obj_size + POOL_ALIGN - 1) & ~(size_t)(POOL_ALIGN - 1);
+    pool->per_slab = (per_slab > 0) ? per_slab : POOL_SLAB_OBJECTS;
+}
+
+/**
+ * Carve a new slab into free objects
+ */
+static int pool_grow(pool_t *pool)
+{
+    pool_slab_t *slab;
+    unsigned char *obj;
+    size_t i;
+
+    slab = malloc(POOL_SLAB_HEADER + pool->obj_size * pool->per_slab);
+    if (slab == NULL) {
+        MB_LOG_ERROR("Failed to allocate pool slab (%zu x %zu bytes)",
+                    pool->per_slab, pool->obj_size);
+        return ERROR_GENERAL;
+    }
+
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    pool->slab_count++;
+
+    /* Push objects in reverse so they are handed out in address order */
+    obj = (unsigned char *)slab + POOL_SLAB_HEADER;
+    for (i = pool->per_slab; i > 0; i--) {
+        void **item = (void **)(obj + (i - 1) * pool->obj_size);
+        *item = pool->free_list;
+        pool->free_list = item;
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * Allocate a zeroed object
+ */
+void *pool_alloc(pool_t *pool)
+{
+    void **obj;
+
+    if (pool == NULL || pool->obj_size == 0) {
+        return NULL;
+    }
+
+    if (pool->free_list == NULL && pool_grow(pool) != SUCCESS) {
+        return NULL;
+    }
+
+    obj = pool->free_list;
+    pool->free_list = *obj;
+    pool->in_use++;
+
+    memset(obj, 0, pool->obj_size);
+
+    return obj;
+}
+
+/**
+ * Return an object to its pool
+ */
+void pool_free(pool_t *pool, void *obj)
+{
+    if (pool == NULL || obj == NULL) {
+        return;
+    }
+
+    *(void **)obj = pool->free_list;
+    pool->free_list = obj;
+    pool->in_use--;
+}
+
+/**
+ * Release all slabs
+ */
+void pool_destroy(pool_t *pool)
+{
+    if (pool == NULL) {
+        return;
+    }
+
+    if (pool->in_use > 0) {
+        MB_LOG_WARNING("Destroying pool with %zu objects in use", pool->in_use);
+    }
+
+    while (pool->slabs != NULL) {
+        pool_slab_t *next = pool->slabs->next;
+        free(pool->slabs);
+        pool->slabs = next;
+    }
+
+    pool->free_list = NULL;
+    pool->slab_count = 0;
+    pool->in_use = 0;
+}
+
+/**
+ * Get size class for a buffer size, or -1 if it bypasses the cache
+ */
+static int pool_buf_class(size_t size)
+{
+    int cls = 0;
+
+    while (cls < POOL_BUF_CLASSES && (POOL_BUF_MIN << cls) < size) {
+        cls++;
+    }
+
+    return (cls < POOL_BUF_CLASSES) ? cls : -1;
+}
+
+/**
+ * Borrow an I/O buffer from the calling thread's cache
+ */
+void *pool_buf_get(size_t size, size_t *cap)
+{
+    pool_buf_cache_t *cache = &pool_buf_cache;
+    int cls = pool_buf_class(size);
+    void *buf;
+
+    if (cap == NULL) {
+        return NULL;
+    }
+
+    if (cls < 0) {
+        /* Oversized: plain allocation, freed again by pool_buf_put() */
+        buf = malloc(size);
+        *cap = (buf != NULL) ? size : 0;
+        return buf;
+    }
+
+    buf = cache->free_list[cls];
+    if (buf != NULL) {
+        cache->free_list[cls] = *(void **)buf;
+        cache->count[cls]--;
+    } else {
+        buf = malloc(POOL_BUF_MIN << cls);
+    }
+
+    *cap = (buf != NULL) ? (POOL_BUF_MIN << cls) : 0;
+
+    return buf;
+}
+
+/**
+ * Return an I/O buffer to the calling thread's cache
+ */
+void pool_buf_put(void *buf, size_t cap)
+{
+    pool_buf_cache_t *cache = &pool_buf_cache;
+    int cls;
+
+    if (buf == NULL) {
+        return;
+    }
+
+    cls = pool_buf_class(cap);
+    if (cls < 0 || cache->count[cls] >= POOL_BUF_KEEP) {
+        free(buf);
+        return;
+    }
+
+    *(void **)buf = cache->free_list[cls];
+    cache->free_list[cls] = buf;
+    cache->count[cls]++;
+}
+
+/**
+ * Free all idle buffers cached by the calling thread
+ */
+void pool_buf_trim(void)
+{
+    pool_buf_cache_t *cache = &pool_buf_cache;
+    int cls;
+
+    for (cls = 0; cls < POOL_BUF_CLASSES; cls++) {
+        while (cache->free_list[cls] != NULL) {
+            void *next = *(void **)cache->free_list[cls];
+            free(cache->free_list[cls]);
+            cache->free_list[cls] = next;
+        }
+        cache->count[cls] = 0;
+    }
+}
+
+/**
+ * Get bytes held idle in the calling thread's cache
+ */
+size_t pool_buf_cached(void)
+{
+    const pool_buf_cache_t *cache = &pool_buf_cache;
+    size_t total = 0;
+    int cls;
+
+    for (cls = 0; cls < POOL_BUF_CLASSES; cls++) {
+        total += cache->count[cls] * (POOL_BUF_MIN << cls);
+    }
+
+    return total;
+}
@@ -0,0 +1,173 @@
+/*
+ * ring.c - Double-mapped ("magic") ring buffer
+ */
+
+#include "ring.h"
+#include "telnet.h"
+#include <sys/mman.h>
+
+/* Huge page size assumed for MFD_HUGETLB rings */
+#define RING_HUGE_PAGE_SIZE     (2 * 1024 * 1024)
+
+/**
+ * Map the same memfd twice, back to back
+ */
+static int ring_map_mirrored(ring_t *ring, size_t size, bool huge)
+{
+    unsigned char *base;
+    int fd;
+
+    fd = memfd_create("otelnet-ring", MFD_CLOEXEC | (huge ? MFD_HUGETLB : 0));
+    if (fd < 0) {
+        return ERROR_GENERAL;
+    }
+
+    if (ftruncate(fd, (off_t)size) < 0) {
+        close(fd);
+        return ERROR_GENERAL;
+    }
+
+    /* Reserve address space for both views, then map the file over it */
+    base = mmap(NULL, size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return ERROR_GENERAL;
+    }
+
+    if (mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+        mmap(base + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(base, size * 2);
+        close(fd);
+        return ERROR_GENERAL;
+    }
+
+    close(fd);
+
+    ring->base = base;
+    ring->size = size;
+    ring->mirrored = true;
+    ring->huge = huge;
+
+    return SUCCESS;
+}
+
+/**
+ * Create ring buffer
+ */
+int ring_init(ring_t *ring, size_t size)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+
+    if (ring == NULL || size == 0) {
+        return ERROR_INVALID_ARG;
+    }
+
+    memset(ring, 0, sizeof(*ring));
+
+#if OTELNET_HUGEPAGES
+    {
+        size_t huge_size = (size + RING_HUGE_PAGE_SIZE - 1) & ~(size_t)(RING_HUGE_PAGE_SIZE - 1);
+        if (ring_map_mirrored(ring, huge_size, true) == SUCCESS) {
+            MB_LOG_DEBUG("Receive ring: %zu bytes, huge pages", huge_size);
+            return SUCCESS;
+        }
+    }
+#endif
+
+    size = (size + page - 1) & ~(page - 1);
+    if (ring_map_mirrored(ring, size, false) == SUCCESS) {
+        MB_LOG_DEBUG("Receive ring: %zu bytes, double mapped", size);
+        return SUCCESS;
+    }
+
+    MB_LOG_WARNING("Double-mapped ring unavailable (%s), using linear buffer", strerror(errno));
+
+    ring->base = malloc(size);
+    if (ring->base == NULL) {
+        MB_LOG_ERROR("Failed to allocate %zu byte receive buffer", size);
+        return ERROR_GENERAL;
+    }
+    ring->size = size;
+
+    return SUCCESS;
+}
+
+/**
+ * Release ring buffer
+ */
+void ring_free(ring_t *ring)
+{
+    if (ring == NULL || ring->base == NULL) {
+        return;
+    }
+
+    if (ring->mirrored) {
+        munmap(ring->base, ring->size * 2);
+    } else {
+        free(ring->base);
+    }
+
+    memset(ring, 0, sizeof(*ring));
+}
+
+/**
+ * Get contiguous space at the write position
+ */
+unsigned char *ring_reserve(ring_t *ring, size_t len)
+{
+    if (ring == NULL || ring->base == NULL || len > ring->size) {
+        return NULL;
+    }
+
+    /* Linear fallback: restart at the front, losing the history */
+    if (!ring->mirrored && ring->pos + len > ring->size) {
+        ring->pos = 0;
+        ring->fill = 0;
+    }
+
+    /* The reserved span overwrites the oldest history */
+    ring->fill = MIN(ring->fill, ring->size - len);
+
+    return ring->base + ring->pos;
+}
+
+/**
+ * Commit bytes written at the write position
+ */
+void ring_commit(ring_t *ring, size_t len)
+{
+    if (ring == NULL || ring->base == NULL) {
+        return;
+    }
+
+    ring->pos += len;
+    if (ring->mirrored) {
+        ring->pos %= ring->size;
+    }
+    ring->fill = MIN(ring->fill + len, ring->size);
+}
+
+/**
+ * Get the most recent history bytes as one contiguous span
+ */
+const unsigned char *ring_tail(const ring_t *ring, size_t len)
+{
+    if (ring == NULL || ring->base == NULL || len > ring->fill) {
+        return NULL;
+    }
+
+    /* The second mapping makes [pos - len, pos) contiguous even across the wrap */
+    if (ring->mirrored) {
+        return ring->base + ring->size + ring->pos - len;
+    }
+
+    return ring->base + ring->pos - len;
+}
+
+/**
+ * Get number of history bytes available to ring_tail()
+ */
+size_t ring_history(const ring_t *ring)
+{
+    return (ring != NULL) ? ring->fill : 0;
+}
@@ -0,0 +1,702 @@
+/*
+ * server.c - Telnet server running a program per client (otelnet --listen)
+ */
+
+#include "server.h"
+#include <ctype.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+
+/* Set by SIGINT/SIGTERM */
+static volatile sig_atomic_t g_server_stop = 0;
+
+/**
+ * Server signal handler
+ */
+static void server_signal_handler(int signum)
+{
+    (void)signum;
+    g_server_stop = 1;
+}
+
+/**
+ * SIGCHLD handler (only interrupts epoll_wait)
+ */
+static void server_child_handler(int signum)
+{
+    (void)signum;
+}
+
+/**
+ * Get monotonic time in milliseconds
+ */
+static uint64_t server_now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/**
+ * Start listening
+ */
+int server_init(server_t *srv, const char *spec, char **argv)
+{
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+
+    memset(srv, 0, sizeof(*srv));
+    srv->epoll_fd = -1;
+    srv->spare_fd = -1;
+    srv->argv = argv;
+    pool_init(&srv->conns, sizeof(server_conn_t), 0);
+
+    /* Whoever reaches the port gets a shell: loopback unless asked otherwise */
+    if (strchr(spec, ':') == NULL) {
+        snprintf(srv->listen, sizeof(srv->listen), "127.0.0.1:%s", spec);
+    } else {
+        snprintf(srv->listen, sizeof(srv->listen), "%s", spec);
+    }
+
+    srv->listen_fd = transport_listen(srv->listen);
+    if (srv->listen_fd < 0) {
+        MB_LOG_ERROR("Failed to listen on %s", srv->listen);
+        return srv->listen_fd;
+    }
+
+    srv->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (srv->epoll_fd < 0 || epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, srv->listen_fd, &ev) < 0) {
+        MB_LOG_ERROR("Failed to create epoll instance: %s", strerror(errno));
+        return ERROR_IO;
+    }
+    srv->spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    MB_LOG_INFO("Serving %s on %s", argv[0], srv->listen);
+
+    return SUCCESS;
+}
+
+/**
+ * Hang up a connection; it is freed after the current batch of events
+ */
+static void server_close_conn(server_t *srv, server_conn_t *conn)
+{
+    if (conn->dead) {
+        return;
+    }
+
+    /* Closing the master hangs up the pty; the signal covers programs that ignore it */
+    if (conn->pty_fd >= 0) {
+        close(conn->pty_fd);
+        conn->pty_fd = -1;
+    }
+    if (conn->pid > 0) {
+        kill(-conn->pid, SIGHUP);
+    }
+    if (conn->spawn_by != 0) {
+        srv->starting--;
+    }
+
+    srv->active--;
+    MB_LOG_INFO("Server: client %s:%d left (%zu open)", conn->tn.cold->host,
+                conn->tn.cold->port, srv->active);
+
+    telnet_free(&conn->tn);
+    transport_close(&conn->tn.transport);
+    iobuf_free(&conn->to_pty);
+
+    /* Off the open list, onto the dead one */
+    if (conn->prev != NULL) {
+        conn->prev->next = conn->next;
+    } else {
+        srv->open = conn->next;
+    }
+    if (conn->next != NULL) {
+        conn->next->prev = conn->prev;
+    }
+    conn->dead = true;
+    conn->next = srv->dead;
+    srv->dead = conn;
+}
+
+/**
+ * Free connections closed during the last batch and collect ended programs
+ */
+static void server_reap(server_t *srv)
+{
+    while (srv->dead != NULL) {
+        server_conn_t *conn = srv->dead;
+
+        srv->dead = conn->next;
+        pool_free(&srv->conns, conn);
+    }
+
+    while (waitpid(-1, NULL, WNOHANG) > 0) {
+        /* Nothing to keep: the pty tells when a program ends */
+    }
+}
+
+/**
+ * Register what one descriptor waits for with epoll
+ */
+static void server_watch(server_t *srv, server_ref_t *ref, int fd, uint32_t want)
+{
+    if (want != ref->events) {
+        struct epoll_event ev = { .events = want, .data.ptr = ref };
+
+        epoll_ctl(srv->epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+        ref->events = want;
+    }
+}
+
+/**
+ * Bring a connection's epoll registrations up to date
+ */
+static void server_update(server_t *srv, server_conn_t *conn)
+{
+    uint32_t want = 0;
+
+    if (!conn->closing && iobuf_len(&conn->to_pty) < SERVER_HIGH_WATER) {
+        want |= EPOLLIN;
+    }
+    if (telnet_output_pending(&conn->tn)) {
+        want |= EPOLLOUT;
+    }
+    server_watch(srv, &conn->client, conn->tn.fd, want);
+
+    if (conn->pty_fd >= 0) {
+        want = 0;
+        if (telnet_output_queued(&conn->tn, TELNET_OUT_CLASSES) < SERVER_HIGH_WATER) {
+            want |= EPOLLIN;
+        }
+        if (iobuf_len(&conn->to_pty) > 0) {
+            want |= EPOLLOUT;
+        }
+        server_watch(srv, &conn->pty, conn->pty_fd, want);
+    }
+
+    /* Program ended and its last output has gone out */
+    if (conn->closing && !(conn->client.events & EPOLLOUT)) {
+        server_close_conn(srv, conn);
+    }
+}
+
+/**
+ * Program side of the child: make the pty its controlling terminal and exec
+ */
+static void server_exec(char **argv, int slave, const char *term)
+{
+    setsid();
+    ioctl(slave, TIOCSCTTY, 0);
+    dup2(slave, STDIN_FILENO);
+    dup2(slave, STDOUT_FILENO);
+    dup2(slave, STDERR_FILENO);
+
+    /* Ignored signals survive exec */
+    signal(SIGPIPE, SIG_DFL);
+    setenv("TERM", term, 1);
+
+    execvp(argv[0], argv);
+    dprintf(STDERR_FILENO, "otelnet: cannot run %s: %s\n", argv[0], strerror(errno));
+    _exit(127);
+}
+
+/**
+ * Start the program on a new pty, sized and typed as the client said
+ */
+static int server_spawn(server_t *srv, server_conn_t *conn)
+{
+    telnet_cold_t *cold = conn->tn.cold;
+    struct winsize ws;
+    char term[sizeof(cold->terminal_type)];
+    char name[SMALL_BUFFER_SIZE];
+    struct epoll_event ev = { .events = 0, .data.ptr = &conn->pty };
+    int master;
+    int slave;
+    pid_t pid;
+
+    srv->starting--;
+    conn->spawn_by = 0;
+
+    /* TERM is conventionally lower case; no answer means no capabilities */
+    for (size_t i = 0; i < sizeof(term); i++) {
+        term[i] = (char)tolower((unsigned char)cold->terminal_type[i]);
+        if (term[i] == '\0') {
+            break;
+        }
+    }
+    if (term[0] == '\0') {
+        snprintf(term, sizeof(term), "dumb");
+    }
+
+    master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0 ||
+        ptsname_r(master, name, sizeof(name)) != 0) {
+        MB_LOG_ERROR("Failed to allocate a pty: %s", strerror(errno));
+        if (master >= 0) {
+            close(master);
+        }
+        return ERROR_IO;
+    }
+
+    slave = open(name, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (slave < 0) {
+        MB_LOG_ERROR("Failed to open %s: %s", name, strerror(errno));
+        close(master);
+        return ERROR_IO;
+    }
+
+    memset(&ws, 0, sizeof(ws));
+    ws.ws_col = (unsigned short)cold->term_width;
+    ws.ws_row = (unsigned short)cold->term_height;
+    ioctl(master, TIOCSWINSZ, &ws);
+    conn->tn.window_changed = false;
+
+    pid = fork();
+    if (pid == 0) {
+        server_exec(srv->argv, slave, term);
+    }
+    close(slave);
+
+    if (pid < 0) {
+        MB_LOG_ERROR("Failed to start %s: %s", srv->argv[0], strerror(errno));
+        close(master);
+        return ERROR_IO;
+    }
+
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+    conn->pty_fd = master;
+    conn->pid = pid;
+
+    if (epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, master, &ev) < 0) {
+        MB_LOG_ERROR("Failed to watch pty: %s", strerror(errno));
+        return ERROR_IO;
+    }
+
+    MB_LOG_INFO("Server: client %s:%d runs %s (pid %d, %s, TERM=%s, %dx%d)", cold->host,
+                cold->port, srv->argv[0], (int)pid, name, term, cold->term_width,
+                cold->term_height);
+
+    return SUCCESS;
+}
+
+/**
+ * Program could not be started: tell the client, then let it go
+ */
+static void server_spawn_failed(server_t *srv, server_conn_t *conn)
+{
+    static const char note[] = "\r\n[otelnet: cannot start program]\r\n";
+
+    srv->failed++;
+    telnet_queue_output(&conn->tn, TELNET_OUT_BULK, note, sizeof(note) - 1);
+    conn->closing = true;
+}
+
+/**
+ * Start programs whose client did not send a terminal type in time
+ * @return epoll_wait() timeout until the next one is due (-1 = none waiting)
+ */
+static int server_check_starting(server_t *srv)
+{
+    uint64_t now = server_now_ms();
+    uint64_t next = 0;
+
+    server_conn_t *next_conn;
+
+    for (server_conn_t *conn = srv->open; conn != NULL && srv->starting > 0; conn = next_conn) {
+        /* server_update() may close it (onto the dead list) */
+        next_conn = conn->next;
+        if (conn->spawn_by == 0) {
+            continue;
+        }
+        if (conn->spawn_by <= now) {
+            if (server_spawn(srv, conn) != SUCCESS) {
+                server_spawn_failed(srv, conn);
+            }
+            server_update(srv, conn);
+        } else if (next == 0 || conn->spawn_by < next) {
+            next = conn->spawn_by;
+        }
+    }
+
+    return (next == 0) ? -1 : (int)(next - now);
+}
+
+/**
+ * Start serving an accepted client
+ */
+static void server_open_conn(server_t *srv, int fd, const struct sockaddr_in *addr)
+{
+    server_conn_t *conn = pool_alloc(&srv->conns);
+    struct epoll_event ev = { .events = 0, .data.ptr = NULL };
+    transport_t tp;
+
+    if (conn == NULL || telnet_init(&conn->tn) != SUCCESS) {
+        MB_LOG_ERROR("Out of memory for client on %s", srv->listen);
+        if (conn != NULL) {
+            pool_free(&srv->conns, conn);
+        }
+        close(fd);
+        return;
+    }
+
+    conn->client.watch = SERVER_WATCH_CLIENT;
+    conn->client.conn = conn;
+    conn->pty.watch = SERVER_WATCH_PTY;
+    conn->pty.conn = conn;
+    conn->pty_fd = -1;
+    iobuf_init(&conn->to_pty, OTELNET_TERM_QUEUE_LIMIT);
+
+    transport_adopt(&tp, TRANSPORT_TCP, fd);
+    inet_ntop(AF_INET, &addr->sin_addr, conn->tn.cold->host, sizeof(conn->tn.cold->host));
+    conn->tn.cold->port = ntohs(addr->sin_port);
+
+    /* The pty echoes and edits lines: the client sends characters as typed */
+    telnet_accept(&conn->tn, &tp, true);
+
+    /* Empty until the client answers DO TTYPE */
+    conn->tn.cold->terminal_type[0] = '\0';
+    conn->spawn_by = server_now_ms() + SERVER_SPAWN_WAIT_MS;
+    srv->starting++;
+
+    conn->next = srv->open;
+    if (srv->open != NULL) {
+        srv->open->prev = conn;
+    }
+    srv->open = conn;
+    srv->active++;
+    srv->peak = MAX(srv->peak, srv->active);
+    srv->served++;
+
+    ev.data.ptr = &conn->client;
+    if (epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        MB_LOG_ERROR("Failed to watch client: %s", strerror(errno));
+        server_close_conn(srv, conn);
+        return;
+    }
+
+    MB_LOG_INFO("Server: client %s:%d (%zu open)", conn->tn.cold->host, conn->tn.cold->port,
+                srv->active);
+
+    server_update(srv, conn);
+}
+
+/**
+ * Out of descriptors: take one client off the queue and close it, rather
+ * than spin on a listening socket that stays readable
+ */
+static void server_refuse(server_t *srv)
+{
+    int fd;
+
+    if (srv->spare_fd < 0) {
+        return;
+    }
+
+    close(srv->spare_fd);
+    fd = accept4(srv->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd >= 0) {
+        close(fd);
+    }
+    srv->spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    MB_LOG_WARNING("Out of file descriptors (%zu clients), refused a client", srv->active);
+}
+
+/**
+ * Accept clients
+ */
+static void server_accept(server_t *srv)
+{
+    for (int i = 0; i < SERVER_ACCEPT_BURST; i++) {
+        struct sockaddr_in addr;
+        socklen_t addr_len = sizeof(addr);
+        int fd = accept4(srv->listen_fd, (struct sockaddr *)&addr, &addr_len,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (fd < 0) {
+            if (errno == EMFILE || errno == ENFILE) {
+                server_refuse(srv);
+            }
+            return;
+        }
+
+        server_open_conn(srv, fd, &addr);
+    }
+}
+
+/**
+ * Pass client input to the program, or hold it until the program runs
+ */
+static int server_to_pty(server_conn_t *conn, unsigned char *data, size_t len)
+{
+    size_t done = 0;
+
+    /* Return is CR LF (or CR NUL, already CR) on an NVT but CR on a terminal */
+    if (!conn->tn.binary_remote) {
+        size_t kept = 0;
+
+        for (size_t i = 0; i < len; i++) {
+            if (!(conn->cr && data[i] == '\n')) {
+                data[kept++] = data[i];
+            }
+            conn->cr = (data[i] == '\r');
+        }
+        len = kept;
+    }
+
+    if (conn->pty_fd >= 0 && iobuf_len(&conn->to_pty) == 0) {
+        ssize_t n = write(conn->pty_fd, data, len);
+
+        if (n < 0 && errno != EAGAIN && errno != EINTR) {
+            return (errno == EIO) ? ERROR_CONNECTION : ERROR_IO;
+        }
+        done = (n > 0) ? (size_t)n : 0;
+    }
+
+    if (done < len && iobuf_append(&conn->to_pty, data + done, len - done) != SUCCESS) {
+        return ERROR_IO;
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * Read and decode client input
+ * @return SUCCESS, ERROR_CONNECTION when the client left or the program
+ *         ended, ERROR_IO on failure
+ */
+static int server_client_read(server_t *srv, server_conn_t *conn)
+{
+    static unsigned char in[IO_BUFFER_SIZE];
+    static unsigned char data[IO_BUFFER_SIZE + 1];
+    size_t len;
+    ssize_t n;
+    int ret;
+
+    n = telnet_recv(&conn->tn, in, sizeof(in));
+    if (n < 0) {
+        return ERROR_IO;
+    }
+    if (n == 0) {
+        return conn->tn.is_connected ? SUCCESS : ERROR_CONNECTION;
+    }
+
+    telnet_process_input(&conn->tn, in, (size_t)n, data, sizeof(data), &len);
+    srv->bytes_in += len;
+
+    if (len > 0) {
+        ret = server_to_pty(conn, data, len);
+        if (ret != SUCCESS) {
+            return ret;
+        }
+    }
+
+    if (conn->spawn_by != 0 && conn->tn.cold->terminal_type[0] != '\0') {
+        if (server_spawn(srv, conn) != SUCCESS) {
+            server_spawn_failed(srv, conn);
+        }
+    } else if (conn->pty_fd >= 0 && conn->tn.window_changed) {
+        struct winsize ws;
+
+        conn->tn.window_changed = false;
+        memset(&ws, 0, sizeof(ws));
+        ws.ws_col = (unsigned short)conn->tn.cold->term_width;
+        ws.ws_row = (unsigned short)conn->tn.cold->term_height;
+        ioctl(conn->pty_fd, TIOCSWINSZ, &ws);
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * Read program output and queue it for the client
+ * @return Bytes read (0 if none), ERROR_CONNECTION when the program ended,
+ *         ERROR_IO on failure
+ */
+static ssize_t server_pty_read(server_t *srv, server_conn_t *conn)
+{
+    static unsigned char in[IO_BUFFER_SIZE];
+    static unsigned char out[2 * IO_BUFFER_SIZE];
+    size_t len;
+    ssize_t n;
+
+    n = read(conn->pty_fd, in, sizeof(in));
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EINTR) {
+            return 0;
+        }
+        /* EIO: the last holder of the slave side closed it */
+        return (errno == EIO) ? ERROR_CONNECTION : ERROR_IO;
+    }
+    if (n == 0) {
+        return ERROR_CONNECTION;
+    }
+
+    telnet_prepare_output(&conn->tn, in, (size_t)n, out, sizeof(out), &len);
+    if (telnet_queue_output(&conn->tn, TELNET_OUT_BULK, out, len) < 0) {
+        return ERROR_IO;
+    }
+    srv->bytes_out += (uint64_t)n;
+
+    return n;
+}
+
+/**
+ * Handle epoll events on a client socket
+ */
+static void server_client_event(server_t *srv, server_conn_t *conn, uint32_t events)
+{
+    int ret = SUCCESS;
+
+    if ((events & EPOLLOUT) && telnet_flush_output(&conn->tn) < 0) {
+        ret = ERROR_IO;
+    }
+
+    if (ret == SUCCESS && (events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+        if (conn->client.events & EPOLLIN) {
+            ret = server_client_read(srv, conn);
+        } else if (events & (EPOLLHUP | EPOLLERR)) {
+            /* Not reading (held back or draining) and the socket is gone */
+            ret = ERROR_IO;
+        }
+    }
+
+    if (ret == ERROR_CONNECTION && conn->tn.is_connected) {
+        /* Program ended while taking input */
+        close(conn->pty_fd);
+        conn->pty_fd = -1;
+        conn->closing = true;
+    } else if (ret != SUCCESS) {
+        server_close_conn(srv, conn);
+        return;
+    }
+
+    server_update(srv, conn);
+}
+
+/**
+ * Handle epoll events on a pty master
+ */
+static void server_pty_event(server_t *srv, server_conn_t *conn, uint32_t events)
+{
+    ssize_t ret = SUCCESS;
+
+    if ((events & EPOLLOUT) && iobuf_write_fd(&conn->to_pty, conn->pty_fd) < 0) {
+        ret = (errno == EIO) ? ERROR_CONNECTION : ERROR_IO;
+    }
+
+    if (ret >= 0 && (events & EPOLLHUP)) {
+        /* Program ended: what is left in the pty is bounded, take it all */
+        do {
+            ret = server_pty_read(srv, conn);
+        } while (ret > 0);
+        if (ret == 0) {
+            ret = ERROR_CONNECTION;
+        }
+    } else if (ret >= 0 && (events & (EPOLLIN | EPOLLERR))) {
+        ret = server_pty_read(srv, conn);
+    }
+
+    if (ret == ERROR_CONNECTION) {
+        MB_LOG_DEBUG("Server: program of %s:%d ended", conn->tn.cold->host, conn->tn.cold->port);
+        close(conn->pty_fd);
+        conn->pty_fd = -1;
+        conn->closing = true;
+    } else if (ret < 0) {
+        server_close_conn(srv, conn);
+        return;
+    }
+
+    server_update(srv, conn);
+}
+
+/**
+ * Serve clients until SIGINT or SIGTERM
+ */
+int server_run(server_t *srv)
+{
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    struct sigaction sa;
+    int timeout = -1;
+    int ret = SUCCESS;
+
+    /* No SA_RESTART: a signal ends epoll_wait() */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = server_signal_handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    /* Wakes epoll_wait() to collect programs hung up with nothing else to do */
+    sa.sa_handler = server_child_handler;
+    sigaction(SIGCHLD, &sa, NULL);
+
+    while (!g_server_stop) {
+        int n = epoll_wait(srv->epoll_fd, events, SERVER_MAX_EVENTS, timeout);
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                server_reap(srv);
+                continue;
+            }
+            MB_LOG_ERROR("epoll_wait failed: %s", strerror(errno));
+            ret = ERROR_IO;
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            server_ref_t *ref = events[i].data.ptr;
+
+            if (ref == NULL) {
+                server_accept(srv);
+            } else if (ref->conn->dead) {
+                /* Closed earlier in this batch */
+                continue;
+            } else if (ref->watch == SERVER_WATCH_CLIENT) {
+                server_client_event(srv, ref->conn, events[i].events);
+            } else {
+                server_pty_event(srv, ref->conn, events[i].events);
+            }
+        }
+
+        timeout = (srv->starting > 0) ? server_check_starting(srv) : -1;
+        server_reap(srv);
+    }
+
+    MB_LOG_INFO("Server stopped: %llu clients served, %zu at most at once",
+                srv->served, srv->peak);
+
+    return ret;
+}
+
+/**
+ * Hang up every client and stop listening
+ */
+void server_close(server_t *srv)
+{
+    while (srv->open != NULL) {
+        server_close_conn(srv, srv->open);
+    }
+    server_reap(srv);
+    pool_destroy(&srv->conns);
+
+    if (srv->listen_fd >= 0) {
+        close(srv->listen_fd);
+        srv->listen_fd = -1;
+    }
+    if (srv->spare_fd >= 0) {
+        close(srv->spare_fd);
+        srv->spare_fd = -1;
+    }
+    if (srv->epoll_fd >= 0) {
+        close(srv->epoll_fd);
+        srv->epoll_fd = -1;
+    }
+}
@@ -0,0 +1,304 @@
+/*
+ * session.c - Detachable sessions (otelnet -D / otelnet -A)
+ */
+
+#include "session.h"
+#include "telnet.h"
+#include <poll.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/* Attach client signal flags */
+static volatile sig_atomic_t g_session_winch = 0;
+static volatile sig_atomic_t g_session_stop = 0;
+
+/**
+ * Fill in a Unix socket address
+ */
+static int session_addr(const char *path, struct sockaddr_un *addr)
+{
+    if (path == NULL || strlen(path) >= sizeof(addr->sun_path)) {
+        MB_LOG_ERROR("Session socket path too long: %s", path ? path : "(null)");
+        return ERROR_INVALID_ARG;
+    }
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    SAFE_STRNCPY(addr->sun_path, path, sizeof(addr->sun_path));
+
+    return SUCCESS;
+}
+
+/**
+ * Create the session socket
+ */
+int session_listen(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (session_addr(path, &addr) != SUCCESS) {
+        return ERROR_IO;
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        MB_LOG_ERROR("Failed to create session socket: %s", strerror(errno));
+        return ERROR_IO;
+    }
+
+    int ret = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    if (ret < 0 && errno == EADDRINUSE) {
+        /* Someone still answering there is a live session; otherwise it is stale */
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool live = probe >= 0 && connect(probe, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+
+        if (probe >= 0) {
+            close(probe);
+        }
+        if (live) {
+            close(fd);
+            return ERROR_CONNECTION;
+        }
+        unlink(path);
+        ret = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    }
+
+    /* Sessions carry a terminal: keep them to this user */
+    if (ret < 0 || chmod(path, 0600) < 0 || listen(fd, 4) < 0) {
+        MB_LOG_ERROR("Failed to listen on %s: %s", path, strerror(errno));
+        close(fd);
+        return ERROR_IO;
+    }
+
+    MB_LOG_INFO("Session socket %s", path);
+
+    return fd;
+}
+
+/**
+ * Accept an attaching client
+ */
+int session_accept(int listen_fd)
+{
+    struct ucred cred = { .pid = 0, .uid = (uid_t)-1, .gid = (gid_t)-1 };
+    socklen_t cred_len = sizeof(cred);
+    int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+    if (fd < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            MB_LOG_ERROR("Failed to accept session client: %s", strerror(errno));
+        }
+        return ERROR_IO;
+    }
+
+    /* The socket mode is the first guard; the peer's credentials the second */
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) < 0 || cred.uid != getuid()) {
+        MB_LOG_WARNING("Refusing session client of another user (uid %d)", (int)cred.uid);
+        close(fd);
+        return ERROR_IO;
+    }
+
+    return fd;
+}
+
+/**
+ * Close every descriptor a received message carried
+ */
+static void session_close_rights(struct msghdr *msg)
+{
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            int fd;
+
+            for (size_t i = 0; i < count; i++) {
+                memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(fd));
+                close(fd);
+            }
+        }
+    }
+}
+
+/**
+ * Read an accepted client's attach request
+ */
+int session_read_attach(int fd, int *in_fd, int *out_fd)
+{
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(2 * sizeof(int))];
+    } control;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    char type = 0;
+    ssize_t n;
+    int fds[2];
+
+    /* The client sends its terminal right after the connect */
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = &type;
+    iov.iov_len = 1;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return 1;
+    }
+    if (n < 0) {
+        MB_LOG_WARNING("Failed to read session client: %s", strerror(errno));
+        return ERROR_IO;
+    }
+    if (n != 1 || type != SESSION_MSG_ATTACH) {
+        MB_LOG_WARNING("Session client sent no attach request");
+        session_close_rights(&msg);
+        return ERROR_IO;
+    }
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if ((msg.msg_flags & MSG_CTRUNC) || cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET ||
+        cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(2 * sizeof(int))) {
+        MB_LOG_WARNING("Session client sent no terminal");
+        session_close_rights(&msg);
+        return ERROR_IO;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+    *in_fd = fds[0];
+    *out_fd = fds[1];
+
+    return SUCCESS;
+}
+
+/**
+ * Send a control message
+ */
+int session_send(int fd, char msg)
+{
+    if (fd < 0 || send(fd, &msg, 1, MSG_NOSIGNAL) != 1) {
+        return ERROR_IO;
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * Attach client signal handler
+ */
+static void session_signal_handler(int signum)
+{
+    if (signum == SIGWINCH) {
+        g_session_winch = 1;
+    } else {
+        g_session_stop = 1;
+    }
+}
+
+/**
+ * Attach this terminal to a session and wait until it is handed back
+ */
+int session_attach(const char *path)
+{
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(2 * sizeof(int))];
+    } control;
+    struct sockaddr_un addr;
+    struct sigaction sa;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    sigset_t block, orig;
+    char type = SESSION_MSG_ATTACH;
+    int fds[2] = { STDIN_FILENO, STDOUT_FILENO };
+    int ret = SESSION_MSG_DETACHED;
+    int fd;
+
+    if (!isatty(STDIN_FILENO)) {
+        return ERROR_INVALID_ARG;
+    }
+
+    if (session_addr(path, &addr) != SUCCESS) {
+        return ERROR_CONNECTION;
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return ERROR_CONNECTION;
+    }
+
+    /* Hand over the terminal */
+    memset(&msg, 0, sizeof(msg));
+    memset(&control, 0, sizeof(control));
+    iov.iov_base = &type;
+    iov.iov_len = 1;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    if (sendmsg(fd, &msg, MSG_NOSIGNAL) != 1) {
+        close(fd);
+        return ERROR_CONNECTION;
+    }
+
+    /* Signals are only taken inside ppoll(), so none is missed between checks */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = session_signal_handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGWINCH, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+    sigemptyset(&block);
+    sigaddset(&block, SIGWINCH);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    sigaddset(&block, SIGHUP);
+    sigprocmask(SIG_BLOCK, &block, &orig);
+
+    while (!g_session_stop) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        char reply;
+
+        if (g_session_winch) {
+            g_session_winch = 0;
+            session_send(fd, SESSION_MSG_WINCH);
+        }
+
+        if (ppoll(&pfd, 1, NULL, &orig) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        /* The session lets go of the terminal before it answers or closes */
+        ssize_t n = read(fd, &reply, 1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n == 1 && reply == SESSION_MSG_ENDED) {
+            ret = SESSION_MSG_ENDED;
+        }
+        break;
+    }
+
+    sigprocmask(SIG_SETMASK, &orig, NULL);
+    close(fd);
+
+    return ret;
+}
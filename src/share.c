@@ -0,0 +1,402 @@
+/*
+ * share.c - Read-only spectators of a session (SPECTATE)
+ */
+
+#include "share.h"
+#include "session.h"
+#include "telnet.h"
+#include <ctype.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+/* Entries handed to one writev() */
+#define SHARE_IOV_MAX   16
+
+/**
+ * Drop a reference to a chunk
+ */
+static void share_chunk_put(share_t *sh, share_chunk_t *chunk)
+{
+    if (--chunk->refs > 0) {
+        return;
+    }
+
+    if (sh->last == chunk) {
+        sh->last = NULL;
+    }
+    pool_buf_put(chunk, chunk->cap);
+}
+
+/**
+ * Disconnect a spectator and release its queue
+ */
+static void share_drop_viewer(share_t *sh, share_viewer_t *v)
+{
+    while (v->count > 0) {
+        share_chunk_put(sh, v->queue[v->head].chunk);
+        v->head = (v->head + 1) % SHARE_QUEUE_SLOTS;
+        v->count--;
+    }
+
+    close(v->fd);
+    v->fd = -1;
+    v->queued = 0;
+    v->skipped = 0;
+    sh->count--;
+
+    MB_LOG_INFO("Spectator left (%zu watching)", sh->count);
+}
+
+/**
+ * Initialize the hub
+ */
+void share_init(share_t *sh)
+{
+    memset(sh, 0, sizeof(*sh));
+    sh->listen_fd = -1;
+    sh->queue_limit = SHARE_QUEUE_DEFAULT;
+
+    for (size_t i = 0; i < SHARE_MAX_VIEWERS; i++) {
+        sh->viewers[i].fd = -1;
+    }
+}
+
+/**
+ * Start accepting spectators
+ */
+int share_open(share_t *sh, const char *spec, size_t queue_limit, bool disconnect_slow)
+{
+    const char *p = spec;
+    int fd;
+
+    while (isdigit((unsigned char)*p)) {
+        p++;
+    }
+
+    if (*p == '\0' && p != spec) {
+        /* Port number: loopback only, spectators are local users */
+        struct sockaddr_in addr;
+        int one = 1;
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons((uint16_t)atoi(spec));
+
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            MB_LOG_ERROR("Failed to create spectator socket: %s", strerror(errno));
+            return ERROR_IO;
+        }
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0) {
+            MB_LOG_ERROR("Failed to listen on 127.0.0.1:%s: %s", spec, strerror(errno));
+            close(fd);
+            return ERROR_IO;
+        }
+    } else {
+        fd = session_listen(spec);
+        if (fd < 0) {
+            return ERROR_IO;
+        }
+        /* Colleagues in the owner's group may watch */
+        chmod(spec, 0660);
+        SAFE_STRNCPY(sh->path, spec, sizeof(sh->path));
+    }
+
+    sh->listen_fd = fd;
+    sh->queue_limit = queue_limit;
+    sh->disconnect_slow = disconnect_slow;
+
+    MB_LOG_INFO("Spectators on %s (queue %zu bytes, slow spectators %s)", spec, queue_limit,
+                disconnect_slow ? "disconnected" : "skip output");
+
+    return SUCCESS;
+}
+
+/**
+ * Disconnect all spectators and stop listening
+ */
+void share_close(share_t *sh)
+{
+    for (size_t i = 0; i < SHARE_MAX_VIEWERS; i++) {
+        if (sh->viewers[i].fd >= 0) {
+            share_drop_viewer(sh, &sh->viewers[i]);
+        }
+    }
+
+    if (sh->listen_fd >= 0) {
+        close(sh->listen_fd);
+        sh->listen_fd = -1;
+        if (sh->path[0] != '\0') {
+            unlink(sh->path);
+        }
+    }
+}
+
+/**
+ * Accept a spectator
+ */
+share_viewer_t *share_accept(share_t *sh)
+{
+    int fd = accept4(sh->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+    if (fd < 0) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < SHARE_MAX_VIEWERS; i++) {
+        share_viewer_t *v = &sh->viewers[i];
+
+        if (v->fd < 0) {
+            v->fd = fd;
+            v->head = 0;
+            v->count = 0;
+            v->queued = 0;
+            v->skipped = 0;
+            sh->count++;
+            sh->served++;
+            MB_LOG_INFO("Spectator joined (%zu watching)", sh->count);
+            return v;
+        }
+    }
+
+    MB_LOG_WARNING("Spectator refused: %d already watching", SHARE_MAX_VIEWERS);
+    close(fd);
+
+    return NULL;
+}
+
+/**
+ * Spectator fell behind: skip its output until it catches up, or let it go
+ */
+static void share_viewer_behind(share_t *sh, share_viewer_t *v, size_t len)
+{
+    if (sh->disconnect_slow) {
+        MB_LOG_WARNING("Spectator too slow (%zu bytes queued), disconnecting", v->queued);
+        sh->slow_disconnects++;
+        share_drop_viewer(sh, v);
+        return;
+    }
+
+    if (v->skipped == 0) {
+        MB_LOG_DEBUG("Spectator behind (%zu bytes queued), skipping output", v->queued);
+    }
+    v->skipped += len;
+    sh->skipped_bytes += len;
+}
+
+/**
+ * Store this push's bytes once for every spectator that needs to queue them
+ * Appends to the last chunk while it has room, else starts a new one.
+ * @return Offset of the bytes in *chunk, or (size_t)-1 if out of memory
+ */
+static size_t share_store(share_t *sh, const void *data, size_t len, share_chunk_t **chunk)
+{
+    share_chunk_t *c = sh->last;
+    size_t at;
+
+    if (c == NULL || c->cap - sizeof(*c) - c->len < len) {
+        size_t cap;
+
+        c = pool_buf_get(sizeof(*c) + MAX(len, POOL_BUF_MAX - sizeof(*c)), &cap);
+        if (c == NULL) {
+            return (size_t)-1;
+        }
+        c->refs = 0;
+        c->cap = cap;
+        c->len = 0;
+        sh->last = c;
+    }
+
+    at = c->len;
+    memcpy(c->data + at, data, len);
+    c->len += len;
+    *chunk = c;
+
+    return at;
+}
+
+/**
+ * Send output to spectators
+ */
+void share_push(share_t *sh, share_viewer_t *only, const void *data, size_t len)
+{
+    share_chunk_t *chunk = NULL;
+    size_t at = 0;
+
+    if (sh->count == 0 || len == 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < SHARE_MAX_VIEWERS; i++) {
+        share_viewer_t *v = &sh->viewers[i];
+        size_t done = 0;
+
+        if (v->fd < 0 || (only != NULL && v != only)) {
+            continue;
+        }
+
+        /* Behind: nothing more until the backlog is gone */
+        if (v->skipped > 0) {
+            share_viewer_behind(sh, v, len);
+            continue;
+        }
+
+        /* Caught up: write straight through */
+        if (v->count == 0) {
+            ssize_t n = send(v->fd, data, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                share_drop_viewer(sh, v);
+                continue;
+            }
+            done = (n > 0) ? (size_t)n : 0;
+            if (done == len) {
+                continue;
+            }
+        }
+
+        if (v->queued + len - done > sh->queue_limit) {
+            share_viewer_behind(sh, v, len - done);
+            continue;
+        }
+
+        /* Copy once per push, shared by every spectator that queues it */
+        if (chunk == NULL) {
+            at = share_store(sh, data, len, &chunk);
+            if (at == (size_t)-1) {
+                chunk = NULL;
+                share_viewer_behind(sh, v, len - done);
+                continue;
+            }
+        }
+
+        share_entry_t *tail = (v->count > 0) ?
+            &v->queue[(v->head + v->count - 1) % SHARE_QUEUE_SLOTS] : NULL;
+        if (tail != NULL && tail->chunk == chunk && tail->end == at) {
+            tail->end = at + len;
+        } else if (v->count < SHARE_QUEUE_SLOTS) {
+            share_entry_t *e = &v->queue[(v->head + v->count) % SHARE_QUEUE_SLOTS];
+            e->chunk = chunk;
+            e->start = at + done;
+            e->end = at + len;
+            chunk->refs++;
+            v->count++;
+        } else {
+            share_viewer_behind(sh, v, len - done);
+            continue;
+        }
+        v->queued += len - done;
+    }
+
+    /* Nobody kept a reference (all dropped on the way) */
+    if (chunk != NULL && chunk->refs == 0) {
+        chunk->refs = 1;
+        share_chunk_put(sh, chunk);
+    }
+}
+
+/**
+ * Send a spectator's queued output
+ */
+static void share_flush(share_t *sh, share_viewer_t *v)
+{
+    struct iovec iov[SHARE_IOV_MAX];
+    size_t n_iov = 0;
+    ssize_t n;
+
+    for (size_t i = 0; i < v->count && n_iov < SHARE_IOV_MAX; i++) {
+        share_entry_t *e = &v->queue[(v->head + i) % SHARE_QUEUE_SLOTS];
+        iov[n_iov].iov_base = e->chunk->data + e->start;
+        iov[n_iov].iov_len = e->end - e->start;
+        n_iov++;
+    }
+
+    n = writev(v->fd, iov, (int)n_iov);
+    if (n < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            share_drop_viewer(sh, v);
+        }
+        return;
+    }
+
+    v->queued -= (size_t)n;
+    while (n > 0) {
+        share_entry_t *e = &v->queue[v->head];
+        size_t span = MIN((size_t)n, e->end - e->start);
+
+        e->start += span;
+        n -= (ssize_t)span;
+        if (e->start == e->end) {
+            share_chunk_put(sh, e->chunk);
+            v->head = (v->head + 1) % SHARE_QUEUE_SLOTS;
+            v->count--;
+        }
+    }
+
+    /* Caught up after skipping: say so, then carry on live */
+    if (v->count == 0 && v->skipped > 0) {
+        char note[SMALL_BUFFER_SIZE];
+        int len = snprintf(note, sizeof(note), "\r\n[otelnet: %llu bytes skipped]\r\n",
+                           (unsigned long long)v->skipped);
+
+        v->skipped = 0;
+        share_push(sh, v, note, (size_t)len);
+    }
+}
+
+/**
+ * Add the listening socket and spectators to select() sets
+ */
+int share_fill_fds(share_t *sh, fd_set *readfds, fd_set *writefds, int maxfd)
+{
+    if (sh->listen_fd < 0) {
+        return maxfd;
+    }
+
+    FD_SET(sh->listen_fd, readfds);
+    maxfd = MAX(maxfd, sh->listen_fd);
+
+    for (size_t i = 0; i < SHARE_MAX_VIEWERS; i++) {
+        share_viewer_t *v = &sh->viewers[i];
+
+        if (v->fd < 0) {
+            continue;
+        }
+        FD_SET(v->fd, readfds);
+        if (v->count > 0 || v->skipped > 0) {
+            FD_SET(v->fd, writefds);
+        }
+        maxfd = MAX(maxfd, v->fd);
+    }
+
+    return maxfd;
+}
+
+/**
+ * Flush queued output and drop closed spectators after select()
+ */
+void share_service(share_t *sh, fd_set *readfds, fd_set *writefds)
+{
+    for (size_t i = 0; i < SHARE_MAX_VIEWERS; i++) {
+        share_viewer_t *v = &sh->viewers[i];
+
+        if (v->fd < 0) {
+            continue;
+        }
+
+        /* Read-only: input is discarded, EOF means the spectator left */
+        if (FD_ISSET(v->fd, readfds)) {
+            char discard[SMALL_BUFFER_SIZE];
+            ssize_t n = recv(v->fd, discard, sizeof(discard), MSG_DONTWAIT);
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                share_drop_viewer(sh, v);
+                continue;
+            }
+        }
+
+        if (FD_ISSET(v->fd, writefds)) {
+            share_flush(sh, v);
+        }
+    }
+}
@@ -3,44 +3,117 @@
  */
 
 #include "telnet.h"
+#include "charset.h"
+#include "comport.h"
+#include "pool.h"
+
+/* Slab pool for cold blocks */
+static pool_t telnet_cold_pool;
+
+/**
+ * Allocate a zeroed cold block
+ */
+static telnet_cold_t *telnet_cold_alloc(void)
+{
+    if (telnet_cold_pool.obj_size == 0) {
+        pool_init(&telnet_cold_pool, sizeof(telnet_cold_t), 0);
+    }
+
+    return pool_alloc(&telnet_cold_pool);
+}
+
+/**
+ * Return a cold block to the pool
+ */
+static void telnet_cold_free(telnet_cold_t *cold)
+{
+    pool_free(&telnet_cold_pool, cold);
+}
+
+/**
+ * Return the subnegotiation buffer to the buffer pool
+ */
+static void telnet_sb_release(telnet_t *tn)
+{
+    pool_buf_put(tn->sb_buffer, TELNET_SB_MAX);
+    tn->sb_buffer = NULL;
+    tn->sb_len = 0;
+}
 
 /**
  * Initialize telnet structure
  */
-void telnet_init(telnet_t *tn)
+int telnet_init(telnet_t *tn)
 {
     if (tn == NULL) {
-        return;
+        return ERROR_INVALID_ARG;
     }
 
     memset(tn, 0, sizeof(telnet_t));
     tn->fd = -1;
+    tn->transport.fd = -1;
     tn->is_connected = false;
     tn->state = TELNET_STATE_DATA;
 
-    /* Initialize option tracking */
-    memset(tn->local_options, 0, sizeof(tn->local_options));
-    memset(tn->remote_options, 0, sizeof(tn->remote_options));
+    /* Cold block: host, terminal and COM port data */
+    tn->cold = telnet_cold_alloc();
+    if (tn->cold == NULL) {
+        MB_LOG_ERROR("Failed to allocate telnet state");
+        return ERROR_GENERAL;
+    }
 
     /* Set default options we support */
-    tn->local_options[TELOPT_BINARY] = true;
-    tn->local_options[TELOPT_SGA] = true;
+    telnet_opt_set(&tn->local_options, TELOPT_BINARY, true);
+    telnet_opt_set(&tn->local_options, TELOPT_SGA, true);
 
     /* Default to line mode until server requests character mode */
     tn->linemode = true;
 
     /* Set default terminal type and initialize cycle index */
-    SAFE_STRNCPY(tn->terminal_type, "XTERM", sizeof(tn->terminal_type));
-    tn->ttype_index = 0;
+    SAFE_STRNCPY(tn->cold->terminal_type, "XTERM", sizeof(tn->cold->terminal_type));
+    tn->cold->ttype_index = 0;
 
     /* Set default terminal size (RFC 1073) */
-    tn->term_width = 80;
-    tn->term_height = 24;
+    tn->cold->term_width = 80;
+    tn->cold->term_height = 24;
 
     /* Set default terminal speed (RFC 1079) */
-    SAFE_STRNCPY(tn->terminal_speed, "38400,38400", sizeof(tn->terminal_speed));
+    SAFE_STRNCPY(tn->cold->terminal_speed, "38400,38400", sizeof(tn->cold->terminal_speed));
+
+    /* Remote charset is UTF-8 until configured or negotiated (RFC 2066) */
+    tn->charset = CHARSET_UTF8;
+    tn->charset_preferred = CHARSET_INVALID;
+
+    /* Outbound queues; data is held while the remote has paused us (RFC 1372/2217) */
+    for (int i = 0; i < TELNET_OUT_CLASSES; i++) {
+        iobuf_init(&tn->outq[i], TELNET_OUTQ_LIMIT);
+    }
+    tn->out_split = TELNET_OUT_CLASSES;
 
     MB_LOG_DEBUG("Telnet initialized");
+
+    return SUCCESS;
+}
+
+/**
+ * Release memory owned by a telnet structure
+ */
+void telnet_free(telnet_t *tn)
+{
+    if (tn == NULL) {
+        return;
+    }
+
+    if (tn->is_connected) {
+        telnet_disconnect(tn);
+    }
+
+    telnet_sb_release(tn);
+    for (int i = 0; i < TELNET_OUT_CLASSES; i++) {
+        iobuf_free(&tn->outq[i]);
+    }
+    telnet_cold_free(tn->cold);
+    tn->cold = NULL;
 }
 
 /**
@@ -48,8 +121,7 @@ void telnet_init(telnet_t *tn)
  */
 int telnet_connect(telnet_t *tn, const char *host, int port)
 {
-    struct sockaddr_in server_addr;
-    struct hostent *he;
+    transport_t tp;
 
     if (tn == NULL || host == NULL) {
         MB_LOG_ERROR("Invalid arguments to telnet_connect");
@@ -63,51 +135,36 @@ int telnet_connect(telnet_t *tn, const char *host, int port)
 
     MB_LOG_INFO("Connecting to telnet server: %s:%d", host, port);
 
-    /* Create socket */
-    tn->fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (tn->fd < 0) {
-        MB_LOG_ERROR("Failed to create socket: %s", strerror(errno));
+    if (transport_open(&tp, host, port) != SUCCESS) {
         return ERROR_CONNECTION;
     }
 
-    /* Set non-blocking mode */
-    int flags = fcntl(tn->fd, F_GETFL, 0);
-    if (flags >= 0) {
-        fcntl(tn->fd, F_SETFL, flags | O_NONBLOCK);
-    }
-
-    /* Resolve hostname */
-    he = gethostbyname(host);
-    if (he == NULL) {
-        MB_LOG_ERROR("Failed to resolve host: %s", host);
-        close(tn->fd);
-        tn->fd = -1;
-        return ERROR_CONNECTION;
-    }
+    /* Save connection info */
+    SAFE_STRNCPY(tn->cold->host, host, sizeof(tn->cold->host));
+    tn->cold->port = port;
 
-    /* Setup server address */
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(port);
-    memcpy(&server_addr.sin_addr, he->h_addr_list[0], he->h_length);
+    return telnet_attach(tn, &tp);
+}
 
-    /* Connect to server */
-    if (connect(tn->fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
-        if (errno != EINPROGRESS) {
-            MB_LOG_ERROR("Failed to connect: %s", strerror(errno));
-            close(tn->fd);
-            tn->fd = -1;
-            return ERROR_CONNECTION;
-        }
-        /* Connection in progress for non-blocking socket */
+/**
+ * Start a session over an already open transport
+ */
+int telnet_attach(telnet_t *tn, const transport_t *tp)
+{
+    if (tn == NULL || tp == NULL || tp->ops == NULL) {
+        return ERROR_INVALID_ARG;
     }
 
-    /* Save connection info */
-    SAFE_STRNCPY(tn->host, host, sizeof(tn->host));
-    tn->port = port;
+    tn->transport = *tp;
+    tn->fd = tp->fd;
     tn->is_connected = true;
 
-    MB_LOG_INFO("Connected to telnet server");
+    MB_LOG_INFO("Connected to telnet server (%s)", transport_name(tp->type));
+
+    /* A serial device rarely speaks telnet: only answer what it asks for */
+    if (tp->type == TRANSPORT_SERIAL) {
+        return SUCCESS;
+    }
 
     /* Send initial option negotiations */
     telnet_send_negotiate(tn, TELNET_WILL, TELOPT_BINARY);
@@ -130,6 +187,140 @@ int telnet_connect(telnet_t *tn, const char *host, int port)
     /* Offer LINEMODE support (RFC 1184) - character mode by default */
     telnet_send_negotiate(tn, TELNET_WILL, TELOPT_LINEMODE);
 
+    /* Offer COM-PORT-OPTION (RFC 2217) for serial console servers */
+    if (tn->cold->comport.offer) {
+        telnet_send_negotiate(tn, TELNET_WILL, TELOPT_COMPORT);
+    }
+
+    /* Offer CHARSET support (RFC 2066) only if a charset is configured */
+    if (tn->charset_preferred != CHARSET_INVALID) {
+        telnet_send_negotiate(tn, TELNET_WILL, TELOPT_CHARSET);
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * Serve a client over an accepted transport
+ */
+int telnet_accept(telnet_t *tn, const transport_t *tp, bool echo)
+{
+    if (tn == NULL || tp == NULL || tp->ops == NULL) {
+        return ERROR_INVALID_ARG;
+    }
+
+    tn->transport = *tp;
+    tn->fd = tp->fd;
+    tn->is_connected = true;
+    tn->server = true;
+    tn->echo_offer = echo;
+
+    /* Nothing is enabled until the client agrees (so DO BINARY sets binary_local) */
+    memset(&tn->local_options, 0, sizeof(tn->local_options));
+
+    MB_LOG_INFO("Serving telnet client (%s)", transport_name(tp->type));
+
+    telnet_send_negotiate(tn, TELNET_WILL, TELOPT_SGA);
+    if (echo) {
+        telnet_send_negotiate(tn, TELNET_WILL, TELOPT_ECHO);
+    }
+    telnet_send_negotiate(tn, TELNET_WILL, TELOPT_BINARY);
+    telnet_send_negotiate(tn, TELNET_DO, TELOPT_BINARY);
+
+    /* Window size (RFC 1073) and terminal type (RFC 1091) */
+    telnet_send_negotiate(tn, TELNET_DO, TELOPT_NAWS);
+    telnet_send_negotiate(tn, TELNET_DO, TELOPT_TTYPE);
+
+    return SUCCESS;
+}
+
+/**
+ * Offer or withdraw server-side echo
+ */
+int telnet_set_echo(telnet_t *tn, bool on)
+{
+    if (tn == NULL || !tn->server) {
+        return ERROR_INVALID_ARG;
+    }
+
+    tn->echo_offer = on;
+    if (on == tn->echo_local) {
+        return SUCCESS;
+    }
+
+    /* Echo starts when the client answers DO ECHO; it stops right away */
+    if (!on) {
+        telnet_opt_set(&tn->local_options, TELOPT_ECHO, false);
+        tn->echo_local = false;
+    }
+
+    return telnet_send_negotiate(tn, on ? TELNET_WILL : TELNET_WONT, TELOPT_ECHO);
+}
+
+/**
+ * Return negotiated state to what telnet_init() set up, keeping configuration
+ */
+static void telnet_reset_negotiation(telnet_t *tn)
+{
+    memset(&tn->local_options, 0, sizeof(tn->local_options));
+    memset(&tn->remote_options, 0, sizeof(tn->remote_options));
+    telnet_opt_set(&tn->local_options, TELOPT_BINARY, true);
+    telnet_opt_set(&tn->local_options, TELOPT_SGA, true);
+
+    tn->binary_remote = false;
+    tn->binary_local = false;
+    tn->echo_remote = false;
+    tn->echo_local = false;
+    tn->sga_remote = false;
+    tn->sga_local = false;
+    tn->linemode = true;
+    tn->linemode_active = false;
+    tn->linemode_edit = false;
+    tn->lflow_restart_any = false;
+    tn->prompt_marks = false;
+    tn->mark_count = 0;
+    tn->mark_offset = 0;
+    tn->decoder = NULL;
+    tn->cold->ttype_index = 0;
+    tn->charset = (tn->charset_preferred != CHARSET_INVALID) ? tn->charset_preferred : CHARSET_UTF8;
+}
+
+/**
+ * Connect again after the connection was lost
+ */
+int telnet_reconnect(telnet_t *tn, const char *host, int port)
+{
+    /* Options a server enables on request (see telnet_handle_negotiate) */
+    static const unsigned char requestable[] = {TELOPT_BINARY, TELOPT_EOR, TELOPT_CHARSET};
+    int ret;
+
+    if (tn == NULL || host == NULL) {
+        return ERROR_INVALID_ARG;
+    }
+
+    /* Remember what the last session's server enabled; an attempt that
+     * failed before negotiating anything keeps the older cache */
+    const uint64_t *bits = tn->remote_options.bits;
+    if ((bits[0] | bits[1] | bits[2] | bits[3]) != 0) {
+        tn->cold->remote_cached = tn->remote_options;
+    }
+
+    telnet_disconnect(tn);
+    telnet_reset_negotiation(tn);
+
+    ret = telnet_connect(tn, host, port);
+    if (ret != SUCCESS || tn->transport.type == TRANSPORT_SERIAL) {
+        return ret;
+    }
+
+    /* Ask for them in the first flight instead of waiting for offers */
+    for (size_t i = 0; i < sizeof(requestable); i++) {
+        if (telnet_opt_isset(&tn->cold->remote_cached, requestable[i])) {
+            MB_LOG_DEBUG("Requesting cached option %d", requestable[i]);
+            telnet_send_negotiate(tn, TELNET_DO, requestable[i]);
+        }
+    }
+
     return SUCCESS;
 }
 
@@ -142,25 +333,49 @@ int telnet_disconnect(telnet_t *tn)
         return ERROR_INVALID_ARG;
     }
 
-    if (!tn->is_connected || tn->fd < 0) {
+    /* Also closes a transport the server already hung up (see telnet_recv) */
+    if (tn->transport.ops == NULL) {
         return SUCCESS;
     }
 
-    MB_LOG_INFO("Disconnecting from telnet server: %s:%d", tn->host, tn->port);
+    MB_LOG_INFO("Disconnecting from telnet server: %s:%d", tn->cold->host, tn->cold->port);
 
-    close(tn->fd);
+    transport_close(&tn->transport);
     tn->fd = -1;
     tn->is_connected = false;
 
     /* Reset state */
     tn->state = TELNET_STATE_DATA;
-    tn->sb_len = 0;
+    telnet_sb_release(tn);
+    tn->cold->comport.enabled = false;
+    tn->cold->comport.suspended = false;
+    tn->cold->comport.remote_suspended = false;
+    tn->cold->comport.break_on = false;
+    tn->lflow_enabled = false;
+    tn->output_paused = false;
+    tn->synch = false;
+    tn->timing_mark = false;
+    for (int i = 0; i < TELNET_OUT_CLASSES; i++) {
+        iobuf_free(&tn->outq[i]);
+    }
+    tn->out_urgent = 0;
+    tn->out_split = TELNET_OUT_CLASSES;
 
     MB_LOG_INFO("Telnet disconnected");
 
     return SUCCESS;
 }
 
+/**
+ * Queue control data ahead of user data and send as much as possible
+ */
+static int telnet_queue_control(telnet_t *tn, const void *data, size_t len)
+{
+    ssize_t sent = telnet_queue_output(tn, TELNET_OUT_CONTROL, data, len);
+
+    return (sent < 0) ? (int)sent : SUCCESS;
+}
+
 /**
  * Send IAC command
  */
@@ -168,7 +383,7 @@ int telnet_send_command(telnet_t *tn, unsigned char command)
 {
     unsigned char buf[2];
 
-    if (tn == NULL || tn->fd < 0) {
+    if (tn == NULL || tn->transport.ops == NULL) {
         return ERROR_INVALID_ARG;
     }
 
@@ -177,14 +392,7 @@ int telnet_send_command(telnet_t *tn, unsigned char command)
 
     MB_LOG_DEBUG("Sending IAC command: %d", command);
 
-    if (send(tn->fd, buf, 2, 0) < 0) {
-        if (errno != EAGAIN && errno != EWOULDBLOCK) {
-            MB_LOG_ERROR("Failed to send IAC command: %s", strerror(errno));
-            return ERROR_IO;
-        }
-    }
-
-    return SUCCESS;
+    return telnet_queue_control(tn, buf, 2);
 }
 
 /**
@@ -194,7 +402,7 @@ int telnet_send_negotiate(telnet_t *tn, unsigned char command, unsigned char opt
 {
     unsigned char buf[3];
 
-    if (tn == NULL || tn->fd < 0) {
+    if (tn == NULL || tn->transport.ops == NULL) {
         return ERROR_INVALID_ARG;
     }
 
@@ -204,16 +412,26 @@ int telnet_send_negotiate(telnet_t *tn, unsigned char command, unsigned char opt
 
     MB_LOG_DEBUG("Sending IAC negotiation: %d %d", command, option);
 
-    if (send(tn->fd, buf, 3, 0) < 0) {
-        if (errno != EAGAIN && errno != EWOULDBLOCK) {
-            MB_LOG_ERROR("Failed to send negotiation: %s", strerror(errno));
-            return ERROR_IO;
-        }
+    return telnet_queue_control(tn, buf, 3);
+}
+
+/**
+ * Send IAC DO TIMING-MARK
+ */
+int telnet_send_timing_mark(telnet_t *tn)
+{
+    int ret = telnet_send_negotiate(tn, TELNET_DO, TELOPT_TIMING_MARK);
+
+    if (ret == SUCCESS) {
+        tn->timing_mark = true;
     }
 
-    return SUCCESS;
+    return ret;
 }
 
+static int telnet_send_charset_request(telnet_t *tn);
+static void telnet_select_decoder(telnet_t *tn);
+
 /**
  * Update line mode vs character mode based on current options
  */
@@ -227,10 +445,8 @@ static void telnet_update_mode(telnet_t *tn)
 
     old_linemode = tn->linemode;
 
-    /* Update deprecated combined flags for compatibility */
-    tn->binary_mode = tn->binary_local || tn->binary_remote;
-    tn->sga_mode = tn->sga_local || tn->sga_remote;
-    tn->echo_mode = tn->echo_remote;
+    /* Receive path: pick the decoder variant for BINARY/NVT */
+    telnet_select_decoder(tn);
 
     /* Character mode: Server echoes (WILL ECHO) and SGA enabled
      * Line mode: Client echoes (WONT ECHO) or no echo negotiation
@@ -252,6 +468,37 @@ static void telnet_update_mode(telnet_t *tn)
     }
 }
 
+/**
+ * Check whether the remote may enable an option (WILL)
+ */
+static bool telnet_remote_option_ok(const telnet_t *tn, unsigned char option)
+{
+    if (tn->server) {
+        return option == TELOPT_BINARY || option == TELOPT_SGA ||
+               option == TELOPT_TTYPE || option == TELOPT_NAWS;
+    }
+
+    return option == TELOPT_BINARY || option == TELOPT_SGA || option == TELOPT_ECHO ||
+           option == TELOPT_CHARSET || option == TELOPT_EOR;
+}
+
+/**
+ * Check whether we enable an option when asked (DO)
+ */
+static bool telnet_local_option_ok(const telnet_t *tn, unsigned char option)
+{
+    if (tn->server) {
+        return option == TELOPT_BINARY || option == TELOPT_SGA ||
+               (option == TELOPT_ECHO && tn->echo_offer);
+    }
+
+    return option == TELOPT_BINARY || option == TELOPT_SGA ||
+           option == TELOPT_TTYPE || option == TELOPT_NAWS ||
+           option == TELOPT_TSPEED || option == TELOPT_ENVIRON ||
+           option == TELOPT_LINEMODE || option == TELOPT_CHARSET ||
+           option == TELOPT_COMPORT || option == TELOPT_LFLOW;
+}
+
 /**
  * Handle received option negotiation (RFC 855 compliant with loop prevention)
  */
@@ -263,12 +510,20 @@ int telnet_handle_negotiate(telnet_t *tn, unsigned char command, unsigned char o
 
     MB_LOG_DEBUG("Received IAC negotiation: cmd=%d opt=%d", command, option);
 
+    /* Answer to our DO TIMING-MARK: the mark itself, nothing to reply (RFC 860) */
+    if (option == TELOPT_TIMING_MARK && tn->timing_mark &&
+        (command == TELNET_WILL || command == TELNET_WONT)) {
+        tn->timing_mark = false;
+        MB_LOG_DEBUG("TIMING-MARK answered");
+        return SUCCESS;
+    }
+
     switch (command) {
         case TELNET_WILL:
             /* Server will use option - only respond if state changes (RFC 855) */
-            if (option == TELOPT_BINARY || option == TELOPT_SGA || option == TELOPT_ECHO) {
-                if (!tn->remote_options[option]) {  /* State change check */
-                    tn->remote_options[option] = true;
+            if (telnet_remote_option_ok(tn, option)) {
+                if (!telnet_opt_isset(&tn->remote_options, option)) {  /* State change check */
+                    telnet_opt_set(&tn->remote_options, option, true);
                     telnet_send_negotiate(tn, TELNET_DO, option);
 
                     if (option == TELOPT_BINARY) {
@@ -280,6 +535,20 @@ int telnet_handle_negotiate(telnet_t *tn, unsigned char command, unsigned char o
                     } else if (option == TELOPT_ECHO) {
                         tn->echo_remote = true;
                         MB_LOG_INFO("Remote ECHO enabled");
+                    } else if (option == TELOPT_CHARSET) {
+                        MB_LOG_INFO("Remote CHARSET enabled");
+                        /* Server may send SB CHARSET REQUEST */
+                    } else if (option == TELOPT_EOR) {
+                        tn->prompt_marks = true;
+                        MB_LOG_INFO("Remote END-OF-RECORD enabled (prompts are marked)");
+                    } else if (option == TELOPT_TTYPE) {
+                        /* Client will report its terminal type: ask for it (RFC 1091) */
+                        unsigned char request[2] = {TELOPT_TTYPE, TTYPE_SEND};
+                        MB_LOG_INFO("Client TERMINAL-TYPE enabled");
+                        telnet_send_subnegotiation(tn, request, 2);
+                    } else if (option == TELOPT_NAWS) {
+                        MB_LOG_INFO("Client NAWS enabled");
+                        /* Client sends SB NAWS now and after every resize */
                     }
                 }
             } else {
@@ -293,8 +562,8 @@ int telnet_handle_negotiate(telnet_t *tn, unsigned char command, unsigned char o
 
         case TELNET_WONT:
             /* Server won't use option - only respond if state changes */
-            if (tn->remote_options[option]) {
-                tn->remote_options[option] = false;
+            if (telnet_opt_isset(&tn->remote_options, option)) {
+                telnet_opt_set(&tn->remote_options, option, false);
                 telnet_send_negotiate(tn, TELNET_DONT, option);
 
                 if (option == TELOPT_BINARY) {
@@ -306,6 +575,8 @@ int telnet_handle_negotiate(telnet_t *tn, unsigned char command, unsigned char o
                     tn->echo_remote = false;
                 } else if (option == TELOPT_LINEMODE) {
                     tn->linemode_active = false;
+                } else if (option == TELOPT_EOR) {
+                    tn->prompt_marks = false;
                 }
             }
             telnet_update_mode(tn);
@@ -313,12 +584,9 @@ int telnet_handle_negotiate(telnet_t *tn, unsigned char command, unsigned char o
 
         case TELNET_DO:
             /* Server wants us to use option - only respond if state changes */
-            if (option == TELOPT_BINARY || option == TELOPT_SGA ||
-                option == TELOPT_TTYPE || option == TELOPT_NAWS ||
-                option == TELOPT_TSPEED || option == TELOPT_ENVIRON ||
-                option == TELOPT_LINEMODE) {
-                if (!tn->local_options[option]) {  /* State change check */
-                    tn->local_options[option] = true;
+            if (telnet_local_option_ok(tn, option)) {
+                if (!telnet_opt_isset(&tn->local_options, option)) {  /* State change check */
+                    telnet_opt_set(&tn->local_options, option, true);
                     telnet_send_negotiate(tn, TELNET_WILL, option);
 
                     if (option == TELOPT_BINARY) {
@@ -327,13 +595,16 @@ int telnet_handle_negotiate(telnet_t *tn, unsigned char command, unsigned char o
                     } else if (option == TELOPT_SGA) {
                         tn->sga_local = true;
                         MB_LOG_INFO("Local SGA enabled");
+                    } else if (option == TELOPT_ECHO) {
+                        tn->echo_local = true;
+                        MB_LOG_INFO("Local ECHO enabled");
                     } else if (option == TELOPT_TTYPE) {
                         MB_LOG_INFO("TERMINAL-TYPE negotiation accepted");
                         /* Server will send SB TTYPE SEND to request type */
                     } else if (option == TELOPT_NAWS) {
                         MB_LOG_INFO("NAWS negotiation accepted");
                         /* Send initial window size */
-                        telnet_send_naws(tn, tn->term_width, tn->term_height);
+                        telnet_send_naws(tn, tn->cold->term_width, tn->cold->term_height);
                     } else if (option == TELOPT_TSPEED) {
                         MB_LOG_INFO("TSPEED negotiation accepted");
                         /* Server will send SB TSPEED SEND to request speed */
@@ -344,6 +615,19 @@ int telnet_handle_negotiate(telnet_t *tn, unsigned char command, unsigned char o
                         tn->linemode_active = true;
                         MB_LOG_INFO("LINEMODE negotiation accepted");
                         /* Server may send MODE subnegotiation */
+                    } else if (option == TELOPT_CHARSET) {
+                        MB_LOG_INFO("CHARSET negotiation accepted");
+                        /* Request the configured charset, if any */
+                        telnet_send_charset_request(tn);
+                    } else if (option == TELOPT_COMPORT) {
+                        MB_LOG_INFO("COM-PORT-OPTION negotiation accepted");
+                        /* Apply configured port settings */
+                        comport_on_enabled(tn);
+                    } else if (option == TELOPT_LFLOW) {
+                        /* Local XON/XOFF handling is on until the server says otherwise */
+                        tn->lflow_enabled = true;
+                        tn->lflow_restart_any = false;
+                        MB_LOG_INFO("LFLOW negotiation accepted");
                     }
                 }
             } else {
@@ -357,8 +641,8 @@ int telnet_handle_negotiate(telnet_t *tn, unsigned char command, unsigned char o
 
         case TELNET_DONT:
             /* Server doesn't want us to use option - only respond if state changes */
-            if (tn->local_options[option]) {
-                tn->local_options[option] = false;
+            if (telnet_opt_isset(&tn->local_options, option)) {
+                telnet_opt_set(&tn->local_options, option, false);
                 telnet_send_negotiate(tn, TELNET_WONT, option);
 
                 if (option == TELOPT_BINARY) {
@@ -366,8 +650,15 @@ int telnet_handle_negotiate(telnet_t *tn, unsigned char command, unsigned char o
                     MB_LOG_WARNING("Server rejected local BINARY mode - multibyte characters may be corrupted on send!");
                 } else if (option == TELOPT_SGA) {
                     tn->sga_local = false;
+                } else if (option == TELOPT_ECHO) {
+                    tn->echo_local = false;
                 } else if (option == TELOPT_LINEMODE) {
                     tn->linemode_active = false;
+                } else if (option == TELOPT_COMPORT) {
+                    tn->cold->comport.enabled = false;
+                    tn->cold->comport.remote_suspended = false;
+                } else if (option == TELOPT_LFLOW) {
+                    tn->lflow_enabled = false;
                 }
             }
             telnet_update_mode(tn);
@@ -382,14 +673,14 @@ int telnet_handle_negotiate(telnet_t *tn, unsigned char command, unsigned char o
 }
 
 /**
- * Send subnegotiation (helper function)
+ * Send subnegotiation
  */
-static int telnet_send_subnegotiation(telnet_t *tn, const unsigned char *data, size_t len)
+int telnet_send_subnegotiation(telnet_t *tn, const unsigned char *data, size_t len)
 {
     unsigned char buf[BUFFER_SIZE];
     size_t pos = 0;
 
-    if (tn == NULL || data == NULL || len == 0 || tn->fd < 0) {
+    if (tn == NULL || data == NULL || len == 0 || tn->transport.ops == NULL) {
         return ERROR_INVALID_ARG;
     }
 
@@ -412,14 +703,7 @@ static int telnet_send_subnegotiation(telnet_t *tn, const unsigned char *data, s
 
     MB_LOG_DEBUG("Sending subnegotiation: %zu bytes", pos);
 
-    if (send(tn->fd, buf, pos, 0) < 0) {
-        if (errno != EAGAIN && errno != EWOULDBLOCK) {
-            MB_LOG_ERROR("Failed to send subnegotiation: %s", strerror(errno));
-            return ERROR_IO;
-        }
-    }
-
-    return SUCCESS;
+    return telnet_queue_control(tn, buf, pos);
 }
 
 /**
@@ -448,6 +732,142 @@ int telnet_send_naws(telnet_t *tn, int width, int height)
     return telnet_send_subnegotiation(tn, data, 5);
 }
 
+/**
+ * Send CHARSET REQUEST for the preferred charset (RFC 2066)
+ * Format: IAC SB CHARSET REQUEST ;<preferred>;UTF-8 IAC SE
+ */
+static int telnet_send_charset_request(telnet_t *tn)
+{
+    unsigned char request[SMALL_BUFFER_SIZE];
+    size_t pos = 0;
+
+    if (tn == NULL || tn->charset_preferred == CHARSET_INVALID) {
+        return SUCCESS;
+    }
+
+    request[pos++] = TELOPT_CHARSET;
+    request[pos++] = CHARSET_REQUEST;
+
+    const char *names[2] = {charset_name(tn->charset_preferred), NULL};
+    if (tn->charset_preferred != CHARSET_UTF8) {
+        names[1] = charset_name(CHARSET_UTF8);
+    }
+
+    for (int n = 0; n < 2 && names[n] != NULL; n++) {
+        size_t name_len = strlen(names[n]);
+        request[pos++] = ';';
+        memcpy(&request[pos], names[n], name_len);
+        pos += name_len;
+    }
+
+    MB_LOG_INFO("Sending CHARSET REQUEST %s", charset_name(tn->charset_preferred));
+
+    return telnet_send_subnegotiation(tn, request, pos);
+}
+
+/**
+ * Handle CHARSET subnegotiation (RFC 2066)
+ */
+static void telnet_handle_charset(telnet_t *tn)
+{
+    unsigned char response[SMALL_BUFFER_SIZE + 2];
+    char name[SMALL_BUFFER_SIZE];
+    size_t pos = 2;
+
+    if (tn->sb_len < 2) {
+        return;
+    }
+
+    switch (tn->sb_buffer[1]) {
+        case CHARSET_REQUEST: {
+            int chosen = CHARSET_INVALID;
+            const char *chosen_name = NULL;
+            size_t chosen_len = 0;
+
+            /* Skip optional "[TTABLE]" marker and version byte */
+            if (tn->sb_len >= pos + 9 && memcmp(&tn->sb_buffer[pos], "[TTABLE]", 8) == 0) {
+                pos += 9;
+            }
+            if (pos >= tn->sb_len) {
+                break;
+            }
+
+            /* First byte is the separator, followed by separated names */
+            unsigned char sep = tn->sb_buffer[pos++];
+            while (pos < tn->sb_len) {
+                size_t start = pos;
+                while (pos < tn->sb_len && tn->sb_buffer[pos] != sep) {
+                    pos++;
+                }
+                size_t len = MIN(pos - start, sizeof(name) - 1);
+                memcpy(name, &tn->sb_buffer[start], len);
+                name[len] = '\0';
+                pos++;  /* Skip separator */
+
+                int id = charset_lookup(name);
+                if (id == CHARSET_INVALID) {
+                    continue;
+                }
+                /* Take the preferred charset if offered, otherwise the first supported */
+                if (chosen == CHARSET_INVALID || id == tn->charset_preferred) {
+                    chosen = id;
+                    chosen_name = (const char *)&tn->sb_buffer[start];
+                    chosen_len = len;
+                }
+                if (id == tn->charset_preferred) {
+                    break;
+                }
+            }
+
+            response[0] = TELOPT_CHARSET;
+            if (chosen == CHARSET_INVALID) {
+                response[1] = CHARSET_REJECTED;
+                MB_LOG_WARNING("CHARSET REQUEST contained no supported charset");
+                telnet_send_subnegotiation(tn, response, 2);
+            } else {
+                response[1] = CHARSET_ACCEPTED;
+                memcpy(&response[2], chosen_name, chosen_len);
+                tn->charset = chosen;
+                MB_LOG_INFO("Sending CHARSET ACCEPTED %s", charset_name(chosen));
+                telnet_send_subnegotiation(tn, response, 2 + chosen_len);
+            }
+            break;
+        }
+
+        case CHARSET_ACCEPTED: {
+            size_t len = MIN(tn->sb_len - 2, sizeof(name) - 1);
+            memcpy(name, &tn->sb_buffer[2], len);
+            name[len] = '\0';
+
+            int id = charset_lookup(name);
+            if (id != CHARSET_INVALID) {
+                tn->charset = id;
+                MB_LOG_INFO("Server accepted CHARSET %s", charset_name(id));
+            } else {
+                MB_LOG_WARNING("Server accepted unknown CHARSET '%s'", name);
+            }
+            break;
+        }
+
+        case CHARSET_REJECTED:
+            /* Keep the configured charset as a static fallback */
+            MB_LOG_WARNING("Server rejected CHARSET request, using %s", charset_name(tn->charset));
+            break;
+
+        case CHARSET_TTABLE_IS:
+            /* Translation tables are not supported */
+            response[0] = TELOPT_CHARSET;
+            response[1] = CHARSET_TTABLE_REJECTED;
+            MB_LOG_DEBUG("Rejecting CHARSET TTABLE-IS");
+            telnet_send_subnegotiation(tn, response, 2);
+            break;
+
+        default:
+            MB_LOG_DEBUG("Ignoring CHARSET subnegotiation code %d", tn->sb_buffer[1]);
+            break;
+    }
+}
+
 /**
  * Handle subnegotiation (RFC 1091 TERMINAL-TYPE, RFC 1184 LINEMODE)
  */
@@ -470,27 +890,44 @@ int telnet_handle_subnegotiation(telnet_t *tn)
                 const int num_types = 3;
 
                 /* Get current terminal type from cycle */
-                const char *current_type = terminal_types[tn->ttype_index % num_types];
+                const char *current_type = terminal_types[tn->cold->ttype_index % num_types];
 
                 /* Update stored terminal type */
-                SAFE_STRNCPY(tn->terminal_type, current_type, sizeof(tn->terminal_type));
+                SAFE_STRNCPY(tn->cold->terminal_type, current_type, sizeof(tn->cold->terminal_type));
 
                 /* Prepare response */
                 unsigned char response[68];  /* 1 (option) + 1 (IS) + 64 (terminal type) + 2 safety */
-                size_t term_len = strlen(tn->terminal_type);
+                size_t term_len = strlen(tn->cold->terminal_type);
 
                 response[0] = TELOPT_TTYPE;
                 response[1] = TTYPE_IS;
-                memcpy(&response[2], tn->terminal_type, term_len);
+                memcpy(&response[2], tn->cold->terminal_type, term_len);
 
-                MB_LOG_INFO("Sending TERMINAL-TYPE IS %s (cycle %d)", tn->terminal_type, tn->ttype_index);
+                MB_LOG_INFO("Sending TERMINAL-TYPE IS %s (cycle %d)", tn->cold->terminal_type, tn->cold->ttype_index);
                 telnet_send_subnegotiation(tn, response, 2 + term_len);
 
                 /* Advance to next type for next request */
-                tn->ttype_index++;
+                tn->cold->ttype_index++;
 
                 /* RFC 1091: After cycling through all types, repeat the cycle */
                 /* This allows the server to detect when we've looped */
+            } else if (tn->server && tn->sb_len >= 2 && tn->sb_buffer[1] == TTYPE_IS) {
+                /* Client reports its terminal type */
+                size_t term_len = MIN(tn->sb_len - 2, sizeof(tn->cold->terminal_type) - 1);
+
+                memcpy(tn->cold->terminal_type, &tn->sb_buffer[2], term_len);
+                tn->cold->terminal_type[term_len] = '\0';
+                MB_LOG_INFO("Client TERMINAL-TYPE IS %s", tn->cold->terminal_type);
+            }
+            break;
+
+        case TELOPT_NAWS:
+            /* Client window size (RFC 1073): width and height, 16 bits each */
+            if (tn->server && tn->sb_len >= 5) {
+                tn->cold->term_width = (tn->sb_buffer[1] << 8) | tn->sb_buffer[2];
+                tn->cold->term_height = (tn->sb_buffer[3] << 8) | tn->sb_buffer[4];
+                tn->window_changed = true;
+                MB_LOG_DEBUG("Client window size %dx%d", tn->cold->term_width, tn->cold->term_height);
             }
             break;
 
@@ -499,13 +936,13 @@ int telnet_handle_subnegotiation(telnet_t *tn)
             if (tn->sb_len >= 2 && tn->sb_buffer[1] == TTYPE_SEND) {  /* SEND = 1 */
                 /* Server requests terminal speed - send IS response */
                 unsigned char response[36];  /* 1 (option) + 1 (IS) + 32 (speed) + 2 safety */
-                size_t speed_len = strlen(tn->terminal_speed);
+                size_t speed_len = strlen(tn->cold->terminal_speed);
 
                 response[0] = TELOPT_TSPEED;
                 response[1] = TTYPE_IS;  /* IS = 0 */
-                memcpy(&response[2], tn->terminal_speed, speed_len);
+                memcpy(&response[2], tn->cold->terminal_speed, speed_len);
 
-                MB_LOG_INFO("Sending TSPEED IS %s", tn->terminal_speed);
+                MB_LOG_INFO("Sending TSPEED IS %s", tn->cold->terminal_speed);
                 telnet_send_subnegotiation(tn, response, 2 + speed_len);
             }
             break;
@@ -602,6 +1039,43 @@ int telnet_handle_subnegotiation(telnet_t *tn)
             }
             break;
 
+        case TELOPT_CHARSET:
+            /* CHARSET subnegotiation (RFC 2066) */
+            telnet_handle_charset(tn);
+            break;
+
+        case TELOPT_COMPORT:
+            /* COM-PORT-OPTION subnegotiation (RFC 2217) */
+            comport_handle_subnegotiation(tn);
+            break;
+
+        case TELOPT_LFLOW:
+            /* LFLOW subnegotiation (RFC 1372) */
+            if (tn->sb_len >= 2) {
+                switch (tn->sb_buffer[1]) {
+                    case LFLOW_OFF:
+                        tn->lflow_enabled = false;
+                        MB_LOG_INFO("LFLOW: local flow control disabled");
+                        break;
+                    case LFLOW_ON:
+                        tn->lflow_enabled = true;
+                        MB_LOG_INFO("LFLOW: local flow control enabled");
+                        break;
+                    case LFLOW_RESTART_ANY:
+                        tn->lflow_restart_any = true;
+                        MB_LOG_DEBUG("LFLOW: any character restarts output");
+                        break;
+                    case LFLOW_RESTART_XON:
+                        tn->lflow_restart_any = false;
+                        MB_LOG_DEBUG("LFLOW: only XON restarts output");
+                        break;
+                    default:
+                        MB_LOG_DEBUG("Ignoring LFLOW command %d", tn->sb_buffer[1]);
+                        break;
+                }
+            }
+            break;
+
         default:
             /* Unknown option - just log and ignore */
             MB_LOG_DEBUG("Ignoring subnegotiation for unsupported option %d", option);
@@ -612,211 +1086,444 @@ int telnet_handle_subnegotiation(telnet_t *tn)
 }
 
 /**
- * Process incoming data from telnet server
+ * Warn once that decoded input did not fit the output buffer
  */
-int telnet_process_input(telnet_t *tn, const unsigned char *input, size_t input_len,
-                         unsigned char *output, size_t output_size, size_t *output_len)
+static void telnet_warn_input_overflow(void)
 {
-    size_t out_pos = 0;
+    static bool overflow_warned = false;
 
-    if (tn == NULL || input == NULL || output == NULL || output_len == NULL) {
-        return ERROR_INVALID_ARG;
+    if (!overflow_warned) {
+        MB_LOG_WARNING("Telnet input buffer full - data may be truncated (multibyte chars may break)");
+        overflow_warned = true;
     }
+}
 
-    *output_len = 0;
+/* Decoder actions (what to do with a byte in a given state) */
+typedef enum {
+    TN_ACT_NONE,                /* State change only */
+    TN_ACT_DATA,                /* Emit byte as data */
+    TN_ACT_CR,                  /* CR in data (NVT: wait for LF/NUL) */
+    TN_ACT_XONXOFF,             /* XON/XOFF in data (remote flow control) */
+    TN_ACT_IAC_DATA,            /* IAC IAC - escaped 0xFF */
+    TN_ACT_SB_BEGIN,            /* IAC SB */
+    TN_ACT_MARK,                /* IAC GA / IAC EOR - record/prompt mark */
+    TN_ACT_DM,                  /* IAC DM - end of Synch */
+    TN_ACT_AYT,                 /* IAC AYT - answer */
+    TN_ACT_NOTICE,              /* IAC IP/AO/BREAK - log */
+    TN_ACT_IGNORE,              /* IAC NOP/EL/EC - ignore */
+    TN_ACT_UNKNOWN,             /* Unknown IAC command */
+    TN_ACT_WILL,                /* Option byte after WILL */
+    TN_ACT_WONT,                /* Option byte after WONT */
+    TN_ACT_DO,                  /* Option byte after DO */
+    TN_ACT_DONT,                /* Option byte after DONT */
+    TN_ACT_SB_DATA,             /* Accumulate subnegotiation byte */
+    TN_ACT_SB_END,              /* IAC SE */
+    TN_ACT_CR_NUL,              /* CR NUL - carriage return only */
+    TN_ACT_CR_LF,               /* CR LF - newline */
+    TN_ACT_CR_IAC,              /* CR IAC - emit CR, then IAC */
+    TN_ACT_CR_OTHER             /* CR <other> - emit both (non-standard) */
+} telnet_action_t;
+
+/* Transition table entry */
+typedef struct {
+    uint8_t action;             /* telnet_action_t */
+    uint8_t next;               /* telnet_state_t */
+} telnet_transition_t;
+
+#define TELNET_STATE_COUNT  (TELNET_STATE_SEENCR + 1)
+#define TN(action, next)    { (action), (next) }
+
+/* State machine (RFC 854/855) indexed by [state][byte]. Each row starts
+ * from a default for all 256 bytes and overrides the special ones. */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Woverride-init"
+static const telnet_transition_t telnet_transitions[TELNET_STATE_COUNT][256] = {
+    [TELNET_STATE_DATA] = {
+        [0 ... 255]         = TN(TN_ACT_DATA, TELNET_STATE_DATA),
+        ['\r']              = TN(TN_ACT_CR, TELNET_STATE_SEENCR),
+        [ASCII_XON]         = TN(TN_ACT_XONXOFF, TELNET_STATE_DATA),
+        [ASCII_XOFF]        = TN(TN_ACT_XONXOFF, TELNET_STATE_DATA),
+        [TELNET_IAC]        = TN(TN_ACT_NONE, TELNET_STATE_IAC),
+    },
+    [TELNET_STATE_IAC] = {
+        [0 ... 255]         = TN(TN_ACT_UNKNOWN, TELNET_STATE_DATA),
+        [TELNET_IAC]        = TN(TN_ACT_IAC_DATA, TELNET_STATE_DATA),
+        [TELNET_WILL]       = TN(TN_ACT_NONE, TELNET_STATE_WILL),
+        [TELNET_WONT]       = TN(TN_ACT_NONE, TELNET_STATE_WONT),
+        [TELNET_DO]         = TN(TN_ACT_NONE, TELNET_STATE_DO),
+        [TELNET_DONT]       = TN(TN_ACT_NONE, TELNET_STATE_DONT),
+        [TELNET_SB]         = TN(TN_ACT_SB_BEGIN, TELNET_STATE_SB),
+        [TELNET_GA]         = TN(TN_ACT_MARK, TELNET_STATE_DATA),
+        [TELNET_EOR]        = TN(TN_ACT_MARK, TELNET_STATE_DATA),
+        [TELNET_DM]         = TN(TN_ACT_DM, TELNET_STATE_DATA),
+        [TELNET_AYT]        = TN(TN_ACT_AYT, TELNET_STATE_DATA),
+        [TELNET_IP]         = TN(TN_ACT_NOTICE, TELNET_STATE_DATA),
+        [TELNET_AO]         = TN(TN_ACT_NOTICE, TELNET_STATE_DATA),
+        [TELNET_BREAK]      = TN(TN_ACT_NOTICE, TELNET_STATE_DATA),
+        [TELNET_NOP]        = TN(TN_ACT_IGNORE, TELNET_STATE_DATA),
+        [TELNET_EL]         = TN(TN_ACT_IGNORE, TELNET_STATE_DATA),
+        [TELNET_EC]         = TN(TN_ACT_IGNORE, TELNET_STATE_DATA),
+    },
+    [TELNET_STATE_WILL] = {
+        [0 ... 255]         = TN(TN_ACT_WILL, TELNET_STATE_DATA),
+    },
+    [TELNET_STATE_WONT] = {
+        [0 ... 255]         = TN(TN_ACT_WONT, TELNET_STATE_DATA),
+    },
+    [TELNET_STATE_DO] = {
+        [0 ... 255]         = TN(TN_ACT_DO, TELNET_STATE_DATA),
+    },
+    [TELNET_STATE_DONT] = {
+        [0 ... 255]         = TN(TN_ACT_DONT, TELNET_STATE_DATA),
+    },
+    [TELNET_STATE_SB] = {
+        [0 ... 255]         = TN(TN_ACT_SB_DATA, TELNET_STATE_SB),
+        [TELNET_IAC]        = TN(TN_ACT_NONE, TELNET_STATE_SB_IAC),
+    },
+    [TELNET_STATE_SB_IAC] = {
+        /* IAC IAC is an escaped 0xFF; anything else but SE is kept as-is */
+        [0 ... 255]         = TN(TN_ACT_SB_DATA, TELNET_STATE_SB),
+        [TELNET_SE]         = TN(TN_ACT_SB_END, TELNET_STATE_DATA),
+    },
+    [TELNET_STATE_SEENCR] = {
+        /* RFC 854: CR must be followed by NUL or LF in non-binary mode */
+        [0 ... 255]         = TN(TN_ACT_CR_OTHER, TELNET_STATE_DATA),
+        ['\0']              = TN(TN_ACT_CR_NUL, TELNET_STATE_DATA),
+        ['\n']              = TN(TN_ACT_CR_LF, TELNET_STATE_DATA),
+        [TELNET_IAC]        = TN(TN_ACT_CR_IAC, TELNET_STATE_IAC),
+    },
+};
+#pragma GCC diagnostic pop
+
+#undef TN
+
+/* IAC command names for logging, indexed by command - TELNET_EOR */
+static const char *const telnet_command_names[] = {
+    "EOR", "SE", "NOP", "DM", "BREAK", "IP", "AO", "AYT",
+    "EC", "EL", "GA", "SB", "WILL", "WONT", "DO", "DONT", "IAC"
+};
 
-    for (size_t i = 0; i < input_len; i++) {
-        unsigned char c = input[i];
+/**
+ * Append one byte of decoded data
+ */
+static inline void telnet_emit(unsigned char c, unsigned char *output, size_t output_size,
+                               size_t *out_pos)
+{
+    if (*out_pos < output_size) {
+        output[(*out_pos)++] = c;
+    } else {
+        telnet_warn_input_overflow();
+    }
+}
 
-        switch (tn->state) {
-            case TELNET_STATE_DATA:
-                if (c == TELNET_IAC) {
-                    tn->state = TELNET_STATE_IAC;
-                } else if (c == '\r' && !tn->binary_remote) {
-                    /* CR in non-binary mode - need to check next byte (RFC 854) */
-                    tn->state = TELNET_STATE_SEENCR;
-                } else {
-                    /* Regular data */
-                    if (out_pos < output_size) {
-                        output[out_pos++] = c;
-                    } else {
-                        /* Buffer full - log warning once */
-                        static bool overflow_warned = false;
-                        if (!overflow_warned) {
-                            MB_LOG_WARNING("Telnet input buffer full - data may be truncated (multibyte chars may break)");
-                            overflow_warned = true;
-                        }
-                    }
-                }
-                break;
+/**
+ * Run one byte through the protocol state machine
+ * The transition table gives the next state and the action; binary is a
+ * compile-time constant in each decoder variant, so the CR handling of
+ * the non-binary variant is compiled out of the binary one.
+ */
+static inline __attribute__((always_inline))
+void telnet_decode_byte(telnet_t *tn, unsigned char c, unsigned char *output,
+                        size_t output_size, size_t *out_pos, const bool binary)
+{
+    const telnet_transition_t *t;
 
-            case TELNET_STATE_IAC:
-                if (c == TELNET_IAC) {
-                    /* Escaped IAC - output single IAC */
-                    if (out_pos < output_size) {
-                        output[out_pos++] = TELNET_IAC;
-                    }
-                    tn->state = TELNET_STATE_DATA;
-                } else if (c == TELNET_WILL) {
-                    tn->state = TELNET_STATE_WILL;
-                } else if (c == TELNET_WONT) {
-                    tn->state = TELNET_STATE_WONT;
-                } else if (c == TELNET_DO) {
-                    tn->state = TELNET_STATE_DO;
-                } else if (c == TELNET_DONT) {
-                    tn->state = TELNET_STATE_DONT;
-                } else if (c == TELNET_SB) {
-                    tn->state = TELNET_STATE_SB;
-                    tn->sb_len = 0;
-                } else if (c == TELNET_GA) {
-                    /* Go Ahead - silently ignore in character mode (RFC 858) */
-                    MB_LOG_DEBUG("Received IAC GA (ignored)");
-                    tn->state = TELNET_STATE_DATA;
-                } else if (c == TELNET_NOP) {
-                    /* No Operation - silently ignore (RFC 854) */
-                    MB_LOG_DEBUG("Received IAC NOP");
-                    tn->state = TELNET_STATE_DATA;
-                } else if (c == TELNET_AYT) {
-                    /* Are You There - respond with confirmation (RFC 854) */
-                    MB_LOG_DEBUG("Received IAC AYT");
-                    const char *response = "\r\n[ModemBridge: Yes, I'm here]\r\n";
-                    telnet_send(tn, response, strlen(response));
-                    tn->state = TELNET_STATE_DATA;
-                } else if (c == TELNET_IP) {
-                    /* Interrupt Process - log but don't act (RFC 854) */
-                    MB_LOG_INFO("Received IAC IP (Interrupt Process)");
-                    tn->state = TELNET_STATE_DATA;
-                } else if (c == TELNET_AO) {
-                    /* Abort Output - log but don't act (RFC 854) */
-                    MB_LOG_INFO("Received IAC AO (Abort Output)");
-                    tn->state = TELNET_STATE_DATA;
-                } else if (c == TELNET_BREAK) {
-                    /* Break - log but don't act (RFC 854) */
-                    MB_LOG_INFO("Received IAC BREAK");
-                    tn->state = TELNET_STATE_DATA;
-                } else if (c == TELNET_EL) {
-                    /* Erase Line - log but don't act (RFC 854) */
-                    MB_LOG_DEBUG("Received IAC EL (Erase Line)");
-                    tn->state = TELNET_STATE_DATA;
-                } else if (c == TELNET_EC) {
-                    /* Erase Character - log but don't act (RFC 854) */
-                    MB_LOG_DEBUG("Received IAC EC (Erase Character)");
-                    tn->state = TELNET_STATE_DATA;
-                } else if (c == TELNET_DM) {
-                    /* Data Mark - marks end of urgent data (RFC 854) */
-                    MB_LOG_DEBUG("Received IAC DM (Data Mark)");
-                    tn->state = TELNET_STATE_DATA;
-                } else if (c == TELNET_EOR) {
-                    /* End of Record - log but don't act (RFC 885) */
-                    MB_LOG_DEBUG("Received IAC EOR (End of Record)");
-                    tn->state = TELNET_STATE_DATA;
-                } else {
-                    /* Unknown IAC command - log and ignore */
-                    MB_LOG_WARNING("Received unknown IAC command: %d", c);
-                    tn->state = TELNET_STATE_DATA;
-                }
-                break;
+    if ((unsigned int)tn->state >= TELNET_STATE_COUNT) {
+        MB_LOG_WARNING("Invalid telnet state: %d", tn->state);
+        tn->state = TELNET_STATE_DATA;
+    }
 
-            case TELNET_STATE_WILL:
-                telnet_handle_negotiate(tn, TELNET_WILL, c);
-                tn->state = TELNET_STATE_DATA;
-                break;
+    t = &telnet_transitions[tn->state][c];
+    tn->state = (telnet_state_t)t->next;
 
-            case TELNET_STATE_WONT:
-                telnet_handle_negotiate(tn, TELNET_WONT, c);
-                tn->state = TELNET_STATE_DATA;
-                break;
+    switch ((telnet_action_t)t->action) {
+        case TN_ACT_NONE:
+            break;
 
-            case TELNET_STATE_DO:
-                telnet_handle_negotiate(tn, TELNET_DO, c);
-                tn->state = TELNET_STATE_DATA;
-                break;
+        case TN_ACT_DATA:
+            if (tn->synch) {
+                /* Synch in progress - discard data up to IAC DM */
+                tn->synch_discarded++;
+            } else {
+                telnet_emit(c, output, output_size, out_pos);
+            }
+            break;
 
-            case TELNET_STATE_DONT:
-                telnet_handle_negotiate(tn, TELNET_DONT, c);
+        case TN_ACT_CR:
+            if (tn->synch) {
+                tn->synch_discarded++;
                 tn->state = TELNET_STATE_DATA;
-                break;
+            } else if (binary) {
+                /* Binary mode - CR is plain data */
+                telnet_emit(c, output, output_size, out_pos);
+                tn->state = TELNET_STATE_DATA;
+            }
+            /* else: NVT - need to check next byte (RFC 854) */
+            break;
 
-            case TELNET_STATE_SB:
-                if (c == TELNET_IAC) {
-                    tn->state = TELNET_STATE_SB_IAC;
-                } else {
-                    /* Accumulate subnegotiation data */
-                    if (tn->sb_len < sizeof(tn->sb_buffer)) {
-                        tn->sb_buffer[tn->sb_len++] = c;
-                    }
+        case TN_ACT_XONXOFF:
+            if (tn->synch) {
+                tn->synch_discarded++;
+            } else if (tn->remote_xonxoff) {
+                /* Remote device flow control - hold or release our output */
+                tn->output_paused = (c == ASCII_XOFF);
+                MB_LOG_DEBUG("Remote %s, outbound %zu bytes queued",
+                             tn->output_paused ? "XOFF" : "XON",
+                             telnet_output_queued(tn, TELNET_OUT_CLASSES));
+            } else {
+                telnet_emit(c, output, output_size, out_pos);
+            }
+            break;
+
+        case TN_ACT_IAC_DATA:
+            /* Escaped IAC - output single IAC */
+            if (tn->synch) {
+                tn->synch_discarded++;
+            } else if (*out_pos < output_size) {
+                output[(*out_pos)++] = TELNET_IAC;
+            }
+            break;
+
+        case TN_ACT_SB_BEGIN:
+            tn->sb_len = 0;
+            break;
+
+        case TN_ACT_MARK:
+            /* GA: the server is waiting for input; EOR: end of record (RFC 885) */
+            MB_LOG_DEBUG("Received IAC %s (prompt mark)", telnet_command_names[c - TELNET_EOR]);
+            if (c == TELNET_GA) {
+                tn->prompt_marks = true;
+            }
+            tn->mark_count++;
+            tn->mark_offset = *out_pos;
+            break;
+
+        case TN_ACT_DM:
+            /* Data Mark - marks end of urgent data (RFC 854) */
+            if (tn->synch) {
+                tn->synch = false;
+                MB_LOG_INFO("Synch complete (%llu bytes discarded)",
+                           (unsigned long long)tn->synch_discarded);
+            } else {
+                MB_LOG_DEBUG("Received IAC DM (Data Mark)");
+            }
+            break;
+
+        case TN_ACT_AYT: {
+            /* Are You There - respond with confirmation (RFC 854) */
+            const char *response = "\r\n[ModemBridge: Yes, I'm here]\r\n";
+            MB_LOG_DEBUG("Received IAC AYT");
+            telnet_queue_control(tn, response, strlen(response));
+            break;
+        }
+
+        case TN_ACT_NOTICE:
+            /* Interrupt Process, Abort Output, Break - log but don't act (RFC 854) */
+            MB_LOG_INFO("Received IAC %s", telnet_command_names[c - TELNET_EOR]);
+            break;
+
+        case TN_ACT_IGNORE:
+            /* No Operation, Erase Line, Erase Character - nothing to do as a client */
+            MB_LOG_DEBUG("Received IAC %s", telnet_command_names[c - TELNET_EOR]);
+            break;
+
+        case TN_ACT_UNKNOWN:
+            /* Unknown IAC command - log and ignore */
+            MB_LOG_WARNING("Received unknown IAC command: %d", c);
+            break;
+
+        case TN_ACT_WILL:
+            telnet_handle_negotiate(tn, TELNET_WILL, c);
+            break;
+
+        case TN_ACT_WONT:
+            telnet_handle_negotiate(tn, TELNET_WONT, c);
+            break;
+
+        case TN_ACT_DO:
+            telnet_handle_negotiate(tn, TELNET_DO, c);
+            break;
+
+        case TN_ACT_DONT:
+            telnet_handle_negotiate(tn, TELNET_DONT, c);
+            break;
+
+        case TN_ACT_SB_DATA:
+            /* Accumulate subnegotiation data */
+            if (tn->sb_buffer == NULL) {
+                size_t cap;
+                tn->sb_buffer = pool_buf_get(TELNET_SB_MAX, &cap);
+                if (tn->sb_buffer == NULL) {
+                    break;
                 }
-                break;
+            }
+            if (tn->sb_len < TELNET_SB_MAX) {
+                tn->sb_buffer[tn->sb_len++] = c;
+            }
+            break;
 
-            case TELNET_STATE_SB_IAC:
-                if (c == TELNET_SE) {
-                    /* End of subnegotiation */
-                    telnet_handle_subnegotiation(tn);
-                    tn->sb_len = 0;
-                    tn->state = TELNET_STATE_DATA;
-                } else if (c == TELNET_IAC) {
-                    /* Escaped IAC in subnegotiation */
-                    if (tn->sb_len < sizeof(tn->sb_buffer)) {
-                        tn->sb_buffer[tn->sb_len++] = TELNET_IAC;
-                    }
-                    tn->state = TELNET_STATE_SB;
-                } else {
-                    /* Invalid sequence - return to SB state */
-                    if (tn->sb_len < sizeof(tn->sb_buffer)) {
-                        tn->sb_buffer[tn->sb_len++] = c;
-                    }
-                    tn->state = TELNET_STATE_SB;
+        case TN_ACT_SB_END:
+            /* End of subnegotiation */
+            telnet_handle_subnegotiation(tn);
+            telnet_sb_release(tn);
+            break;
+
+        case TN_ACT_CR_NUL:
+            /* CR NUL - output just CR */
+            if (tn->synch) {
+                /* The CR was held when the urgent data arrived - discard the pair */
+                tn->synch_discarded += 2;
+            } else {
+                telnet_emit('\r', output, output_size, out_pos);
+            }
+            break;
+
+        case TN_ACT_CR_LF:
+            /* CR LF - output CR LF (newline), or only CR if that is all that fits */
+            if (tn->synch) {
+                tn->synch_discarded += 2;
+            } else if (*out_pos + 1 < output_size) {
+                output[(*out_pos)++] = '\r';
+                output[(*out_pos)++] = '\n';
+            } else if (*out_pos < output_size) {
+                output[(*out_pos)++] = '\r';
+            }
+            break;
+
+        case TN_ACT_CR_IAC:
+            /* CR IAC - output CR and process IAC */
+            if (tn->synch) {
+                tn->synch_discarded++;
+            } else if (*out_pos < output_size) {
+                output[(*out_pos)++] = '\r';
+            }
+            break;
+
+        case TN_ACT_CR_OTHER:
+            /* CR followed by other character - output CR and the character */
+            MB_LOG_DEBUG("Received CR followed by 0x%02x (non-standard)", c);
+            if (tn->synch) {
+                tn->synch_discarded += 2;
+            } else {
+                if (*out_pos < output_size) {
+                    output[(*out_pos)++] = '\r';
                 }
-                break;
+                if (*out_pos < output_size) {
+                    output[(*out_pos)++] = c;
+                }
+            }
+            break;
+    }
+}
 
-            case TELNET_STATE_SEENCR:
-                /* RFC 854: CR must be followed by NUL or LF in non-binary mode
-                 * CR NUL means carriage return only
-                 * CR LF means newline
-                 * CR <other> is illegal, treat as CR followed by the character */
-                if (c == '\0') {
-                    /* CR NUL - output just CR */
-                    if (out_pos < output_size) {
-                        output[out_pos++] = '\r';
-                    }
-                    MB_LOG_DEBUG("Received CR NUL (carriage return only)");
-                } else if (c == '\n') {
-                    /* CR LF - output CR LF (newline) */
-                    if (out_pos + 1 < output_size) {
-                        output[out_pos++] = '\r';
-                        output[out_pos++] = '\n';
-                    } else if (out_pos < output_size) {
-                        /* Only room for CR */
-                        output[out_pos++] = '\r';
-                    }
-                    MB_LOG_DEBUG("Received CR LF (newline)");
-                } else if (c == TELNET_IAC) {
-                    /* CR IAC - output CR and process IAC */
-                    if (out_pos < output_size) {
-                        output[out_pos++] = '\r';
-                    }
-                    tn->state = TELNET_STATE_IAC;
-                    break;
-                } else {
-                    /* CR followed by other character - output CR and process character normally */
-                    if (out_pos < output_size) {
-                        output[out_pos++] = '\r';
-                    }
-                    if (out_pos < output_size) {
-                        output[out_pos++] = c;
-                    }
-                    MB_LOG_DEBUG("Received CR followed by 0x%02x (non-standard)", c);
+/**
+ * Decode a chunk with the variant for one BINARY state
+ * Plain data is copied in runs: the binary variant only scans for IAC,
+ * the text variant for IAC and CR. Per-byte processing is left for
+ * commands, subnegotiation, Synch and in-band XON/XOFF.
+ * @return Input bytes consumed (stops early if BINARY changed mid-chunk)
+ */
+static inline __attribute__((always_inline))
+size_t telnet_decode_chunk(telnet_t *tn, const unsigned char *input, size_t input_len,
+                           unsigned char *output, size_t output_size, size_t *out_pos,
+                           const bool binary)
+{
+    size_t i = 0;
+
+    while (i < input_len) {
+        if (tn->state == TELNET_STATE_DATA && !tn->synch && !tn->remote_xonxoff) {
+            const unsigned char *run = input + i;
+            size_t avail = input_len - i;
+            size_t run_len;
+
+            if (binary) {
+                const unsigned char *iac = memchr(run, TELNET_IAC, avail);
+                run_len = (iac != NULL) ? (size_t)(iac - run) : avail;
+            } else {
+                run_len = 0;
+                while (run_len < avail && run[run_len] != TELNET_IAC && run[run_len] != '\r') {
+                    run_len++;
                 }
-                tn->state = TELNET_STATE_DATA;
-                break;
+            }
 
-            default:
-                MB_LOG_WARNING("Invalid telnet state: %d", tn->state);
-                tn->state = TELNET_STATE_DATA;
-                break;
+            if (run_len > 0) {
+                size_t copy = MIN(run_len, output_size - *out_pos);
+                if (output + *out_pos != run) {
+                    /* memmove: in-place decoding writes just behind the input */
+                    memmove(output + *out_pos, run, copy);
+                }
+                *out_pos += copy;
+                if (copy < run_len) {
+                    telnet_warn_input_overflow();
+                }
+                i += run_len;
+                continue;
+            }
+        }
+
+        telnet_decode_byte(tn, input[i++], output, output_size, out_pos, binary);
+
+        /* WILL/WONT BINARY switched variants - let the caller continue */
+        if (tn->binary_remote != binary) {
+            break;
         }
     }
 
+    return i;
+}
+
+/**
+ * Decoder variant for BINARY mode (pure IAC scanner)
+ */
+static size_t telnet_decode_binary(telnet_t *tn, const unsigned char *input, size_t input_len,
+                                   unsigned char *output, size_t output_size, size_t *out_pos)
+{
+    return telnet_decode_chunk(tn, input, input_len, output, output_size, out_pos, true);
+}
+
+/**
+ * Decoder variant for NVT mode (CR NUL / CR LF handling)
+ */
+static size_t telnet_decode_text(telnet_t *tn, const unsigned char *input, size_t input_len,
+                                 unsigned char *output, size_t output_size, size_t *out_pos)
+{
+    return telnet_decode_chunk(tn, input, input_len, output, output_size, out_pos, false);
+}
+
+/**
+ * Select the decoder variant for the current receive mode
+ */
+static void telnet_select_decoder(telnet_t *tn)
+{
+    tn->decoder = tn->binary_remote ? telnet_decode_binary : telnet_decode_text;
+}
+
+/**
+ * Process incoming data from telnet server
+ */
+int telnet_process_input(telnet_t *tn, const unsigned char *input, size_t input_len,
+                         unsigned char *output, size_t output_size, size_t *output_len)
+{
+    size_t out_pos = 0;
+    size_t consumed = 0;
+
+    if (tn == NULL || input == NULL || output == NULL || output_len == NULL) {
+        return ERROR_INVALID_ARG;
+    }
+
+    *output_len = 0;
+    tn->mark_count = 0;
+
+    if (tn->decoder == NULL) {
+        telnet_select_decoder(tn);
+    }
+
+    /* The variant is chosen once per chunk (again only if BINARY changes) */
+    while (consumed < input_len) {
+        consumed += tn->decoder(tn, input + consumed, input_len - consumed,
+                                output, output_size, &out_pos);
+    }
+
     *output_len = out_pos;
 
     if (out_pos > 0) {
@@ -826,6 +1533,18 @@ int telnet_process_input(telnet_t *tn, const unsigned char *input, size_t input_
     return SUCCESS;
 }
 
+/**
+ * Check whether the last processed input ended on a record/prompt mark
+ */
+bool telnet_ends_with_mark(telnet_t *tn, size_t output_len)
+{
+    if (tn == NULL) {
+        return false;
+    }
+
+    return tn->mark_count > 0 && tn->mark_offset == output_len;
+}
+
 /**
  * Prepare data for sending to telnet server (escape IAC bytes)
  */
@@ -886,7 +1605,7 @@ ssize_t telnet_send(telnet_t *tn, const void *data, size_t len)
 {
     ssize_t sent;
 
-    if (tn == NULL || data == NULL || tn->fd < 0) {
+    if (tn == NULL || data == NULL || tn->transport.ops == NULL) {
         return ERROR_INVALID_ARG;
     }
 
@@ -896,7 +1615,7 @@ ssize_t telnet_send(telnet_t *tn, const void *data, size_t len)
 
     MB_LOG_DEBUG("Telnet sending %zu bytes", len);
 
-    sent = send(tn->fd, data, len, 0);
+    sent = tn->transport.ops->send(&tn->transport, data, len, false);
     if (sent < 0) {
         if (errno == EAGAIN || errno == EWOULDBLOCK) {
             /* Would block */
@@ -909,6 +1628,225 @@ ssize_t telnet_send(telnet_t *tn, const void *data, size_t len)
     return sent;
 }
 
+/**
+ * Queue outbound data and send as much as possible
+ */
+ssize_t telnet_queue_output(telnet_t *tn, telnet_out_class_t cls, const void *data, size_t len)
+{
+    if (tn == NULL || data == NULL || cls >= TELNET_OUT_CLASSES) {
+        return ERROR_INVALID_ARG;
+    }
+
+    if (!tn->is_connected) {
+        return ERROR_CONNECTION;
+    }
+
+    if (iobuf_append(&tn->outq[cls], data, len) != SUCCESS) {
+        MB_LOG_WARNING("Outbound queue full (%zu bytes pending), dropping %zu bytes",
+                      iobuf_len(&tn->outq[cls]), len);
+        return ERROR_GENERAL;
+    }
+
+    return telnet_flush_output(tn);
+}
+
+/**
+ * Check whether a partial send of escaped data stopped inside an
+ * IAC IAC or CR LF / CR NUL pair (the queue front is always on a boundary)
+ */
+static bool telnet_out_split(const unsigned char *data, size_t sent, size_t len)
+{
+    size_t run = 0;
+
+    if (sent == 0 || sent >= len) {
+        return false;
+    }
+
+    if (data[sent - 1] == '\r') {
+        return data[sent] == '\n' || data[sent] == '\0';
+    }
+
+    while (run < sent && data[sent - 1 - run] == TELNET_IAC) {
+        run++;
+    }
+
+    return (run % 2) != 0;
+}
+
+/**
+ * Pick the class to send from next
+ */
+static int telnet_out_next(const telnet_t *tn)
+{
+    /* Finish a split pair first, or the other class would land inside it */
+    if (tn->out_split < TELNET_OUT_CLASSES) {
+        return tn->out_split;
+    }
+
+    for (int cls = 0; cls < TELNET_OUT_CLASSES; cls++) {
+        if (iobuf_len(&tn->outq[cls]) == 0) {
+            continue;
+        }
+        if (cls != TELNET_OUT_CONTROL && telnet_output_paused(tn)) {
+            break;
+        }
+        return cls;
+    }
+
+    return -1;
+}
+
+/**
+ * Send queued outbound data
+ */
+ssize_t telnet_flush_output(telnet_t *tn)
+{
+    ssize_t total = 0;
+    int cls;
+
+    if (tn == NULL) {
+        return ERROR_INVALID_ARG;
+    }
+
+    /* Bytes the transport already accepted go first (proxy request, TLS
+     * record retry); with data queued, the transport's send does this
+     * itself and can put both in one segment */
+    if (tn->transport.held > 0 && telnet_out_next(tn) < 0 &&
+        transport_flush(&tn->transport) < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        }
+        MB_LOG_ERROR("Telnet send error: %s", strerror(errno));
+        return ERROR_IO;
+    }
+
+    while ((cls = telnet_out_next(tn)) >= 0) {
+        iobuf_t *q = &tn->outq[cls];
+        const unsigned char *data = iobuf_data(q);
+        size_t len = iobuf_len(q);
+        ssize_t sent;
+
+        if (tn->out_split == cls) {
+            /* One byte completes the pair */
+            len = 1;
+        } else if (cls == TELNET_OUT_CONTROL && tn->out_urgent > 0) {
+            /* Stop just before the Synch DM */
+            len = tn->out_urgent - 1;
+        }
+
+        if (len == 0) {
+            /* The DM goes out as urgent data: the urgent pointer marks it (RFC 854) */
+            sent = tn->transport.ops->send(&tn->transport, data, 1, true);
+            if (sent < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    break;
+                }
+                MB_LOG_ERROR("Failed to send Synch: %s", strerror(errno));
+                return ERROR_IO;
+            }
+            len = 1;
+        } else {
+            sent = telnet_send(tn, data, len);
+            if (sent < 0) {
+                return sent;
+            }
+            if (sent == 0) {
+                break;
+            }
+        }
+
+        if (tn->out_split == cls) {
+            tn->out_split = TELNET_OUT_CLASSES;
+        } else if (cls != TELNET_OUT_CONTROL && telnet_out_split(data, (size_t)sent, len)) {
+            tn->out_split = (uint8_t)cls;
+        }
+
+        if (cls == TELNET_OUT_CONTROL && tn->out_urgent > 0) {
+            tn->out_urgent = ((size_t)sent < tn->out_urgent) ? tn->out_urgent - (size_t)sent : 0;
+        }
+
+        iobuf_consume(q, (size_t)sent);
+        total += sent;
+
+        if ((size_t)sent < len) {
+            break;
+        }
+    }
+
+    return total;
+}
+
+/**
+ * Drop queued outbound data of one class
+ */
+size_t telnet_discard_output(telnet_t *tn, telnet_out_class_t cls)
+{
+    iobuf_t *q;
+    size_t dropped;
+
+    if (tn == NULL || cls == TELNET_OUT_CONTROL || cls >= TELNET_OUT_CLASSES) {
+        return 0;
+    }
+
+    q = &tn->outq[cls];
+    dropped = iobuf_len(q);
+
+    /* Keep the byte that completes a pair already partly on the wire */
+    if (tn->out_split == cls && dropped > 0) {
+        unsigned char c = iobuf_data(q)[0];
+        iobuf_clear(q);
+        iobuf_append(q, &c, 1);
+        dropped--;
+    } else {
+        iobuf_clear(q);
+    }
+
+    return dropped;
+}
+
+/**
+ * Get number of queued outbound bytes
+ */
+size_t telnet_output_queued(const telnet_t *tn, telnet_out_class_t cls)
+{
+    size_t total = 0;
+
+    if (tn == NULL) {
+        return 0;
+    }
+
+    if (cls < TELNET_OUT_CLASSES) {
+        return iobuf_len(&tn->outq[cls]);
+    }
+
+    for (int i = 0; i < TELNET_OUT_CLASSES; i++) {
+        total += iobuf_len(&tn->outq[i]);
+    }
+
+    return total;
+}
+
+/**
+ * Check whether outbound data is held by remote flow control
+ */
+bool telnet_output_paused(const telnet_t *tn)
+{
+    return tn != NULL && (tn->output_paused || tn->cold->comport.remote_suspended);
+}
+
+/**
+ * Check whether queued outbound data can be sent
+ */
+bool telnet_output_pending(const telnet_t *tn)
+{
+    if (tn == NULL || tn->transport.want_read) {
+        /* A TLS handshake step needs the server's reply first */
+        return false;
+    }
+
+    return tn->transport.held > 0 || telnet_out_next(tn) >= 0;
+}
+
 /**
  * Receive data from telnet server
  */
@@ -916,7 +1854,7 @@ ssize_t telnet_recv(telnet_t *tn, void *buffer, size_t size)
 {
     ssize_t n;
 
-    if (tn == NULL || buffer == NULL || tn->fd < 0) {
+    if (tn == NULL || buffer == NULL || tn->transport.ops == NULL) {
         return ERROR_INVALID_ARG;
     }
 
@@ -924,13 +1862,15 @@ ssize_t telnet_recv(telnet_t *tn, void *buffer, size_t size)
         return ERROR_CONNECTION;
     }
 
-    n = recv(tn->fd, buffer, size, 0);
+    n = tn->transport.ops->recv(&tn->transport, buffer, size);
     if (n < 0) {
         if (errno == EAGAIN || errno == EWOULDBLOCK) {
             /* No data available */
             return 0;
         }
-        MB_LOG_ERROR("Telnet recv error: %s", strerror(errno));
+        int err = errno;
+        MB_LOG_ERROR("Telnet recv error: %s", strerror(err));
+        errno = err;    /* Callers tell a timed out path from a reset */
         return ERROR_IO;
     }
 
@@ -946,6 +1886,130 @@ ssize_t telnet_recv(telnet_t *tn, void *buffer, size_t size)
     return n;
 }
 
+/**
+ * Set preferred remote character set
+ */
+int telnet_set_charset(telnet_t *tn, const char *name)
+{
+    int id;
+
+    if (tn == NULL || name == NULL) {
+        return ERROR_INVALID_ARG;
+    }
+
+    id = charset_lookup(name);
+    if (id == CHARSET_INVALID) {
+        MB_LOG_WARNING("Unsupported charset: %s", name);
+        return ERROR_INVALID_ARG;
+    }
+
+    tn->charset_preferred = id;
+    tn->charset = id;
+
+    MB_LOG_INFO("Remote charset set to %s", charset_name(id));
+
+    /* Renegotiate if the server already agreed to CHARSET */
+    if (telnet_opt_isset(&tn->local_options, TELOPT_CHARSET) && tn->is_connected) {
+        telnet_send_charset_request(tn);
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * Handle TCP urgent notification
+ */
+void telnet_handle_urgent(telnet_t *tn)
+{
+    if (tn == NULL || tn->synch) {
+        return;
+    }
+
+    tn->synch = true;
+    MB_LOG_INFO("Received urgent data (Synch), discarding input until Data Mark");
+}
+
+/**
+ * Send Synch (IAC DM, DM as urgent data)
+ */
+int telnet_send_synch(telnet_t *tn)
+{
+    unsigned char buf[2] = { TELNET_IAC, TELNET_DM };
+    ssize_t ret;
+
+    if (tn == NULL || tn->transport.ops == NULL) {
+        return ERROR_INVALID_ARG;
+    }
+
+    if (!tn->is_connected) {
+        return ERROR_CONNECTION;
+    }
+
+    MB_LOG_DEBUG("Sending Synch");
+
+    if (iobuf_append(&tn->outq[TELNET_OUT_CONTROL], buf, sizeof(buf)) != SUCCESS) {
+        MB_LOG_WARNING("Control queue full, dropping Synch");
+        return ERROR_GENERAL;
+    }
+
+    /* The urgent pointer must point at the DM (RFC 854); it is sent
+     * after the control data queued before it */
+    tn->out_urgent = iobuf_len(&tn->outq[TELNET_OUT_CONTROL]);
+
+    ret = telnet_flush_output(tn);
+
+    return (ret < 0) ? (int)ret : SUCCESS;
+}
+
+/**
+ * Send Interrupt Process followed by Synch
+ */
+int telnet_send_interrupt(telnet_t *tn)
+{
+    int ret;
+
+    if (tn == NULL) {
+        return ERROR_INVALID_ARG;
+    }
+
+    /* Input typed or pasted ahead of the interrupt is no longer wanted */
+    size_t dropped = telnet_discard_output(tn, TELNET_OUT_INTERACTIVE) +
+                     telnet_discard_output(tn, TELNET_OUT_BULK);
+    if (dropped > 0) {
+        MB_LOG_DEBUG("Discarding %zu queued outbound bytes", dropped);
+    }
+
+    MB_LOG_INFO("Sending Interrupt Process");
+
+    ret = telnet_send_command(tn, TELNET_IP);
+    if (ret != SUCCESS) {
+        return ret;
+    }
+
+    return telnet_send_synch(tn);
+}
+
+/**
+ * Send Abort Output followed by Synch
+ */
+int telnet_send_abort_output(telnet_t *tn)
+{
+    int ret;
+
+    if (tn == NULL) {
+        return ERROR_INVALID_ARG;
+    }
+
+    MB_LOG_INFO("Sending Abort Output");
+
+    ret = telnet_send_command(tn, TELNET_AO);
+    if (ret != SUCCESS) {
+        return ret;
+    }
+
+    return telnet_send_synch(tn);
+}
+
 /**
  * Get file descriptor for select/poll
  */
@@ -967,7 +2031,7 @@ bool telnet_is_connected(telnet_t *tn)
         return false;
     }
 
-    return tn->is_connected && tn->fd >= 0;
+    return tn->is_connected && tn->transport.ops != NULL;
 }
 
 /**
@@ -991,5 +2055,5 @@ bool telnet_is_binary_mode(telnet_t *tn)
         return false;
     }
 
-    return tn->binary_mode;
+    return tn->binary_local || tn->binary_remote;
 }
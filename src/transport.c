@@ -0,0 +1,1546 @@
+/*
+ * transport.c - Byte stream transports under the telnet engine
+ */
+
+#include "transport.h"
+#include "telnet.h"
+#include <signal.h>
+#include <termios.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <netinet/tcp.h>
+
+#ifdef OTELNET_TLS
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#endif
+
+/* Serial line speeds */
+static const struct {
+    int baud;
+    speed_t speed;
+} transport_speeds[] = {
+    { 1200, B1200 }, { 2400, B2400 }, { 4800, B4800 }, { 9600, B9600 },
+    { 19200, B19200 }, { 38400, B38400 }, { 57600, B57600 }, { 115200, B115200 },
+    { 230400, B230400 }, { 460800, B460800 }, { 921600, B921600 }
+};
+
+#define TRANSPORT_SERIAL_DEFAULT_BAUD   115200
+
+/* Proxy types */
+typedef enum {
+    TRANSPORT_PROXY_NONE,
+    TRANSPORT_PROXY_SOCKS5,
+    TRANSPORT_PROXY_HTTP
+} transport_proxy_type_t;
+
+#define TRANSPORT_PROXY_NAME_MAX    256
+#define TRANSPORT_PROXY_IO_MAX      1024
+
+/* Proxy for TCP and TLS connections (see transport_proxy_configure()) */
+static struct {
+    transport_proxy_type_t type;
+    char host[TRANSPORT_PROXY_NAME_MAX];
+    int port;
+    char user[TRANSPORT_PROXY_NAME_MAX];
+    char pass[TRANSPORT_PROXY_NAME_MAX];
+    struct in_addr addr;            /* Proxy address, once resolved (see transport_proxy_resolve()) */
+    bool resolved;
+} transport_proxy_options;
+
+/* Proxy handshake state */
+struct transport_proxy_s {
+    transport_proxy_type_t type;
+    bool auth;                      /* SOCKS5: username/password sent */
+    bool established;
+    unsigned char request[TRANSPORT_PROXY_IO_MAX];
+    size_t request_len;
+    size_t request_sent;
+    unsigned char reply[TRANSPORT_PROXY_IO_MAX];
+    size_t reply_len;
+    size_t reply_used;              /* Proxy reply; bytes after it are session data */
+};
+
+/* TLS peer verification (see transport_tls_configure()) */
+static struct {
+    bool verify;
+    char ca_file[BUFFER_SIZE];
+} transport_tls_options = { true, "" };
+
+/* Dead peer detection for TCP and TLS sockets (see transport_keepalive_configure()) */
+static struct {
+    int idle;                       /* Seconds before the first keepalive (0 = off) */
+    int interval;
+    int count;
+    unsigned int user_timeout_ms;   /* TCP_USER_TIMEOUT (0 = kernel default) */
+} transport_keepalive_options;
+
+#ifdef OTELNET_TLS
+/* Largest TLS record payload: one SSL_write builds at most one record */
+#define TRANSPORT_TLS_RECORD    16384
+
+/* TLS session state */
+struct transport_tls_s {
+    SSL *ssl;
+    bool established;
+    /* A record that hit EAGAIN must be retried with the same bytes */
+    unsigned char retry[TRANSPORT_TLS_RECORD];
+    size_t retry_len;
+};
+
+/* Shared client context, created on first use */
+static SSL_CTX *transport_tls_ctx;
+#endif
+
+/**
+ * Set a descriptor non-blocking
+ */
+static void transport_set_nonblock(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags >= 0) {
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    }
+}
+
+/**
+ * Base64-encode
+ */
+bool transport_base64(const unsigned char *in, size_t len, char *out, size_t size)
+{
+    static const char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t o = 0;
+
+    if ((len + 2) / 3 * 4 + 1 > size) {
+        return false;
+    }
+
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t v = (uint32_t)in[i] << 16;
+
+        if (i + 1 < len) {
+            v |= (uint32_t)in[i + 1] << 8;
+        }
+        if (i + 2 < len) {
+            v |= in[i + 2];
+        }
+
+        out[o++] = alphabet[(v >> 18) & 0x3F];
+        out[o++] = alphabet[(v >> 12) & 0x3F];
+        out[o++] = (i + 1 < len) ? alphabet[(v >> 6) & 0x3F] : '=';
+        out[o++] = (i + 2 < len) ? alphabet[v & 0x3F] : '=';
+    }
+    out[o] = '\0';
+
+    return true;
+}
+
+/**
+ * Build the whole proxy request up front
+ * SOCKS5 offers a single method, so the greeting, credentials and
+ * CONNECT can all go out in one write without waiting for replies.
+ */
+static int transport_proxy_build(transport_proxy_t *px, const char *host, int port)
+{
+    size_t host_len = strlen(host);
+    unsigned char *p = px->request;
+
+    px->type = transport_proxy_options.type;
+
+    if (px->type == TRANSPORT_PROXY_HTTP) {
+        char credentials[TRANSPORT_PROXY_NAME_MAX * 2];
+        char auth[TRANSPORT_PROXY_IO_MAX / 2] = "";
+        int n;
+
+        if (transport_proxy_options.user[0] != '\0') {
+            snprintf(credentials, sizeof(credentials), "%s:%s",
+                     transport_proxy_options.user, transport_proxy_options.pass);
+            strcpy(auth, "Proxy-Authorization: Basic ");
+            if (!transport_base64((const unsigned char *)credentials, strlen(credentials),
+                                  auth + strlen(auth), sizeof(auth) - strlen(auth) - 2)) {
+                MB_LOG_ERROR("Proxy credentials too long");
+                return ERROR_INVALID_ARG;
+            }
+            strcat(auth, "\r\n");
+        }
+
+        n = snprintf((char *)px->request, sizeof(px->request),
+                     "CONNECT %s:%d HTTP/1.1\r\nHost: %s:%d\r\n%s\r\n",
+                     host, port, host, port, auth);
+        if (n < 0 || (size_t)n >= sizeof(px->request)) {
+            MB_LOG_ERROR("Proxy request too long for %s", host);
+            return ERROR_INVALID_ARG;
+        }
+        px->request_len = (size_t)n;
+        return SUCCESS;
+    }
+
+    if (host_len > 255) {
+        MB_LOG_ERROR("Host name too long for SOCKS5: %s", host);
+        return ERROR_INVALID_ARG;
+    }
+
+    /* Greeting: one method, no authentication or username/password */
+    px->auth = transport_proxy_options.user[0] != '\0';
+    *p++ = 0x05;
+    *p++ = 0x01;
+    *p++ = px->auth ? 0x02 : 0x00;
+
+    /* Username/password subnegotiation (RFC 1929) */
+    if (px->auth) {
+        size_t ulen = strlen(transport_proxy_options.user);
+        size_t plen = strlen(transport_proxy_options.pass);
+
+        *p++ = 0x01;
+        *p++ = (unsigned char)ulen;
+        memcpy(p, transport_proxy_options.user, ulen);
+        p += ulen;
+        *p++ = (unsigned char)plen;
+        memcpy(p, transport_proxy_options.pass, plen);
+        p += plen;
+    }
+
+    /* CONNECT by name: the proxy resolves it */
+    *p++ = 0x05;
+    *p++ = 0x01;
+    *p++ = 0x00;
+    *p++ = 0x03;
+    *p++ = (unsigned char)host_len;
+    memcpy(p, host, host_len);
+    p += host_len;
+    *p++ = (unsigned char)(port >> 8);
+    *p++ = (unsigned char)(port & 0xFF);
+
+    px->request_len = (size_t)(p - px->request);
+
+    return SUCCESS;
+}
+
+/**
+ * Get a SOCKS5 reply code description
+ */
+static const char *transport_socks5_error(unsigned char rep)
+{
+    switch (rep) {
+        case 0x01:
+            return "general failure";
+        case 0x02:
+            return "connection not allowed by ruleset";
+        case 0x03:
+            return "network unreachable";
+        case 0x04:
+            return "host unreachable";
+        case 0x05:
+            return "connection refused";
+        case 0x06:
+            return "TTL expired";
+        case 0x07:
+            return "command not supported";
+        case 0x08:
+            return "address type not supported";
+        default:
+            return "unknown error";
+    }
+}
+
+/**
+ * Parse the proxy reply received so far
+ * Returns its length once complete, 0 if more is needed, -1 on refusal.
+ */
+static int transport_proxy_parse(transport_proxy_t *px)
+{
+    const unsigned char *p = px->reply;
+    size_t n = px->reply_len;
+    size_t off = 0;
+
+    if (px->type == TRANSPORT_PROXY_HTTP) {
+        const unsigned char *end = memmem(p, n, "\r\n\r\n", 4);
+        int status = 0;
+
+        if (end == NULL) {
+            return 0;
+        }
+        if (sscanf((const char *)p, "HTTP/%*s %d", &status) != 1 || status < 200 || status > 299) {
+            const unsigned char *eol = memchr(p, '\r', n);
+            MB_LOG_ERROR("Proxy refused CONNECT: %.*s", (int)(eol - p), (const char *)p);
+            return -1;
+        }
+        return (int)(end + 4 - p);
+    }
+
+    /* Method selection */
+    if (n < 2) {
+        return 0;
+    }
+    if (p[0] != 0x05 || p[1] != (px->auth ? 0x02 : 0x00)) {
+        MB_LOG_ERROR("SOCKS5 proxy rejected %s", px->auth ? "username/password" : "no authentication");
+        return -1;
+    }
+    off = 2;
+
+    /* Authentication status */
+    if (px->auth) {
+        if (n < off + 2) {
+            return 0;
+        }
+        if (p[off + 1] != 0x00) {
+            MB_LOG_ERROR("SOCKS5 proxy authentication failed");
+            return -1;
+        }
+        off += 2;
+    }
+
+    /* CONNECT reply: VER REP RSV ATYP BND.ADDR BND.PORT */
+    if (n < off + 5) {
+        return 0;
+    }
+    if (p[off] != 0x05 || p[off + 1] != 0x00) {
+        MB_LOG_ERROR("SOCKS5 proxy CONNECT failed: %s", transport_socks5_error(p[off + 1]));
+        return -1;
+    }
+    switch (p[off + 3]) {
+        case 0x01:
+            off += 4 + 4 + 2;
+            break;
+        case 0x03:
+            off += 4 + 1 + p[off + 4] + 2;
+            break;
+        case 0x04:
+            off += 4 + 16 + 2;
+            break;
+        default:
+            MB_LOG_ERROR("SOCKS5 proxy sent a malformed reply");
+            return -1;
+    }
+
+    return (n < off) ? 0 : (int)off;
+}
+
+/**
+ * Write out the rest of the proxy request
+ * more (MSG_MORE) lets the session's first bytes share its segment.
+ */
+static int transport_proxy_flush(transport_t *tp, bool more)
+{
+    transport_proxy_t *px = tp->proxy;
+
+    while (px->request_sent < px->request_len) {
+        ssize_t n = send(tp->fd, px->request + px->request_sent,
+                         px->request_len - px->request_sent, more ? MSG_MORE : 0);
+        if (n < 0) {
+            return -1;
+        }
+        px->request_sent += (size_t)n;
+        tp->held -= (size_t)n;
+    }
+
+    return 0;
+}
+
+/**
+ * Read the proxy reply; 0 once the tunnel is up
+ */
+static int transport_proxy_handshake(transport_t *tp)
+{
+    transport_proxy_t *px = tp->proxy;
+
+    while (!px->established) {
+        ssize_t n;
+        int used;
+
+        if (px->reply_len == sizeof(px->reply)) {
+            MB_LOG_ERROR("Proxy reply too long");
+            errno = EPROTO;
+            return -1;
+        }
+
+        n = recv(tp->fd, px->reply + px->reply_len, sizeof(px->reply) - px->reply_len, 0);
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            MB_LOG_ERROR("Proxy closed the connection");
+            errno = ECONNRESET;
+            return -1;
+        }
+        px->reply_len += (size_t)n;
+
+        used = transport_proxy_parse(px);
+        if (used < 0) {
+            errno = ECONNREFUSED;
+            return -1;
+        }
+        if (used > 0) {
+            px->reply_used = (size_t)used;
+            px->established = true;
+            MB_LOG_INFO("Proxy tunnel established");
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Hand out session data that arrived with the proxy reply
+ */
+static size_t transport_proxy_take(transport_t *tp, void *buffer, size_t size)
+{
+    transport_proxy_t *px = tp->proxy;
+    size_t n = MIN(size, px->reply_len - px->reply_used);
+
+    memcpy(buffer, px->reply + px->reply_used, n);
+    px->reply_used += n;
+
+    return n;
+}
+
+/**
+ * Socket send (TCP urgent data for Synch)
+ */
+static ssize_t transport_socket_send(transport_t *tp, const void *data, size_t len, bool urgent)
+{
+    /* Data sent before the proxy replies is optimistic: it follows the request */
+    if (tp->proxy != NULL && transport_proxy_flush(tp, true) < 0) {
+        return -1;
+    }
+
+    return send(tp->fd, data, len, urgent && tp->type == TRANSPORT_TCP ? MSG_OOB : 0);
+}
+
+/**
+ * Socket receive
+ */
+static ssize_t transport_socket_recv(transport_t *tp, void *buffer, size_t size)
+{
+    if (tp->proxy != NULL) {
+        size_t n;
+
+        if (transport_proxy_handshake(tp) < 0) {
+            return -1;
+        }
+        n = transport_proxy_take(tp, buffer, size);
+        if (n > 0) {
+            return (ssize_t)n;
+        }
+    }
+
+    return recv(tp->fd, buffer, size, 0);
+}
+
+/**
+ * Close descriptor
+ */
+static void transport_fd_close(transport_t *tp)
+{
+    close(tp->fd);
+}
+
+/**
+ * Device write (no urgent data on a serial line)
+ */
+static ssize_t transport_fd_send(transport_t *tp, const void *data, size_t len, bool urgent)
+{
+    (void)urgent;
+    return write(tp->fd, data, len);
+}
+
+/**
+ * Device read
+ */
+static ssize_t transport_fd_recv(transport_t *tp, void *buffer, size_t size)
+{
+    ssize_t n = read(tp->fd, buffer, size);
+
+    /* A pty master reports EIO once the slave side is closed */
+    if (n < 0 && errno == EIO) {
+        return 0;
+    }
+
+    return n;
+}
+
+/**
+ * Close helper command socket and reap the command
+ */
+static void transport_pipe_close(transport_t *tp)
+{
+    close(tp->fd);
+
+    if (tp->pid > 0) {
+        kill(tp->pid, SIGTERM);
+        waitpid(tp->pid, NULL, 0);
+        tp->pid = 0;
+    }
+}
+
+/**
+ * Memory send: append to the outbound queue
+ */
+static ssize_t transport_memory_send(transport_t *tp, const void *data, size_t len, bool urgent)
+{
+    (void)urgent;
+
+    if (iobuf_append(tp->mem_tx, data, len) != SUCCESS) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    return (ssize_t)len;
+}
+
+/**
+ * Memory receive: take from the inbound queue
+ */
+static ssize_t transport_memory_recv(transport_t *tp, void *buffer, size_t size)
+{
+    size_t n = MIN(size, iobuf_len(tp->mem_rx));
+
+    if (n == 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    memcpy(buffer, iobuf_data(tp->mem_rx), n);
+    iobuf_consume(tp->mem_rx, n);
+
+    return (ssize_t)n;
+}
+
+/**
+ * Nothing to release
+ */
+static void transport_memory_close(transport_t *tp)
+{
+    (void)tp;
+}
+
+static const transport_ops_t transport_socket_ops = {
+    transport_socket_send, transport_socket_recv, transport_fd_close, NULL
+};
+
+static const transport_ops_t transport_device_ops = {
+    transport_fd_send, transport_fd_recv, transport_fd_close, NULL
+};
+
+static const transport_ops_t transport_pipe_ops = {
+    transport_socket_send, transport_socket_recv, transport_pipe_close, NULL
+};
+
+static const transport_ops_t transport_memory_ops = {
+    transport_memory_send, transport_memory_recv, transport_memory_close, NULL
+};
+
+/**
+ * Apply keepalive and user timeout settings to a TCP socket
+ */
+static void transport_set_keepalive(int fd)
+{
+    int on = 1;
+
+    if (transport_keepalive_options.idle > 0) {
+        if (setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on)) < 0 ||
+            setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &transport_keepalive_options.idle,
+                       sizeof(int)) < 0 ||
+            setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &transport_keepalive_options.interval,
+                       sizeof(int)) < 0 ||
+            setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &transport_keepalive_options.count,
+                       sizeof(int)) < 0) {
+            MB_LOG_WARNING("Failed to set TCP keepalive: %s", strerror(errno));
+        }
+    }
+
+    /* Unacknowledged data (or keepalives) this long means the path is dead */
+    if (transport_keepalive_options.user_timeout_ms > 0 &&
+        setsockopt(fd, IPPROTO_TCP, TCP_USER_TIMEOUT, &transport_keepalive_options.user_timeout_ms,
+                   sizeof(unsigned int)) < 0) {
+        MB_LOG_WARNING("Failed to set TCP_USER_TIMEOUT: %s", strerror(errno));
+    }
+}
+
+/**
+ * Set up a TCP socket for telnet: non-blocking, inline urgent data, small
+ * unsent backlog, keepalive
+ */
+static void transport_set_tcp_options(int fd)
+{
+    transport_set_nonblock(fd);
+
+    /* Keep urgent data in the stream so IAC DM is seen in order (Synch) */
+    int oobinline = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_OOBINLINE, &oobinline, sizeof(oobinline)) < 0) {
+        MB_LOG_WARNING("Failed to set SO_OOBINLINE: %s", strerror(errno));
+    }
+
+    /* Keep little unsent data in the kernel, so queued control and
+     * interactive data is not stuck behind a bulk backlog */
+    int lowat = TELNET_NOTSENT_LOWAT;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof(lowat)) < 0) {
+        MB_LOG_WARNING("Failed to set TCP_NOTSENT_LOWAT: %s", strerror(errno));
+    }
+
+    transport_set_keepalive(fd);
+}
+
+/**
+ * Resolve a host name to an IPv4 address (blocks for DNS)
+ */
+static int transport_resolve_host(const char *host, struct in_addr *addr)
+{
+    struct hostent *he = gethostbyname(host);
+
+    if (he == NULL || he->h_addrtype != AF_INET) {
+        MB_LOG_ERROR("Failed to resolve host: %s", host);
+        return ERROR_CONNECTION;
+    }
+
+    memcpy(addr, he->h_addr_list[0], sizeof(*addr));
+
+    return SUCCESS;
+}
+
+/**
+ * Open TCP connection (non-blocking connect)
+ * addr, if given, is where host was resolved to earlier.
+ */
+static int transport_open_tcp(transport_t *tp, const char *host, int port,
+                              const struct in_addr *addr)
+{
+    struct sockaddr_in server_addr;
+    struct in_addr resolved;
+    const char *target = host;
+    int target_port = port;
+
+    /* Through a proxy: connect there, the proxy resolves the target */
+    if (transport_proxy_options.type != TRANSPORT_PROXY_NONE) {
+        tp->proxy = calloc(1, sizeof(*tp->proxy));
+        if (tp->proxy == NULL || transport_proxy_build(tp->proxy, host, port) != SUCCESS) {
+            free(tp->proxy);
+            tp->proxy = NULL;
+            return ERROR_CONNECTION;
+        }
+        tp->held = tp->proxy->request_len;
+        host = transport_proxy_options.host;
+        port = transport_proxy_options.port;
+        addr = transport_proxy_options.resolved ? &transport_proxy_options.addr : NULL;
+        MB_LOG_INFO("Connecting to %s:%d via %s proxy %s:%d", target, target_port,
+                    tp->proxy->type == TRANSPORT_PROXY_HTTP ? "HTTP" : "SOCKS5", host, port);
+    }
+
+    tp->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (tp->fd < 0) {
+        MB_LOG_ERROR("Failed to create socket: %s", strerror(errno));
+        return ERROR_CONNECTION;
+    }
+
+    transport_set_tcp_options(tp->fd);
+
+    /* Resolve hostname */
+    if (addr == NULL) {
+        if (transport_resolve_host(host, &resolved) != SUCCESS) {
+            close(tp->fd);
+            return ERROR_CONNECTION;
+        }
+        addr = &resolved;
+    }
+
+    /* Setup server address */
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(port);
+    server_addr.sin_addr = *addr;
+
+    /* Connect to server */
+    if (connect(tp->fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+        if (errno != EINPROGRESS) {
+            MB_LOG_ERROR("Failed to connect: %s", strerror(errno));
+            close(tp->fd);
+            return ERROR_CONNECTION;
+        }
+        /* Connection in progress for non-blocking socket */
+    }
+
+    tp->ops = &transport_socket_ops;
+
+    return SUCCESS;
+}
+
+/**
+ * Open Unix domain stream socket
+ */
+static int transport_open_unix(transport_t *tp, const char *path)
+{
+    struct sockaddr_un addr;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        MB_LOG_ERROR("Unix socket path too long: %s", path);
+        return ERROR_CONNECTION;
+    }
+
+    tp->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (tp->fd < 0) {
+        MB_LOG_ERROR("Failed to create socket: %s", strerror(errno));
+        return ERROR_CONNECTION;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+
+    if (connect(tp->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        MB_LOG_ERROR("Failed to connect to %s: %s", path, strerror(errno));
+        close(tp->fd);
+        return ERROR_CONNECTION;
+    }
+
+    transport_set_nonblock(tp->fd);
+    tp->ops = &transport_socket_ops;
+
+    return SUCCESS;
+}
+
+/**
+ * Open serial line or pty device in raw mode
+ * Spec: DEVICE[,BAUD]
+ */
+static int transport_open_serial(transport_t *tp, const char *spec)
+{
+    char device[BUFFER_SIZE];
+    const char *comma = strchr(spec, ',');
+    int baud = TRANSPORT_SERIAL_DEFAULT_BAUD;
+    struct termios tio;
+
+    SAFE_STRNCPY(device, spec, sizeof(device));
+    if (comma != NULL) {
+        device[MIN((size_t)(comma - spec), sizeof(device) - 1)] = '\0';
+        baud = atoi(comma + 1);
+    }
+
+    tp->fd = open(device, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (tp->fd < 0) {
+        MB_LOG_ERROR("Failed to open %s: %s", device, strerror(errno));
+        return ERROR_CONNECTION;
+    }
+
+    if (tcgetattr(tp->fd, &tio) == 0) {
+        size_t i;
+
+        for (i = 0; i < sizeof(transport_speeds) / sizeof(transport_speeds[0]); i++) {
+            if (transport_speeds[i].baud == baud) {
+                break;
+            }
+        }
+        if (i == sizeof(transport_speeds) / sizeof(transport_speeds[0])) {
+            MB_LOG_ERROR("Unsupported baud rate: %d", baud);
+            close(tp->fd);
+            return ERROR_CONNECTION;
+        }
+
+        cfmakeraw(&tio);
+        tio.c_cflag |= CLOCAL | CREAD;
+        cfsetispeed(&tio, transport_speeds[i].speed);
+        cfsetospeed(&tio, transport_speeds[i].speed);
+        if (tcsetattr(tp->fd, TCSANOW, &tio) < 0) {
+            MB_LOG_WARNING("Failed to configure %s: %s", device, strerror(errno));
+        }
+        MB_LOG_INFO("Serial line %s at %d baud", device, baud);
+    }
+
+    tp->ops = &transport_device_ops;
+
+    return SUCCESS;
+}
+
+/**
+ * Run a helper command and talk to its stdin/stdout
+ */
+static int transport_open_pipe(transport_t *tp, const char *command)
+{
+    int sv[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) {
+        MB_LOG_ERROR("Failed to create socket pair: %s", strerror(errno));
+        return ERROR_CONNECTION;
+    }
+
+    tp->pid = fork();
+    if (tp->pid < 0) {
+        MB_LOG_ERROR("Failed to fork: %s", strerror(errno));
+        close(sv[0]);
+        close(sv[1]);
+        return ERROR_CONNECTION;
+    }
+
+    if (tp->pid == 0) {
+        /* Child: stdin/stdout are the stream, stderr stays on the terminal */
+        dup2(sv[1], STDIN_FILENO);
+        dup2(sv[1], STDOUT_FILENO);
+        signal(SIGPIPE, SIG_DFL);
+        execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+        _exit(127);
+    }
+
+    close(sv[1]);
+    tp->fd = sv[0];
+    transport_set_nonblock(tp->fd);
+    tp->ops = &transport_pipe_ops;
+
+    MB_LOG_INFO("Started transport command (pid %d): %s", (int)tp->pid, command);
+
+    return SUCCESS;
+}
+
+#ifdef OTELNET_TLS
+/**
+ * Log queued OpenSSL errors
+ */
+static void transport_tls_log_errors(const char *what)
+{
+    unsigned long err;
+    char buf[256];
+    bool logged = false;
+
+    while ((err = ERR_get_error()) != 0) {
+        ERR_error_string_n(err, buf, sizeof(buf));
+        MB_LOG_ERROR("%s: %s", what, buf);
+        logged = true;
+    }
+
+    if (!logged) {
+        MB_LOG_ERROR("%s: %s", what, errno != 0 ? strerror(errno) : "connection closed");
+    }
+}
+
+/**
+ * Map an OpenSSL I/O result to send()/recv() conventions
+ * Returns 0 for a clean end of stream, else -1 with errno set.  Output
+ * that must wait for inbound data sets want_read.
+ */
+static int transport_tls_result(transport_t *tp, int ret, bool output, const char *what)
+{
+    switch (SSL_get_error(tp->tls->ssl, ret)) {
+        case SSL_ERROR_WANT_READ:
+            tp->want_read = output;
+            errno = EAGAIN;
+            return -1;
+        case SSL_ERROR_WANT_WRITE:
+            errno = EAGAIN;
+            return -1;
+        case SSL_ERROR_ZERO_RETURN:
+            return 0;
+        case SSL_ERROR_SYSCALL:
+            if (errno == 0) {
+                errno = ECONNRESET;
+            }
+            transport_tls_log_errors(what);
+            return -1;
+        default:
+            transport_tls_log_errors(what);
+            errno = EPROTO;
+            return -1;
+    }
+}
+
+/**
+ * Drive the handshake; 0 once established
+ */
+static int transport_tls_handshake(transport_t *tp)
+{
+    transport_tls_t *tls = tp->tls;
+    char info[SMALL_BUFFER_SIZE];
+    int ret;
+
+    if (tls->established) {
+        return 0;
+    }
+
+    /* OpenSSL reads the socket itself: the ClientHello waits for the proxy */
+    if (tp->proxy != NULL &&
+        (transport_proxy_flush(tp, false) < 0 || transport_proxy_handshake(tp) < 0)) {
+        tp->want_read = (errno == EAGAIN && tp->proxy->request_sent == tp->proxy->request_len);
+        return -1;
+    }
+
+    ERR_clear_error();
+    errno = 0;
+    tp->want_read = false;
+    ret = SSL_do_handshake(tls->ssl);
+    if (ret != 1) {
+        int result = transport_tls_result(tp, ret, true, "TLS handshake failed");
+
+        if (result < 0 && errno == EAGAIN) {
+            return -1;
+        }
+        if (SSL_get_verify_result(tls->ssl) != X509_V_OK) {
+            MB_LOG_ERROR("TLS certificate verification failed: %s",
+                         X509_verify_cert_error_string(SSL_get_verify_result(tls->ssl)));
+        }
+        if (result == 0) {
+            errno = ECONNRESET;
+        }
+        return -1;
+    }
+
+    tls->established = true;
+    transport_tls_info(tp, info, sizeof(info));
+    MB_LOG_INFO("TLS session established: %s", info);
+
+    return 0;
+}
+
+/**
+ * Write out a record that hit EAGAIN
+ */
+static int transport_tls_flush(transport_t *tp)
+{
+    transport_tls_t *tls = tp->tls;
+    size_t n;
+    int ret;
+
+    if (tls->retry_len == 0) {
+        return 0;
+    }
+
+    ERR_clear_error();
+    errno = 0;
+    tp->want_read = false;
+    ret = SSL_write_ex(tls->ssl, tls->retry, tls->retry_len, &n);
+    if (ret != 1) {
+        if (transport_tls_result(tp, ret, true, "TLS send failed") == 0) {
+            errno = EPIPE;
+        }
+        return -1;
+    }
+
+    tp->held -= tls->retry_len;
+    tls->retry_len = 0;
+
+    return 0;
+}
+
+/**
+ * TLS send (no urgent data inside a TLS stream)
+ */
+static ssize_t transport_tls_send(transport_t *tp, const void *data, size_t len, bool urgent)
+{
+    transport_tls_t *tls = tp->tls;
+    size_t n;
+    int ret;
+
+    (void)urgent;
+
+    if (transport_tls_handshake(tp) < 0 || transport_tls_flush(tp) < 0) {
+        return -1;
+    }
+
+    len = MIN(len, TRANSPORT_TLS_RECORD);
+
+    ERR_clear_error();
+    errno = 0;
+    ret = SSL_write_ex(tls->ssl, data, len, &n);
+    if (ret == 1) {
+        return (ssize_t)n;
+    }
+
+    if (transport_tls_result(tp, ret, true, "TLS send failed") == 0) {
+        errno = EPIPE;
+        return -1;
+    }
+
+    if (errno == EAGAIN) {
+        /* The record is already built: keep its bytes for the retry and
+         * report them as sent, so the caller's queue is free to change */
+        memcpy(tls->retry, data, len);
+        tls->retry_len = len;
+        tp->held += len;
+        return (ssize_t)len;
+    }
+
+    return -1;
+}
+
+/**
+ * TLS receive
+ * Reads until the buffer is full or the socket is drained, so no
+ * decrypted data is left inside OpenSSL where select() cannot see it.
+ */
+static ssize_t transport_tls_recv(transport_t *tp, void *buffer, size_t size)
+{
+    transport_tls_t *tls = tp->tls;
+    size_t total = 0;
+
+    if (transport_tls_handshake(tp) < 0) {
+        return -1;
+    }
+
+    while (total < size) {
+        size_t n;
+        int ret;
+
+        ERR_clear_error();
+        errno = 0;
+        ret = SSL_read_ex(tls->ssl, (unsigned char *)buffer + total, size - total, &n);
+        if (ret != 1) {
+            if (total > 0) {
+                break;
+            }
+            return transport_tls_result(tp, ret, false, "TLS receive failed");
+        }
+        total += n;
+    }
+
+    /* A send waiting for the peer can be retried */
+    tp->want_read = false;
+
+    return (ssize_t)total;
+}
+
+/**
+ * Close TLS session and socket
+ */
+static void transport_tls_close(transport_t *tp)
+{
+    if (tp->tls != NULL) {
+        if (tp->tls->established) {
+            /* Best effort close_notify; the socket is non-blocking */
+            SSL_shutdown(tp->tls->ssl);
+        }
+        SSL_free(tp->tls->ssl);
+        free(tp->tls);
+        tp->tls = NULL;
+    }
+
+    tp->held = 0;
+    tp->want_read = false;
+    close(tp->fd);
+}
+
+static const transport_ops_t transport_tls_ops = {
+    transport_tls_send, transport_tls_recv, transport_tls_close, transport_tls_flush
+};
+
+/**
+ * Create the shared client context
+ */
+static int transport_tls_init(void)
+{
+    SSL_CTX *ctx;
+
+    if (transport_tls_ctx != NULL) {
+        return SUCCESS;
+    }
+
+    ctx = SSL_CTX_new(TLS_client_method());
+    if (ctx == NULL) {
+        transport_tls_log_errors("Failed to create TLS context");
+        return ERROR_GENERAL;
+    }
+
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+
+    /* Servers that just close the connection end the session cleanly */
+    SSL_CTX_set_options(ctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+
+    /* A record that hit EAGAIN is retried from tls->retry, not the caller's buffer */
+    SSL_CTX_set_mode(ctx, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+#ifdef SSL_OP_ENABLE_KTLS
+    /* Hand record encryption to the kernel when it supports the cipher */
+    SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+#endif
+
+    if (transport_tls_options.verify) {
+        int ret;
+
+        if (transport_tls_options.ca_file[0] != '\0') {
+            ret = SSL_CTX_load_verify_locations(ctx, transport_tls_options.ca_file, NULL);
+        } else {
+            ret = SSL_CTX_set_default_verify_paths(ctx);
+        }
+        if (ret != 1) {
+            transport_tls_log_errors("Failed to load CA certificates");
+            SSL_CTX_free(ctx);
+            return ERROR_GENERAL;
+        }
+        SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+    } else {
+        MB_LOG_WARNING("TLS server certificate verification disabled");
+    }
+
+    transport_tls_ctx = ctx;
+
+    return SUCCESS;
+}
+
+/**
+ * Open TCP connection and start a TLS client session on it
+ * The handshake runs from send/recv as the socket becomes ready.
+ */
+static int transport_open_tls(transport_t *tp, const char *host, int port,
+                              const struct in_addr *addr)
+{
+    transport_tls_t *tls;
+
+    if (transport_tls_init() != SUCCESS) {
+        return ERROR_CONNECTION;
+    }
+
+    if (transport_open_tcp(tp, host, port, addr) != SUCCESS) {
+        return ERROR_CONNECTION;
+    }
+
+    tls = calloc(1, sizeof(*tls));
+    if (tls == NULL || (tls->ssl = SSL_new(transport_tls_ctx)) == NULL) {
+        MB_LOG_ERROR("Failed to create TLS session");
+        free(tls);
+        close(tp->fd);
+        return ERROR_CONNECTION;
+    }
+
+    SSL_set_fd(tls->ssl, tp->fd);
+    SSL_set_connect_state(tls->ssl);
+    SSL_set_tlsext_host_name(tls->ssl, host);
+    if (transport_tls_options.verify) {
+        SSL_set1_host(tls->ssl, host);
+    }
+
+    tp->tls = tls;
+    tp->ops = &transport_tls_ops;
+
+    return SUCCESS;
+}
+#endif
+
+/**
+ * Get transport type named by a connection target
+ */
+transport_type_t transport_parse(const char *target)
+{
+    if (target == NULL) {
+        return TRANSPORT_NONE;
+    }
+
+    if (strncmp(target, "tls:", 4) == 0) {
+        return TRANSPORT_TLS;
+    }
+    if (strncmp(target, "unix:", 5) == 0) {
+        return TRANSPORT_UNIX;
+    }
+    if (strncmp(target, "serial:", 7) == 0) {
+        return TRANSPORT_SERIAL;
+    }
+    if (strncmp(target, "pipe:", 5) == 0) {
+        return TRANSPORT_PIPE;
+    }
+
+    return TRANSPORT_TCP;
+}
+
+/**
+ * Open a transport for a connection target
+ */
+int transport_open(transport_t *tp, const char *target, int port)
+{
+    return transport_open_resolved(tp, target, port, NULL);
+}
+
+/**
+ * Open a transport, connecting TCP and TLS targets to an address resolved earlier
+ */
+int transport_open_resolved(transport_t *tp, const char *target, int port,
+                            const struct in_addr *addr)
+{
+    int ret = ERROR_INVALID_ARG;
+
+    if (tp == NULL || target == NULL) {
+        return ERROR_INVALID_ARG;
+    }
+
+    memset(tp, 0, sizeof(*tp));
+    tp->fd = -1;
+    tp->type = transport_parse(target);
+
+    switch (tp->type) {
+        case TRANSPORT_TCP:
+            ret = transport_open_tcp(tp, target, port, addr);
+            break;
+        case TRANSPORT_TLS:
+#ifdef OTELNET_TLS
+            ret = transport_open_tls(tp, target + 4, port, addr);
+#else
+            MB_LOG_ERROR("TLS support not compiled in (rebuild with OpenSSL)");
+            ret = ERROR_CONNECTION;
+#endif
+            break;
+        case TRANSPORT_UNIX:
+            ret = transport_open_unix(tp, target + 5);
+            break;
+        case TRANSPORT_SERIAL:
+            ret = transport_open_serial(tp, target + 7);
+            break;
+        case TRANSPORT_PIPE:
+            ret = transport_open_pipe(tp, target + 5);
+            break;
+        default:
+            break;
+    }
+
+    if (ret != SUCCESS) {
+        free(tp->proxy);
+        tp->proxy = NULL;
+        tp->held = 0;
+        tp->fd = -1;
+        tp->ops = NULL;
+        tp->type = TRANSPORT_NONE;
+    }
+
+    return ret;
+}
+
+/**
+ * Open an in-memory transport
+ */
+int transport_open_memory(transport_t *tp, iobuf_t *rx, iobuf_t *tx)
+{
+    if (tp == NULL || rx == NULL || tx == NULL) {
+        return ERROR_INVALID_ARG;
+    }
+
+    memset(tp, 0, sizeof(*tp));
+    tp->type = TRANSPORT_MEMORY;
+    tp->fd = -1;
+    tp->mem_rx = rx;
+    tp->mem_tx = tx;
+    tp->ops = &transport_memory_ops;
+
+    return SUCCESS;
+}
+
+/**
+ * Take over an accepted socket
+ */
+int transport_adopt(transport_t *tp, transport_type_t type, int fd)
+{
+    if (tp == NULL || fd < 0 || (type != TRANSPORT_TCP && type != TRANSPORT_UNIX)) {
+        return ERROR_INVALID_ARG;
+    }
+
+    memset(tp, 0, sizeof(*tp));
+    tp->type = type;
+    tp->fd = fd;
+    tp->ops = &transport_socket_ops;
+
+    if (type == TRANSPORT_TCP) {
+        transport_set_tcp_options(fd);
+    } else {
+        transport_set_nonblock(fd);
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * Listen on [ADDRESS:]PORT
+ */
+int transport_listen(const char *spec)
+{
+    struct sockaddr_in addr;
+    const char *colon = strrchr(spec, ':');
+    const char *port_str = spec;
+    int one = 1;
+    int port;
+    int fd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    if (colon != NULL) {
+        char host[SMALL_BUFFER_SIZE];
+        size_t host_len = MIN((size_t)(colon - spec), sizeof(host) - 1);
+
+        memcpy(host, spec, host_len);
+        host[host_len] = '\0';
+        if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+            return ERROR_INVALID_ARG;
+        }
+        port_str = colon + 1;
+    }
+
+    port = atoi(port_str);
+    if (port < 1 || port > 65535) {
+        return ERROR_INVALID_ARG;
+    }
+    addr.sin_port = htons((uint16_t)port);
+
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return ERROR_IO;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        close(fd);
+        return ERROR_IO;
+    }
+
+    return fd;
+}
+
+/**
+ * Close a transport
+ */
+void transport_close(transport_t *tp)
+{
+    if (tp == NULL || tp->ops == NULL) {
+        return;
+    }
+
+    tp->ops->close(tp);
+    free(tp->proxy);
+    tp->proxy = NULL;
+    tp->held = 0;
+    tp->ops = NULL;
+    tp->fd = -1;
+    tp->type = TRANSPORT_NONE;
+}
+
+/**
+ * Write out bytes held by the transport
+ */
+int transport_flush(transport_t *tp)
+{
+    if (tp == NULL || tp->ops == NULL || tp->held == 0) {
+        return 0;
+    }
+
+    if (tp->proxy != NULL && transport_proxy_flush(tp, false) < 0) {
+        return -1;
+    }
+
+    return (tp->ops->flush != NULL) ? tp->ops->flush(tp) : 0;
+}
+
+/**
+ * Check whether a transport type takes a TCP port
+ */
+bool transport_uses_port(transport_type_t type)
+{
+    return type == TRANSPORT_TCP || type == TRANSPORT_TLS;
+}
+
+/**
+ * Check whether the descriptor carries the plain byte stream
+ */
+bool transport_fd_is_stream(const transport_t *tp)
+{
+    if (tp == NULL || tp->ops == NULL || tp->fd < 0) {
+        return false;
+    }
+
+    /* Nothing of the stream may be left in the proxy reply buffer */
+    if (tp->proxy != NULL &&
+        (!tp->proxy->established || tp->proxy->reply_used < tp->proxy->reply_len)) {
+        return false;
+    }
+
+#ifdef OTELNET_TLS
+    if (tp->type == TRANSPORT_TLS) {
+        return tp->tls->established && tp->tls->retry_len == 0 &&
+               SSL_pending(tp->tls->ssl) == 0 &&
+               BIO_get_ktls_send(SSL_get_wbio(tp->tls->ssl)) &&
+               BIO_get_ktls_recv(SSL_get_rbio(tp->tls->ssl));
+    }
+#endif
+
+    return true;
+}
+
+/**
+ * Route TCP and TLS connections through a proxy
+ */
+int transport_proxy_configure(const char *url)
+{
+    char spec[BUFFER_SIZE];
+    char *host;
+    char *user = "";
+    char *pass = "";
+    char *at;
+    char *colon;
+    transport_proxy_type_t type;
+    int port;
+
+    memset(&transport_proxy_options, 0, sizeof(transport_proxy_options));
+
+    if (url == NULL || url[0] == '\0') {
+        return SUCCESS;
+    }
+
+    if (strncmp(url, "socks5://", 9) == 0 || strncmp(url, "socks5h://", 10) == 0) {
+        type = TRANSPORT_PROXY_SOCKS5;
+        port = 1080;
+    } else if (strncmp(url, "http://", 7) == 0) {
+        type = TRANSPORT_PROXY_HTTP;
+        port = 8080;
+    } else {
+        MB_LOG_ERROR("Unsupported proxy (use socks5:// or http://): %s", url);
+        return ERROR_INVALID_ARG;
+    }
+
+    SAFE_STRNCPY(spec, strstr(url, "://") + 3, sizeof(spec));
+    host = spec;
+
+    /* user[:pass]@ */
+    at = strrchr(spec, '@');
+    if (at != NULL) {
+        *at = '\0';
+        host = at + 1;
+        user = spec;
+        colon = strchr(user, ':');
+        if (colon != NULL) {
+            *colon = '\0';
+            pass = colon + 1;
+        }
+    }
+
+    /* host[:port][/] */
+    host[strcspn(host, "/")] = '\0';
+    colon = strrchr(host, ':');
+    if (colon != NULL) {
+        *colon = '\0';
+        port = atoi(colon + 1);
+    }
+
+    /* Every field fits a SOCKS5 length byte */
+    if (host[0] == '\0' || port < 1 || port > 65535 || strlen(host) >= TRANSPORT_PROXY_NAME_MAX ||
+        strlen(user) >= TRANSPORT_PROXY_NAME_MAX || strlen(pass) >= TRANSPORT_PROXY_NAME_MAX) {
+        MB_LOG_ERROR("Invalid proxy: %s", url);
+        return ERROR_INVALID_ARG;
+    }
+
+    memcpy(transport_proxy_options.host, host, strlen(host) + 1);
+    memcpy(transport_proxy_options.user, user, strlen(user) + 1);
+    memcpy(transport_proxy_options.pass, pass, strlen(pass) + 1);
+    transport_proxy_options.port = port;
+    transport_proxy_options.type = type;
+
+    return SUCCESS;
+}
+
+/**
+ * Check whether TCP and TLS connections go through a proxy
+ */
+bool transport_proxy_enabled(void)
+{
+    return transport_proxy_options.type != TRANSPORT_PROXY_NONE;
+}
+
+/**
+ * Resolve the proxy host once for all later connections
+ */
+int transport_proxy_resolve(void)
+{
+    if (!transport_proxy_enabled()) {
+        return SUCCESS;
+    }
+
+    if (transport_resolve_host(transport_proxy_options.host, &transport_proxy_options.addr) != SUCCESS) {
+        return ERROR_CONNECTION;
+    }
+    transport_proxy_options.resolved = true;
+
+    return SUCCESS;
+}
+
+/**
+ * Resolve the host of a TCP or TLS target
+ */
+int transport_resolve(const char *target, struct in_addr *addr)
+{
+    transport_type_t type = transport_parse(target);
+
+    if (addr == NULL || (type != TRANSPORT_TCP && type != TRANSPORT_TLS)) {
+        return ERROR_INVALID_ARG;
+    }
+
+    return transport_resolve_host(type == TRANSPORT_TLS ? target + 4 : target, addr);
+}
+
+/**
+ * Set dead peer detection for TCP and TLS sockets
+ */
+void transport_keepalive_configure(int idle, int interval, int count, unsigned int user_timeout_ms)
+{
+    transport_keepalive_options.idle = MAX(idle, 0);
+    transport_keepalive_options.interval = MAX(interval, 1);
+    transport_keepalive_options.count = MAX(count, 1);
+    transport_keepalive_options.user_timeout_ms = user_timeout_ms;
+}
+
+/**
+ * Set TLS peer verification options
+ */
+void transport_tls_configure(bool verify, const char *ca_file)
+{
+    transport_tls_options.verify = verify;
+    SAFE_STRNCPY(transport_tls_options.ca_file, ca_file != NULL ? ca_file : "",
+                 sizeof(transport_tls_options.ca_file));
+}
+
+/**
+ * Describe an established TLS session
+ */
+bool transport_tls_info(const transport_t *tp, char *buf, size_t size)
+{
+#ifdef OTELNET_TLS
+    if (tp != NULL && tp->ops != NULL && tp->type == TRANSPORT_TLS && tp->tls->established) {
+        bool tx = BIO_get_ktls_send(SSL_get_wbio(tp->tls->ssl));
+        bool rx = BIO_get_ktls_recv(SSL_get_rbio(tp->tls->ssl));
+
+        snprintf(buf, size, "%s %s, kTLS %s", SSL_get_version(tp->tls->ssl),
+                 SSL_get_cipher_name(tp->tls->ssl),
+                 tx && rx ? "tx+rx" : tx ? "tx" : rx ? "rx" : "off");
+        return true;
+    }
+#else
+    (void)tp;
+    (void)buf;
+    (void)size;
+#endif
+
+    return false;
+}
+
+/**
+ * Check whether this build supports TLS
+ */
+bool transport_tls_available(void)
+{
+#ifdef OTELNET_TLS
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Get a printable name for a transport type
+ */
+const char *transport_name(transport_type_t type)
+{
+    switch (type) {
+        case TRANSPORT_TCP:
+            return "tcp";
+        case TRANSPORT_TLS:
+            return "tls";
+        case TRANSPORT_UNIX:
+            return "unix";
+        case TRANSPORT_SERIAL:
+            return "serial";
+        case TRANSPORT_PIPE:
+            return "pipe";
+        case TRANSPORT_MEMORY:
+            return "memory";
+        default:
+            return "none";
+    }
+}
@@ -0,0 +1,419 @@
+/*
+ * utf8.c - UTF-8 validation and chunk boundary handling
+ *
+ * The vectorized validator follows the lookup-table algorithm of Keiser
+ * and Lemire ("Validating UTF-8 In Less Than One Instruction Per Byte"):
+ * three 16-entry nibble tables classify every byte pair of a 16-byte block
+ * at once, so valid text is checked without any per-byte branches.
+ */
+
+#include "utf8.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <tmmintrin.h>
+#define UTF8_HAVE_SSSE3 1
+#endif
+
+/* U+FFFD REPLACEMENT CHARACTER */
+static const unsigned char utf8_replacement[3] = {0xEF, 0xBF, 0xBD};
+
+/**
+ * Check if byte is start of multibyte UTF-8 sequence
+ */
+bool utf8_is_start(unsigned char byte)
+{
+    /* UTF-8 start bytes: 11xxxxxx */
+    return (byte & 0xC0) == 0xC0 && (byte & 0xFE) != 0xFE;
+}
+
+/**
+ * Check if byte is UTF-8 continuation byte
+ */
+bool utf8_is_continuation(unsigned char byte)
+{
+    /* UTF-8 continuation bytes: 10xxxxxx */
+    return (byte & 0xC0) == 0x80;
+}
+
+/**
+ * Get expected length of UTF-8 sequence from first byte
+ */
+int utf8_sequence_length(unsigned char byte)
+{
+    if ((byte & 0x80) == 0x00) {
+        /* 0xxxxxxx - 1 byte (ASCII) */
+        return 1;
+    } else if ((byte & 0xE0) == 0xC0) {
+        /* 110xxxxx - 2 bytes */
+        return 2;
+    } else if ((byte & 0xF0) == 0xE0) {
+        /* 1110xxxx - 3 bytes */
+        return 3;
+    } else if ((byte & 0xF8) == 0xF0) {
+        /* 11110xxx - 4 bytes */
+        return 4;
+    }
+
+    /* Invalid */
+    return 0;
+}
+
+/**
+ * Decode one UTF-8 character (strict, RFC 3629)
+ */
+int utf8_decode_char(const unsigned char *s, size_t len, uint32_t *cp)
+{
+    unsigned char c;
+    unsigned char lo = 0x80;
+    unsigned char hi = 0xBF;
+    int need;
+    uint32_t value;
+
+    if (s == NULL || len == 0 || cp == NULL) {
+        return 0;
+    }
+
+    c = s[0];
+    if (c < 0x80) {
+        *cp = c;
+        return 1;
+    }
+
+    /* Continuation bytes, overlong C0/C1 and F5-FF never start a sequence */
+    if (c < 0xC2 || c > 0xF4) {
+        return -1;
+    }
+
+    need = utf8_sequence_length(c);
+    value = c & (0x7F >> need);
+
+    /* Second byte range excludes overlongs, surrogates and > U+10FFFF */
+    if (c == 0xE0) {
+        lo = 0xA0;
+    } else if (c == 0xED) {
+        hi = 0x9F;
+    } else if (c == 0xF0) {
+        lo = 0x90;
+    } else if (c == 0xF4) {
+        hi = 0x8F;
+    }
+
+    for (int k = 1; k < need; k++) {
+        if ((size_t)k >= len) {
+            return 0;
+        }
+        if (k == 1 ? (s[k] < lo || s[k] > hi) : !utf8_is_continuation(s[k])) {
+            return -1;
+        }
+        value = (value << 6) | (s[k] & 0x3F);
+    }
+
+    *cp = value;
+    return need;
+}
+
+/**
+ * Scalar validator: length of valid prefix
+ */
+static size_t utf8_validate_scalar(const unsigned char *data, size_t len)
+{
+    size_t i = 0;
+    uint32_t cp;
+
+    while (i < len) {
+        /* Skip ASCII eight bytes at a time */
+        while (i + 8 <= len) {
+            uint64_t word;
+            memcpy(&word, data + i, sizeof(word));
+            if (word & 0x8080808080808080ULL) {
+                break;
+            }
+            i += 8;
+        }
+
+        if (i >= len) {
+            break;
+        }
+
+        int used = utf8_decode_char(data + i, len - i, &cp);
+        if (used <= 0) {
+            break;
+        }
+        i += (size_t)used;
+    }
+
+    return i;
+}
+
+#ifdef UTF8_HAVE_SSSE3
+
+/* Error classes of the lookup algorithm */
+#define U8_TOO_SHORT    (1 << 0)
+#define U8_TOO_LONG     (1 << 1)
+#define U8_OVERLONG_3   (1 << 2)
+#define U8_TOO_LARGE    (1 << 3)
+#define U8_SURROGATE    (1 << 4)
+#define U8_OVERLONG_2   (1 << 5)
+#define U8_TOO_LARGE_1000 (1 << 6)
+#define U8_OVERLONG_4   (1 << 6)
+#define U8_TWO_CONTS    (1 << 7)
+#define U8_CARRY        (U8_TOO_SHORT | U8_TOO_LONG | U8_TWO_CONTS)
+
+/**
+ * Back up from a block boundary to the start of a possibly incomplete character
+ */
+static size_t utf8_char_boundary(const unsigned char *data, size_t pos)
+{
+    for (size_t k = 1; k <= 3 && k <= pos; k++) {
+        unsigned char c = data[pos - k];
+        if (c >= 0xC0) {
+            return pos - k;
+        } else if (c < 0x80) {
+            break;
+        }
+    }
+
+    return pos;
+}
+
+/**
+ * SSSE3 validator: returns a character boundary up to which data is valid
+ */
+__attribute__((target("ssse3")))
+static size_t utf8_validate_ssse3(const unsigned char *data, size_t len)
+{
+    const __m128i byte_1_high = _mm_setr_epi8(
+        /* 0_______ : ASCII in byte 1 */
+        U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG,
+        U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG,
+        /* 10______ : continuation in byte 1 */
+        (char)U8_TWO_CONTS, (char)U8_TWO_CONTS, (char)U8_TWO_CONTS, (char)U8_TWO_CONTS,
+        /* 1100____, 1101____ : two byte lead */
+        U8_TOO_SHORT | U8_OVERLONG_2,
+        U8_TOO_SHORT,
+        /* 1110____ : three byte lead */
+        U8_TOO_SHORT | U8_OVERLONG_3 | U8_SURROGATE,
+        /* 1111____ : four byte lead */
+        U8_TOO_SHORT | U8_TOO_LARGE | U8_TOO_LARGE_1000 | U8_OVERLONG_4);
+    const __m128i byte_1_low = _mm_setr_epi8(
+        (char)(U8_CARRY | U8_OVERLONG_3 | U8_OVERLONG_2 | U8_OVERLONG_4),
+        (char)(U8_CARRY | U8_OVERLONG_2),
+        (char)U8_CARRY,
+        (char)U8_CARRY,
+        (char)(U8_CARRY | U8_TOO_LARGE),
+        (char)(U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000),
+        (char)(U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000),
+        (char)(U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000),
+        (char)(U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000),
+        (char)(U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000),
+        (char)(U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000),
+        (char)(U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000),
+        (char)(U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000),
+        (char)(U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000 | U8_SURROGATE),
+        (char)(U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000),
+        (char)(U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000));
+    const __m128i byte_2_high = _mm_setr_epi8(
+        /* 0_______ : ASCII in byte 2 */
+        U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT,
+        U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT,
+        /* 1000____ */
+        (char)(U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_OVERLONG_3 |
+               U8_TOO_LARGE_1000 | U8_OVERLONG_4),
+        /* 1001____ */
+        (char)(U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_OVERLONG_3 | U8_TOO_LARGE),
+        /* 101_____ */
+        (char)(U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_SURROGATE | U8_TOO_LARGE),
+        (char)(U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_SURROGATE | U8_TOO_LARGE),
+        /* 11______ : lead in byte 2 */
+        U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT);
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    const __m128i third_min = _mm_set1_epi8((char)(0xE0 - 0x80));
+    const __m128i fourth_min = _mm_set1_epi8((char)(0xF0 - 0x80));
+    const __m128i high_bit = _mm_set1_epi8((char)0x80);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i prev = zero;
+    size_t pos = 0;
+
+    while (pos + 16 <= len) {
+        __m128i input = _mm_loadu_si128((const __m128i *)(data + pos));
+
+        /* ASCII block after an ASCII block: nothing to check */
+        if (_mm_movemask_epi8(_mm_or_si128(input, prev)) == 0) {
+            prev = input;
+            pos += 16;
+            continue;
+        }
+
+        __m128i prev1 = _mm_alignr_epi8(input, prev, 15);
+        __m128i sc = _mm_and_si128(
+            _mm_and_si128(
+                _mm_shuffle_epi8(byte_1_high, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+                _mm_shuffle_epi8(byte_1_low, _mm_and_si128(prev1, nibble))),
+            _mm_shuffle_epi8(byte_2_high, _mm_and_si128(_mm_srli_epi16(input, 4), nibble)));
+
+        /* Third and fourth bytes of 3/4-byte sequences must be continuations */
+        __m128i prev2 = _mm_alignr_epi8(input, prev, 14);
+        __m128i prev3 = _mm_alignr_epi8(input, prev, 13);
+        __m128i must23 = _mm_and_si128(
+            _mm_or_si128(_mm_subs_epu8(prev2, third_min), _mm_subs_epu8(prev3, fourth_min)),
+            high_bit);
+        __m128i error = _mm_xor_si128(must23, sc);
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(error, zero)) != 0xFFFF) {
+            break;
+        }
+
+        prev = input;
+        pos += 16;
+    }
+
+    return utf8_char_boundary(data, pos);
+}
+
+/**
+ * Check CPU support for SSSE3 (cached)
+ */
+static bool utf8_cpu_has_ssse3(void)
+{
+    static int supported = -1;
+
+    if (supported < 0) {
+        supported = __builtin_cpu_supports("ssse3") ? 1 : 0;
+    }
+
+    return supported == 1;
+}
+
+#endif /* UTF8_HAVE_SSSE3 */
+
+/**
+ * Find the longest valid prefix
+ */
+size_t utf8_validate(const unsigned char *data, size_t len)
+{
+    size_t pos = 0;
+
+    if (data == NULL) {
+        return 0;
+    }
+
+#ifdef UTF8_HAVE_SSSE3
+    if (len >= 32 && utf8_cpu_has_ssse3()) {
+        pos = utf8_validate_ssse3(data, len);
+    }
+#endif
+
+    /* Scalar validation from the last known character boundary */
+    return pos + utf8_validate_scalar(data + pos, len - pos);
+}
+
+/**
+ * Initialize UTF-8 stream state
+ */
+void utf8_stream_init(utf8_stream_t *st, bool replace_invalid)
+{
+    if (st == NULL) {
+        return;
+    }
+
+    memset(st, 0, sizeof(*st));
+    st->replace_invalid = replace_invalid;
+}
+
+/**
+ * Emit an invalid sequence (replaced or passed through)
+ */
+static void utf8_emit_invalid(utf8_stream_t *st, const unsigned char *bad, size_t bad_len,
+                              unsigned char *output, size_t output_size, size_t *out_pos)
+{
+    const unsigned char *src = st->replace_invalid ? utf8_replacement : bad;
+    size_t len = st->replace_invalid ? sizeof(utf8_replacement) : bad_len;
+
+    st->invalid_count++;
+
+    if (*out_pos + len <= output_size) {
+        memcpy(output + *out_pos, src, len);
+        *out_pos += len;
+    }
+}
+
+/**
+ * Process a chunk of UTF-8 data
+ */
+int utf8_stream_process(utf8_stream_t *st, const unsigned char *input, size_t input_len,
+                        unsigned char *output, size_t output_size, size_t *output_len)
+{
+    size_t i = 0;
+    size_t out_pos = 0;
+    uint32_t cp;
+    int ret;
+
+    if (st == NULL || input == NULL || output == NULL || output_len == NULL) {
+        return ERROR_INVALID_ARG;
+    }
+
+    *output_len = 0;
+
+    /* Complete a sequence carried over from the previous chunk */
+    if (st->carry_len > 0) {
+        ret = 0;
+        while (ret == 0 && i < input_len) {
+            st->carry[st->carry_len++] = input[i++];
+            ret = utf8_decode_char(st->carry, st->carry_len, &cp);
+        }
+
+        if (ret == 0) {
+            /* Still incomplete */
+            return SUCCESS;
+        }
+
+        if (ret > 0) {
+            if (st->carry_len <= output_size) {
+                memcpy(output, st->carry, st->carry_len);
+                out_pos = st->carry_len;
+            }
+        } else {
+            /* The byte just appended broke the sequence - reprocess it */
+            i--;
+            st->carry_len--;
+            utf8_emit_invalid(st, st->carry, st->carry_len, output, output_size, &out_pos);
+        }
+        st->carry_len = 0;
+    }
+
+    while (i < input_len) {
+        size_t valid = utf8_validate(input + i, input_len - i);
+
+        if (out_pos + valid > output_size) {
+            MB_LOG_WARNING("UTF-8 stage buffer full - %zu bytes dropped", input_len - i);
+            break;
+        }
+        memcpy(output + out_pos, input + i, valid);
+        out_pos += valid;
+        i += valid;
+
+        if (i >= input_len) {
+            break;
+        }
+
+        ret = utf8_decode_char(input + i, input_len - i, &cp);
+        if (ret == 0) {
+            /* Sequence split at chunk boundary - carry it */
+            st->carry_len = input_len - i;
+            memcpy(st->carry, input + i, st->carry_len);
+            break;
+        }
+
+        /* Invalid: skip the maximal valid prefix (at least one byte) */
+        size_t bad = 1;
+        while (bad < input_len - i && utf8_decode_char(input + i, bad + 1, &cp) == 0) {
+            bad++;
+        }
+        utf8_emit_invalid(st, input + i, bad, output, output_size, &out_pos);
+        i += bad;
+    }
+
+    *output_len = out_pos;
+
+    return SUCCESS;
+}
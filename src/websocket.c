@@ -0,0 +1,402 @@
+/*
+ * websocket.c - WebSocket server side (RFC 6455) for browser consoles
+ */
+
+#include "websocket.h"
+#include "telnet.h"
+#include <ctype.h>
+#include <strings.h>
+
+/* Appended to the client's key before hashing (RFC 6455 section 1.3) */
+#define WS_GUID     "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+/**
+ * Rotate a 32-bit word left
+ */
+static inline uint32_t ws_rol(uint32_t v, unsigned int n)
+{
+    return (v << n) | (v >> (32 - n));
+}
+
+/**
+ * Hash one 64-byte block into the SHA-1 state
+ */
+static void ws_sha1_block(uint32_t h[5], const unsigned char *block)
+{
+    uint32_t w[80];
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 |
+               (uint32_t)block[i * 4 + 2] << 8 | block[i * 4 + 3];
+    }
+    for (int i = 16; i < 80; i++) {
+        w[i] = ws_rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    for (int i = 0; i < 80; i++) {
+        uint32_t f;
+        uint32_t k;
+        uint32_t t;
+
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+
+        t = ws_rol(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = ws_rol(b, 30);
+        b = a;
+        a = t;
+    }
+
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+}
+
+/**
+ * Compute the SHA-1 digest of data
+ */
+void ws_sha1(const void *data, size_t len, unsigned char digest[20])
+{
+    uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    const unsigned char *p = data;
+    unsigned char tail[128];
+    size_t full = len & ~(size_t)63;
+    size_t rest = len - full;
+    size_t tail_len;
+    uint64_t bits = (uint64_t)len * 8;
+
+    for (size_t i = 0; i < full; i += 64) {
+        ws_sha1_block(h, p + i);
+    }
+
+    /* Padding: 0x80, zeros, then the length in bits (big-endian) */
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, p + full, rest);
+    tail[rest] = 0x80;
+    tail_len = (rest < 56) ? 64 : 128;
+    for (int i = 0; i < 8; i++) {
+        tail[tail_len - 1 - i] = (unsigned char)(bits >> (i * 8));
+    }
+    for (size_t i = 0; i < tail_len; i += 64) {
+        ws_sha1_block(h, tail + i);
+    }
+
+    for (int i = 0; i < 5; i++) {
+        digest[i * 4] = (unsigned char)(h[i] >> 24);
+        digest[i * 4 + 1] = (unsigned char)(h[i] >> 16);
+        digest[i * 4 + 2] = (unsigned char)(h[i] >> 8);
+        digest[i * 4 + 3] = (unsigned char)h[i];
+    }
+}
+
+/**
+ * Find a request header (case-insensitive name, value trimmed)
+ */
+static bool ws_header(const char *request, const char *name, char *value, size_t size)
+{
+    size_t name_len = strlen(name);
+    const char *line = strstr(request, "\r\n");
+
+    while (line != NULL && line[2] != '\0') {
+        line += 2;
+        if (strncasecmp(line, name, name_len) == 0 && line[name_len] == ':') {
+            const char *v = line + name_len + 1;
+            const char *end = strstr(v, "\r\n");
+            size_t len;
+
+            if (end == NULL) {
+                end = v + strlen(v);
+            }
+            while (v < end && (*v == ' ' || *v == '\t')) {
+                v++;
+            }
+            while (end > v && (end[-1] == ' ' || end[-1] == '\t')) {
+                end--;
+            }
+            len = MIN((size_t)(end - v), size - 1);
+            memcpy(value, v, len);
+            value[len] = '\0';
+            return true;
+        }
+        line = strstr(line, "\r\n");
+    }
+
+    return false;
+}
+
+/**
+ * Check that a browser's Origin names the host it connected to
+ * Requests without an Origin header do not come from a browser page.
+ */
+static bool ws_same_origin(const char *request)
+{
+    char origin[SMALL_BUFFER_SIZE];
+    char host[SMALL_BUFFER_SIZE];
+    const char *origin_host;
+
+    if (!ws_header(request, "Origin", origin, sizeof(origin))) {
+        return true;
+    }
+    if (!ws_header(request, "Host", host, sizeof(host)) || host[0] == '\0') {
+        return false;
+    }
+
+    /* "scheme://host[:port]"; an opaque origin ("null") matches nothing */
+    origin_host = strstr(origin, "://");
+    if (origin_host == NULL) {
+        return false;
+    }
+
+    return strcasecmp(origin_host + 3, host) == 0;
+}
+
+/**
+ * Check an opening handshake and build the HTTP response
+ */
+int ws_handshake(const char *request, const char *origin, char *response, size_t size,
+                 size_t *response_len)
+{
+    char value[SMALL_BUFFER_SIZE];
+    char key[SMALL_BUFFER_SIZE + sizeof(WS_GUID)];
+    char accept[32];
+    unsigned char digest[20];
+    const char *reason;
+    const char *extra = "";
+    int status;
+    int len;
+
+    if (strncmp(request, "GET ", 4) != 0) {
+        status = 405;
+        reason = "Method Not Allowed";
+    } else if (!ws_header(request, "Upgrade", value, sizeof(value)) ||
+               strcasestr(value, "websocket") == NULL) {
+        status = 426;
+        reason = "Upgrade Required";
+        extra = "Upgrade: websocket\r\n";
+    } else if (!ws_header(request, "Sec-WebSocket-Version", value, sizeof(value)) ||
+               strcmp(value, "13") != 0) {
+        status = 426;
+        reason = "Upgrade Required";
+        extra = "Sec-WebSocket-Version: 13\r\n";
+    } else if ((origin != NULL && origin[0] != '\0') ?
+               (!ws_header(request, "Origin", value, sizeof(value)) ||
+                strcasecmp(value, origin) != 0) :
+               !ws_same_origin(request)) {
+        /* A page from elsewhere must not drive the console with the user's browser */
+        status = 403;
+        reason = "Forbidden";
+    } else if (!ws_header(request, "Sec-WebSocket-Key", value, sizeof(value)) ||
+               value[0] == '\0') {
+        status = 400;
+        reason = "Bad Request";
+    } else {
+        snprintf(key, sizeof(key), "%s%s", value, WS_GUID);
+        ws_sha1(key, strlen(key), digest);
+        transport_base64(digest, sizeof(digest), accept, sizeof(accept));
+
+        len = snprintf(response, size,
+                       "HTTP/1.1 101 Switching Protocols\r\n"
+                       "Upgrade: websocket\r\n"
+                       "Connection: Upgrade\r\n"
+                       "Sec-WebSocket-Accept: %s\r\n"
+                       "\r\n", accept);
+        *response_len = MIN((size_t)len, size - 1);
+        return 101;
+    }
+
+    len = snprintf(response, size,
+                   "HTTP/1.1 %d %s\r\n"
+                   "%s"
+                   "Connection: close\r\n"
+                   "Content-Length: 0\r\n"
+                   "\r\n", status, reason, extra);
+    *response_len = MIN((size_t)len, size - 1);
+
+    return status;
+}
+
+/**
+ * Write a final server frame header
+ */
+size_t ws_frame_header(unsigned char *out, unsigned char opcode, uint64_t len)
+{
+    out[0] = 0x80 | opcode;
+
+    if (len < 126) {
+        out[1] = (unsigned char)len;
+        return 2;
+    }
+    if (len <= 0xFFFF) {
+        out[1] = 126;
+        out[2] = (unsigned char)(len >> 8);
+        out[3] = (unsigned char)len;
+        return 4;
+    }
+
+    out[1] = 127;
+    for (int i = 0; i < 8; i++) {
+        out[2 + i] = (unsigned char)(len >> (56 - i * 8));
+    }
+    return 10;
+}
+
+/**
+ * Build a close frame
+ */
+size_t ws_close_frame(unsigned char *out, unsigned int status)
+{
+    size_t len = ws_frame_header(out, WS_OP_CLOSE, 2);
+
+    out[len++] = (unsigned char)(status >> 8);
+    out[len++] = (unsigned char)status;
+
+    return len;
+}
+
+/**
+ * Reset a parser for a new connection
+ */
+void ws_parser_init(ws_parser_t *p)
+{
+    memset(p, 0, sizeof(*p));
+    p->head_need = 2;
+}
+
+/**
+ * Take a complete frame header
+ * @return SUCCESS, or ERROR_INVALID_ARG on a protocol violation
+ */
+static int ws_parse_header(ws_parser_t *p)
+{
+    const unsigned char *h = p->head;
+    size_t pos = 2;
+    uint64_t len = h[1] & 0x7F;
+    bool fin = (h[0] & 0x80) != 0;
+
+    p->opcode = h[0] & 0x0F;
+
+    /* No extensions are negotiated, so no RSV bits */
+    if ((h[0] & 0x70) != 0) {
+        return ERROR_INVALID_ARG;
+    }
+
+    if (len == 126) {
+        len = (uint64_t)h[2] << 8 | h[3];
+        pos = 4;
+    } else if (len == 127) {
+        len = 0;
+        for (int i = 0; i < 8; i++) {
+            len = len << 8 | h[2 + i];
+        }
+        pos = 10;
+        if (len >> 63) {
+            return ERROR_INVALID_ARG;
+        }
+    }
+
+    switch (p->opcode) {
+        case WS_OP_CONTINUATION:
+        case WS_OP_TEXT:
+        case WS_OP_BINARY:
+            break;
+        case WS_OP_CLOSE:
+        case WS_OP_PING:
+        case WS_OP_PONG:
+            if (!fin || len > WS_CONTROL_MAX) {
+                return ERROR_INVALID_ARG;
+            }
+            break;
+        default:
+            return ERROR_INVALID_ARG;
+    }
+
+    memcpy(p->mask, h + pos, 4);
+    p->mask_pos = 0;
+    p->remaining = len;
+    p->control_len = 0;
+    p->in_payload = true;
+
+    return SUCCESS;
+}
+
+/**
+ * Decode client frames
+ */
+ssize_t ws_parse(ws_parser_t *p, unsigned char *data, size_t len, ws_msg_t *msg)
+{
+    size_t used = 0;
+    size_t n;
+
+    msg->type = WS_MSG_NONE;
+    msg->data = NULL;
+    msg->len = 0;
+
+    if (!p->in_payload) {
+        while (used < len && p->head_len < p->head_need) {
+            p->head[p->head_len++] = data[used++];
+
+            /* Two bytes tell the length field's size; a mask must follow it */
+            if (p->head_len == 2) {
+                unsigned char len7 = p->head[1] & 0x7F;
+
+                if (!(p->head[1] & 0x80)) {
+                    return ERROR_INVALID_ARG;
+                }
+                p->head_need = 2 + (len7 == 126 ? 2 : len7 == 127 ? 8 : 0) + 4;
+            }
+        }
+        if (p->head_len < p->head_need) {
+            return (ssize_t)used;
+        }
+        if (ws_parse_header(p) != SUCCESS) {
+            return ERROR_INVALID_ARG;
+        }
+        p->head_len = 0;
+        p->head_need = 2;
+    }
+
+    n = (size_t)MIN((uint64_t)(len - used), p->remaining);
+    for (size_t i = 0; i < n; i++) {
+        data[used + i] ^= p->mask[p->mask_pos];
+        p->mask_pos = (p->mask_pos + 1) & 3;
+    }
+    p->remaining -= n;
+
+    if (p->opcode & 0x8) {
+        memcpy(p->control + p->control_len, data + used, n);
+        p->control_len += n;
+        if (p->remaining == 0) {
+            msg->type = WS_MSG_CONTROL;
+            msg->opcode = p->opcode;
+            msg->data = p->control;
+            msg->len = p->control_len;
+        }
+    } else if (n > 0) {
+        msg->type = WS_MSG_DATA;
+        msg->opcode = p->opcode;
+        msg->data = data + used;
+        msg->len = n;
+    }
+
+    if (p->remaining == 0) {
+        p->in_payload = false;
+    }
+
+    return (ssize_t)(used + n);
+}
@@ -26,7 +26,7 @@ TELOPT_ECHO = 1
 TELOPT_SGA = 3
 TELOPT_TTYPE = 24
 TELOPT_LINEMODE = 34
-TELOPT_CHARSET = 42  # Unsupported option for testing
+TELOPT_AUTHENTICATION = 37  # Unsupported option for testing
 
 def bytes_to_hex(data):
     """Convert bytes to hex string for logging"""
@@ -53,7 +53,7 @@ def option_name(opt):
         TELOPT_SGA: "SGA",
         TELOPT_TTYPE: "TERMINAL-TYPE",
         TELOPT_LINEMODE: "LINEMODE",
-        TELOPT_CHARSET: "CHARSET"
+        TELOPT_AUTHENTICATION: "AUTHENTICATION"
     }
     return names.get(opt, f"UNKNOWN({opt})")
 
@@ -104,13 +104,13 @@ def run_test_server(port=8881):
 
         # Test 1: Send unsupported option requests
         print("\n[TEST SERVER] Test 1: Sending unsupported option requests")
-        print("[TEST SERVER]   Sending: IAC WILL CHARSET (unsupported)")
-        conn.send(bytes([IAC, WILL, TELOPT_CHARSET]))
+        print("[TEST SERVER]   Sending: IAC WILL AUTHENTICATION (unsupported)")
+        conn.send(bytes([IAC, WILL, TELOPT_AUTHENTICATION]))
 
         time.sleep(0.1)
 
-        print("[TEST SERVER]   Sending: IAC DO CHARSET (unsupported)")
-        conn.send(bytes([IAC, DO, TELOPT_CHARSET]))
+        print("[TEST SERVER]   Sending: IAC DO AUTHENTICATION (unsupported)")
+        conn.send(bytes([IAC, DO, TELOPT_AUTHENTICATION]))
 
         # Receive responses
         time.sleep(0.2)
@@ -131,12 +131,12 @@ def run_test_server(port=8881):
                     print(f"[TEST SERVER]   {response_str}")
 
                     # Check expected responses
-                    if cmd == DONT and opt == TELOPT_CHARSET:
-                        print("[TEST SERVER]   ✓ Correctly rejected WILL CHARSET with DONT")
-                        expected_responses.append("DONT CHARSET")
-                    elif cmd == WONT and opt == TELOPT_CHARSET:
-                        print("[TEST SERVER]   ✓ Correctly rejected DO CHARSET with WONT")
-                        expected_responses.append("WONT CHARSET")
+                    if cmd == DONT and opt == TELOPT_AUTHENTICATION:
+                        print("[TEST SERVER]   ✓ Correctly rejected WILL AUTHENTICATION with DONT")
+                        expected_responses.append("DONT AUTHENTICATION")
+                    elif cmd == WONT and opt == TELOPT_AUTHENTICATION:
+                        print("[TEST SERVER]   ✓ Correctly rejected DO AUTHENTICATION with WONT")
+                        expected_responses.append("WONT AUTHENTICATION")
 
                     i += 3
                 else:
@@ -147,16 +147,16 @@ def run_test_server(port=8881):
             print("[TEST SERVER] TEST RESULTS:")
             print("[TEST SERVER] ======================")
 
-            if "DONT CHARSET" in expected_responses:
-                print("[TEST SERVER] ✓ PASS: Client rejected WILL CHARSET with DONT")
+            if "DONT AUTHENTICATION" in expected_responses:
+                print("[TEST SERVER] ✓ PASS: Client rejected WILL AUTHENTICATION with DONT")
             else:
-                print("[TEST SERVER] ✗ FAIL: Client did not send DONT for WILL CHARSET")
+                print("[TEST SERVER] ✗ FAIL: Client did not send DONT for WILL AUTHENTICATION")
                 test_passed = False
 
-            if "WONT CHARSET" in expected_responses:
-                print("[TEST SERVER] ✓ PASS: Client rejected DO CHARSET with WONT")
+            if "WONT AUTHENTICATION" in expected_responses:
+                print("[TEST SERVER] ✓ PASS: Client rejected DO AUTHENTICATION with WONT")
             else:
-                print("[TEST SERVER] ✗ FAIL: Client did not send WONT for DO CHARSET")
+                print("[TEST SERVER] ✗ FAIL: Client did not send WONT for DO AUTHENTICATION")
                 test_passed = False
 
             if test_passed:
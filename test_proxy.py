@@ -0,0 +1,197 @@
+#!/usr/bin/env python3
+"""
+Local proxy stand-in for proxy support tests and benchmarks
+
+This script runs a minimal SOCKS5 (RFC 1928/1929) or HTTP CONNECT proxy
+that relays to the requested target.  It reports, per connection, whether
+the client pipelined its handshake: the whole request in one write, and
+session data (the initial telnet negotiation) sent before the proxy's
+reply, i.e. without waiting a round trip.  An optional delay stands in
+for a proxy hop on a slow management network.
+"""
+
+import select
+import socket
+import struct
+import sys
+import threading
+import time
+
+def bytes_to_hex(data):
+    """Convert bytes to hex string for logging"""
+    return ' '.join(f'{b:02x}' for b in data)
+
+def recv_exact(conn, n):
+    """Receive exactly n bytes"""
+    data = b''
+    while len(data) < n:
+        chunk = conn.recv(n - len(data))
+        if not chunk:
+            raise ConnectionError("client closed during handshake")
+        data += chunk
+    return data
+
+def socks5_handshake(conn, user, password):
+    """Read a SOCKS5 request; returns (host, port, reply)"""
+    ver, nmethods = recv_exact(conn, 2)
+    methods = recv_exact(conn, nmethods)
+    if ver != 5:
+        raise ConnectionError(f"not SOCKS5 (version {ver})")
+
+    method = 0x02 if user else 0x00
+    reply = b''
+    if method not in methods:
+        conn.sendall(bytes([5, 0xFF]))
+        raise ConnectionError("no acceptable authentication method")
+    reply += bytes([5, method])
+
+    if method == 0x02:
+        _, ulen = recv_exact(conn, 2)
+        got_user = recv_exact(conn, ulen).decode()
+        plen = recv_exact(conn, 1)[0]
+        got_pass = recv_exact(conn, plen).decode()
+        ok = (got_user == user and got_pass == password)
+        reply += bytes([1, 0 if ok else 1])
+        if not ok:
+            conn.sendall(reply)
+            raise ConnectionError("authentication failed")
+
+    _, cmd, _, atyp = recv_exact(conn, 4)
+    if atyp == 1:
+        host = socket.inet_ntoa(recv_exact(conn, 4))
+    elif atyp == 3:
+        host = recv_exact(conn, recv_exact(conn, 1)[0]).decode()
+    elif atyp == 4:
+        host = socket.inet_ntop(socket.AF_INET6, recv_exact(conn, 16))
+    else:
+        raise ConnectionError(f"bad address type {atyp}")
+    port = struct.unpack('!H', recv_exact(conn, 2))[0]
+    if cmd != 1:
+        raise ConnectionError(f"unsupported command {cmd}")
+
+    return host, port, reply
+
+def connect_reply(mode, ok):
+    """Reply to the CONNECT request"""
+    if mode == 'socks5':
+        return bytes([5, 0 if ok else 5, 0, 1, 0, 0, 0, 0, 0, 0])
+    if ok:
+        return b'HTTP/1.1 200 Connection established\r\n\r\n'
+    return b'HTTP/1.1 502 Bad Gateway\r\n\r\n'
+
+def http_handshake(conn):
+    """Read an HTTP CONNECT request; returns (host, port, reply)"""
+    data = b''
+    while b'\r\n\r\n' not in data:
+        chunk = conn.recv(1)
+        if not chunk:
+            raise ConnectionError("client closed during handshake")
+        data += chunk
+
+    request_line = data.split(b'\r\n')[0].decode()
+    method, target, _ = request_line.split(' ', 2)
+    if method != 'CONNECT':
+        raise ConnectionError(f"unsupported method {method}")
+    host, port = target.rsplit(':', 1)
+    return host, int(port), b''
+
+def relay(client, server):
+    """Copy bytes both ways until either side closes"""
+    sockets = [client, server]
+    while True:
+        readable, _, _ = select.select(sockets, [], [], 60)
+        if not readable:
+            return
+        for s in readable:
+            data = s.recv(65536)
+            if not data:
+                return
+            (server if s is client else client).sendall(data)
+
+def handle(conn, addr, mode, user, password, delay):
+    """Serve one proxied connection"""
+    start = time.monotonic()
+    try:
+        # Everything the client sends in its first flight counts as pipelined
+        time.sleep(0.05)
+        if mode == 'socks5':
+            host, port, reply = socks5_handshake(conn, user, password)
+        else:
+            host, port, reply = http_handshake(conn)
+
+        conn.setblocking(False)
+        try:
+            early = conn.recv(65536)
+        except BlockingIOError:
+            early = b''
+        conn.setblocking(True)
+
+        print(f"[PROXY] {addr[0]}:{addr[1]} -> {host}:{port}")
+        if early:
+            print(f"[PROXY]   ✓ {len(early)} bytes of session data sent before the reply")
+            print(f"[PROXY]     {bytes_to_hex(early[:48])}")
+        else:
+            print("[PROXY]   ✗ no session data before the reply (handshake not pipelined)")
+
+        # Simulated proxy hop latency
+        time.sleep(delay)
+        try:
+            server = socket.create_connection((host, port), timeout=10)
+        except OSError:
+            conn.sendall(reply + connect_reply(mode, False))
+            raise
+        conn.sendall(reply + connect_reply(mode, True))
+        if early:
+            server.sendall(early)
+        print(f"[PROXY]   tunnel up after {(time.monotonic() - start) * 1000:.0f} ms")
+
+        relay(conn, server)
+        server.close()
+    except Exception as e:
+        print(f"[PROXY] {addr[0]}:{addr[1]} error: {e}")
+    finally:
+        conn.close()
+
+def run_proxy(port, mode, user, password, delay):
+    """Accept connections until interrupted"""
+    server_socket = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    server_socket.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    server_socket.bind(('127.0.0.1', port))
+    server_socket.listen(16)
+
+    print(f"[PROXY] {mode} proxy listening on 127.0.0.1:{port}")
+    try:
+        while True:
+            conn, addr = server_socket.accept()
+            threading.Thread(target=handle, args=(conn, addr, mode, user, password, delay),
+                             daemon=True).start()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        server_socket.close()
+
+if __name__ == "__main__":
+    # Usage: test_proxy.py [socks5|http] [port] [delay_ms] [user:pass]
+    mode = sys.argv[1] if len(sys.argv) > 1 else 'socks5'
+    port = int(sys.argv[2]) if len(sys.argv) > 2 else (1080 if mode == 'socks5' else 8080)
+    delay = int(sys.argv[3]) / 1000.0 if len(sys.argv) > 3 else 0.0
+    user, password = (sys.argv[4].split(':', 1) + [''])[:2] if len(sys.argv) > 4 else ('', '')
+
+    if mode not in ('socks5', 'http'):
+        print(f"Unknown proxy type: {mode} (use socks5 or http)")
+        sys.exit(1)
+
+    print("=" * 70)
+    print("OTELNET PROXY STAND-IN")
+    print("=" * 70)
+    print()
+    print("To run the test:")
+    print(f"  1. Run this script: python3 {sys.argv[0]} {mode} {port}")
+    scheme = 'socks5' if mode == 'socks5' else 'http'
+    print(f"  2. Set PROXY={scheme}://127.0.0.1:{port} in otelnet.conf")
+    print("  3. In another terminal: ./build/otelnet <host> <port>")
+    print()
+    print("=" * 70)
+    print()
+
+    run_proxy(port, mode, user, password, delay)
@@ -0,0 +1,38 @@
+/*
+ * test.h - Minimal checks for the unit tests under tests/
+ *
+ * Each test is a standalone program linked with every module except
+ * otelnet.c; "make test" builds and runs them all.  A failed check
+ * prints its location and the test exits non-zero at the end.
+ */
+
+#ifndef OTELNET_TEST_H
+#define OTELNET_TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int test_failures;
+
+/* Record a failure (and go on) unless cond holds */
+#define TEST_CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        test_failures++; \
+    } \
+} while (0)
+
+/* Abort the test unless cond holds (later checks depend on it) */
+#define TEST_REQUIRE(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: requirement failed: %s\n", __FILE__, __LINE__, #cond); \
+        exit(EXIT_FAILURE); \
+    } \
+} while (0)
+
+/* Report and exit status for main() */
+#define TEST_DONE(name) \
+    (fprintf(stderr, "%s: %s\n", name, test_failures == 0 ? "ok" : "FAILED"), \
+     test_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE)
+
+#endif /* OTELNET_TEST_H */
@@ -0,0 +1,194 @@
+/*
+ * test_decode.c - In-place decoding vs the per-byte state machine
+ *
+ * The receive path decodes in place: input is received one byte ahead
+ * of where the output starts, and telnet_process_input() compacts it
+ * backwards (see otelnet_process_telnet()), scanning runs of plain data
+ * with the decoder variant for its mode.  Two sessions get the same
+ * random stream of data, CR pairs, commands, negotiation and
+ * subnegotiation in random chunk sizes.  One decodes in place; the
+ * other decodes into a separate buffer and honors in-band XON/XOFF,
+ * which keeps every byte on the state machine (the stream never holds
+ * XON or XOFF as data).  Their output, protocol state and the replies
+ * they send must be identical after every chunk.  Both sessions run
+ * over the in-memory transport, so replies are captured without sockets.
+ */
+
+#include "pool.h"
+#include "telnet.h"
+#include "test.h"
+
+#define STREAMS         200
+#define STREAM_LEN      (64 * 1024)
+#define CHUNK_MAX       600
+
+/* Options the stream negotiates (BINARY switches decoder variants) */
+static const unsigned char options[] = {
+    TELOPT_BINARY, TELOPT_ECHO, TELOPT_SGA, TELOPT_TIMING_MARK, TELOPT_TTYPE, TELOPT_EOR,
+    TELOPT_NAWS, TELOPT_LFLOW, TELOPT_LINEMODE, TELOPT_CHARSET, 99
+};
+
+static uint32_t rng_state;
+
+/**
+ * xorshift32: the same streams on every run
+ */
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+/**
+ * Fill a stream with a random mix of what servers send
+ */
+static size_t make_stream(unsigned char *s, size_t size)
+{
+    size_t n = 0;
+
+    while (n + 32 < size) {
+        uint32_t r = rng() % 100;
+
+        if (r < 55) {
+            s[n++] = (unsigned char)(' ' + rng() % 95);
+        } else if (r < 65) {
+            s[n++] = (unsigned char)(0x80 + rng() % 0x7F);
+        } else if (r < 75) {
+            static const unsigned char after_cr[] = { '\n', '\0', 'x', '\r' };
+            s[n++] = '\r';
+            s[n++] = after_cr[rng() % sizeof(after_cr)];
+        } else if (r < 80) {
+            s[n++] = '\n';
+        } else if (r < 85) {
+            s[n++] = TELNET_IAC;
+            s[n++] = TELNET_IAC;
+        } else if (r < 89) {
+            static const unsigned char commands[] = { TELNET_NOP, TELNET_GA, TELNET_EOR, TELNET_DM };
+            s[n++] = TELNET_IAC;
+            s[n++] = commands[rng() % sizeof(commands)];
+        } else if (r < 97) {
+            s[n++] = TELNET_IAC;
+            s[n++] = (unsigned char)(TELNET_WILL + rng() % 4);
+            s[n++] = options[rng() % sizeof(options)];
+        } else {
+            size_t len = rng() % 8;
+            s[n++] = TELNET_IAC;
+            s[n++] = TELNET_SB;
+            s[n++] = (rng() % 2) ? TELOPT_TTYPE : 99;
+            s[n++] = 1;         /* SEND */
+            for (size_t i = 0; i < len; i++) {
+                s[n++] = (unsigned char)rng();
+                if (s[n - 1] == TELNET_IAC) {
+                    s[n++] = TELNET_IAC;
+                }
+            }
+            s[n++] = TELNET_IAC;
+            s[n++] = TELNET_SE;
+        }
+    }
+
+    return n;
+}
+
+/**
+ * Start a session over the in-memory transport
+ */
+static void open_session(telnet_t *tn, iobuf_t *rx, iobuf_t *tx)
+{
+    transport_t tp;
+
+    iobuf_init(rx, STREAM_LEN);
+    iobuf_init(tx, STREAM_LEN * 4);
+    TEST_REQUIRE(telnet_init(tn) == SUCCESS);
+    TEST_REQUIRE(transport_open_memory(&tp, rx, tx) == SUCCESS);
+    TEST_REQUIRE(telnet_attach(tn, &tp) == SUCCESS);
+}
+
+/**
+ * End a session
+ */
+static void close_session(telnet_t *tn, iobuf_t *rx, iobuf_t *tx)
+{
+    telnet_free(tn);
+    transport_close(&tn->transport);
+    iobuf_free(rx);
+    iobuf_free(tx);
+}
+
+/**
+ * Decode one stream both ways and compare
+ */
+static void run_stream(const unsigned char *stream, size_t len)
+{
+    static unsigned char work[CHUNK_MAX + 1];
+    static unsigned char out[CHUNK_MAX];
+    telnet_t a;
+    telnet_t b;
+    iobuf_t a_rx, a_tx;
+    iobuf_t b_rx, b_tx;
+    size_t pos = 0;
+
+    open_session(&a, &a_rx, &a_tx);
+    open_session(&b, &b_rx, &b_tx);
+
+    /* The reference: no run scanning, every byte through the state machine */
+    b.remote_xonxoff = true;
+
+    while (pos < len) {
+        size_t n = 1 + rng() % CHUNK_MAX;
+        size_t a_len;
+        size_t b_len;
+
+        n = MIN(n, len - pos);
+
+        /* In place: received one byte ahead of the output */
+        memcpy(work + 1, stream + pos, n);
+        TEST_CHECK(telnet_process_input(&a, work + 1, n, work, n + 1, &a_len) == SUCCESS);
+
+        TEST_CHECK(telnet_process_input(&b, stream + pos, n, out, sizeof(out), &b_len) == SUCCESS);
+
+        TEST_CHECK(a_len == b_len);
+        TEST_CHECK(memcmp(work, out, MIN(a_len, b_len)) == 0);
+        TEST_CHECK(a.state == b.state);
+        TEST_CHECK(a.decoder == b.decoder);
+        TEST_CHECK(a.mark_count == b.mark_count);
+        TEST_CHECK(iobuf_len(&a_tx) == iobuf_len(&b_tx));
+        TEST_CHECK(iobuf_len(&a_tx) == 0 ||
+                   memcmp(iobuf_data(&a_tx), iobuf_data(&b_tx), iobuf_len(&a_tx)) == 0);
+        if (test_failures > 0) {
+            fprintf(stderr, "test_decode: first difference at stream offset %zu\n", pos);
+            exit(EXIT_FAILURE);
+        }
+
+        iobuf_clear(&a_tx);
+        iobuf_clear(&b_tx);
+        pos += n;
+    }
+
+    close_session(&a, &a_rx, &a_tx);
+    close_session(&b, &b_rx, &b_tx);
+}
+
+int main(void)
+{
+    unsigned char *stream = malloc(STREAM_LEN);
+
+    openlog("test_decode", LOG_PERROR, LOG_USER);
+    setlogmask(LOG_UPTO(LOG_ERR));
+    TEST_REQUIRE(stream != NULL);
+
+    for (uint32_t seed = 1; seed <= STREAMS; seed++) {
+        size_t len;
+
+        rng_state = seed * 2654435761u;
+        len = make_stream(stream, STREAM_LEN);
+        run_stream(stream, len);
+    }
+
+    free(stream);
+    pool_buf_trim();
+
+    return TEST_DONE("test_decode");
+}
@@ -0,0 +1,159 @@
+/*
+ * test_memory.c - Client and server sessions over the in-memory transport
+ *
+ * A client (telnet_attach()) and a server (telnet_accept()) are joined
+ * by two byte queues, each one's tx being the other's rx.  After the
+ * negotiation settles both ends must be in binary mode and the server
+ * must have the client's terminal type.  Then a random byte stream,
+ * IAC escaped with telnet_prepare_output(), is queued as bulk data on
+ * the client and must decode unchanged on the server.  The transfer
+ * rate is printed as a codec benchmark, free of socket and pty costs.
+ */
+
+#include <time.h>
+
+#include "pool.h"
+#include "telnet.h"
+#include "test.h"
+
+#define QUEUE_LIMIT     (1024 * 1024)
+#define CHUNK           4096
+#define BULK_TOTAL      (64 * 1024 * 1024)
+
+typedef struct {
+    telnet_t tn;
+    unsigned char in[CHUNK + 1];
+    unsigned char *received;        /* Decoded data (NULL: not collected) */
+    size_t received_len;
+} peer_t;
+
+static iobuf_t to_server;
+static iobuf_t to_client;
+
+/**
+ * Receive and decode whatever is queued for a peer
+ * @return Decoded bytes
+ */
+static size_t pump(peer_t *p)
+{
+    size_t total = 0;
+    ssize_t n;
+
+    while ((n = telnet_recv(&p->tn, p->in + 1, CHUNK)) > 0) {
+        size_t len;
+
+        TEST_REQUIRE(telnet_process_input(&p->tn, p->in + 1, (size_t)n, p->in, (size_t)n + 1,
+                                          &len) == SUCCESS);
+        if (p->received != NULL) {
+            memcpy(p->received + p->received_len, p->in, len);
+            p->received_len += len;
+        }
+        total += len;
+    }
+    TEST_REQUIRE(n == 0);
+
+    return total;
+}
+
+/**
+ * Run both ends until neither has anything left to send
+ */
+static void settle(peer_t *client, peer_t *server)
+{
+    do {
+        telnet_flush_output(&client->tn);
+        telnet_flush_output(&server->tn);
+        pump(server);
+        pump(client);
+    } while (iobuf_len(&to_server) > 0 || iobuf_len(&to_client) > 0 ||
+             telnet_output_queued(&client->tn, TELNET_OUT_CLASSES) > 0 ||
+             telnet_output_queued(&server->tn, TELNET_OUT_CLASSES) > 0);
+}
+
+static uint32_t rng_state = 2463534242u;
+
+/**
+ * xorshift32: the same stream on every run
+ */
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+int main(void)
+{
+    static peer_t client;
+    static peer_t server;
+    transport_t tp;
+    unsigned char *data;
+    unsigned char escaped[CHUNK * 2];
+    struct timespec start;
+    struct timespec end;
+    size_t sent = 0;
+    double seconds;
+
+    openlog("test_memory", LOG_PERROR, LOG_USER);
+    setlogmask(LOG_UPTO(LOG_WARNING));
+
+    iobuf_init(&to_server, QUEUE_LIMIT);
+    iobuf_init(&to_client, QUEUE_LIMIT);
+
+    TEST_REQUIRE(telnet_init(&client.tn) == SUCCESS);
+    TEST_REQUIRE(transport_open_memory(&tp, &to_client, &to_server) == SUCCESS);
+    TEST_REQUIRE(telnet_attach(&client.tn, &tp) == SUCCESS);
+
+    TEST_REQUIRE(telnet_init(&server.tn) == SUCCESS);
+    TEST_REQUIRE(transport_open_memory(&tp, &to_server, &to_client) == SUCCESS);
+    TEST_REQUIRE(telnet_accept(&server.tn, &tp, true) == SUCCESS);
+
+    settle(&client, &server);
+    TEST_CHECK(telnet_is_binary_mode(&client.tn));
+    TEST_CHECK(telnet_is_binary_mode(&server.tn));
+    TEST_CHECK(strcmp(server.tn.cold->terminal_type, "XTERM") == 0);
+
+    /* Every byte value, IAC included, must come through unchanged */
+    data = malloc(BULK_TOTAL);
+    server.received = malloc(BULK_TOTAL);
+    TEST_REQUIRE(data != NULL && server.received != NULL);
+    for (size_t i = 0; i < BULK_TOTAL; i += 4) {
+        uint32_t r = rng();
+        memcpy(data + i, &r, 4);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (sent < BULK_TOTAL) {
+        size_t len;
+
+        TEST_REQUIRE(telnet_prepare_output(&client.tn, data + sent, CHUNK, escaped,
+                                           sizeof(escaped), &len) == SUCCESS);
+        TEST_REQUIRE(telnet_queue_output(&client.tn, TELNET_OUT_BULK, escaped, len) >= 0);
+        sent += CHUNK;
+
+        /* Drain before the queue limit is reached, as the socket would */
+        if (iobuf_len(&to_server) > QUEUE_LIMIT / 2) {
+            pump(&server);
+        }
+    }
+    settle(&client, &server);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    TEST_CHECK(server.received_len == BULK_TOTAL);
+    TEST_CHECK(memcmp(server.received, data, MIN(server.received_len, (size_t)BULK_TOTAL)) == 0);
+
+    seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("test_memory: %d MB escaped, queued and decoded in %.3f s (%.0f MB/s)\n",
+           BULK_TOTAL >> 20, seconds, (double)(BULK_TOTAL >> 20) / seconds);
+
+    free(data);
+    free(server.received);
+    telnet_free(&client.tn);
+    telnet_free(&server.tn);
+    iobuf_free(&to_server);
+    iobuf_free(&to_client);
+    pool_buf_trim();
+
+    return TEST_DONE("test_memory");
+}
@@ -0,0 +1,125 @@
+/*
+ * test_ring.c - Receive ring wraparound, mirrored and linear fallback
+ *
+ * A byte counter is written through ring_reserve()/ring_commit() in
+ * uneven chunks until it has wrapped the ring many times; after every
+ * chunk ring_tail() must return the newest history bytes in order.  The
+ * mirrored ring keeps up to its size of history across the wrap; the
+ * linear fallback (used when the double mapping cannot be set up)
+ * drops its history when a reservation does not fit before the end.
+ */
+
+#include "ring.h"
+#include "telnet.h"
+#include "test.h"
+
+#define RING_SIZE       4096
+#define RING_ROUNDS     40
+
+/* Chunk sizes, chosen to end at every offset relative to the wrap */
+static const size_t chunk_sizes[] = { 1, 1000, 777, 4095, 2048, 3, 4096, 513 };
+
+/**
+ * Check that the last len history bytes end at counter value next
+ */
+static bool tail_matches(const ring_t *ring, size_t len, size_t next)
+{
+    const unsigned char *tail = ring_tail(ring, len);
+
+    if (tail == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (tail[i] != (unsigned char)((next - len + i) * 7)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Write the counter through a ring and check its history as it wraps
+ */
+static void run_ring(ring_t *ring)
+{
+    size_t next = 0;
+    size_t since_reset = 0;
+    bool wrapped_history = false;
+
+    for (size_t round = 0; round < RING_ROUNDS * (sizeof(chunk_sizes) / sizeof(chunk_sizes[0])); round++) {
+        size_t len = chunk_sizes[round % (sizeof(chunk_sizes) / sizeof(chunk_sizes[0]))];
+        size_t pos = ring->pos;
+        unsigned char *span = ring_reserve(ring, len);
+
+        TEST_REQUIRE(span != NULL);
+        if (!ring->mirrored && pos + len > ring->size) {
+            /* Linear: the span starts over at the front */
+            TEST_CHECK(span == ring->base);
+            TEST_CHECK(ring_history(ring) == 0);
+            since_reset = 0;
+        }
+
+        /* History still readable while the span is written, and not inside it */
+        TEST_CHECK(ring_history(ring) <= ring->size - len);
+        memset(span, 0xAA, len);
+        TEST_CHECK(tail_matches(ring, ring_history(ring), next));
+
+        for (size_t i = 0; i < len; i++) {
+            span[i] = (unsigned char)((next + i) * 7);
+        }
+        ring_commit(ring, len);
+        next += len;
+        since_reset += len;
+
+        if (ring->mirrored) {
+            TEST_CHECK(ring_history(ring) == MIN(next, ring->size));
+            /* A span written across the end shows up at the front of the ring */
+            if (pos + len > ring->size) {
+                TEST_CHECK(ring->base[0] == (unsigned char)((next - ring->pos) * 7));
+                wrapped_history = true;
+            }
+        } else {
+            TEST_CHECK(ring_history(ring) == since_reset);
+        }
+
+        /* Newest bytes, whole history, and a span across the wrap */
+        TEST_CHECK(tail_matches(ring, 1, next));
+        TEST_CHECK(tail_matches(ring, ring_history(ring), next));
+        if (ring->mirrored && ring->pos > 0 && ring->pos < ring_history(ring)) {
+            TEST_CHECK(tail_matches(ring, ring->pos + 1, next));
+        }
+        TEST_CHECK(ring_tail(ring, ring_history(ring) + 1) == NULL);
+    }
+
+    TEST_CHECK(ring_reserve(ring, ring->size + 1) == NULL);
+    if (ring->mirrored) {
+        TEST_CHECK(wrapped_history);
+    }
+}
+
+int main(void)
+{
+    ring_t ring;
+
+    openlog("test_ring", LOG_PERROR, LOG_USER);
+    setlogmask(LOG_UPTO(LOG_WARNING));
+
+    TEST_REQUIRE(ring_init(&ring, RING_SIZE) == SUCCESS);
+    if (ring.mirrored) {
+        run_ring(&ring);
+    } else {
+        fprintf(stderr, "test_ring: double mapping unavailable, mirrored case skipped\n");
+    }
+    ring_free(&ring);
+
+    /* The state ring_init() falls back to when mapping fails */
+    memset(&ring, 0, sizeof(ring));
+    ring.base = malloc(RING_SIZE);
+    ring.size = RING_SIZE;
+    TEST_REQUIRE(ring.base != NULL);
+    run_ring(&ring);
+    ring_free(&ring);
+
+    return TEST_DONE("test_ring");
+}
@@ -0,0 +1,281 @@
+/*
+ * test_synch.c - Synch ordering on a backed-up TCP connection, and
+ *                Synch discard on receive
+ *
+ * Bulk data full of IAC IAC pairs fills the socket, then IAC AO and a
+ * Synch are sent.  The receiver must see IAC AO ahead of the bulk data
+ * still queued, IAC DM after it with the DM byte exactly at the urgent
+ * mark, and no command inside an escaped pair, however the queues were
+ * split across sends.  On the receive side, after the urgent
+ * notification everything up to IAC DM is discarded except telnet
+ * commands, and what follows the DM decodes as it would have without
+ * the Synch.
+ */
+
+#include "telnet.h"
+#include "test.h"
+
+#include <sys/ioctl.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#define BULK_MAX        (16 * 1024 * 1024)
+#define BULK_CHUNK      4096
+#define RECEIVE_MAX     (BULK_MAX + 4096)
+
+/**
+ * Connect a transport to a loopback server (small send buffer, urgent
+ * data inline on the server)
+ */
+static void tcp_pair(transport_t *tp, int *server)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t len = sizeof(addr);
+    int small = 4096;
+    int on = 1;
+    int lfd = socket(AF_INET, SOCK_STREAM, 0);
+
+    TEST_REQUIRE(lfd >= 0);
+    TEST_REQUIRE(bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    TEST_REQUIRE(listen(lfd, 1) == 0);
+    TEST_REQUIRE(getsockname(lfd, (struct sockaddr *)&addr, &len) == 0);
+
+    TEST_REQUIRE(transport_open(tp, "127.0.0.1", ntohs(addr.sin_port)) == SUCCESS);
+    setsockopt(tp->fd, SOL_SOCKET, SO_SNDBUF, &small, sizeof(small));
+
+    *server = accept(lfd, NULL, NULL);
+    TEST_REQUIRE(*server >= 0);
+    setsockopt(*server, SOL_SOCKET, SO_OOBINLINE, &on, sizeof(on));
+    fcntl(*server, F_SETFL, O_NONBLOCK);
+    close(lfd);
+}
+
+/**
+ * Read what is available, noting the offset of the urgent mark
+ */
+static void drain(int fd, unsigned char *buf, size_t *len, size_t size, long *mark)
+{
+    for (;;) {
+        int at_mark = 0;
+        ssize_t n;
+
+        TEST_REQUIRE(ioctl(fd, SIOCATMARK, &at_mark) == 0);
+        if (at_mark && *mark < 0) {
+            *mark = (long)*len;
+        }
+
+        /* recv() stops at the mark, so each read lies on one side of it */
+        n = recv(fd, buf + *len, size - *len, 0);
+        if (n <= 0) {
+            return;
+        }
+        *len += (size_t)n;
+    }
+}
+
+/**
+ * Send IAC AO + Synch behind a full socket and check what arrives
+ */
+static void test_send(void)
+{
+    static unsigned char bulk[BULK_CHUNK];
+    unsigned char *received = malloc(RECEIVE_MAX);
+    size_t received_len = 0;
+    size_t queued = 0;
+    long mark = -1;
+    long ao_at = -1;
+    long dm_at = -1;
+    size_t data_after_ao = 0;
+    size_t data_bytes = 0;
+    transport_t tp;
+    telnet_t tn;
+    int server;
+
+    TEST_REQUIRE(received != NULL);
+    tcp_pair(&tp, &server);
+    TEST_REQUIRE(telnet_init(&tn) == SUCCESS);
+    TEST_REQUIRE(telnet_attach(&tn, &tp) == SUCCESS);
+
+    /* Escaped 0xFF bytes: every IAC on the wire is half of a pair */
+    memset(bulk, TELNET_IAC, sizeof(bulk));
+    while (queued < BULK_MAX) {
+        TEST_REQUIRE(telnet_queue_output(&tn, TELNET_OUT_BULK, bulk, sizeof(bulk)) >= 0);
+        queued += sizeof(bulk);
+        if (telnet_output_queued(&tn, TELNET_OUT_BULK) > BULK_CHUNK) {
+            break;
+        }
+    }
+    TEST_REQUIRE(telnet_output_queued(&tn, TELNET_OUT_BULK) > 0);
+
+    /* Odd split: the next send may end between the two bytes of a pair */
+    drain(server, received, &received_len, 1001, &mark);
+
+    TEST_CHECK(telnet_send_abort_output(&tn) == SUCCESS);
+
+    while (telnet_output_queued(&tn, TELNET_OUT_CLASSES) > 0) {
+        TEST_REQUIRE(telnet_flush_output(&tn) >= 0);
+        drain(server, received, &received_len, RECEIVE_MAX, &mark);
+    }
+
+    /* What the kernels still hold arrives as the receive window opens */
+    for (int idle = 0; idle < 20; idle++) {
+        size_t before = received_len;
+
+        usleep(5000);
+        drain(server, received, &received_len, RECEIVE_MAX, &mark);
+        if (received_len != before) {
+            idle = 0;
+        }
+    }
+
+    /* Walk the stream as a receiver would */
+    for (size_t i = 0; i < received_len; i++) {
+        if (received[i] != TELNET_IAC) {
+            TEST_CHECK(!"stray data byte");
+            continue;
+        }
+        TEST_REQUIRE(i + 1 < received_len);
+        switch (received[++i]) {
+            case TELNET_IAC:
+                data_bytes++;
+                if (ao_at >= 0) {
+                    data_after_ao++;
+                }
+                break;
+            case TELNET_WILL:
+            case TELNET_WONT:
+            case TELNET_DO:
+            case TELNET_DONT:
+                i++;
+                break;
+            case TELNET_AO:
+                TEST_CHECK(ao_at < 0);
+                ao_at = (long)i;
+                break;
+            case TELNET_DM:
+                TEST_CHECK(dm_at < 0);
+                dm_at = (long)i;
+                break;
+            default:
+                TEST_CHECK(!"unexpected command");
+                break;
+        }
+    }
+
+    TEST_CHECK(data_bytes * 2 == queued);
+    TEST_CHECK(ao_at >= 0);
+    TEST_CHECK(dm_at > ao_at);
+    TEST_CHECK(mark == dm_at);
+    /* IAC AO overtook the bulk data still queued when it was sent */
+    TEST_CHECK(data_after_ao > 0);
+
+    telnet_free(&tn);
+    transport_close(&tn.transport);
+    close(server);
+    free(received);
+}
+
+/**
+ * Decode a stream in one call
+ */
+static size_t decode(telnet_t *tn, const unsigned char *in, size_t len, unsigned char *out,
+                     size_t size)
+{
+    size_t out_len = 0;
+
+    TEST_CHECK(telnet_process_input(tn, in, len, out, size, &out_len) == SUCCESS);
+    return out_len;
+}
+
+/**
+ * Discard data, but not commands, from the urgent notification to IAC DM
+ */
+static void test_receive(void)
+{
+    static const unsigned char stream[] = {
+        'l', 'o', 's', 't', '\r', '\n', TELNET_IAC, TELNET_IAC, '\r', '\0',
+        TELNET_IAC, TELNET_WILL, TELOPT_ECHO, 'x',
+        TELNET_IAC, TELNET_DM,
+        'k', 'e', 'p', 't', '\r', '\n', '\r', '\0', TELNET_IAC, TELNET_IAC
+    };
+    static const size_t after_dm = 16;
+    unsigned char out[64];
+    unsigned char expect[64];
+    size_t out_len;
+    size_t expect_len;
+    telnet_t tn;
+    telnet_t plain;
+
+    TEST_REQUIRE(telnet_init(&tn) == SUCCESS);
+    TEST_REQUIRE(telnet_init(&plain) == SUCCESS);
+
+    telnet_handle_urgent(&tn);
+    TEST_CHECK(tn.synch);
+
+    /* Byte by byte, so no decoding shortcut skips the discard */
+    out_len = 0;
+    for (size_t i = 0; i < sizeof(stream); i++) {
+        out_len += decode(&tn, stream + i, 1, out + out_len, sizeof(out) - out_len);
+    }
+    expect_len = decode(&plain, stream + after_dm, sizeof(stream) - after_dm, expect,
+                        sizeof(expect));
+
+    TEST_CHECK(!tn.synch);
+    TEST_CHECK(tn.synch_discarded == 10);
+    /* The WILL ECHO inside the discarded span was still acted on */
+    TEST_CHECK(telnet_opt_isset(&tn.remote_options, TELOPT_ECHO));
+    TEST_CHECK(out_len == expect_len && memcmp(out, expect, expect_len) == 0);
+
+    telnet_free(&tn);
+    telnet_free(&plain);
+}
+
+/**
+ * A CR held from before the urgent notification goes with what follows it
+ */
+static void test_receive_held_cr(void)
+{
+    static const struct {
+        unsigned char after_cr[2];
+        size_t len;
+        uint64_t discarded;
+    } cases[] = {
+        { { '\0' }, 1, 2 },
+        { { '\n' }, 1, 2 },
+        { { 'x' }, 1, 2 },
+        { { TELNET_IAC, TELNET_IAC }, 2, 2 },
+    };
+    static const unsigned char tail[] = { TELNET_IAC, TELNET_DM, 'o', 'k' };
+    static const unsigned char cr = '\r';
+
+    for (size_t k = 0; k < sizeof(cases) / sizeof(cases[0]); k++) {
+        unsigned char out[16];
+        size_t out_len;
+        telnet_t tn;
+
+        TEST_REQUIRE(telnet_init(&tn) == SUCCESS);
+
+        TEST_CHECK(decode(&tn, &cr, 1, out, sizeof(out)) == 0);
+        telnet_handle_urgent(&tn);
+        out_len = decode(&tn, cases[k].after_cr, cases[k].len, out, sizeof(out));
+        out_len += decode(&tn, tail, sizeof(tail), out + out_len, sizeof(out) - out_len);
+
+        TEST_CHECK(!tn.synch);
+        TEST_CHECK(tn.synch_discarded == cases[k].discarded);
+        TEST_CHECK(out_len == 2 && memcmp(out, "ok", 2) == 0);
+
+        telnet_free(&tn);
+    }
+}
+
+int main(void)
+{
+    openlog("test_synch", LOG_PERROR, LOG_USER);
+    setlogmask(LOG_UPTO(LOG_WARNING));
+
+    test_send();
+    test_receive();
+    test_receive_held_cr();
+
+    return TEST_DONE("test_synch");
+}
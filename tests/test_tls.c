@@ -0,0 +1,175 @@
+/*
+ * test_tls.c - TLS send retried after EAGAIN
+ *
+ * A TLS client transport writes to an in-process server that does not
+ * read until the client socket is full.  The record that hit EAGAIN is
+ * then written again from the transport's own copy (not the caller's
+ * buffer it was built from), which OpenSSL only allows with
+ * SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER.  Once the server drains, every
+ * byte must arrive once and in order.  The server certificate is
+ * generated here; verification is off.
+ */
+
+#include "telnet.h"
+
+#ifdef OTELNET_TLS
+
+#include "test.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#define CHUNK           4096
+#define SEND_MAX        (64 * 1024 * 1024)
+
+/**
+ * Server context with a fresh self-signed certificate
+ */
+static SSL_CTX *server_ctx(void)
+{
+    SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+    EVP_PKEY *key = EVP_EC_gen("P-256");
+    X509 *cert = X509_new();
+    X509_NAME *name;
+
+    TEST_REQUIRE(ctx != NULL && key != NULL && cert != NULL);
+
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+    X509_set_pubkey(cert, key);
+    name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *)"localhost",
+                               -1, -1, 0);
+    X509_set_issuer_name(cert, name);
+    TEST_REQUIRE(X509_sign(cert, key, EVP_sha256()) > 0);
+
+    TEST_REQUIRE(SSL_CTX_use_certificate(ctx, cert) == 1);
+    TEST_REQUIRE(SSL_CTX_use_PrivateKey(ctx, key) == 1);
+    X509_free(cert);
+    EVP_PKEY_free(key);
+
+    return ctx;
+}
+
+/**
+ * Read what the server has, checking it against the byte counter
+ * @return false on a mismatch
+ */
+static bool server_drain(SSL *ssl, size_t *received)
+{
+    unsigned char buf[CHUNK];
+    size_t n;
+
+    while (SSL_read_ex(ssl, buf, sizeof(buf), &n) == 1) {
+        for (size_t i = 0; i < n; i++) {
+            if (buf[i] != (unsigned char)((*received + i) * 7)) {
+                fprintf(stderr, "test_tls: byte %zu differs\n", *received + i);
+                return false;
+            }
+        }
+        *received += n;
+    }
+
+    return true;
+}
+
+int main(void)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    unsigned char chunk[CHUNK];
+    transport_t tp;
+    SSL_CTX *ctx;
+    SSL *ssl;
+    int listen_fd;
+    int fd;
+    int sndbuf = 4096;
+    size_t sent = 0;
+    size_t received = 0;
+    bool blocked = false;
+
+    openlog("test_tls", LOG_PERROR, LOG_USER);
+    setlogmask(LOG_UPTO(LOG_WARNING));
+
+    ctx = server_ctx();
+
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    TEST_REQUIRE(bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    TEST_REQUIRE(listen(listen_fd, 1) == 0);
+    TEST_REQUIRE(getsockname(listen_fd, (struct sockaddr *)&addr, &addr_len) == 0);
+
+    transport_tls_configure(false, NULL);
+    TEST_REQUIRE(transport_open(&tp, "tls:127.0.0.1", ntohs(addr.sin_port)) == SUCCESS);
+    TEST_REQUIRE(setsockopt(tp.fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf)) == 0);
+
+    fd = accept(listen_fd, NULL, NULL);
+    TEST_REQUIRE(fd >= 0);
+    TEST_REQUIRE(fcntl(fd, F_SETFL, O_NONBLOCK) == 0);
+    ssl = SSL_new(ctx);
+    SSL_set_fd(ssl, fd);
+    SSL_set_accept_state(ssl);
+
+    /* Handshake: the client drives it from send, the server from SSL_do_handshake */
+    for (int i = 0; i < 1000 && !SSL_is_init_finished(ssl); i++) {
+        tp.ops->send(&tp, chunk, 0, false);
+        SSL_do_handshake(ssl);
+        usleep(1000);
+    }
+    TEST_REQUIRE(SSL_is_init_finished(ssl));
+
+    /* Fill the socket until a record is held for retry */
+    while (sent < SEND_MAX && !blocked) {
+        ssize_t n;
+
+        for (size_t i = 0; i < CHUNK; i++) {
+            chunk[i] = (unsigned char)((sent + i) * 7);
+        }
+        n = tp.ops->send(&tp, chunk, CHUNK, false);
+        TEST_REQUIRE(n > 0);
+        sent += (size_t)n;
+        blocked = (tp.held > 0);
+    }
+    TEST_REQUIRE(blocked);
+
+    /* The caller's buffer no longer holds the record */
+    memset(chunk, 0xEE, sizeof(chunk));
+
+    for (int i = 0; i < 10000 && (tp.held > 0 || received < sent); i++) {
+        TEST_REQUIRE(server_drain(ssl, &received));
+        if (tp.held > 0 && transport_flush(&tp) < 0) {
+            TEST_REQUIRE(errno == EAGAIN);
+        }
+        usleep(100);
+    }
+
+    TEST_CHECK(tp.held == 0);
+    TEST_CHECK(received == sent);
+
+    SSL_free(ssl);
+    close(fd);
+    close(listen_fd);
+    transport_close(&tp);
+    SSL_CTX_free(ctx);
+
+    return TEST_DONE("test_tls");
+}
+
+#else
+
+int main(void)
+{
+    printf("test_tls: skipped (built without TLS)\n");
+    return EXIT_SUCCESS;
+}
+
+#endif